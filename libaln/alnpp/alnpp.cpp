@@ -197,7 +197,7 @@ const ALNNODE* CAln::GetTree() const
   return m_pALN->pTree;
 }
 
-void CAln::SetDataInfo(int nPoints, int nCols, const double* adblData,
+void CAln::SetDataInfo(long long nPoints, int nCols, const double* adblData,
                        const VARINFO* aVarInfo /*= NULL*/, const double MSEorF)
 {
 	m_datainfo.nPoints = nPoints;
@@ -264,6 +264,12 @@ BOOL CAln::SetGrowable(ALNNODE* pNode)
   return ALNSetGrowable(m_pALN, pNode);
 }
 
+BOOL CAln::Rebalance()
+{
+  m_nLastError = ALNRebalance(m_pALN);
+  return m_nLastError == ALN_NOERROR;
+}
+
 BOOL CAln::Destroy()
 {
   m_nLastError = ALN_NOERROR;
@@ -327,8 +333,8 @@ double CAln::CalcRMSError(int nNotifyMask /*= AN_NONE*/,
 }
 
 // eval
-BOOL CAln::Eval(double* adblResult, int* pnStart /*=NULL*/, 
-                int* pnEnd /*= NULL*/, int nNotifyMask /*= AN_NONE*/,
+BOOL CAln::Eval(double* adblResult, long long* pnStart /*=NULL*/, 
+                long long* pnEnd /*= NULL*/, int nNotifyMask /*= AN_NONE*/,
                 ALNDATAINFO* pData /*= NULL*/, void* pvData /*= NULL*/)
 {
   if (pData == NULL)
@@ -355,6 +361,13 @@ double CAln::QuickEval(const double* adblX, ALNNODE** ppActiveLFN /*= NULL*/)
   return ALNQuickEval(m_pALN, adblX, ppActiveLFN);
 }
 
+// quick eval with a caller owned hint
+double CAln::QuickEvalHinted(const double* adblX, ALNEVALHINT* pHint)
+{
+  m_nLastError = ALN_NOERROR;
+  return ALNQuickEvalHinted(m_pALN, adblX, pHint);
+}
+
 // get variable monotonicicty, returns -1 on failure
 int CAln::VarMono(int nVar)
 {
@@ -377,6 +390,13 @@ BOOL CAln::Write(const char* pszFileName)
   return m_nLastError == ALN_NOERROR;
 }
 
+// save ALN to disk file in the flat format
+BOOL CAln::WriteFlat(const char* pszFileName)
+{
+  m_nLastError = ALNWriteFlat(m_pALN, pszFileName);
+  return m_nLastError == ALN_NOERROR;
+}
+
 // read ALN from disk file... destroys any existing ALN
 BOOL CAln::Read(const char* pszFileName)
 {
@@ -387,6 +407,35 @@ BOOL CAln::Read(const char* pszFileName)
   return m_nLastError == ALN_NOERROR;
 }
 
+// save ALN and training state to a checkpoint file
+BOOL CAln::WriteCheckpoint(const char* pszFileName, 
+                           const void* pvUserData /*= NULL*/, 
+                           int nUserBytes /*= 0*/)
+{
+  m_nLastError = ALNWriteCheckpoint(m_pALN, pszFileName, pvUserData, nUserBytes);
+  return m_nLastError == ALN_NOERROR;
+}
+
+// read ALN and training state from a checkpoint file... destroys any 
+// existing ALN
+BOOL CAln::ReadCheckpoint(const char* pszFileName, 
+                          void* pvUserData /*= NULL*/, int nUserBytes /*= 0*/)
+{
+  Destroy();
+  ASSERT(m_pALN == NULL);
+
+  m_nLastError = ALNReadCheckpoint(pszFileName, &m_pALN, pvUserData, nUserBytes);
+  return m_nLastError == ALN_NOERROR;
+}
+
+// save ALN as C source
+BOOL CAln::WriteAsC(const char* pszFileName,
+                    const char* pszFunction /*= NULL*/)
+{
+  m_nLastError = ALNWriteAsC(m_pALN, pszFileName, pszFunction);
+  return m_nLastError == ALN_NOERROR;
+}
+
 // conversion to dtree
 DTREE* CAln::ConvertDtree(int nMaxDepth)
 {
@@ -397,6 +446,29 @@ DTREE* CAln::ConvertDtree(int nMaxDepth)
   return pDtree;
 }
 
+DTREE* CAln::ConvertDtree(int nMaxDepth, ALNDATAINFO* pData, 
+                          int nMaxBlocks /*= 0*/,
+                          int nNotifyMask /*= AN_NONE*/, 
+                          void* pvData /*= NULL*/)
+{
+  if (pData == NULL)
+    pData = &m_datainfo;
+
+  CALLBACKDATA data;
+  data.pALN = this;
+  data.pvData = pvData;
+
+  ALNCALLBACKINFO callback;
+  callback.nNotifyMask = nNotifyMask;
+  callback.pvData = &data;
+  callback.pfnNotifyProc = ALNNotifyProc;
+
+  DTREE* pDtree = NULL;
+  m_nLastError = ALNConvertDtreeEx(m_pALN, nMaxDepth, &pDtree, pData, 
+                                   &callback, nMaxBlocks);
+  return pDtree;
+}
+
 // confidence intervals
 BOOL CAln::CalcConfidence(ALNCONFIDENCE* pConfidence, 
                           int nNotifyMask /*= AN_NONE*/, 
@@ -420,6 +492,28 @@ BOOL CAln::CalcConfidence(ALNCONFIDENCE* pConfidence,
   return m_nLastError == ALN_NOERROR;
 }
 
+BOOL CAln::AddConfidenceSketch(void* pvSketch, 
+                               int nNotifyMask /*= AN_NONE*/, 
+                               ALNDATAINFO* pData /*= NULL*/, 
+                               void* pvData /*= NULL*/)
+{
+  if (pData == NULL)
+    pData = &m_datainfo;
+
+  CALLBACKDATA data;
+  data.pALN = this;
+  data.pvData = pvData;
+
+  ALNCALLBACKINFO callback;
+  callback.nNotifyMask = nNotifyMask;
+  callback.pvData = &data;
+  callback.pfnNotifyProc = ALNNotifyProc;
+
+  m_nLastError = ALNConfidenceSketchAdd(m_pALN, pData, &callback, pvSketch);
+
+  return m_nLastError == ALN_NOERROR;
+}
+
 double CAln::ConfidencePLimit(const ALNCONFIDENCE* pConfidence, 
                               double dblSignificance)
 {
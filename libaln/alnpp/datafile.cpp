@@ -33,6 +33,29 @@
 #include <string.h>
 #include <memory.h>
 #include <ctype.h>
+#include <limits.h>
+
+#if __cplusplus >= 201703L || _MSVC_LANG >= 201703L
+#include <charconv>
+#endif
+
+#ifdef _WIN32
+#define WIN32_EXTRA_LEAN
+#define WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include <datafile.h>
 
@@ -53,17 +76,19 @@ static char THIS_FILE[] = __FILE__;
 CDataFile::CDataFile()
 {
   m_pBuffer = NULL;
-  m_lBufferLen = 0;
+  m_nBufferLen = 0;
   m_lColumns = 0;
-  m_lRows = 0;
+  m_nRows = 0;
+  m_bView = FALSE;
 }
 
 CDataFile::CDataFile(const CDataFile& datafile)
 {
   m_pBuffer = NULL;
-  m_lBufferLen = 0;
+  m_nBufferLen = 0;
   m_lColumns = 0;
-  m_lRows = 0;
+  m_nRows = 0;
+  m_bView = FALSE;
 
   *this = datafile;
 }
@@ -82,7 +107,7 @@ double CDataFile::GetColMax(long lCol) const
   double* pdblBase = m_pBuffer + lCol;
 
   double dblMax = *pdblBase;               
-  for(long i = 0; i < m_lRows; i++, pdblBase += m_lColumns)
+  for(long long i = 0; i < m_nRows; i++, pdblBase += m_lColumns)
   {
     double dbl = *pdblBase;               
     if (dbl > dblMax)
@@ -102,7 +127,7 @@ double CDataFile::GetColMin(long lCol) const
   double* pdblBase = m_pBuffer + lCol;
 
   double dblMin = m_pBuffer[lCol];               
-  for(long i = 0; i < m_lRows; i++, pdblBase += m_lColumns)
+  for(long long i = 0; i < m_nRows; i++, pdblBase += m_lColumns)
   {
     double dbl = *pdblBase;               
     if (dbl < dblMin)
@@ -114,29 +139,50 @@ double CDataFile::GetColMin(long lCol) const
   return dblMin;
 }
          
-BOOL CDataFile::Create(long lRows, long lColumns)
+BOOL CDataFile::Create(long long nRows, long lColumns)
 {                    
   Destroy();
   ASSERT(m_pBuffer == NULL);
   
   m_lColumns = lColumns;
-  m_lRows = lRows;
+  m_nRows = nRows;
    
-  // allocate array mem         
-  long lElements = m_lRows * m_lColumns * 2;
-  if (lElements > 0)
+  // allocate array mem, appends grow it geometrically
+  long long nElements = m_nRows * m_lColumns;
+  if (nElements > 0)
   {
-    if (!Grow(lElements * sizeof(double)))
+    if (!Resize(nElements * (long long)sizeof(double)))
     {
       m_lColumns = 0;
-      m_lRows = 0;
+      m_nRows = 0;
 
       return FALSE;
     }
 
-    memset(m_pBuffer, 0, m_lBufferLen);
+    memset(m_pBuffer, 0, (size_t)m_nBufferLen);
+  }
+
+  return TRUE;
+}
+
+BOOL CDataFile::CreateView(CDataFile& datafile, long long nFirstRow, long long nRows)
+{
+  ASSERT(&datafile != this);
+  ASSERT(nFirstRow >= 0 && nRows >= 0 && nFirstRow + nRows <= datafile.m_nRows);
+  if (&datafile == this || nFirstRow < 0 || nRows < 0 || 
+      nFirstRow + nRows > datafile.m_nRows)
+  {
+    return FALSE;
   }
 
+  Destroy();
+
+  m_lColumns = datafile.m_lColumns;
+  m_nRows = nRows;
+  m_nBufferLen = nRows * m_lColumns * (long long)sizeof(double);
+  m_pBuffer = (m_nBufferLen > 0) ? datafile.m_pBuffer + nFirstRow * m_lColumns : NULL;
+  m_bView = TRUE;
+
   return TRUE;
 }
 
@@ -144,13 +190,15 @@ void CDataFile::Destroy()
 {   
   if (m_pBuffer != NULL)
   {
-    free(m_pBuffer);
+    if (!m_bView)
+      free(m_pBuffer);
     m_pBuffer = NULL;
   }
   
-  m_lBufferLen = 0;
+  m_nBufferLen = 0;
   m_lColumns = 0;
-  m_lRows = 0;
+  m_nRows = 0;
+  m_bView = FALSE;
 }
 
 CDataFile& CDataFile::operator = (const CDataFile& datafile)
@@ -159,88 +207,140 @@ CDataFile& CDataFile::operator = (const CDataFile& datafile)
   if (&datafile == this)
     return *this;
   
+  // a view gets its own block rather than writing into another file's
+  if (m_bView)
+    Destroy();
+
   // try to grow ourself
-  if (!Grow(datafile.m_lBufferLen))
+  if (!Grow(datafile.m_nBufferLen))
   {
     Destroy();
     return *this; // failed to grow file... no error return!
   }
   
-  m_lRows = datafile.m_lRows;
+  m_nRows = datafile.m_nRows;
   m_lColumns = datafile.m_lColumns;
-  memcpy(m_pBuffer, datafile.m_pBuffer, m_lBufferLen);
+  if (datafile.m_nBufferLen > 0)
+    memcpy(m_pBuffer, datafile.m_pBuffer, (size_t)datafile.m_nBufferLen);
 
   return *this;
 }
 
-BOOL CDataFile::Grow(long lNewLen)
+BOOL CDataFile::Grow(long long nNewLen)
 {
-  static const long lGrowBytes = 1024;
+  static const long long nGrowBytes = 1024;
 
-	if (lNewLen > m_lBufferLen)
+	if (nNewLen > m_nBufferLen)
 	{
-		// grow the buffer
-		long lNewBufferSize = (long)m_lBufferLen;
-
-		// watch out for buffers which cannot be grown!
-		ASSERT(lGrowBytes != 0);
+		// grow the buffer by half again, so a run of appends copies each
+		// element a bounded number of times
+		long long nNewBufferSize = m_nBufferLen + m_nBufferLen / 2;
+		if (nNewBufferSize < nNewLen)
+			nNewBufferSize = nNewLen;
+		if (nNewBufferSize < nGrowBytes)
+			nNewBufferSize = nGrowBytes;
+
+		return Resize(nNewBufferSize);
+	}
 
-		// determine new buffer size
-		while (lNewBufferSize < lNewLen)
-			lNewBufferSize += lGrowBytes;
+  return TRUE;
+}
 
-		// allocate new buffer
-		BYTE* pNew;
-		if (m_pBuffer == NULL)
-			pNew = (BYTE*)malloc(lNewBufferSize);
-		else
-			pNew = (BYTE*)realloc(m_pBuffer, lNewBufferSize);
+BOOL CDataFile::Resize(long long nNewLen)
+{
+  ASSERT(nNewLen >= 0);
 
-		if (pNew == NULL)
-			return FALSE;
+  // the block must be addressable on this platform
+  if ((unsigned long long)nNewLen > (size_t)-1)
+    return FALSE;
 
-		m_pBuffer = (double*)pNew;
-		m_lBufferLen = lNewBufferSize;
+	// allocate new buffer, a view copies what fits into a block of its own
+	BYTE* pNew;
+	if (m_bView)
+	{
+		pNew = (nNewLen == 0) ? NULL : (BYTE*)malloc((size_t)nNewLen);
+		if (pNew != NULL && m_nBufferLen > 0)
+			memcpy(pNew, m_pBuffer, (size_t)((nNewLen < m_nBufferLen) ? nNewLen : m_nBufferLen));
+		if (pNew != NULL || nNewLen == 0)
+			m_bView = FALSE;
+	}
+	else if (nNewLen == 0)
+	{
+		free(m_pBuffer);
+		pNew = NULL;
 	}
+	else if (m_pBuffer == NULL)
+		pNew = (BYTE*)malloc((size_t)nNewLen);
+	else
+		pNew = (BYTE*)realloc(m_pBuffer, (size_t)nNewLen);
+
+	if (pNew == NULL && nNewLen != 0)
+		return FALSE;
+
+	m_pBuffer = (double*)pNew;
+	m_nBufferLen = nNewLen;
 
   return TRUE;
 }
- 
-static BOOL SimpleFloatParse(char* pszText, double& d)
+
+BOOL CDataFile::Reserve(long long nRows)
+{
+  ASSERT(m_lColumns > 0);
+  if (m_lColumns <= 0 || nRows > LLONG_MAX / (long long)sizeof(double) / m_lColumns)
+    return FALSE;
+
+  long long nLen = nRows * m_lColumns * (long long)sizeof(double);
+  if (nLen <= m_nBufferLen)
+    return TRUE;
+
+  return Resize(nLen);
+}
+
+BOOL CDataFile::AppendRow(const double* adblRow)
 {
-	ASSERT(pszText != NULL);
-	while (*pszText == ' ' || *pszText == '\t')
-		pszText++;
+  ASSERT(m_lColumns > 0);
+  if (m_lColumns <= 0 || m_nRows >= LLONG_MAX / (long long)sizeof(double) / m_lColumns - 1)
+    return FALSE;
 
-	char chFirst = pszText[0];
-	d = strtod(pszText, &pszText);
-	if (d == 0.0 && chFirst != '0')
-		return FALSE;   // could not convert
-	while (*pszText == ' ' || *pszText == '\t')
-		pszText++;
+  long long nIndex = m_nRows * m_lColumns;
+  if (!Grow((nIndex + m_lColumns) * (long long)sizeof(double)))
+    return FALSE;
 
-	if (*pszText != '\0')
-		return FALSE;   // not terminated properly
+  memcpy(m_pBuffer + nIndex, adblRow, m_lColumns * sizeof(double));
+  m_nRows++;
 
-	return TRUE;
+  return TRUE;
 }
 
+BOOL CDataFile::ShrinkToFit()
+{
+  long long nLen = m_nRows * m_lColumns * (long long)sizeof(double);
+  if (nLen >= m_nBufferLen)
+    return TRUE;
+
+  return Resize(nLen);
+}
+ 
 BOOL CDataFile::Append(const CDataFile& datafile)
 {
+  // an empty file takes the columns of the first file appended
+  if (m_nRows == 0 && m_lColumns == 0)
+    m_lColumns = datafile.m_lColumns;
+
   // grow memory to desired length
-  long lLength = sizeof(double) * ((datafile.m_lRows + m_lRows) * m_lColumns);
-  if (!Grow(lLength))
+  long long nLength = (long long)sizeof(double) * ((datafile.m_nRows + m_nRows) * m_lColumns);
+  if (!Grow(nLength))
     return FALSE;
 
   // test if column count is same 
   if (m_lColumns == datafile.m_lColumns)
   {
     // just copy mem!
-    long lDestPoints = m_lRows * m_lColumns;
-    long lSrcPoints = datafile.m_lRows * m_lColumns;
-    memcpy(m_pBuffer + lDestPoints, 
+    long long nDestPoints = m_nRows * m_lColumns;
+    long long nSrcPoints = datafile.m_nRows * m_lColumns;
+    memcpy(m_pBuffer + nDestPoints, 
            datafile.m_pBuffer, 
-           lSrcPoints * sizeof(double));
+           (size_t)nSrcPoints * sizeof(double));
   }
   else
   {
@@ -248,11 +348,11 @@ BOOL CDataFile::Append(const CDataFile& datafile)
     if (m_lColumns > datafile.m_lColumns)
     {
       // zero out mem
-      long lDestPoints = m_lRows * m_lColumns;
-      long lSrcPoints = datafile.m_lRows * m_lColumns;
-      memset(m_pBuffer + lDestPoints, 
+      long long nDestPoints = m_nRows * m_lColumns;
+      long long nSrcPoints = datafile.m_nRows * m_lColumns;
+      memset(m_pBuffer + nDestPoints, 
              0, 
-             lSrcPoints * sizeof(double));
+             (size_t)nSrcPoints * sizeof(double));
     }
 
     // truncate number of copied columns if necessary
@@ -260,157 +360,410 @@ BOOL CDataFile::Append(const CDataFile& datafile)
                    datafile.m_lColumns : 
                    m_lColumns;
 
-    long i = 0;        // row index of source
-    long w = m_lRows;  // row index of dest
-    for (; i < datafile.m_lRows; i++, w++)
+    long long i = 0;        // row index of source
+    long long w = m_nRows;  // row index of dest
+    for (; i < datafile.m_nRows; i++, w++)
     {
-      register long lSrcOffset = i * datafile.m_lColumns;
-      register long lDestOffset = w * m_lColumns;
+      long long nSrcOffset = i * datafile.m_lColumns;
+      long long nDestOffset = w * m_lColumns;
       for (long j = 0; j < lMaxCol; j++)
       {
-        m_pBuffer[lDestOffset + j] = datafile.m_pBuffer[lSrcOffset + j];
+        m_pBuffer[nDestOffset + j] = datafile.m_pBuffer[nSrcOffset + j];
       }
     }
   }
 
   // set new row count
-  m_lRows += datafile.m_lRows;
+  m_nRows += datafile.m_nRows;
   
   return TRUE;
 }
  
-BOOL CDataFile::Read(const char* pszFileName)
+/////////////////////////////////////////////////////////////////////////////
+// text loading
+// the file is mapped (or read whole if it cannot be), cut into chunks at
+// line ends, and each chunk is scanned twice in parallel: once to count
+// its data rows and check columns, so the buffer is allocated exactly,
+// then to parse its numbers straight into place
+// tokens are separated by ' ', ',', '\t', '\r' and '\n'; a token starting
+// with punctuation other than '-' and '.' begins a comment that runs to
+// the end of the line; lines without data are skipped
+
+// smallest chunk worth a thread
+#define READCHUNKMIN (1L << 20)
+
+// maps a file read-only, returns NULL on failure
+static const char* MapTextFile(const char* pszFileName, size_t& nSize)
 {
-  // clear existing data
-  Destroy();
+  const char* pText = NULL;
+  nSize = 0;
+#ifdef _WIN32
+  HANDLE hFile = CreateFileA(pszFileName, GENERIC_READ, FILE_SHARE_READ, NULL,
+                             OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (hFile == INVALID_HANDLE_VALUE)
+    return NULL;
+
+  LARGE_INTEGER size;
+  if (GetFileSizeEx(hFile, &size) && size.QuadPart > 0)
+  {
+    HANDLE hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (hMapping != NULL)
+    {
+      // the view keeps the mapping alive
+      pText = (const char*)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+      CloseHandle(hMapping);
+      if (pText != NULL)
+        nSize = (size_t)size.QuadPart;
+    }
+  }
+  CloseHandle(hFile);
+#else
+  int fd = open(pszFileName, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+  {
+    void* pv = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (pv != MAP_FAILED)
+    {
+      pText = (const char*)pv;
+      nSize = (size_t)st.st_size;
+      madvise(pv, nSize, MADV_SEQUENTIAL);
+    }
+  }
+  close(fd);
+#endif
+  return pText;
+}
+
+static void UnmapTextFile(const char* pText, size_t nSize)
+{
+#ifdef _WIN32
+  UnmapViewOfFile(pText);
+#else
+  munmap((void*)pText, nSize);
+#endif
+}
+
+// reads a file that cannot be mapped (empty, or not a regular file) into
+// a malloc'ed buffer, returns FALSE on failure
+static BOOL LoadTextFile(const char* pszFileName, char*& pText, size_t& nSize)
+{
+  pText = NULL;
+  nSize = 0;
 
-  // open file
   FILE* f = NULL;
-  if (fopen_s(&f, pszFileName, "r") != 0)
-    return FALSE;
-  
-  // alloc line buffer
-  char* pBuf = new char[4096];
-  if (pBuf == NULL)
+  if (fopen_s(&f, pszFileName, "rb") != 0)
     return FALSE;
 
-  BOOL bFirstRow = TRUE;
-  
-  long lRow = 0;
-  while (!feof(f))
-  {   
-    // read a line
-    char* p = fgets(pBuf, 4096, f);
-    if (p == NULL)
+  size_t nAlloc = 0;
+  for (;;)
+  {
+    if (nSize == nAlloc)
+    {
+      size_t nNew = nAlloc ? nAlloc * 2 : 65536;
+      char* pNew = (char*)realloc(pText, nNew);
+      if (pNew == NULL)
+      {
+        free(pText);
+        pText = NULL;
+        fclose(f);
+        return FALSE;
+      }
+      pText = pNew;
+      nAlloc = nNew;
+    }
+    size_t nRead = fread(pText + nSize, 1, nAlloc - nSize, f);
+    if (nRead == 0)
       break;
+    nSize += nRead;
+  }
+
+  BOOL bOK = !ferror(f);
+  fclose(f);
+  return bOK;
+}
+
+static inline BOOL IsDelimiter(char ch)
+{
+  return ch == ' ' || ch == ',' || ch == '\t' || ch == '\r' || ch == '\n';
+}
+
+static inline BOOL IsComment(char ch)
+{
+  return ch != '-' && ch != '.' && ispunct((unsigned char)ch);
+}
+
+// parses a whole token as a double
+static BOOL ParseNumber(const char* pTok, const char* pEnd, double& d)
+{
+#ifdef __cpp_lib_to_chars
+  std::from_chars_result res = std::from_chars(pTok, pEnd, d);
+  if (res.ec == std::errc() && res.ptr == pEnd)
+    return TRUE;
+  // overflow, underflow and forms only strtod takes fall through
+#endif
+
+  // strtod needs a terminated copy
+  char szLocal[64];
+  size_t nLen = pEnd - pTok;
+  char* psz = szLocal;
+  if (nLen >= sizeof(szLocal) && (psz = (char*)malloc(nLen + 1)) == NULL)
+    return FALSE;
+  memcpy(psz, pTok, nLen);
+  psz[nLen] = '\0';
+
+  char* pszStop;
+  d = strtod(psz, &pszStop);
+  BOOL bOK = nLen > 0 && pszStop == psz + nLen;
+
+  if (psz != szLocal)
+    free(psz);
+  return bOK;
+}
+
+// scans the lines in [p, pEnd); counts data rows in nRows and places the
+// column count of the first in lFirstColumns, or if pdblOut is non-NULL
+// stores lColumns values for each data row there; returns FALSE on a bad
+// number or a row whose column count differs
+static BOOL ScanTextChunk(const char* p, const char* pEnd, double* pdblOut,
+                          long lColumns, long long& nRows, long& lFirstColumns)
+{
+  nRows = 0;
+  lFirstColumns = 0;
 
+  while (p < pEnd)
+  {
     long lCol = 0;
-    
-    // parse tokens
-    char* pTok = NULL;
-    while ((pTok = strtok(p, " ,\t\n")))
+    BOOL bComment = FALSE;
+
+    // one line
+    while (p < pEnd && *p != '\n')
     {
-      p = NULL;   // continue parsing from original string next 
-                  //   time thru loop
-     
-      // detect comments (any punctuation except '-' and '.')
-      if ((*pTok != '-') && (*pTok != '.') && ispunct(*pTok))
+      if (IsDelimiter(*p))
       {
-        break;
+        p++;
+        continue;
       }
 
-      // pTok is now null terminated, so we can parse out a double
-      double dbl;
-      if (!SimpleFloatParse(pTok, dbl))
+      const char* pTok = p;
+      while (p < pEnd && !IsDelimiter(*p))
+        p++;
+
+      if (bComment)
+        continue;
+      if (IsComment(*pTok))
       {
-        // invalid input!
-        delete[] pBuf;
-        Destroy();
-        return FALSE;
+        bComment = TRUE;
+        continue;
       }
-     
-      // calc current data block index
-      long lIndex = (long)lRow * m_lColumns + lCol;
-      
-      // grow memory if necessary
-      if (lIndex >= m_lBufferLen / (long)sizeof(double) &&
-          !Grow((lIndex + 1) * sizeof(double)))
+
+      if (pdblOut != NULL)
       {
-        // failed allocation
-        delete[] pBuf;
-        Destroy();
-        return FALSE;
+        if (lCol >= lColumns || !ParseNumber(pTok, p, pdblOut[lCol]))
+          return FALSE;
       }
+      lCol++;
+    }
+    if (p < pEnd)
+      p++;    // past '\n'
+
+    if (lCol == 0)
+      continue;   // no data on this line
 
-      // store data
-      m_pBuffer[lIndex] = dbl;
+    if (nRows == 0)
+      lFirstColumns = lCol;
+    else if (lCol != lFirstColumns)
+      return FALSE;   // column count differs
 
-      // increase column count
-      lCol++;  
+    if (pdblOut != NULL)
+    {
+      if (lCol != lColumns)
+        return FALSE;
+      pdblOut += lColumns;
     }
+    nRows++;
+  }
 
-    // increase row count
-    lRow++;
+  return TRUE;
+}
 
-    // finished parsing this row... check column count
-    if (lCol == 0)
+BOOL CDataFile::Read(const char* pszFileName)
+{
+  // clear existing data
+  Destroy();
+
+  size_t nSize = 0;
+  char* pLoaded = NULL;
+  const char* pText = MapTextFile(pszFileName, nSize);
+  if (pText == NULL)
+  {
+    if (!LoadTextFile(pszFileName, pLoaded, nSize))
+      return FALSE;
+    pText = pLoaded;
+  }
+
+  // chunk boundaries, each just past a '\n'
+  int nChunks = 1;
+#ifdef _OPENMP
+  nChunks = omp_get_max_threads() * 4;
+#endif
+  if ((size_t)nChunks > nSize / READCHUNKMIN)
+    nChunks = (int)(nSize / READCHUNKMIN);
+  if (nChunks < 1)
+    nChunks = 1;
+
+  size_t* anStart = (size_t*)malloc((nChunks + 1) * sizeof(size_t));
+  long long* anRows = (long long*)malloc(nChunks * sizeof(long long));
+  long* alColumns = (long*)malloc(nChunks * sizeof(long));
+  BOOL bOK = anStart != NULL && anRows != NULL && alColumns != NULL;
+  int i;
+
+  if (bOK)
+  {
+    anStart[0] = 0;
+    for (i = 1; i < nChunks; i++)
     {
-      lRow--;  // no data on this row, fixup row count
+      size_t n = nSize / nChunks * i;
+      if (n < anStart[i - 1])
+        n = anStart[i - 1];
+      const char* pNewline = (const char*)memchr(pText + n, '\n', nSize - n);
+      anStart[i] = (pNewline != NULL) ? (size_t)(pNewline - pText) + 1 : nSize;
     }
-    else if (bFirstRow)
+    anStart[nChunks] = nSize;
+
+    // count rows
+    #pragma omp parallel for schedule(dynamic)
+    for (i = 0; i < nChunks; i++)
     {
-      m_lColumns = lCol;
-      bFirstRow = FALSE;
+      if (!ScanTextChunk(pText + anStart[i], pText + anStart[i + 1], NULL, 0,
+                         anRows[i], alColumns[i]))
+      {
+        anRows[i] = -1;
+      }
     }
-    else if (lCol != m_lColumns)
+
+    // every chunk must agree on the column count
+    long long nRows = 0;
+    for (i = 0; i < nChunks && bOK; i++)
     {
-      // too many columns in this row!
-      delete[] pBuf;
-      Destroy();
-      return FALSE;
+      if (anRows[i] < 0)
+        bOK = FALSE;
+      else if (anRows[i] > 0)
+      {
+        if (nRows == 0)
+          m_lColumns = alColumns[i];
+        else if (alColumns[i] != m_lColumns)
+          bOK = FALSE;
+        nRows += anRows[i];
+      }
     }
-  }         
 
-  m_lRows = lRow;
+    if (bOK && nRows > 0)
+      bOK = Resize(nRows * m_lColumns * (long long)sizeof(double));
 
-  fclose(f);  
-  delete[] pBuf;
+    // parse in place, chunk i starting at row anRows[i]
+    if (bOK && nRows > 0)
+    {
+      long long nRow = 0;
+      for (i = 0; i < nChunks; i++)
+      {
+        long long n = anRows[i];
+        anRows[i] = nRow;
+        nRow += n;
+      }
 
-  return TRUE;
+      int nFailed = 0;
+      #pragma omp parallel for schedule(dynamic) reduction(+:nFailed)
+      for (i = 0; i < nChunks; i++)
+      {
+        long long nChunkRows;
+        long lChunkColumns;
+        if (!ScanTextChunk(pText + anStart[i], pText + anStart[i + 1],
+                           m_pBuffer + anRows[i] * m_lColumns, m_lColumns,
+                           nChunkRows, lChunkColumns))
+        {
+          nFailed++;
+        }
+      }
+      bOK = (nFailed == 0);
+    }
+
+    if (bOK)
+      m_nRows = nRows;
+  }
+
+  free(anStart);
+  free(anRows);
+  free(alColumns);
+  if (pLoaded != NULL)
+    free(pLoaded);
+  else
+    UnmapTextFile(pText, nSize);
+
+  if (!bOK)
+    Destroy();
+
+  return bOK;
 }
 
+// binary files start with a 4 byte signature: "CD64" is followed by
+// 64-bit row and column counts; the older "CDF" is followed by counts in
+// a long as written by the platform that made the file
+
 BOOL CDataFile::ReadBinary(const char* pszFileName)
 {
+  // clear existing data
+  Destroy();
+
   // open file
   FILE* f = NULL;
   if (fopen_s(&f, pszFileName, "rb") != 0)
     return FALSE;
 
-  unsigned int nDataPoints;
-  long lRows;
-  long lColumns;
+  size_t nDataPoints;
+  long long nRows;
+  long long nColumns;
 
   // check signature
   char szSig[4] = "";
   static unsigned int nSigLen = sizeof(szSig);
   if (fread(szSig, 1, nSigLen, f) != nSigLen)
     goto error;
-  else if (strcmp(szSig, "CDF") != 0)
-    goto error;
 
   // read rows, cols
-  if (fread(&lRows, sizeof(lRows), 1, f) != 1)
+  if (memcmp(szSig, "CD64", nSigLen) == 0)
+  {
+    if (fread(&nRows, sizeof(nRows), 1, f) != 1 ||
+        fread(&nColumns, sizeof(nColumns), 1, f) != 1)
+      goto error;
+  }
+  else if (memcmp(szSig, "CDF", nSigLen) == 0)
+  {
+    long lRows, lColumns;
+    if (fread(&lRows, sizeof(lRows), 1, f) != 1 ||
+        fread(&lColumns, sizeof(lColumns), 1, f) != 1)
+      goto error;
+    nRows = lRows;
+    nColumns = lColumns;
+  }
+  else
     goto error;
 
-  if (fread(&lColumns, sizeof(lColumns), 1, f) != 1)
+  if (nRows < 0 || nColumns < 0 || nColumns > LONG_MAX ||
+      (nColumns > 0 && nRows > LLONG_MAX / (long long)sizeof(double) / nColumns))
     goto error;
   
   // create space for data
-  if (!Create(lRows, lColumns))
+  if (!Resize(nRows * nColumns * (long long)sizeof(double)))
     goto error;
+  m_nRows = nRows;
+  m_lColumns = (long)nColumns;
 
   // read data
-  nDataPoints = m_lRows * m_lColumns;
+  nDataPoints = (size_t)(m_nRows * m_lColumns);
   if (fread(m_pBuffer, sizeof(double), nDataPoints, f) != nDataPoints)
     goto error;
 
@@ -420,6 +773,7 @@ BOOL CDataFile::ReadBinary(const char* pszFileName)
 
 error:
   fclose(f);
+  Destroy();
   return FALSE;
 }
 
@@ -448,12 +802,12 @@ BOOL CDataFile::Write(const char* pszFileName, int nDelim /*= '\t'*/)
   if (fopen_s(&f, pszFileName, "w") != 0)
     return FALSE;
   
-  for (long i = 0; i < m_lRows; i++)
+  for (long long i = 0; i < m_nRows; i++)
   {
     for(long j = 0; j < m_lColumns; j++)
     {
-      long lIndex = i * m_lColumns + j;
-      double dbl = m_pBuffer[lIndex];     
+      long long nIndex = i * m_lColumns + j;
+      double dbl = m_pBuffer[nIndex];     
 
       // value
       fprintf(f, "%0.19g", dbl);
@@ -478,22 +832,23 @@ BOOL CDataFile::WriteBinary(const char* pszFileName)
   if (fopen_s(&f, pszFileName, "wb") != 0)
     return FALSE;
  
-  unsigned int nDataPoints;
+  size_t nDataPoints;
+  long long nColumns = m_lColumns;
 
-  static char szSig[] = "CDF";
+  static const char szSig[4] = { 'C', 'D', '6', '4' };
   static unsigned int nSigLen = sizeof(szSig);
   if (fwrite(szSig, 1, nSigLen, f) != nSigLen)
     goto error;
 
   // write rows, cols
-  if (fwrite(&m_lRows, sizeof(m_lRows), 1, f) != 1)
+  if (fwrite(&m_nRows, sizeof(m_nRows), 1, f) != 1)
     goto error;
 
-  if (fwrite(&m_lColumns, sizeof(m_lColumns), 1, f) != 1)
+  if (fwrite(&nColumns, sizeof(nColumns), 1, f) != 1)
     goto error;
   
   // write data
-  nDataPoints = m_lRows * m_lColumns;
+  nDataPoints = (size_t)(m_nRows * m_lColumns);
   if (fwrite(m_pBuffer, sizeof(double), nDataPoints, f) != nDataPoints)
     goto error;
 
@@ -143,6 +143,7 @@ extern "C" {
 #define LFN_W(pNode) ((pNode)->DATA.LFN.adblW)
 #define LFN_C(pNode) ((pNode)->DATA.LFN.adblC)
 #define LFN_D(pNode) ((pNode)->DATA.LFN.adblD)
+#define LFN_INDEX(pNode) ((pNode)->DATA.LFN.nIndex)
 #define MINMAX_FLAGS(pNode) ((pNode)->fNode)
 #define MINMAX_TYPE(pNode) ((pNode)->fNode & (GF_MIN | GF_MAX))
 #define MINMAX_ISMAX(pNode) ((pNode)->fNode & GF_MAX)
@@ -218,6 +219,7 @@ extern "C" {
 				char* afVarMap;               /* var index bitmap,                   */
 																			/*   currently unused, must be NULL    */
 				int nVDim;                    /* vector dimensions, except adblW     */
+				int nIndex;                   /* position in the ALN leaf index      */
 				double* adblW;                /* weight vector, nVDim + 1 elements   */
 				double* adblC;                /* centroid vector                     */
 				double* adblD;                /* ave sq dist from centroid vector    */
@@ -270,9 +272,26 @@ extern "C" {
 													/* symmetric confidence interval is 1 - 2p         */
 		double dblLowerBound; /* upper bound on error                            */
 		double dblUpperBound; /* lower bound on error                            */
-		int    nSamples;      /* number of samples used when calculating bounds  */
+		long long nSamples;   /* number of samples used when calculating bounds  */
 	} ALNCONFIDENCE;
 
+	/* evaluation hint structure --------------------------------------------- */
+	typedef struct tagALNEVALHINT
+	{
+		ALNNODE* pLFN;        /* active LFN of the previous evaluation, or NULL  */
+		double dblValue;      /* value of the previous evaluation                */
+	} ALNEVALHINT;
+
+	/* mapped flat file structure -------------------------------------------- */
+	typedef struct tagALNFLAT
+	{
+		int nDim;             /* number of ALN inputs + 1 for output             */
+		int nOutput;          /* index of output var                             */
+		int nLFNs;            /* number of LFNs                                  */
+		const void* pvImage;  /* file mapped read only                           */
+		long long nImageSize; /* size of file                                    */
+	} ALNFLAT;
+
 	/* LFN analysis structures ----------------------------------------------- */
 	typedef struct tagLFNSTATS
 	{
@@ -304,6 +323,11 @@ extern "C" {
 																			/* implemented;  currently must be 1   */
 		ALNREGION* aRegions;              /* array of regions, nRegions elements */
 		ALNNODE* pTree;                   /* pointer to root node of tree        */
+		ALNNODE** apLFNs;                 /* leaf index: the LFNs of the tree in */
+																			/*   no fixed order, NULL until built; */
+																			/*   maintained by the library         */
+		int nLFNs;                        /* number of LFNs in leaf index        */
+		int nLFNAlloc;                    /* allocated size of leaf index        */
 	} ALN;
 
 	/*
@@ -319,7 +343,7 @@ extern "C" {
 	/* structure used for passing training and eval data                       */
 	typedef struct tagVECTORINFO
 	{
-		int nPoint;               /* training or eval sequence number            */
+		long long nPoint;         /* training or eval sequence number            */
 		int bNeedData;            /* TRUE if callback must supply data           */
 		const VARINFO* aVarInfo;  /* VARINFO array, may be NULL                  */
 		double* adblX;	          /* input vector, can be modified               */
@@ -336,7 +360,8 @@ extern "C" {
 
 	typedef struct tagTRAININFO
 	{
-		int nEpochs;					    /* total number of epochs required,            */
+		int nEpochs;					    /* number of epochs run, fewer than requested  */
+		                          /* if they ended early on convergence          */
 		int nLFNs;						    /* number of LFNs in ALN                       */
 		int nActiveLFNs;			    /* number of resp. LFNs in ALN, 0 at start     */
 		double dblRMSErr;			    /* RMS error, 0 at start                       */
@@ -344,7 +369,7 @@ extern "C" {
 
 	typedef struct tagADAPTINFO
 	{
-		int nAdapt;						    /* adaptation sequence number                  */
+		long long nAdapt;		    /* adaptation sequence number                  */
 		const double* adblX;	    /* training vector                             */
 		double dblErr;				    /* signed distance from point to surface       */
 	} ADAPTINFO;
@@ -359,7 +384,7 @@ extern "C" {
 
 	typedef struct tagALNDATAINFO
 	{
-		int nPoints;              /* number of data points                       */
+		long long nPoints;        /* number of data points                       */
 		const VARINFO* aVarInfo;  /* variable info... may be NULL                */
 		const double* adblData;   /* data array... may be NULL                   */
 		int nCols;                /* number of columns in non-NULL data array    */
@@ -433,6 +458,12 @@ extern "C" {
 	*/
 	ALNIMP void ALNAPI ALNSRand(unsigned int nSeed);
 
+	/*
+	// current state of ALN internal pseudo-random number generator;
+	// passing it to ALNSRand continues the same sequence
+	*/
+	ALNIMP unsigned int ALNAPI ALNGetRandSeed(void);
+
 	/*
 	// return next value from ALN internal pseudo-random number generator
 	*/
@@ -487,7 +518,7 @@ extern "C" {
 		const ALNDATAINFO* pDataInfo,
 		const ALNCALLBACKINFO* pCallbackInfo,
 		double* adblResult,
-		int* pnStart, int* pnEnd);
+		long long* pnStart, long long* pnEnd);
 
 	/*
 	// quick evaluation of ALN on single vector
@@ -495,6 +526,16 @@ extern "C" {
 	ALNIMP double ALNAPI ALNQuickEval(const ALN* pALN, const double* adblX,
 		ALNNODE** ppActiveLFN);
 
+	/*
+	// quick evaluation of ALN on single vector, starting from the active LFN
+	// of the previous evaluation held in a caller owned hint; the hint is
+	// updated and the ALN is not written, so each thread or tracked entity
+	// can keep its own hint; initialize pHint->pLFN to NULL, and reset it
+	// when the ALN is split, pruned or destroyed
+	*/
+	ALNIMP double ALNAPI ALNQuickEvalHinted(const ALN* pALN, const double* adblX,
+		ALNEVALHINT* pHint);
+
 
 	/*
 	/////////////////////////////////////////////////////////////////////////////
@@ -537,6 +578,40 @@ extern "C" {
 		double dblInterval,
 		double* pdblTLimit);
 
+	/*
+	// streaming confidence intervals, for data too large to keep all the
+	// errors, or intervals that are updated as errors arrive: the errors
+	// are summarized in a quantile sketch whose bounds have a rank error
+	// of at most dblEpsilon times the number of errors added, in memory
+	// O(1/dblEpsilon log(dblEpsilon n)); 0 < dblEpsilon < 0.5
+	// dblEpsilon should be well below dblP / 2, the rank of each bound
+	// ALNConfidenceSketchAdd evaluates the ALN on a data set and adds its
+	// errors; ALNConfidenceSketchAddErrors adds errors computed by the
+	// application; ALNConfidenceSketchCalc sets the bounds and nSamples of
+	// pConfidence, whose dblP must be initialized as for ALNCalcConfidence
+	// returns ALN_* error code, (ALN_NOERROR on success)
+	*/
+	ALNIMP int ALNAPI ALNConfidenceSketchCreate(double dblEpsilon,
+		void** ppvSketch);
+
+	ALNIMP int ALNAPI ALNConfidenceSketchAdd(const ALN* pALN,
+		const ALNDATAINFO* pDataInfo,
+		const ALNCALLBACKINFO* pCallbackInfo,
+		void* pvSketch);
+
+	ALNIMP int ALNAPI ALNConfidenceSketchAddErrors(void* pvSketch,
+		const double* adblErr,
+		long long nErr);
+
+	ALNIMP int ALNAPI ALNConfidenceSketchCalc(void* pvSketch,
+		ALNCONFIDENCE* pConfidence);
+
+	ALNIMP int ALNAPI ALNConfidenceSketchInfo(void* pvSketch,
+		long long* pnErrors,
+		long* plTuples);
+
+	ALNIMP int ALNAPI ALNConfidenceSketchFree(void* pvSketch);
+
 
 	/*
 	/////////////////////////////////////////////////////////////////////////////
@@ -571,21 +646,81 @@ extern "C" {
 	*/
 
 	/*
-	// saving ALN to disk file
+	// saving ALN to disk file, in the tree (v1) format
 	*/
 	ALNIMP int ALNAPI ALNWrite(const ALN* pALN, const char* pszFileName);
 
 	/*
-	// loading ALN from disk file
+	// saving ALN to disk file, in the flat (v2) format, which loads faster
+	// but is not read by versions before it
+	*/
+	ALNIMP int ALNAPI ALNWriteFlat(const ALN* pALN, const char* pszFileName);
+
+	/*
+	// loading ALN from disk file, either flat (v2) or tree (v1) format
 	*/
 	ALNIMP int ALNAPI ALNRead(const char* pszFileName, ALN** ppALN);
 
+	/*
+	// mapping a flat (v2) file read only for evaluation, without building
+	// an ALN; the file is used in place, so loading allocates nothing per
+	// node and the pages are shared by every process mapping the file
+	*/
+	ALNIMP int ALNAPI ALNMapFlat(const char* pszFileName, ALNFLAT** ppFlat);
+
+	/*
+	// quick evaluation of a mapped flat file on single vector; gives the
+	// ALNQuickEval value of the ALN ALNRead loads from the file, and the
+	// index of the active LFN counting the LFNs from left to right
+	*/
+	ALNIMP double ALNAPI ALNQuickEvalFlat(const ALNFLAT* pFlat,
+		const double* adblX, int* pnActiveLFN);
+
+	ALNIMP int ALNAPI ALNUnmapFlat(ALNFLAT* pFlat);
+
+	/*
+	// saving ALN with its training state (responsibility counts, split
+	// structures of all pieces, smoothing, random number generator state)
+	// and nUserBytes of caller data to a checkpoint file; the file is
+	// replaced atomically, so a crash leaves the previous checkpoint intact
+	*/
+	ALNIMP int ALNAPI ALNWriteCheckpoint(const ALN* pALN, const char* pszFileName,
+		const void* pvUserData, int nUserBytes);
+
+	/*
+	// loading ALN and training state from a checkpoint file; restores the
+	// random number generator state and copies the caller data, which must
+	// have been written with the same nUserBytes
+	*/
+	ALNIMP int ALNAPI ALNReadCheckpoint(const char* pszFileName, ALN** ppALN,
+		void* pvUserData, int nUserBytes);
+
+	/*
+	// saving ALN as a self contained C source file defining
+	//   double pszFunction(const double* x, int* pnLFN);
+	// which returns the ALNQuickEval value, with all weights as constants;
+	// pszFunction may be NULL for ALNEvalC
+	*/
+	ALNIMP int ALNAPI ALNWriteAsC(const ALN* pALN, const char* pszFileName,
+		const char* pszFunction);
+
 	/*
 	// conversion to dtree
 	*/
 	ALNIMP int ALNAPI ALNConvertDtree(const ALN* pALN, int nMaxDepth,
 		DTREE** ppDtree);
 
+	/*
+	// conversion to dtree guided by samples of the inputs it will be
+	// evaluated on (training data or a query log), read like training data;
+	// splits minimize the expected evaluation cost over the samples, the
+	// most rewarding first, and at most nMaxBlocks blocks are made (0 for
+	// no limit besides nMaxDepth)
+	*/
+	ALNIMP int ALNAPI ALNConvertDtreeEx(const ALN* pALN, int nMaxDepth,
+		DTREE** ppDtree, const ALNDATAINFO* pDataInfo,
+		const ALNCALLBACKINFO* pCallbackInfo, int nMaxBlocks);
+
 	/*
 	/////////////////////////////////////////////////////////////////////////////
 	// memory management
@@ -643,6 +778,13 @@ extern "C" {
 
 	ALNIMP int ALNAPI ALNSetGrowable(ALN* pALN, ALNNODE* pParent);
 
+	/*
+	// rebalance chains of minmax nodes of the same type, putting pieces
+	// that are active more often nearer the root; the function is unchanged
+	*/
+
+	ALNIMP int ALNAPI ALNRebalance(ALN* pALN);
+
 
 	/*
 	///////////////////////////////////////////////////////////////////////////////
@@ -100,6 +100,7 @@ extern int nPercentForTest;   // the percentage of the data file used for testin
 extern BOOL bEstimateNoiseVariance; // This is TRUE when the TVfile is split into two parts to determine the noise variance in the data. 
 extern int nMaxLag; // The maximum lag of any input determined in preprocUniversalFile.
 extern double dblFracTest;    // The fraction of the PreprocessedDataFile used for TSfile (default 10%) if no separate test file is provided.
+extern BOOL bCheckpoint; // If TRUE, approximation saves its state after every iteration and resumes from it after a crash
 extern CDataFile OutputData;  // The result of evaluation with a column added for the DTREE output
 extern int nMessageNumber; // messages used in the Doc and View
 extern int nPercentProgress; // used for progress indicator
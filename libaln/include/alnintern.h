@@ -25,12 +25,7 @@
 // Functions
 void splitControl(ALN*, double); // if average noise variance of a piece is higher
 			// than the square training error, splitting is prevented
-void doSplits(ALN*, ALNNODE*, double); //does the recursion of splitcontrol
-void zeroSplitValues(ALN*, ALNNODE*);  // sets the square error to zero in each LFN
-void splitUpdateValues(ALN*); // accumulates the training square error and number of hits on each linear piece
-void splitNoiseSetVAR(ALN*); // accumulates the variance square error and number of hits on each linear piece
-void dodivideTR(ALN*, ALNNODE*); // divides the total square training set errors of the pieces by their hit count
-void dodivideVAR(ALN*, ALNNODE*); // divides the sum of noise variance samples of the pieces by their respective hit counts
+void splitUpdateValues(ALN*, double); // accumulates the training square error and number of hits on each linear piece
 
 // Thread procedures
 UINT TakeActionProc(LPVOID pParam);  // separate thread
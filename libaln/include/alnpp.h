@@ -124,7 +124,7 @@ public:
 	// aln data 
   const ALNDATAINFO* GetDataInfo() const { return &m_datainfo; }
   ALNDATAINFO* GetDataInfo() { return &m_datainfo; }
-  void SetDataInfo(int nPoints, int nCols, const double* adblData,
+  void SetDataInfo(long long nPoints, int nCols, const double* adblData,
                    const VARINFO* aVarInfo = NULL, const double MSEorF = -1.0);
                   
   // region (nRegion must be 0)
@@ -151,6 +151,7 @@ public:
   BOOL AddTreeString(ALNNODE* pParent, const char* pszTreeString, 
                      int& nParsed);
   BOOL SetGrowable(ALNNODE* pNode);
+  BOOL Rebalance();
   
   BOOL Destroy();
 
@@ -163,12 +164,15 @@ public:
                       void* pvData = NULL);
 
   // eval
-  BOOL Eval(double* adblResult, int* pnStart = NULL, int* pnEnd = NULL, 
+  BOOL Eval(double* adblResult, long long* pnStart = NULL, long long* pnEnd = NULL, 
             int nNotifyMask = AN_NONE, ALNDATAINFO* pData = NULL, 
             void* pvData = NULL);
 
   // quick eval
   double QuickEval(const double* adblX, ALNNODE** ppActiveLFN = NULL);
+
+  // quick eval starting from the previous active LFN held in pHint
+  double QuickEvalHinted(const double* adblX, ALNEVALHINT* pHint);
   
   // get variable monotonicicty, returns -1 on failure
   int VarMono(int nVar);
@@ -179,15 +183,38 @@ public:
   // save ALN to disk file
   BOOL Write(const char* pszFileName);
 
+  // save ALN to disk file in the flat format; see ALNWriteFlat
+  BOOL WriteFlat(const char* pszFileName);
+
   // read ALN from disk file... destroys any existing ALN
   BOOL Read(const char* pszFileName);
 
+  // save ALN and training state to a checkpoint file
+  BOOL WriteCheckpoint(const char* pszFileName, 
+                       const void* pvUserData = NULL, int nUserBytes = 0);
+
+  // read ALN and training state from a checkpoint file... destroys any 
+  // existing ALN
+  BOOL ReadCheckpoint(const char* pszFileName, 
+                      void* pvUserData = NULL, int nUserBytes = 0);
+
+  // save ALN as C source for a function evaluating it; see ALNWriteAsC
+  BOOL WriteAsC(const char* pszFileName, const char* pszFunction = NULL);
+
   // conversion to dtree
   DTREE* ConvertDtree(int nMaxDepth);
 
+  // conversion to dtree guided by samples of the inputs it will be
+  // evaluated on; see ALNConvertDtreeEx
+  DTREE* ConvertDtree(int nMaxDepth, ALNDATAINFO* pData, int nMaxBlocks = 0,
+                      int nNotifyMask = AN_NONE, void* pvData = NULL);
+
   // confidence intervals
   BOOL CalcConfidence(ALNCONFIDENCE* pConfidence, int nNotifyMask = AN_NONE, 
                       ALNDATAINFO* pData = NULL, void* pvData = NULL);
+  BOOL AddConfidenceSketch(void* pvSketch, int nNotifyMask = AN_NONE, 
+                           ALNDATAINFO* pData = NULL, void* pvData = NULL);
+    // adds the errors on pData to a sketch from ALNConfidenceSketchCreate
 
   static double ConfidencePLimit(const ALNCONFIDENCE* pConfidence, 
                                  double dblSignificance);
@@ -216,6 +243,7 @@ public:
 
   // ALN internal pseudo-random number generator
   static void SRand(unsigned int nSeed) { ::ALNSRand(nSeed); }
+  static unsigned int GetRandSeed() { return ::ALNGetRandSeed(); }
   static unsigned long Rand() { return ::ALNRand(); }
   static float RandFloat() { return ::ALNRandFloat(); }
 
@@ -163,12 +163,12 @@ void ALNAPI DebugValidateALNDataInfo(const ALN* pALN,
 
 
 // calculate start and end points of data set given varinfo deltas
-void ALNAPI CalcDataEndPoints(long& nStart, long& nEnd, 
+void ALNAPI CalcDataEndPoints(long long& nStart, long long& nEnd, 
                               const ALN* pALN,
                               const ALNDATAINFO* pDataInfo);
 
 // allocate and init data column base pointers
-const double** ALNAPI AllocColumnBase(int nStart, 
+const double** ALNAPI AllocColumnBase(long long nStart, 
                                       const ALN* pALN,
                                       const ALNDATAINFO* pDataInfo);
 
@@ -178,8 +178,8 @@ void ALNAPI FreeColumnBase(const double**);
 // fill input vector
 void ALNAPI FillInputVector(const ALN* pALN,
                             double* adblX, 
-                            int nPoint,
-                            int nStart,
+                            long long nPoint,
+                            long long nStart,
                             const double** apdblBase,
                             const ALNDATAINFO* pDataInfo,
                             const ALNCALLBACKINFO* pCallbackInfo);
@@ -301,12 +301,22 @@ int ALNAPI CalcActiveChild(double& dblRespActive, double& dblDistance,
 int ALNAPI EvalTree(const ALNNODE* pNode, const ALN* pALN,
                     const ALNDATAINFO* pDataInfo,
                     const ALNCALLBACKINFO* pCallbackInfo,
-                    double* adblResult, int* pnStart, int* pnEnd,
+                    double* adblResult, long long* pnStart, long long* pnEnd,
                     BOOL bErrorResults = FALSE,
                     ALNNODE** apActiveLFNs = NULL,
                     double* adblInput = NULL,
                     double* adblOutput = NULL);
 
+// evaluate a tree on points nFirst to nLast of a dataset, which must be
+// within the range of CalcDataEndPoints; adblResult holds
+// nLast - nFirst + 1 values, eg for evaluating in bounded memory
+int ALNAPI EvalTreeRange(const ALN* pALN,
+                         const ALNDATAINFO* pDataInfo,
+                         const ALNCALLBACKINFO* pCallbackInfo,
+                         long long nFirst, long long nLast,
+                         double* adblResult,
+                         BOOL bErrorResults = FALSE);
+
 
 ///////////////////////////////////////////////////////////////////////////////
 // monotonicity checking and support routines
@@ -341,6 +351,13 @@ inline void ALNAPI SetSmoothingEpsilon(ALNREGION* pRegion)
 
 // used to count number of LFNs in an ALN
 void ALNAPI CountLFNs(const ALNNODE* pNode, int& nTotal, int& nAdapted);
+void ALNAPI CountLFNs(ALN* pALN, int& nTotal, int& nAdapted);
+
+// leaf index of an ALN (alnmem.cpp); BuildLFNIndex makes room for nReserve
+// more LFNs and returns FALSE if out of memory, FreeLFNIndex drops the index
+// so it is rebuilt when next needed
+BOOL ALNAPI BuildLFNIndex(ALN* pALN, int nReserve = 0);
+void ALNAPI FreeLFNIndex(ALN* pALN);
 
 // init any uninitialized LFN's
 void ALNAPI InitLFNs(ALNNODE* pNode, ALN* pALN, const double* adblX);
@@ -374,7 +391,9 @@ inline void Callback(const ALN* pALN, int nCode, void* pParam,
 void ALNAPI Jitter(ALN* pALN, double* adblX);
 
 // shuffle
-void ALNAPI Shuffle(int nStart, int nEnd, int* anShuffle);
+// anShuffle holds nEnd - nStart + 1 indexes, in 32 bits when they fit
+void ALNAPI Shuffle(long long nStart, long long nEnd, int* anShuffle);
+void ALNAPI Shuffle(long long nStart, long long nEnd, long long* anShuffle);
 
 // training context info
 typedef struct tagTRAINDATA
@@ -424,7 +443,9 @@ int ALNAPI SplitLFN(ALN* pALN, ALNNODE* pNode);
 #define DTREE_MINDEPTH    1
 #define DTREE_MAXDEPTH    30
 
-DTREE* ALNAPI BuildDtree(const ALN* pALN, int nMaxDepth);
+DTREE* ALNAPI BuildDtree(const ALN* pALN, int nMaxDepth,
+                         const double* adblSamples = NULL, int nSamples = 0,
+                         int nBlockBudget = 0);
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -437,24 +458,23 @@ using namespace std;
 
 // calculate probability p of an event occuring, such that
 // the probablity of m or less such events occuring in n trials
-// is x; currently limited to accuracy of 1.e-7
-double ALNAPI PLimit(int n, int m, double dblX);
+// is x, to full double precision
+double ALNAPI PLimit(long long n, long long m, double dblX);
   // returns indefinite (quiet Nan) if x < 0 or x > 1 or n < 0 
   // returns 0 if m < 0
   // returns 1 if m >= n
 
 // calculate covariance matrix C and fitted parameters A to a dataset
 // with independent variables X and dependent variable Y; std dev of each 
-// data point is in S
-// arrays U,V,W are scratch space used by SVD
+// data point is in S, or 1.0 if S is NULL
+// V and W receive the right singular vectors and singular values of X
 BOOL ALNAPI CalcCovariance(int nCols,   // number of input vars
                     int nRows,          // number of rows
-                    double* adblX,      // RMA based input vectors (nCols * nRows)
-                    double* adblY,      // RMA based result vector (nRows)
+                    const double* adblX,// RMA based input vectors (nRows * nCols)
+                    const double* adblY,// RMA based result vector (nRows)
                     double* adblC,      // RMA covariance matrix (nCols * nCols)
                     double* adblA,      // RMA fitted parameter vector (nCols)
-                    double* adblS,      // RMA std dev vector (nRows)
-                    double* adblU,      // RMA U matrix (nCols * nRows)
+                    const double* adblS,// RMA std dev vector (nRows)
                     double* adblV,      // RMA V matrix (nCols * nCols)
                     double* adblW,      // RMA W matrix (nCols)
                     double& dblChiSq);  // chi square of fit
@@ -11,6 +11,7 @@ extern FILE* fpProtocol;
 extern double dblTrainErr;
 extern int nMaxEpochs;
 extern int nNumberLFNs;
+extern int nTotalEpochs;
 
 class CMyAln;
 void fillvector(double *, CMyAln *);
@@ -31,6 +32,11 @@ class CMyAln : public CAln
     //cerr << "Training finished.  RMSE: " << pTrainInfo->dblRMSErr << endl; 
 		//fprintf(fpProtocol,"Training finished.  Training set RMSE = %f \n", pTrainInfo->dblRMSErr);
 		dblTrainErr = pTrainInfo->dblRMSErr;
+		// the epochs of a call may end early, so the last epoch is reported here
+		nTotalEpochs += pTrainInfo->nEpochs;
+		nNumberLFNs = pTrainInfo->nActiveLFNs;
+		fprintf(fpProtocol,"after %d epochs: Estimated RMSE %f Active/Total LFNs %d/%d\n", pTrainInfo->nEpochs,
+			pTrainInfo->dblRMSErr, pTrainInfo->nActiveLFNs, pTrainInfo->nLFNs);
 		return TRUE;
   }
 
@@ -43,12 +49,6 @@ class CMyAln : public CAln
 
   virtual BOOL OnEpochEnd(EPOCHINFO* pEpochInfo, void* pvData) 
   {
-		if(pEpochInfo->nEpoch == (nMaxEpochs -1))
-		{
-      nNumberLFNs = pEpochInfo->nActiveLFNs;
-		  fprintf(fpProtocol,"Estimated RMSE %f Active/Total LFNs %d/%d\n", pEpochInfo->dblEstRMSErr,
-			        pEpochInfo->nActiveLFNs, pEpochInfo->nLFNs);
-		}
 	  return TRUE;
   }
 
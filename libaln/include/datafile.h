@@ -99,59 +99,66 @@ public:
   CDataFile();    
   CDataFile(const CDataFile& datafile);
     
-  BOOL Create(long lRows, long lColumns);
+  BOOL Create(long long nRows, long lColumns);
+
+  BOOL CreateView(CDataFile& datafile, long long nFirstRow, long long nRows);
+    // makes this a view of nRows rows of datafile starting at nFirstRow,
+    // sharing its data without copying; datafile must not be resized or
+    // destroyed while the view is used, and growing the view copies it
 
 // Attributes
 public:
   
   long ColumnCount() const
     { return m_lColumns; }
-  long RowCount() const
-    { return m_lRows; }
+  long long RowCount() const
+    { return m_nRows; }
+  BOOL IsView() const
+    { return m_bView; }
   
   double GetColMax(long lCol) const;
   double GetColMin(long lCol) const;
   
-  double operator[](long lIndex) const
+  double operator[](long long nIndex) const
     {
-      ASSERT(lIndex < (m_lBufferLen / (long)sizeof(double)));
-      return m_pBuffer[lIndex];
+      ASSERT(nIndex < (m_nBufferLen / (long long)sizeof(double)));
+      return m_pBuffer[nIndex];
     }
-  double& operator[](long lIndex)
+  double& operator[](long long nIndex)
     {
-      ASSERT(lIndex < (m_lBufferLen / (long)sizeof(double)));
-      return m_pBuffer[lIndex];
+      ASSERT(nIndex < (m_nBufferLen / (long long)sizeof(double)));
+      return m_pBuffer[nIndex];
     }
 
-  long CalcDataIndex(long lRow, long lColumn, long lDelta = 0) const
+  long long CalcDataIndex(long long nRow, long lColumn, long lDelta = 0) const
     {
-      ASSERT((lRow + lDelta) >= 0 && (lRow + lDelta) < m_lRows && 
+      ASSERT((nRow + lDelta) >= 0 && (nRow + lDelta) < m_nRows && 
              lColumn >=0 && lColumn < m_lColumns);
-      ASSERT((lRow + lDelta) * m_lColumns + lColumn < (m_lBufferLen / (long)sizeof(double)));
-      return (lRow + lDelta) * m_lColumns + lColumn;
+      ASSERT((nRow + lDelta) * m_lColumns + lColumn < (m_nBufferLen / (long long)sizeof(double)));
+      return (nRow + lDelta) * m_lColumns + lColumn;
     }
 
-  const double* GetRowAt(long lRow) const
+  const double* GetRowAt(long long nRow) const
     {
       ASSERT(m_pBuffer);
-      return m_pBuffer + CalcDataIndex(lRow, 0, 0);
+      return m_pBuffer + CalcDataIndex(nRow, 0, 0);
     }
 
-  double* GetRowAt(long lRow)
+  double* GetRowAt(long long nRow)
     {
       ASSERT(m_pBuffer);
-      return m_pBuffer + CalcDataIndex(lRow, 0, 0);
+      return m_pBuffer + CalcDataIndex(nRow, 0, 0);
     }
 
-  double GetAt(long lRow, long lColumn, long lDelta = 0) const
+  double GetAt(long long nRow, long lColumn, long lDelta = 0) const
     { 
       ASSERT(m_pBuffer);
-      return m_pBuffer[CalcDataIndex(lRow, lColumn, lDelta)];
+      return m_pBuffer[CalcDataIndex(nRow, lColumn, lDelta)];
     }
-  void SetAt(long lRow, long lColumn, double dbl, long lDelta = 0)
+  void SetAt(long long nRow, long lColumn, double dbl, long lDelta = 0)
     { 
       ASSERT(m_pBuffer);
-      m_pBuffer[CalcDataIndex(lRow, lColumn, lDelta)] = dbl;
+      m_pBuffer[CalcDataIndex(nRow, lColumn, lDelta)] = dbl;
     }
 
 	const double* GetDataPtr() const
@@ -165,7 +172,20 @@ public:
 
   BOOL Append(const CDataFile& datafile);
     // appends datafile to end of this... truncates or adds columns
-    // from datafile as necessary to match our columns
+    // from datafile as necessary to match our columns; an empty file
+    // takes the columns of datafile
+
+  BOOL AppendRow(const double* adblRow);
+    // appends one row of ColumnCount() values, which must be set by
+    // Create (eg Create(0, lColumns)) or a read; the buffer grows
+    // geometrically, so appending n rows costs O(n)
+
+  BOOL Reserve(long long nRows);
+    // makes room for nRows rows of the current columns without changing
+    // the row count
+
+  BOOL ShrinkToFit();
+    // releases room beyond the current rows
 
   BOOL Read(const char* pszFileName);
   BOOL ReadBinary(const char* pszFileName);
@@ -187,13 +207,17 @@ public:
 
 protected:  
 
-  // growing the data file
-  BOOL Grow(long lNewLen);
+  // growing the data file, by at least half its length
+  BOOL Grow(long long nNewLen);
+
+  // reallocating the data block to exactly nNewLen bytes
+  BOOL Resize(long long nNewLen);
   
   double* m_pBuffer;      // data block
-  long m_lBufferLen;      // length of block
+  long long m_nBufferLen; // length of block in bytes
   long m_lColumns;        // number of columns
-  long m_lRows;           // number of rows
+  long long m_nRows;      // number of rows
+  BOOL m_bView;           // TRUE if the data block belongs to another file
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -27,6 +27,8 @@
 #ifndef __DTREE_H__
 #define __DTREE_H__
 
+#include <stddef.h>  /* size_t */
+
 #ifdef __cplusplus
 extern "C" {
 #endif             
@@ -166,7 +168,10 @@ typedef struct tagDTREE           /* main decision tree struct              */
   BLOCK* aBlocks;                 /* array of blocks                        */
   int nNodes;                     /* number of dtree nodes                  */
   DTREENODE* aNodes;              /* array of nodes                         */
-} DTREE;                          /* 36 bytes                               */
+  void* pvFlatImage;              /* flat image the arrays live in, NULL    */
+                                  /*   if the arrays are heap allocated     */
+  void* pvCompiled;               /* compiled evaluation data, NULL if none */
+} DTREE;                          /* 44 bytes on Win32, 68 on x64           */
 
 #if defined(_MSC_VER)
 #pragma pack()                    /* restore default structure alignment    */
@@ -226,6 +231,52 @@ DTRIMP int DTREEAPI WriteDtree(const char* pszFileName, DTREE* pDtree);
 DTRIMP int DTREEAPI BinReadDtree(const char* pszFileName, DTREE** ppDtree);
 DTRIMP int DTREEAPI BinWriteDtree(const char* pszFileName, DTREE* pDtree);
 
+/*
+/////////////////////////////////////////////////////////////////////
+// flat binary image routines
+
+   A flat image stores all arrays and links as offsets, so it is used in
+   place rather than parsed: FlatReadDtree maps the file read only (the
+   pages are shared by every process loading the same file), and
+   ReadDtreeFromMemory does the same for an image already in memory, eg
+   one linked into an executable.  Only the small pointer based arrays
+   (VARDEF, LINEARFORM, BLOCK, MINMAXNODE) are rebuilt, in one allocation.
+   A DTREE loaded this way has pvFlatImage set and is read only: it can be
+   evaluated and written, but its arrays must not be modified or replaced.
+   BinReadDtree also recognizes flat files.
+*/
+
+/* returns DTR_NOERROR on success
+   places a new DTREE in *ppDtree - use DestroyDtree to Destroy *ppDtree,
+   which also unmaps the file */
+DTRIMP int DTREEAPI FlatReadDtree(const char* pszFileName, DTREE** ppDtree);
+DTRIMP int DTREEAPI FlatWriteDtree(const char* pszFileName, DTREE* pDtree);
+
+/* returns DTR_NOERROR on success
+   pvImage is the contents of a file written by FlatWriteDtree, aligned
+   to 8 bytes; it is not copied and must outlive the DTREE placed in
+   *ppDtree - use DestroyDtree to Destroy *ppDtree */
+DTRIMP int DTREEAPI ReadDtreeFromMemory(const void* pvImage, size_t cbImage,
+                                        DTREE** ppDtree);
+
+/*
+/////////////////////////////////////////////////////////////////////
+// C source generation
+
+   WriteDtreeAsC writes a self contained C source file defining
+     double pszFunction(const double* x, int* pnLinearIndex);
+   which returns the same value and linear form index as EvalDtree: the
+   threshold descent becomes branches, each block's min/max tree is
+   unrolled and all weights are constants.  pszFunction may be NULL for
+   the name EvalDtreeC.  Results are bit identical when the generated
+   code is compiled without floating point contraction (eg /fp:precise,
+   -ffp-contract=off).
+*/
+
+/* returns DTR_NOERROR on success */
+DTRIMP int DTREEAPI WriteDtreeAsC(const char* pszFileName, DTREE* pDtree,
+                                  const char* pszFunction);
+
 /*                   
 /////////////////////////////////////////////////////////////////////
 // Dtree evaluation routines                   
@@ -238,6 +289,19 @@ DTRIMP int DTREEAPI BinWriteDtree(const char* pszFileName, DTREE* pDtree);
 DTRIMP int DTREEAPI EvalDtree(DTREE* pDtree, double* adblInput, 
                               double* pdblResult, int* pnLinearIndex);
 
+/* evaluates nRows input vectors, row i starting at adblRows + i * nStride;
+   the output variable is not read, so when it is the last variable rows
+   may omit it.  Results, bounded as by EvalDtree, go to adblOut[i] and
+   the responsible linear form indexes to anLFIndex[i] (if not NULL).
+   Rows are grouped by block and, on a compiled DTREE, each block is
+   evaluated over its rows together; large batches use all processors.
+   An empty batch (nRows 0) does nothing and may pass NULL buffers.
+   returns DTR_NOERROR if every row was evaluated, otherwise an error
+   from one of the rows that failed */
+DTRIMP int DTREEAPI EvalDtreeBatch(DTREE* pDtree, const double* adblRows,
+                                   int nRows, int nStride, double* adblOut,
+                                   int* anLFIndex);
+
 /* min/max tree evaluation         
    returns DTR_NOERROR on success         
    places result in pdblResult, 
@@ -252,6 +316,118 @@ DTRIMP int DTREEAPI EvalMinMaxTree(MINMAXNODE* pMMN, LINEARFORM* aLF, int nDim,
 DTRIMP int DTREEAPI EvalLinearForm(LINEARFORM* pLF, int nDim, int nOutput, 
                                    double* adblInput, double* pdblResult);
 
+/*
+/////////////////////////////////////////////////////////////////////
+// compiled evaluation
+
+   CompileDtree builds a flattened copy of the blocks that EvalDtree then
+   uses instead of walking the min/max trees: the linear forms of each
+   block are stored contiguously without the output column and evaluated
+   in one vectorizable pass, and the min/max tree becomes a flat program.
+   In DTR_COMPILE_STRICT mode results are bit identical to the tree walk;
+   DTR_COMPILE_FAST folds the output weight into the other weights, which
+   saves a division per form but may change results in the last bit.
+   The loaders compile in strict mode.  If the arrays or min/max trees of
+   a DTREE are replaced after compiling, EvalDtree and EvalDtreeBatch
+   notice and walk the trees; weights changed in place are not noticed, so
+   a DTREE modified that way must be compiled again or uncompiled.
+*/
+
+#define DTR_COMPILE_STRICT  0
+#define DTR_COMPILE_FAST    1
+
+/* returns DTR_NOERROR on success, replacing any previous compilation */
+DTRIMP int DTREEAPI CompileDtree(DTREE* pDtree, int nFlags);
+
+/* frees the compiled data; EvalDtree goes back to the min/max trees */
+DTRIMP void DTREEAPI UncompileDtree(DTREE* pDtree);
+
+/*
+/////////////////////////////////////////////////////////////////////
+// cached evaluation
+
+   A DTREECACHE serves a stream of slowly moving inputs, such as a control
+   loop or a lagged time series.  It remembers the box of the leaf the
+   last miss reached, the linear form that won there and a radius within
+   which no other form of the block can win: the smallest margin by which
+   the winner beat its siblings at the min/max nodes on its path, less a
+   rounding allowance, over the block's largest slope.  An input inside
+   the box and within the radius of that input is a hit, evaluated with
+   the one form and no descent.  Results are those of the min/max tree
+   walk, so they equal EvalDtree's unless the DTREE was compiled with
+   DTR_COMPILE_FAST.  A cache is not thread safe; use one per thread.
+   A hit costs far less than a clock read, so the cache only counts hits
+   and misses; time whole streams to measure it.
+*/
+
+typedef struct tagDTREECACHE DTREECACHE;
+
+typedef struct tagDTREECACHESTATS /* cached evaluation statistics           */
+{
+  size_t nHits;                   /* inputs evaluated with the cached form  */
+  size_t nMisses;                 /* inputs that descended the dtree        */
+} DTREECACHESTATS;
+
+/* returns a cache for pDtree, which must outlive it, or NULL on failure;
+   use DestroyDtreeCache to destroy */
+DTRIMP DTREECACHE* DTREEAPI CreateDtreeCache(DTREE* pDtree);
+DTRIMP void DTREEAPI DestroyDtreeCache(DTREECACHE* pCache);
+
+/* as EvalDtree, using and updating the cached leaf */
+DTRIMP int DTREEAPI EvalDtreeCached(DTREECACHE* pCache, double* adblInput,
+                                    double* pdblResult, int* pnLinearIndex);
+
+/* forgets the cached leaf, and the statistics if bStats is non-zero; call
+   after changing the forms or min/max trees of the DTREE (a DTREE with a
+   different dimension or block count needs a new cache) */
+DTRIMP void DTREEAPI ResetDtreeCache(DTREECACHE* pCache, int bStats);
+
+DTRIMP void DTREEAPI GetDtreeCacheStats(const DTREECACHE* pCache,
+                                        DTREECACHESTATS* pStats);
+
+/*
+/////////////////////////////////////////////////////////////////////
+// compact evaluation
+
+   A DTREECOMPACT is a reduced precision copy of a DTREE for serving,
+   small enough to keep models of thousands of blocks in cache.  Nodes
+   take 8 bytes: a float threshold and one int packing the variable with
+   the right child, the left child being the next node.  Each linear form
+   is solved for the output, centered on the middle of the variable
+   bounds and stored as a float bias and one float or, with
+   DTR_COMPACT_INT16, one 16 bit weight per input; int16 weights share a
+   scale per input variable.  Centroids and names are dropped.  Results
+   differ from EvalDtree's; MeasureCompactDtree reports by how much.
+*/
+
+#define DTR_COMPACT_FLOAT   0     /* float weights                          */
+#define DTR_COMPACT_INT16   1     /* 16 bit weights, scaled per variable    */
+
+typedef struct tagDTREECOMPACT DTREECOMPACT;
+
+/* returns DTR_NOERROR on success, placing a compact copy of pDtree in
+   *ppCompact - use DestroyCompactDtree to destroy; returns
+   DTR_COMPACTLIMIT if the dtree has too many nodes for its dimension */
+DTRIMP int DTREEAPI CreateCompactDtree(DTREE* pDtree, int nFlags,
+                                       DTREECOMPACT** ppCompact);
+DTRIMP void DTREEAPI DestroyCompactDtree(DTREECOMPACT* pCompact);
+
+/* bytes used by the compact DTREE */
+DTRIMP size_t DTREEAPI GetCompactDtreeSize(const DTREECOMPACT* pCompact);
+
+/* as EvalDtree, on the compact copy */
+DTRIMP int DTREEAPI EvalCompactDtree(const DTREECOMPACT* pCompact,
+                                     const double* adblInput,
+                                     double* pdblResult, int* pnLinearIndex);
+
+/* places in *pdblMaxDev the largest absolute difference between the
+   compact and the double DTREE it was made from, over the center of every
+   leaf box, both sides of every threshold and nSamples random points
+   within the variable bounds */
+DTRIMP int DTREEAPI MeasureCompactDtree(const DTREECOMPACT* pCompact,
+                                        DTREE* pDtree, int nSamples,
+                                        double* pdblMaxDev);
+
                                  
 /*                                 
 /////////////////////////////////////////////////////////////////////
@@ -280,6 +456,9 @@ DTRIMP void DTREEAPI GetDtreeError(int nErrno, char* pBuf, int nMaxBufLen);
 #define DTR_FILEREADERR             (DTR_ERRORBASE + 32)
 #define DTR_FILETYPEERR             (DTR_ERRORBASE + 33)
 #define DTR_ENDIANERR               (DTR_ERRORBASE + 34)
+#define DTR_BADFLATIMAGE            (DTR_ERRORBASE + 35)
+#define DTR_FLATLAYOUTERR           (DTR_ERRORBASE + 36)
+#define DTR_COMPACTLIMIT            (DTR_ERRORBASE + 37)
 #define DTR_MALLOCFAILED            (DTR_ERRORBASE + 50)
 
 #define DTR_BADVERSIONDEF           (DTR_ERRORBASE + 100)
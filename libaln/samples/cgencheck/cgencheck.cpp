@@ -0,0 +1,306 @@
+// ALN Library sample
+// Generated C check.
+// ALNfit Learning Engine for approximation of functions defined by samples.
+// Copyright (C) 2018 William W. Armstrong
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// Version 3 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// For further information contact
+// William W. Armstrong
+// 3624 - 108 Street NW
+// Edmonton, Alberta, Canada  T6J 1B4
+
+// cgencheck.cpp
+// Usage: cgencheck [file.aln [smoothing [rows]]]
+// Writes the ALN as C with ALNWriteAsC, once without smoothing and once
+// with the given smoothing epsilon (default 0.02), each time with a check
+// program holding random rows and their ALNQuickEval results and active
+// LFNs, then builds and runs it.  The check program counts the rows whose
+// value or active LFN differs.  The evaluation order of the min/max nodes
+// is randomized first, so cutoffs are taken on both children.  Without a
+// file argument a random ALN of 256 LFNs in 4 inputs is used.  The
+// compiler command is taken from CGENCHECK_CC (default "cl /nologo /O2
+// /fp:precise" on Windows, "cc -O2 -ffp-contract=off" elsewhere).
+// Returns 1 if any row differs.  Link with libaln.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <aln.h>
+#include "alnpriv.h"
+
+static unsigned int _nSeed = 12345;
+
+static double Rand01()
+{
+  _nSeed = _nSeed * 1103515245u + 12345u;
+  return (_nSeed >> 8) / 16777216.0;
+}
+
+// splits every LFN of the subtree, alternating min and max by level
+static int Grow(ALN* pALN, ALNNODE* pNode, int nDepth, int nLevel)
+{
+  int nRet;
+  if (nLevel == nDepth)
+  {
+    int i;
+    LFN_W(pNode)[0] = Rand01() - 0.5;
+    for (i = 0; i < pALN->nDim; i++)
+    {
+      if (i != pALN->nOutput)
+        LFN_W(pNode)[i + 1] = Rand01() - 0.5;
+    }
+    return ALN_NOERROR;
+  }
+
+  nRet = ALNAddLFNs(pALN, pNode, (nLevel & 1) ? GF_MIN : GF_MAX, 2, NULL);
+  if (nRet != ALN_NOERROR)
+    return nRet;
+  nRet = Grow(pALN, MINMAX_LEFT(pNode), nDepth, nLevel + 1);
+  if (nRet != ALN_NOERROR)
+    return nRet;
+  return Grow(pALN, MINMAX_RIGHT(pNode), nDepth, nLevel + 1);
+}
+
+// picks the child each min/max node evaluates first at random
+static void ShuffleEval(ALNNODE* pNode)
+{
+  if (!NODE_ISMINMAX(pNode))
+    return;
+  MINMAX_EVAL(pNode) = (Rand01() < 0.5) ? MINMAX_RIGHT(pNode) : NULL;
+  ShuffleEval(MINMAX_LEFT(pNode));
+  ShuffleEval(MINMAX_RIGHT(pNode));
+}
+
+// the LFNs of the subtree left to right, as ALNWriteAsC numbers them;
+// with apLFN NULL it only counts them
+static void CollectLFNs(ALNNODE* pNode, ALNNODE** apLFN, int* pnLFNs)
+{
+  if (NODE_ISLFN(pNode))
+  {
+    if (apLFN != NULL)
+      apLFN[*pnLFNs] = pNode;
+    (*pnLFNs)++;
+  }
+  else
+  {
+    CollectLFNs(MINMAX_LEFT(pNode), apLFN, pnLFNs);
+    CollectLFNs(MINMAX_RIGHT(pNode), apLFN, pnLFNs);
+  }
+}
+
+// index of pLFN in apLFN
+static int LFNIndex(ALNNODE* const* apLFN, int nLFNs, const ALNNODE* pLFN)
+{
+  for (int i = 0; i < nLFNs; i++)
+  {
+    if (apLFN[i] == pLFN)
+      return i;
+  }
+  return -1;
+}
+
+// writes pALN as C with a check program for nRows random rows, builds and
+// runs it; returns the exit code of the check, -1 if it did not run
+static int CheckGenerated(ALN* pALN, int nRows)
+{
+  const char* pszModel = "cgencheck_gen.c";
+  const char* pszCheck = "cgencheck_check.c";
+#ifdef _WIN32
+  const char* pszExe = "cgencheck_check.exe";
+  const char* pszRun = "cgencheck_check.exe";
+  const char* pszCC = "cl /nologo /O2 /fp:precise";
+  const char* pszOutOpt = "/Fe";
+#else
+  const char* pszExe = "cgencheck_check";
+  const char* pszRun = "./cgencheck_check";
+  const char* pszCC = "cc -O2 -ffp-contract=off";
+  const char* pszOutOpt = "-o ";
+#endif
+  int nDim = pALN->nDim;
+  int nLFNs = 0;
+  int i, j, nRet = -1;
+  char szCmd[1024];
+  FILE* pFile = NULL;
+  double* adblRows = (double*)malloc((size_t)nRows * nDim * sizeof(double));
+  double* adblMin = (double*)malloc(nDim * sizeof(double));
+  double* adblMax = (double*)malloc(nDim * sizeof(double));
+  ALNNODE** apLFN;
+
+  CollectLFNs(pALN->pTree, NULL, &nLFNs);
+  apLFN = (ALNNODE**)malloc(nLFNs * sizeof(ALNNODE*));
+
+  if (getenv("CGENCHECK_CC") != NULL)
+    pszCC = getenv("CGENCHECK_CC");
+
+  if (adblRows == NULL || adblMin == NULL || adblMax == NULL || apLFN == NULL)
+  {
+    printf("out of memory\n");
+    goto done;
+  }
+  nLFNs = 0;
+  CollectLFNs(pALN->pTree, apLFN, &nLFNs);
+
+  // rows cover the input box of the ALN and a margin around it
+  for (j = 0; j < nDim; j++)
+  {
+    adblMin[j] = pALN->aRegions[0].aConstr[j].dblMin;
+    adblMax[j] = pALN->aRegions[0].aConstr[j].dblMax;
+    if (!(adblMax[j] - adblMin[j] < 1e10))
+    {
+      adblMin[j] = 0;
+      adblMax[j] = 1;
+    }
+  }
+  for (i = 0; i < nRows; i++)
+  {
+    for (j = 0; j < nDim; j++)
+    {
+      double dblWidth = adblMax[j] - adblMin[j];
+      adblRows[(size_t)i * nDim + j] = adblMin[j] + dblWidth * (1.2 * Rand01() - 0.1);
+    }
+  }
+
+  if (ALNWriteAsC(pALN, pszModel, "EvalGenerated") != ALN_NOERROR)
+  {
+    printf("could not write %s\n", pszModel);
+    goto done;
+  }
+
+  if ((pFile = fopen(pszCheck, "wt")) == NULL)
+  {
+    printf("could not write %s\n", pszCheck);
+    goto done;
+  }
+  fprintf(pFile, "#include <stdio.h>\n#include <string.h>\n\n");
+  fprintf(pFile, "double EvalGenerated(const double* x, int* pnLFN);\n\n");
+  fprintf(pFile, "static const double adblRows[%d][%d] = {\n", nRows, nDim);
+  for (i = 0; i < nRows; i++)
+  {
+    fprintf(pFile, "  {");
+    for (j = 0; j < nDim; j++)
+      fprintf(pFile, j ? ", %.17g" : "%.17g", adblRows[(size_t)i * nDim + j]);
+    fprintf(pFile, "},\n");
+  }
+  fprintf(pFile, "};\n\nstatic const double adblExpected[%d] = {\n", nRows);
+  for (i = 0; i < nRows; i++)
+    fprintf(pFile, "  %.17g,\n", ALNQuickEval(pALN, adblRows + (size_t)i * nDim, NULL));
+  fprintf(pFile, "};\n\nstatic const int anExpected[%d] = {\n", nRows);
+  for (i = 0; i < nRows; i++)
+  {
+    ALNNODE* pActiveLFN;
+    ALNQuickEval(pALN, adblRows + (size_t)i * nDim, &pActiveLFN);
+    fprintf(pFile, "  %d,\n", LFNIndex(apLFN, nLFNs, pActiveLFN));
+  }
+  fprintf(pFile, "};\n\n");
+  fprintf(pFile,
+    "int main(void)\n"
+    "{\n"
+    "  int i, n, nDiffs = 0, nLFNDiffs = 0;\n"
+    "  double dbl;\n"
+    "  for (i = 0; i < %d; i++)\n"
+    "  {\n"
+    "    dbl = EvalGenerated(adblRows[i], &n);\n"
+    "    if (memcmp(&dbl, adblExpected + i, sizeof(double)) != 0)\n"
+    "      nDiffs++;\n"
+    "    if (n != anExpected[i])\n"
+    "      nLFNDiffs++;\n"
+    "  }\n"
+    "  printf(\"%%d of %%d values and %%d active LFNs differ\\n\", nDiffs, %d, nLFNDiffs);\n"
+    "  return nDiffs != 0 || nLFNDiffs != 0;\n"
+    "}\n",
+    nRows, nRows);
+  fclose(pFile);
+
+  sprintf(szCmd, "%s %s %s %s%s", pszCC, pszModel, pszCheck, pszOutOpt, pszExe);
+  fflush(stdout);
+  if (system(szCmd) != 0)
+  {
+    printf("could not build generated C with: %s\n", szCmd);
+    goto done;
+  }
+  fflush(stdout);
+  nRet = system(pszRun);
+
+done:
+  free(adblRows);
+  free(adblMin);
+  free(adblMax);
+  free(apLFN);
+  return nRet;
+}
+
+int main(int argc, char* argv[])
+{
+  double dblSmooth = 0.02;
+  int nRows = 20000;
+  int nRet, nFailed = 0;
+  ALN* pALN;
+
+  if (argc > 2)
+    dblSmooth = atof(argv[2]);
+  if (argc > 3)
+    nRows = atoi(argv[3]);
+  if (!(dblSmooth > 0) || nRows < 1)
+  {
+    printf("Usage: cgencheck [file.aln [smoothing [rows]]]\n");
+    return 1;
+  }
+
+  if (argc > 1)
+  {
+    if ((nRet = ALNRead(argv[1], &pALN)) != ALN_NOERROR)
+    {
+      printf("ALNRead %s failed with %d\n", argv[1], nRet);
+      return 1;
+    }
+  }
+  else
+  {
+    pALN = ALNCreateALN(5, 4);
+    if (pALN == NULL)
+    {
+      printf("ALNCreateALN failed\n");
+      return 1;
+    }
+    ALNSetGrowable(pALN, pALN->pTree);
+    if ((nRet = Grow(pALN, pALN->pTree, 8, 0)) != ALN_NOERROR)
+    {
+      printf("growing the tree failed with %d\n", nRet);
+      return 1;
+    }
+  }
+  ShuffleEval(pALN->pTree);
+  nRet = 0;
+  CollectLFNs(pALN->pTree, NULL, &nRet);
+  printf("%d LFNs, %d inputs, %d rows\n", nRet, pALN->nDim - 1, nRows);
+
+  for (int nPass = 0; nPass < 2; nPass++)
+  {
+    // smoothing goes to every region
+    for (int r = 0; r < pALN->nRegions; r++)
+    {
+      pALN->aRegions[r].dblSmoothEpsilon = nPass ? dblSmooth : 0;
+      SetSmoothingEpsilon(pALN->aRegions + r);
+    }
+    printf("smoothing %g: ", nPass ? dblSmooth : 0.0);
+    if (CheckGenerated(pALN, nRows) != 0)
+      nFailed++;
+  }
+
+  ALNDestroyALN(pALN);
+  printf(nFailed ? "FAILED\n" : "passed\n");
+  return nFailed ? 1 : 0;
+}
@@ -0,0 +1,239 @@
+// ALN Library sample
+// Confidence limit throughput benchmark.
+// ALNfit Learning Engine for approximation of functions defined by samples.
+// Copyright (C) 2018 William W. Armstrong
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// Version 3 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// For further information contact
+// William W. Armstrong
+// 3624 - 108 Street NW
+// Edmonton, Alberta, Canada  T6J 1B4
+
+// confbench.cpp
+// Usage: confbench [models [passes]]
+// Computes ALNConfidencePLimit and ALNConfidenceTLimit for a set of
+// random models (sample counts 100 to 10^6, tail probabilities 0.01 to
+// 0.1, significance 0.05 or 0.01) and reports calls per second, first
+// with every model new to the library's table of recent limits, then
+// over repeated passes as a monitoring loop would make them.  The limits
+// are also computed with the bracketing search PLimit used before, and
+// the largest difference in p and the largest error in the binomial tail
+// probability are reported for both.  Link with libaln and boost.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <aln.h>
+#include <boost/math/special_functions/beta.hpp>
+
+using namespace boost::math;
+
+static unsigned int _nSeed = 12345;
+
+static double Rand01()
+{
+  _nSeed = _nSeed * 1103515245u + 12345u;
+  return (_nSeed >> 8) / 16777216.0;
+}
+
+struct MODEL
+{
+  ALNCONFIDENCE conf;
+  double dblSignificance;
+};
+
+// the bracketing search of earlier versions of PLimit, accurate to 1e-7
+static double PLimitSearch(long long n, long long m, double dblX)
+{
+  const double dblInc = 0.1;
+  const double dblAcc = 1.0e-7;
+
+  if (m < 0)
+    return 0.0;
+  if (m >= n)
+    return 1.0;
+
+  double dblP1 = 0.0, dblY1 = dblX - 1.0;
+  double dblP3, dblY3 = 0.0;
+  for (dblP3 = dblInc; dblP3 < 1.0; dblP3 += dblInc)
+  {
+    dblY3 = dblX - (1.0 - ibeta(m + 1, n - m, dblP3));
+    if (fabs(dblY3) < dblAcc)
+      return dblP3;
+    if (dblY3 > 0.0)
+      break;
+    dblP1 = dblP3;
+    dblY1 = dblY3;
+  }
+
+  for (int i = 0; i < 100; i++)
+  {
+    double dblP2 = 0.5 * (dblP1 + dblP3);
+    if ((dblP3 - dblP1) < dblAcc)
+      return dblP2;
+    double dblY2 = dblX - (1.0 - ibeta(m + 1, n - m, dblP2));
+    if (fabs(dblY2) < dblAcc)
+      return dblP2;
+    double dblTrial = dblP2 + (dblP1 - dblP2) * dblY2 /
+                      sqrt(dblY2 * dblY2 - dblY1 * dblY3);
+    double dblY = dblX - (1.0 - ibeta(m + 1, n - m, dblTrial));
+    if (fabs(dblY) < dblAcc)
+      return dblTrial;
+    if ((dblY2 < 0.0) && (dblY > 0.0))
+    {
+      dblP1 = dblP2; dblY1 = dblY2;
+      dblP3 = dblTrial; dblY3 = dblY;
+    }
+    else if ((dblY < 0.0) && (dblY2 > 0.0))
+    {
+      dblP1 = dblTrial; dblY1 = dblY;
+      dblP3 = dblP2; dblY3 = dblY2;
+    }
+    else if (dblY < 0.0)
+    {
+      dblP1 = dblTrial; dblY1 = dblY;
+    }
+    else
+    {
+      dblP3 = dblTrial; dblY3 = dblY;
+    }
+  }
+  return 0.5 * (dblP1 + dblP3);
+}
+
+// m as in ALNConfidencePLimit
+static long long TailEvents(const ALNCONFIDENCE& conf)
+{
+  return (long long)floor((double)conf.nSamples * conf.dblP - 1) + 1;
+}
+
+// error in the probability of m or fewer events at p
+static double TailError(long long n, long long m, double dblX, double dblP)
+{
+  return fabs(1.0 - ibeta((double)(m + 1), (double)(n - m), dblP) - dblX);
+}
+
+int main(int argc, char* argv[])
+{
+  static const double adblTail[] = { 0.01, 0.025, 0.05, 0.1 };
+  int nModels = 2000;
+  int nPasses = 20;
+  int i, j;
+  double dblSec, dblSink = 0.0;
+  clock_t clkStart;
+
+  if (argc > 1)
+    nModels = atoi(argv[1]);
+  if (argc > 2)
+    nPasses = atoi(argv[2]);
+  if (nModels < 1)
+    nModels = 1;
+  if (nPasses < 1)
+    nPasses = 1;
+
+  MODEL* aModel = new MODEL[nModels];
+  double* adblPLimit = new double[nModels];
+  for (i = 0; i < nModels; i++)
+  {
+    aModel[i].conf.nSamples = (long long)(100.0 * pow(10.0, 4.0 * Rand01()));
+    aModel[i].conf.dblP = adblTail[(int)(Rand01() * 4)];
+    aModel[i].conf.dblLowerBound = -1.0;
+    aModel[i].conf.dblUpperBound = 1.0;
+    aModel[i].dblSignificance = Rand01() < 0.5 ? 0.05 : 0.01;
+  }
+
+  /* first pass, every limit computed */
+  clkStart = clock();
+  for (i = 0; i < nModels; i++)
+  {
+    if (ALNConfidencePLimit(&aModel[i].conf, aModel[i].dblSignificance,
+                            &adblPLimit[i]) != ALN_NOERROR)
+    {
+      printf("ALNConfidencePLimit failed\n");
+      return 1;
+    }
+  }
+  dblSec = (double)(clock() - clkStart) / CLOCKS_PER_SEC;
+  printf("%d models\n", nModels);
+  printf("ALNConfidencePLimit, new:      %12.0f calls/s\n",
+         dblSec > 0 ? nModels / dblSec : 0.0);
+
+  /* repeated passes */
+  clkStart = clock();
+  for (j = 0; j < nPasses; j++)
+  {
+    for (i = 0; i < nModels; i++)
+    {
+      double dblPLimit;
+      ALNConfidencePLimit(&aModel[i].conf, aModel[i].dblSignificance,
+                          &dblPLimit);
+      dblSink += dblPLimit;
+    }
+  }
+  dblSec = (double)(clock() - clkStart) / CLOCKS_PER_SEC;
+  printf("ALNConfidencePLimit, repeated: %12.0f calls/s\n",
+         dblSec > 0 ? (double)nModels * nPasses / dblSec : 0.0);
+
+  clkStart = clock();
+  for (j = 0; j < nPasses; j++)
+  {
+    for (i = 0; i < nModels; i++)
+    {
+      double dblTLimit;
+      ALNConfidenceTLimit(&aModel[i].conf, 0.9, &dblTLimit);
+      dblSink += dblTLimit;
+    }
+  }
+  dblSec = (double)(clock() - clkStart) / CLOCKS_PER_SEC;
+  printf("ALNConfidenceTLimit:           %12.0f calls/s\n",
+         dblSec > 0 ? (double)nModels * nPasses / dblSec : 0.0);
+
+  /* bracketing search */
+  double dblMaxDiff = 0.0, dblMaxErr = 0.0, dblMaxSearchErr = 0.0;
+  double dblSearchSec = 0.0;
+  for (i = 0; i < nModels; i++)
+  {
+    long long n = aModel[i].conf.nSamples;
+    long long m = TailEvents(aModel[i].conf);
+    double dblX = aModel[i].dblSignificance;
+
+    clkStart = clock();
+    double dblSearch = PLimitSearch(n, m, dblX);
+    dblSearchSec += (double)(clock() - clkStart) / CLOCKS_PER_SEC;
+
+    if (m < 0 || m >= n)
+      continue;
+
+    double dblDiff = fabs(adblPLimit[i] - dblSearch);
+    double dblErr = TailError(n, m, dblX, adblPLimit[i]);
+    double dblSearchErr = TailError(n, m, dblX, dblSearch);
+    if (dblDiff > dblMaxDiff)
+      dblMaxDiff = dblDiff;
+    if (dblErr > dblMaxErr)
+      dblMaxErr = dblErr;
+    if (dblSearchErr > dblMaxSearchErr)
+      dblMaxSearchErr = dblSearchErr;
+  }
+  printf("bracketing search:             %12.0f calls/s\n",
+         dblSearchSec > 0 ? nModels / dblSearchSec : 0.0);
+  printf("largest difference in p:       %12.3g\n", dblMaxDiff);
+  printf("largest tail error, PLimit:    %12.3g\n", dblMaxErr);
+  printf("largest tail error, search:    %12.3g\n", dblMaxSearchErr);
+
+  delete[] aModel;
+  delete[] adblPLimit;
+  return dblSink == dblSink ? 0 : 1;
+}
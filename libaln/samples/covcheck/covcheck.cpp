@@ -0,0 +1,183 @@
+// ALN Library sample
+// Least squares fit check.
+// ALNfit Learning Engine for approximation of functions defined by samples.
+// Copyright (C) 2018 William W. Armstrong
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// Version 3 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// For further information contact
+// William W. Armstrong
+// 3624 - 108 Street NW
+// Edmonton, Alberta, Canada  T6J 1B4
+
+// covcheck.cpp
+// Usage: covcheck
+// Fits random blocks of 1 to nCols + 3 rows with CalcCovariance, the fit
+// ALNLFNAnalysis makes for the points of each LFN, for nCols = 2 to 6.
+// Blocks with fewer rows than columns are those of an LFN with fewer
+// points than the ALN has variables.  For each block it checks that
+//   V is orthogonal (nCols * nCols),
+//   the residual of A is orthogonal to the columns of X,
+//   A has no component in the null space of X, ie it is the minimum
+//   norm solution, and
+//   C is symmetric and a pseudo-inverse of X^T X.
+// It prints the largest deviation of each kind and returns 1 if one is
+// above 1e-8.  Link with libaln.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <aln.h>
+#include "alnpriv.h"
+
+static unsigned int _nSeed = 12345;
+
+static double Rand01()
+{
+  _nSeed = _nSeed * 1103515245u + 12345u;
+  return (_nSeed >> 8) / 16777216.0;
+}
+
+#define MAXCOLS 6
+#define MAXROWS (MAXCOLS + 3)
+
+// largest deviations over all blocks
+static double _dblOrtho = 0, _dblNormal = 0, _dblNull = 0, _dblPinv = 0;
+
+static void Max(double& dblMax, double dbl)
+{
+  dbl = fabs(dbl);
+  if (!(dbl <= dblMax))
+    dblMax = dbl;               // NaN sticks
+}
+
+static BOOL CheckBlock(int nCols, int nRows)
+{
+  double adblX[MAXROWS * MAXCOLS], adblY[MAXROWS];
+  double adblC[MAXCOLS * MAXCOLS], adblA[MAXCOLS];
+  double adblV[MAXCOLS * MAXCOLS], adblW[MAXCOLS];
+  double adblXTX[MAXCOLS * MAXCOLS], adblP[MAXCOLS * MAXCOLS];
+  double dblChiSq;
+  int i, j, k, m;
+
+  for (i = 0; i < nRows; i++)
+  {
+    for (j = 0; j < nCols; j++)
+      adblX[i * nCols + j] = (j == nCols - 1) ? 1.0 : Rand01();
+    adblY[i] = Rand01();
+  }
+  if (!CalcCovariance(nCols, nRows, adblX, adblY, adblC, adblA, NULL,
+                      adblV, adblW, dblChiSq))
+  {
+    printf("CalcCovariance failed on %d rows, %d columns\n", nRows, nCols);
+    return FALSE;
+  }
+
+  // V^T V = I
+  for (j = 0; j < nCols; j++)
+  {
+    for (k = 0; k < nCols; k++)
+    {
+      double dbl = 0;
+      for (i = 0; i < nCols; i++)
+        dbl += adblV[i * nCols + j] * adblV[i * nCols + k];
+      Max(_dblOrtho, dbl - (j == k));
+    }
+  }
+
+  // X^T (X A - Y) = 0
+  for (j = 0; j < nCols; j++)
+  {
+    double dbl = 0;
+    for (i = 0; i < nRows; i++)
+    {
+      double dblR = -adblY[i];
+      for (k = 0; k < nCols; k++)
+        dblR += adblX[i * nCols + k] * adblA[k];
+      dbl += adblX[i * nCols + j] * dblR;
+    }
+    Max(_dblNormal, dbl);
+  }
+
+  // the columns of V past the rank span the null space of X
+  for (j = (nRows < nCols) ? nRows : nCols; j < nCols; j++)
+  {
+    double dbl = 0;
+    for (k = 0; k < nCols; k++)
+      dbl += adblV[k * nCols + j] * adblA[k];
+    Max(_dblNull, dbl);
+  }
+
+  // C = C^T and (X^T X) C (X^T X) = X^T X
+  for (j = 0; j < nCols; j++)
+  {
+    for (k = 0; k < nCols; k++)
+    {
+      double dbl = 0;
+      for (i = 0; i < nRows; i++)
+        dbl += adblX[i * nCols + j] * adblX[i * nCols + k];
+      adblXTX[j * nCols + k] = dbl;
+      Max(_dblPinv, adblC[j * nCols + k] - adblC[k * nCols + j]);
+    }
+  }
+  for (j = 0; j < nCols; j++)
+  {
+    for (k = 0; k < nCols; k++)
+    {
+      double dbl = 0;
+      for (m = 0; m < nCols; m++)
+        dbl += adblC[j * nCols + m] * adblXTX[m * nCols + k];
+      adblP[j * nCols + k] = dbl;
+    }
+  }
+  for (j = 0; j < nCols; j++)
+  {
+    for (k = 0; k < nCols; k++)
+    {
+      double dbl = 0;
+      for (m = 0; m < nCols; m++)
+        dbl += adblXTX[j * nCols + m] * adblP[m * nCols + k];
+      Max(_dblPinv, dbl - adblXTX[j * nCols + k]);
+    }
+  }
+  return TRUE;
+}
+
+int main(int argc, char* argv[])
+{
+  BOOL bOK = TRUE;
+  int nBlocks = 0;
+  for (int nCols = 2; nCols <= MAXCOLS; nCols++)
+  {
+    for (int nRows = 1; nRows <= nCols + 3; nRows++)
+    {
+      for (int n = 0; n < 20; n++)
+      {
+        if (!CheckBlock(nCols, nRows))
+          bOK = FALSE;
+        nBlocks++;
+      }
+    }
+  }
+  printf("%d blocks\n", nBlocks);
+  printf("V^T V - I:               %.3g\n", _dblOrtho);
+  printf("X^T (X A - Y):           %.3g\n", _dblNormal);
+  printf("A in null space of X:    %.3g\n", _dblNull);
+  printf("C pseudo-inverse of XTX: %.3g\n", _dblPinv);
+  if (!(_dblOrtho <= 1e-8 && _dblNormal <= 1e-8 && _dblNull <= 1e-8 && _dblPinv <= 1e-8))
+    bOK = FALSE;
+  printf(bOK ? "passed\n" : "FAILED\n");
+  return bOK ? 0 : 1;
+}
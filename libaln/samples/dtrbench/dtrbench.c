@@ -0,0 +1,558 @@
+// DTREE Library sample
+// Text DTREE parse and export throughput benchmark.
+// ALNfit Learning Engine for approximation of functions defined by samples.
+// Copyright (C) 2018 William W. Armstrong
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// Version 3 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// For further information contact
+// William W. Armstrong
+// 3624 - 108 Street NW
+// Edmonton, Alberta, Canada  T6J 1B4
+
+// dtrbench.c
+// Usage: dtrbench [file.dtr [repeats]]
+// Reads and writes a text DTREE file repeatedly with ReadDtree and
+// WriteDtree and reports the throughput in MB/s, then evaluates random
+// rows with a per row EvalDtree loop and with EvalDtreeBatch and reports
+// rows per second, and evaluates a slowly moving random walk with
+// EvalDtree and EvalDtreeCached and reports the hit rate, and compares
+// float and int16 compact copies for size, speed and deviation, then
+// writes the DTREE as C with WriteDtreeAsC, compiles it with a check
+// program and compares its results and latency with EvalDtree.  The
+// compiler command is taken from DTRBENCH_CC (default "cl /nologo /O2
+// /fp:precise" on Windows, "cc -O2 -ffp-contract=off" elsewhere).
+// Without a file argument a synthetic DTREE (10 variables, 4096 linear
+// forms, 512 blocks) is written to dtrbench.dtr and used.  Link with libaln.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dtree.h>
+
+static unsigned int _nSeed = 12345;
+
+static double Rand01()
+{
+  _nSeed = _nSeed * 1103515245u + 12345u;
+  return (_nSeed >> 8) / 16777216.0;
+}
+
+/* balanced min/max tree over linear forms nFirst .. nFirst + nCount - 1 */
+static void BuildMinMax(MINMAXNODE* pMMN, int nFirst, int nCount, int nType)
+{
+  if (nCount == 1)
+  {
+    pMMN->nType = DTREE_LINEAR;
+    MMN_LFINDEX(pMMN) = nFirst;
+    return;
+  }
+  pMMN->nType = nType;
+  BuildMinMax(AddMinMaxNodeChild(pMMN), nFirst, nCount / 2,
+              nType == DTREE_MIN ? DTREE_MAX : DTREE_MIN);
+  BuildMinMax(AddMinMaxNodeChild(pMMN), nFirst + nCount / 2, nCount - nCount / 2,
+              nType == DTREE_MIN ? DTREE_MAX : DTREE_MIN);
+}
+
+static DTREE* BuildSyntheticDtree()
+{
+  const int nDim = 10;
+  const int nBlocks = 512;
+  const int nFormsPerBlock = 8;
+  int i, j;
+  DTREE* pDtree = CreateDtree();
+  if (pDtree == NULL)
+    return NULL;
+
+  pDtree->nDim = nDim;
+  pDtree->nOutputIndex = nDim - 1;
+  pDtree->aVarDefs = CreateVarDefArray(nDim);
+  for (i = 0; i < nDim; i++)
+  {
+    char szName[16];
+    sprintf(szName, "x%d", i);
+    SetVarDefName(pDtree->aVarDefs + i, szName);
+    pDtree->aVarDefs[i].bound.dblMin = -1;
+    pDtree->aVarDefs[i].bound.dblMax = 1;
+  }
+
+  pDtree->nLinearForms = nBlocks * nFormsPerBlock;
+  pDtree->aLinearForms = CreateLinearFormArray(pDtree->nLinearForms, nDim);
+  for (i = 0; i < pDtree->nLinearForms; i++)
+  {
+    LINEARFORM* pLF = pDtree->aLinearForms + i;
+    pLF->dblBias = 0;
+    for (j = 0; j < nDim; j++)
+    {
+      pLF->adblW[j] = (j == nDim - 1) ? -1 : Rand01() - 0.5;
+      pLF->adblC[j] = Rand01() - 0.5;
+      pLF->dblBias -= pLF->adblW[j] * pLF->adblC[j];
+    }
+  }
+
+  /* complete binary dtree with nBlocks leaves */
+  pDtree->nBlocks = nBlocks;
+  pDtree->aBlocks = CreateBlockArray(nBlocks);
+  pDtree->nNodes = 2 * nBlocks - 1;
+  pDtree->aNodes = CreateDtreeNodeArray(pDtree->nNodes);
+  pDtree->aNodes[0].nParentIndex = -1;
+  for (i = 0; i < nBlocks - 1; i++)
+  {
+    DTREENODE* pNode = pDtree->aNodes + i;
+    pNode->nLeaf = 0;
+    DNODE_VARINDEX(pNode) = i % (nDim - 1);
+    DNODE_THRESHOLD(pNode) = Rand01() - 0.5;
+    DNODE_LEFTINDEX(pNode) = 2 * i + 1;
+    DNODE_RIGHTINDEX(pNode) = 2 * i + 2;
+    pDtree->aNodes[2 * i + 1].nParentIndex = i;
+    pDtree->aNodes[2 * i + 2].nParentIndex = i;
+  }
+  for (i = 0; i < nBlocks; i++)
+  {
+    DTREENODE* pNode = pDtree->aNodes + nBlocks - 1 + i;
+    pNode->nLeaf = 1;
+    DNODE_BLOCKINDEX(pNode) = i;
+    pDtree->aBlocks[i].nDtreeIndex = nBlocks - 1 + i;
+    pDtree->aBlocks[i].pMinMaxTree = CreateMinMaxNode();
+    BuildMinMax(pDtree->aBlocks[i].pMinMaxTree, i * nFormsPerBlock,
+                nFormsPerBlock, DTREE_MAX);
+  }
+
+  return pDtree;
+}
+
+/* times nRows random rows through EvalDtree and EvalDtreeBatch */
+static void BenchEval(DTREE* pDtree, int nRows)
+{
+  int nStride = pDtree->nDim;
+  double* adblRows = (double*)malloc((size_t)nRows * nStride * sizeof(double));
+  double* adblOut = (double*)malloc(nRows * sizeof(double));
+  double* adblBatch = (double*)malloc(nRows * sizeof(double));
+  double dblSec;
+  clock_t clkStart;
+  int i, j, nDiffs = 0;
+
+  if (adblRows == NULL || adblOut == NULL || adblBatch == NULL)
+  {
+    printf("out of memory\n");
+    goto done;
+  }
+
+  for (i = 0; i < nRows; i++)
+  {
+    for (j = 0; j < nStride; j++)
+    {
+      VARBOUND* pBound = &pDtree->aVarDefs[j].bound;
+      adblRows[(size_t)i * nStride + j] = pBound->dblMin +
+        (pBound->dblMax - pBound->dblMin) * Rand01();
+    }
+  }
+
+  clkStart = clock();
+  for (i = 0; i < nRows; i++)
+    EvalDtree(pDtree, adblRows + (size_t)i * nStride, adblOut + i, NULL);
+  dblSec = (double)(clock() - clkStart) / CLOCKS_PER_SEC;
+  printf("EvalDtree:      %10.0f rows/s\n", dblSec > 0 ? nRows / dblSec : 0.0);
+
+  clkStart = clock();
+  EvalDtreeBatch(pDtree, adblRows, nRows, nStride, adblBatch, NULL);
+  dblSec = (double)(clock() - clkStart) / CLOCKS_PER_SEC;
+  printf("EvalDtreeBatch: %10.0f rows/s", dblSec > 0 ? nRows / dblSec : 0.0);
+
+  for (i = 0; i < nRows; i++)
+  {
+    if (memcmp(adblOut + i, adblBatch + i, sizeof(double)) != 0)
+      nDiffs++;
+  }
+  printf(" (%d results differ)\n", nDiffs);
+
+  /* the min/max tree walk, as before CompileDtree */
+  UncompileDtree(pDtree);
+  clkStart = clock();
+  for (i = 0; i < nRows; i++)
+    EvalDtree(pDtree, adblRows + (size_t)i * nStride, adblOut + i, NULL);
+  dblSec = (double)(clock() - clkStart) / CLOCKS_PER_SEC;
+  printf("uncompiled:     %10.0f rows/s\n", dblSec > 0 ? nRows / dblSec : 0.0);
+  CompileDtree(pDtree, DTR_COMPILE_STRICT);
+
+done:
+  free(adblRows);
+  free(adblOut);
+  free(adblBatch);
+}
+
+/* times a random walk of nRows steps through EvalDtree and EvalDtreeCached */
+static void BenchCached(DTREE* pDtree, int nRows, double dblStep)
+{
+  int nDim = pDtree->nDim;
+  double* adblRows = (double*)malloc((size_t)nRows * nDim * sizeof(double));
+  double* adblOut = (double*)malloc(nRows * sizeof(double));
+  double* adblCached = (double*)malloc(nRows * sizeof(double));
+  DTREECACHE* pCache = CreateDtreeCache(pDtree);
+  DTREECACHESTATS stats;
+  double dblSec;
+  double dblHitSec;
+  clock_t clkStart;
+  int i, j, nDiffs = 0;
+
+  if (adblRows == NULL || adblOut == NULL || adblCached == NULL || pCache == NULL)
+  {
+    printf("out of memory\n");
+    goto done;
+  }
+
+  for (i = 0; i < nRows; i++)
+  {
+    for (j = 0; j < nDim; j++)
+    {
+      VARBOUND* pBound = &pDtree->aVarDefs[j].bound;
+      double dblRange = pBound->dblMax - pBound->dblMin;
+      double dbl = (i == 0) ? pBound->dblMin + dblRange * Rand01() :
+        adblRows[(size_t)(i - 1) * nDim + j] + dblRange * dblStep * (Rand01() - 0.5);
+      if (dbl < pBound->dblMin)
+        dbl = pBound->dblMin;
+      else if (dbl > pBound->dblMax)
+        dbl = pBound->dblMax;
+      adblRows[(size_t)i * nDim + j] = dbl;
+    }
+  }
+
+  clkStart = clock();
+  for (i = 0; i < nRows; i++)
+    EvalDtree(pDtree, adblRows + (size_t)i * nDim, adblOut + i, NULL);
+  dblSec = (double)(clock() - clkStart) / CLOCKS_PER_SEC;
+  printf("walk EvalDtree: %10.0f rows/s\n", dblSec > 0 ? nRows / dblSec : 0.0);
+
+  clkStart = clock();
+  for (i = 0; i < nRows; i++)
+    EvalDtreeCached(pCache, adblRows + (size_t)i * nDim, adblCached + i, NULL);
+  dblSec = (double)(clock() - clkStart) / CLOCKS_PER_SEC;
+  printf("walk cached:    %10.0f rows/s", dblSec > 0 ? nRows / dblSec : 0.0);
+
+  for (i = 0; i < nRows; i++)
+  {
+    if (memcmp(adblOut + i, adblCached + i, sizeof(double)) != 0)
+      nDiffs++;
+  }
+  printf(" (%d results differ)\n", nDiffs);
+
+  /* a hit is too short to time alone: time a stream of hits on the first
+     row, and charge the rest of the walk's time to its misses */
+  GetDtreeCacheStats(pCache, &stats);
+  clkStart = clock();
+  for (i = 0; i < nRows; i++)
+    EvalDtreeCached(pCache, adblRows, adblCached + i, NULL);
+  dblHitSec = (double)(clock() - clkStart) / CLOCKS_PER_SEC / nRows;
+  printf("hit rate %.1f%%, %.0f ns per hit, %.0f ns per miss\n",
+         100.0 * stats.nHits / nRows, 1e9 * dblHitSec,
+         stats.nMisses ? 1e9 * (dblSec - stats.nHits * dblHitSec) / stats.nMisses : 0.0);
+
+done:
+  DestroyDtreeCache(pCache);
+  free(adblRows);
+  free(adblOut);
+  free(adblCached);
+}
+
+/* number of nodes in a min/max tree */
+static size_t CountMinMax(MINMAXNODE* pMMN)
+{
+  size_t nCount = 1;
+  MINMAXNODE* pList;
+  if (pMMN->nType == DTREE_LINEAR)
+    return nCount;
+  for (pList = MMN_CHILDLIST(pMMN); pList != NULL; pList = pList->pNext)
+    nCount += CountMinMax(pList);
+  return nCount;
+}
+
+/* times nRows random rows through float and int16 compact copies */
+static void BenchCompact(DTREE* pDtree, int nRows)
+{
+  static const char* aszName[2] = { "float", "int16" };
+  int nStride = pDtree->nDim;
+  double* adblRows = (double*)malloc((size_t)nRows * nStride * sizeof(double));
+  double* adblOut = (double*)malloc(nRows * sizeof(double));
+  size_t cbDtree;
+  int i, j, nFlags;
+
+  if (adblRows == NULL || adblOut == NULL)
+  {
+    printf("out of memory\n");
+    goto done;
+  }
+
+  for (i = 0; i < nRows; i++)
+  {
+    for (j = 0; j < nStride; j++)
+    {
+      VARBOUND* pBound = &pDtree->aVarDefs[j].bound;
+      adblRows[(size_t)i * nStride + j] = pBound->dblMin +
+        (pBound->dblMax - pBound->dblMin) * Rand01();
+    }
+  }
+
+  /* forms with weights and centroids, nodes and min/max trees */
+  cbDtree = (size_t)pDtree->nLinearForms *
+              (sizeof(LINEARFORM) + 2 * pDtree->nDim * sizeof(double)) +
+            (size_t)pDtree->nNodes * sizeof(DTREENODE);
+  for (i = 0; i < pDtree->nBlocks; i++)
+    cbDtree += CountMinMax(pDtree->aBlocks[i].pMinMaxTree) * sizeof(MINMAXNODE);
+  printf("double DTREE:   %10.0f KB\n", cbDtree / 1024.0);
+
+  for (nFlags = DTR_COMPACT_FLOAT; nFlags <= DTR_COMPACT_INT16; nFlags++)
+  {
+    DTREECOMPACT* pCompact;
+    double dblSec, dblMaxDev;
+    clock_t clkStart;
+
+    if (CreateCompactDtree(pDtree, nFlags, &pCompact) != DTR_NOERROR)
+    {
+      printf("could not create %s compact DTREE\n", aszName[nFlags]);
+      continue;
+    }
+    clkStart = clock();
+    for (i = 0; i < nRows; i++)
+      EvalCompactDtree(pCompact, adblRows + (size_t)i * nStride, adblOut + i, NULL);
+    dblSec = (double)(clock() - clkStart) / CLOCKS_PER_SEC;
+    MeasureCompactDtree(pCompact, pDtree, 100000, &dblMaxDev);
+    printf("compact %s: %10.0f KB, %10.0f rows/s, max deviation %g\n",
+           aszName[nFlags], GetCompactDtreeSize(pCompact) / 1024.0,
+           dblSec > 0 ? nRows / dblSec : 0.0, dblMaxDev);
+    DestroyCompactDtree(pCompact);
+  }
+
+done:
+  free(adblRows);
+  free(adblOut);
+}
+
+/* writes the DTREE as C, with a check program holding nRows random rows
+   and their EvalDtree results, then builds and runs it */
+static void BenchCodegen(DTREE* pDtree, int nRows, int nPasses)
+{
+  const char* pszModel = "dtrbench_gen.c";
+  const char* pszCheck = "dtrbench_check.c";
+#ifdef _WIN32
+  const char* pszExe = "dtrbench_check.exe";
+  const char* pszRun = "dtrbench_check.exe";
+  const char* pszCC = "cl /nologo /O2 /fp:precise";
+  const char* pszOutOpt = "/Fe";
+#else
+  const char* pszExe = "dtrbench_check";
+  const char* pszRun = "./dtrbench_check";
+  const char* pszCC = "cc -O2 -ffp-contract=off";
+  const char* pszOutOpt = "-o ";
+#endif
+  int nDim = pDtree->nDim;
+  double* adblRows = (double*)malloc((size_t)nRows * nDim * sizeof(double));
+  double* adblOut = (double*)malloc(nRows * sizeof(double));
+  volatile double dblSink = 0;
+  double dblSec;
+  char szCmd[1024];
+  clock_t clkStart;
+  FILE* pFile = NULL;
+  int i, j, nPass;
+
+  if (getenv("DTRBENCH_CC") != NULL)
+    pszCC = getenv("DTRBENCH_CC");
+
+  if (adblRows == NULL || adblOut == NULL)
+  {
+    printf("out of memory\n");
+    goto done;
+  }
+
+  for (i = 0; i < nRows; i++)
+  {
+    for (j = 0; j < nDim; j++)
+    {
+      VARBOUND* pBound = &pDtree->aVarDefs[j].bound;
+      adblRows[(size_t)i * nDim + j] = pBound->dblMin +
+        (pBound->dblMax - pBound->dblMin) * Rand01();
+    }
+  }
+
+  clkStart = clock();
+  for (nPass = 0; nPass < nPasses; nPass++)
+  {
+    for (i = 0; i < nRows; i++)
+      EvalDtree(pDtree, adblRows + (size_t)i * nDim, adblOut + i, NULL);
+    dblSink += adblOut[nPass % nRows];
+  }
+  dblSec = (double)(clock() - clkStart) / CLOCKS_PER_SEC;
+
+  if (WriteDtreeAsC(pszModel, pDtree, "EvalGenerated") != DTR_NOERROR)
+  {
+    printf("could not write %s\n", pszModel);
+    goto done;
+  }
+
+  if ((pFile = fopen(pszCheck, "wt")) == NULL)
+  {
+    printf("could not write %s\n", pszCheck);
+    goto done;
+  }
+  fprintf(pFile, "#include <stdio.h>\n#include <string.h>\n#include <time.h>\n\n");
+  fprintf(pFile, "double EvalGenerated(const double* x, int* pnLinearIndex);\n\n");
+  fprintf(pFile, "static const double adblRows[%d][%d] = {\n", nRows, nDim);
+  for (i = 0; i < nRows; i++)
+  {
+    fprintf(pFile, "  {");
+    for (j = 0; j < nDim; j++)
+      fprintf(pFile, j ? ", %.17g" : "%.17g", adblRows[(size_t)i * nDim + j]);
+    fprintf(pFile, "},\n");
+  }
+  fprintf(pFile, "};\n\nstatic const double adblExpected[%d] = {\n", nRows);
+  for (i = 0; i < nRows; i++)
+    fprintf(pFile, "  %.17g,\n", adblOut[i]);
+  fprintf(pFile, "};\n\n");
+  fprintf(pFile,
+    "int main(void)\n"
+    "{\n"
+    "  int i, nPass, nDiffs = 0;\n"
+    "  volatile double dblSink = 0;\n"
+    "  double dbl, dblSec;\n"
+    "  clock_t clkStart;\n"
+    "  for (i = 0; i < %d; i++)\n"
+    "  {\n"
+    "    dbl = EvalGenerated(adblRows[i], NULL);\n"
+    "    if (memcmp(&dbl, adblExpected + i, sizeof(double)) != 0)\n"
+    "      nDiffs++;\n"
+    "  }\n"
+    "  clkStart = clock();\n"
+    "  for (nPass = 0; nPass < %d; nPass++)\n"
+    "  {\n"
+    "    for (i = 0; i < %d; i++)\n"
+    "      dblSink += EvalGenerated(adblRows[i], NULL);\n"
+    "  }\n"
+    "  dblSec = (double)(clock() - clkStart) / CLOCKS_PER_SEC;\n"
+    "  printf(\"generated C:    %%10.0f rows/s (%%d of %%d results differ, EvalDtree %%.0f rows/s)\\n\",\n"
+    "         dblSec > 0 ? %d.0 * %d / dblSec : 0.0, nDiffs, %d, %.17g);\n"
+    "  return nDiffs != 0;\n"
+    "}\n",
+    nRows, nPasses, nRows, nRows, nPasses, nRows,
+    dblSec > 0 ? (double)nRows * nPasses / dblSec : 0.0);
+  fclose(pFile);
+
+  sprintf(szCmd, "%s %s %s %s%s", pszCC, pszModel, pszCheck, pszOutOpt, pszExe);
+  fflush(stdout);
+  if (system(szCmd) != 0)
+  {
+    printf("could not build generated C with: %s\n", szCmd);
+    goto done;
+  }
+  system(pszRun);
+
+done:
+  free(adblRows);
+  free(adblOut);
+}
+
+static long FileSize(const char* pszFileName)
+{
+  long lSize = -1;
+  FILE* pFile = fopen(pszFileName, "rb");
+  if (pFile != NULL)
+  {
+    fseek(pFile, 0, SEEK_END);
+    lSize = ftell(pFile);
+    fclose(pFile);
+  }
+  return lSize;
+}
+
+int main(int argc, char* argv[])
+{
+  const char* pszFileName = "dtrbench.dtr";
+  const char* pszOutName = "dtrbench_out.dtr";
+  int nRepeats = 20;
+  int i, nErr;
+  long lSize;
+  double dblMB, dblSec;
+  clock_t clkStart;
+  DTREE* pDtree = NULL;
+
+  if (argc > 1)
+    pszFileName = argv[1];
+  if (argc > 2)
+    nRepeats = atoi(argv[2]);
+  if (nRepeats < 1)
+    nRepeats = 1;
+
+  if (argc <= 1)
+  {
+    pDtree = BuildSyntheticDtree();
+    if (pDtree == NULL || WriteDtree(pszFileName, pDtree) != DTR_NOERROR)
+    {
+      printf("could not write %s\n", pszFileName);
+      return 1;
+    }
+    DestroyDtree(pDtree);
+    pDtree = NULL;
+  }
+
+  lSize = FileSize(pszFileName);
+  if (lSize <= 0)
+  {
+    printf("could not open %s\n", pszFileName);
+    return 1;
+  }
+
+  /* parse */
+  clkStart = clock();
+  for (i = 0; i < nRepeats; i++)
+  {
+    if (pDtree != NULL)
+      DestroyDtree(pDtree);
+    if ((nErr = ReadDtree(pszFileName, &pDtree)) != DTR_NOERROR)
+    {
+      char szErr[256];
+      GetDtreeError(nErr, szErr, sizeof(szErr));
+      printf("%s(%d): %s\n", pszFileName, dtree_lineno, szErr);
+      return 1;
+    }
+  }
+  dblSec = (double)(clock() - clkStart) / CLOCKS_PER_SEC;
+  dblMB = (double)lSize * nRepeats / (1024.0 * 1024.0);
+  printf("%s: %ld bytes, %d linear forms, %d blocks\n", pszFileName, lSize,
+         pDtree->nLinearForms, pDtree->nBlocks);
+  printf("ReadDtree:  %8.2f MB/s (%.2f ms per file)\n",
+         dblSec > 0 ? dblMB / dblSec : 0.0, dblSec * 1000.0 / nRepeats);
+
+  /* export */
+  clkStart = clock();
+  for (i = 0; i < nRepeats; i++)
+  {
+    if (WriteDtree(pszOutName, pDtree) != DTR_NOERROR)
+    {
+      printf("could not write %s\n", pszOutName);
+      return 1;
+    }
+  }
+  dblSec = (double)(clock() - clkStart) / CLOCKS_PER_SEC;
+  dblMB = (double)FileSize(pszOutName) * nRepeats / (1024.0 * 1024.0);
+  printf("WriteDtree: %8.2f MB/s (%.2f ms per file)\n",
+         dblSec > 0 ? dblMB / dblSec : 0.0, dblSec * 1000.0 / nRepeats);
+
+  /* evaluate */
+  BenchEval(pDtree, 1000000);
+  BenchCached(pDtree, 1000000, 0.001);
+  BenchCompact(pDtree, 1000000);
+  BenchCodegen(pDtree, 10000, 100);
+
+  DestroyDtree(pDtree);
+  return 0;
+}
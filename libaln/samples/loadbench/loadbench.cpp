@@ -0,0 +1,253 @@
+// ALN Library sample
+// ALN file load benchmark.
+// ALNfit Learning Engine for approximation of functions defined by samples.
+// Copyright (C) 2018 William W. Armstrong
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// Version 3 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// For further information contact
+// William W. Armstrong
+// 3624 - 108 Street NW
+// Edmonton, Alberta, Canada  T6J 1B4
+
+// loadbench.cpp
+// Usage: loadbench [depth [dim [passes]]]
+// Builds a balanced tree of 2^depth random LFNs in dim inputs, saves it
+// with ALNWrite (tree format) and ALNWriteFlat (flat format) and reports
+// the file sizes and the best of several load times of each with ALNRead,
+// and of the flat file with ALNMapFlat, which evaluates it in place.  The
+// loaded ALNs and the mapped file are checked against the original on
+// random points, the mapped file for the active LFN too.  Link with libaln.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <aln.h>
+
+static double Seconds()
+{
+  return (double)clock() / CLOCKS_PER_SEC;
+}
+
+static long FileSize(const char* pszFileName)
+{
+  long nSize = -1;
+  FILE* pFile = fopen(pszFileName, "rb");
+  if (pFile != NULL)
+  {
+    fseek(pFile, 0, SEEK_END);
+    nSize = ftell(pFile);
+    fclose(pFile);
+  }
+  return nSize;
+}
+
+// splits every LFN of the subtree, alternating min and max by level
+static int Grow(ALN* pALN, ALNNODE* pNode, int nDepth, int nLevel)
+{
+  int nRet;
+  if (nLevel == nDepth)
+  {
+    int i;
+    LFN_W(pNode)[0] = ALNRandFloat() - 0.5;
+    for (i = 0; i < pALN->nDim; i++)
+    {
+      if (i != pALN->nOutput)
+        LFN_W(pNode)[i + 1] = ALNRandFloat() - 0.5;
+    }
+    return ALN_NOERROR;
+  }
+
+  nRet = ALNAddLFNs(pALN, pNode, (nLevel & 1) ? GF_MIN : GF_MAX, 2, NULL);
+  if (nRet != ALN_NOERROR)
+    return nRet;
+  nRet = Grow(pALN, MINMAX_LEFT(pNode), nDepth, nLevel + 1);
+  if (nRet != ALN_NOERROR)
+    return nRet;
+  return Grow(pALN, MINMAX_RIGHT(pNode), nDepth, nLevel + 1);
+}
+
+// the LFNs of the subtree left to right, as ALNQuickEvalFlat numbers them
+static void CollectLFNs(ALNNODE* pNode, ALNNODE** apLFN, int* pnLFNs)
+{
+  if (NODE_ISLFN(pNode))
+    apLFN[(*pnLFNs)++] = pNode;
+  else
+  {
+    CollectLFNs(MINMAX_LEFT(pNode), apLFN, pnLFNs);
+    CollectLFNs(MINMAX_RIGHT(pNode), apLFN, pnLFNs);
+  }
+}
+
+// best of nPasses mapping times, pALN is checked against the first mapping
+static double TimeMap(const char* pszFileName, ALN* pALN, int nLFNs,
+                      int nPasses, int* pnBad)
+{
+  double dblBest = 1e30;
+  double* adblX = (double*)malloc(pALN->nDim * sizeof(double));
+  ALNNODE** apLFN = (ALNNODE**)malloc(nLFNs * sizeof(ALNNODE*));
+  int i, j, k, n = 0;
+
+  *pnBad = 0;
+  if (adblX == NULL || apLFN == NULL)
+  {
+    printf("out of memory\n");
+    *pnBad = -1;
+    nPasses = 0;
+  }
+  else
+    CollectLFNs(pALN->pTree, apLFN, &n);
+
+  for (i = 0; i < nPasses; i++)
+  {
+    ALNFLAT* pFlat;
+    double dblStart = Seconds();
+    int nRet = ALNMapFlat(pszFileName, &pFlat);
+    double dblTime = Seconds() - dblStart;
+    if (nRet != ALN_NOERROR)
+    {
+      printf("ALNMapFlat %s failed with %d\n", pszFileName, nRet);
+      *pnBad = -1;
+      break;
+    }
+    if (dblTime < dblBest)
+      dblBest = dblTime;
+
+    if (i == 0)
+    {
+      for (j = 0; j < 1000; j++)
+      {
+        ALNNODE* pActiveLFN;
+        int nActiveLFN;
+        for (k = 0; k < pALN->nDim; k++)
+          adblX[k] = ALNRandFloat();
+        if (ALNQuickEval(pALN, adblX, &pActiveLFN) != 
+              ALNQuickEvalFlat(pFlat, adblX, &nActiveLFN) ||
+            apLFN[nActiveLFN] != pActiveLFN)
+          (*pnBad)++;
+      }
+    }
+    ALNUnmapFlat(pFlat);
+  }
+
+  free(adblX);
+  free(apLFN);
+  return dblBest;
+}
+
+// best of nPasses load times, pALN is checked against the first load
+static double TimeLoad(const char* pszFileName, const ALN* pALN, int nPasses, 
+                       int* pnBad)
+{
+  double dblBest = 1e30;
+  double* adblX = (double*)malloc(pALN->nDim * sizeof(double));
+  int i, j, k;
+
+  *pnBad = 0;
+  for (i = 0; i < nPasses; i++)
+  {
+    ALN* pLoaded;
+    double dblStart = Seconds();
+    int nRet = ALNRead(pszFileName, &pLoaded);
+    double dblTime = Seconds() - dblStart;
+    if (nRet != ALN_NOERROR)
+    {
+      printf("ALNRead %s failed with %d\n", pszFileName, nRet);
+      *pnBad = -1;
+      break;
+    }
+    if (dblTime < dblBest)
+      dblBest = dblTime;
+
+    if (i == 0)
+    {
+      for (j = 0; j < 1000; j++)
+      {
+        for (k = 0; k < pALN->nDim; k++)
+          adblX[k] = ALNRandFloat();
+        if (ALNQuickEval(pALN, adblX, NULL) != ALNQuickEval(pLoaded, adblX, NULL))
+          (*pnBad)++;
+      }
+    }
+    ALNDestroyALN(pLoaded);
+  }
+
+  free(adblX);
+  return dblBest;
+}
+
+int main(int argc, char* argv[])
+{
+  int nDepth = 17;
+  int nDim = 3;
+  int nPasses = 5;
+  ALN* pALN;
+  int nRet, nBadTree, nBadFlat, nBadMap;
+  double dblTree, dblFlat, dblMap;
+
+  if (argc > 1)
+    nDepth = atoi(argv[1]);
+  if (argc > 2)
+    nDim = atoi(argv[2]);
+  if (argc > 3)
+    nPasses = atoi(argv[3]);
+  if (nDepth < 1 || nDepth > 22 || nDim < 2 || nPasses < 1)
+  {
+    printf("Usage: loadbench [depth [dim [passes]]]\n");
+    return 1;
+  }
+
+  pALN = ALNCreateALN(nDim, nDim - 1);
+  if (pALN == NULL)
+  {
+    printf("ALNCreateALN failed\n");
+    return 1;
+  }
+  ALNSetGrowable(pALN, pALN->pTree);
+  nRet = Grow(pALN, pALN->pTree, nDepth, 0);
+  if (nRet != ALN_NOERROR)
+  {
+    printf("growing the tree failed with %d\n", nRet);
+    return 1;
+  }
+
+  nRet = ALNWrite(pALN, "loadbench_tree.aln");
+  if (nRet == ALN_NOERROR)
+    nRet = ALNWriteFlat(pALN, "loadbench_flat.aln");
+  if (nRet != ALN_NOERROR)
+  {
+    printf("writing failed with %d\n", nRet);
+    return 1;
+  }
+
+  dblTree = TimeLoad("loadbench_tree.aln", pALN, nPasses, &nBadTree);
+  dblFlat = TimeLoad("loadbench_flat.aln", pALN, nPasses, &nBadFlat);
+  dblMap = TimeMap("loadbench_flat.aln", pALN, 1 << nDepth, nPasses, &nBadMap);
+
+  printf("%d LFNs, %d inputs, best of %d loads\n", 1 << nDepth, nDim - 1, nPasses);
+  printf("  tree format %10ld bytes %8.1f ms  %d mismatches\n",
+         FileSize("loadbench_tree.aln"), dblTree * 1000, nBadTree);
+  printf("  flat format %10ld bytes %8.1f ms  %d mismatches\n",
+         FileSize("loadbench_flat.aln"), dblFlat * 1000, nBadFlat);
+  printf("  flat mapped %10ld bytes %8.3f ms  %d mismatches\n",
+         FileSize("loadbench_flat.aln"), dblMap * 1000, nBadMap);
+  if (dblFlat > 0)
+    printf("the flat format loads %.2f times as fast\n", dblTree / dblFlat);
+
+  ALNDestroyALN(pALN);
+  remove("loadbench_tree.aln");
+  remove("loadbench_flat.aln");
+  return 0;
+}
@@ -132,7 +132,7 @@ int main()
 		}
 	    
 		// set data info
-		int nPoints = file.RowCount();
+		long long nPoints = file.RowCount();
 		int nCols = file.ColumnCount();
 		const double* adblData = file.GetDataPtr();
 		aln.SetDataInfo(nPoints, nCols, adblData);
@@ -0,0 +1,247 @@
+// ALN Library sample
+// Rebalancing check.
+// ALNfit Learning Engine for approximation of functions defined by samples.
+// Copyright (C) 2018 William W. Armstrong
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// Version 3 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// For further information contact
+// William W. Armstrong
+// 3624 - 108 Street NW
+// Edmonton, Alberta, Canada  T6J 1B4
+
+// rebalcheck.cpp
+// Usage: rebalcheck [rounds [rows]]
+// Trains a growable ALN on samples of sin(4x) cos(3y) for the given number
+// of rounds of ALNTrain (default 40), after each of which the pieces that
+// do not fit are split, then calls ALNRebalance.  The splitting reads the
+// training rows from TRfile, as in approximate().  Before and after, it
+// reports the depth of the tree and the number of nodes ALNQuickEval
+// visits per evaluation on a grid over the domain, counted by an evaluator
+// that follows ALNQuickEval step by step.
+// The values after rebalancing must be identical to those before, and the
+// active LFN the same unless two pieces tie exactly.  Returns 1 on any
+// difference.  Build like ALNfitDeep and link with libaln.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <aln.h>
+#include <datafile.h>
+#include "alnpriv.h"
+
+extern int nDim;
+extern CDataFile TRfile;
+
+#define GRIDSIZE 200
+
+static unsigned int _nSeed = 12345;
+
+static double Rand01()
+{
+  _nSeed = _nSeed * 1103515245u + 12345u;
+  return (_nSeed >> 8) / 16777216.0;
+}
+
+// ALNQuickEval of an unsmoothed tree, counting the nodes it visits
+static double CountEval(const ALNNODE* pNode, const ALN* pALN,
+                        const double* adblX, CEvalCutoff cutoff,
+                        ALNNODE** ppActiveLFN, long long* pnVisits)
+{
+  (*pnVisits)++;
+  if (NODE_ISLFN(pNode))
+    return CutoffEvalLFN(pNode, pALN, adblX, ppActiveLFN);
+
+  const ALNNODE* pChild0 = MINMAX_EVAL(pNode) ? MINMAX_EVAL(pNode) : MINMAX_LEFT(pNode);
+  const ALNNODE* pChild1 = (pChild0 == MINMAX_LEFT(pNode)) ?
+                             MINMAX_RIGHT(pNode) : MINMAX_LEFT(pNode);
+
+  ALNNODE* pActiveLFN0;
+  double dbl0 = CountEval(pChild0, pALN, adblX, cutoff, &pActiveLFN0, pnVisits);
+  if (Cutoff(dbl0, pNode, cutoff, 0.0))
+  {
+    *ppActiveLFN = pActiveLFN0;
+    return dbl0;
+  }
+
+  ALNNODE* pActiveLFN1;
+  double dbl1 = CountEval(pChild1, pALN, adblX, cutoff, &pActiveLFN1, pnVisits);
+  if ((MINMAX_ISMAX(pNode) > 0) == (dbl1 > dbl0))
+  {
+    *ppActiveLFN = pActiveLFN1;
+    return dbl1;
+  }
+  *ppActiveLFN = pActiveLFN0;
+  return dbl0;
+}
+
+// largest and total LFN depth of the subtree
+static void TreeDepth(const ALNNODE* pNode, int nDepth, int* pnMax,
+                      double* pdblSum, int* pnLFNs)
+{
+  if (NODE_ISLFN(pNode))
+  {
+    if (nDepth > *pnMax)
+      *pnMax = nDepth;
+    *pdblSum += nDepth;
+    (*pnLFNs)++;
+    return;
+  }
+  TreeDepth(MINMAX_LEFT(pNode), nDepth + 1, pnMax, pdblSum, pnLFNs);
+  TreeDepth(MINMAX_RIGHT(pNode), nDepth + 1, pnMax, pdblSum, pnLFNs);
+}
+
+// evaluates the grid, keeping values and active LFNs; returns the number
+// of rows the counting evaluator disagrees with ALNQuickEval on
+static int EvalGrid(const ALN* pALN, double* adblValue, ALNNODE** apActive,
+                    double* pdblVisits)
+{
+  int nBad = 0;
+  long long nVisits = 0;
+  double adblX[3];
+  for (int i = 0; i < GRIDSIZE; i++)
+  {
+    for (int j = 0; j < GRIDSIZE; j++)
+    {
+      int n = i * GRIDSIZE + j;
+      ALNNODE* pActiveLFN;
+      adblX[0] = (i + 0.5) / GRIDSIZE;
+      adblX[1] = (j + 0.5) / GRIDSIZE;
+      adblX[2] = 0;
+      adblValue[n] = ALNQuickEval(pALN, adblX, &apActive[n]);
+      double dbl = adblX[2] + CountEval(pALN->pTree, pALN, adblX, CEvalCutoff(),
+                                        &pActiveLFN, &nVisits);
+      if (dbl != adblValue[n] || pActiveLFN != apActive[n])
+        nBad++;
+    }
+  }
+  *pdblVisits = (double)nVisits / (GRIDSIZE * GRIDSIZE);
+  return nBad;
+}
+
+static void Report(const char* pszWhen, const ALN* pALN, double dblVisits)
+{
+  int nMax = 0, nLFNs = 0;
+  double dblSum = 0;
+  TreeDepth(pALN->pTree, 0, &nMax, &dblSum, &nLFNs);
+  printf("%-7s %5d LFNs  max depth %4d  mean LFN depth %7.2f  %7.2f nodes per eval\n",
+         pszWhen, nLFNs, nMax, dblSum / nLFNs, dblVisits);
+}
+
+int main(int argc, char* argv[])
+{
+  int nRounds = 40;
+  int nRows = 2000;
+  int nRet, nFailed = 0;
+
+  if (argc > 1)
+    nRounds = atoi(argv[1]);
+  if (argc > 2)
+    nRows = atoi(argv[2]);
+  if (nRounds < 1 || nRows < 10)
+  {
+    printf("Usage: rebalcheck [rounds [rows]]\n");
+    return 1;
+  }
+
+  double* adblBefore = (double*)malloc(GRIDSIZE * GRIDSIZE * sizeof(double));
+  double* adblAfter = (double*)malloc(GRIDSIZE * GRIDSIZE * sizeof(double));
+  ALNNODE** apBefore = (ALNNODE**)malloc(GRIDSIZE * GRIDSIZE * sizeof(ALNNODE*));
+  ALNNODE** apAfter = (ALNNODE**)malloc(GRIDSIZE * GRIDSIZE * sizeof(ALNNODE*));
+  ALN* pALN = ALNCreateALN(3, 2);
+  if (!TRfile.Create(nRows, 3) || adblBefore == NULL || adblAfter == NULL ||
+      apBefore == NULL || apAfter == NULL || pALN == NULL)
+  {
+    printf("out of memory\n");
+    return 1;
+  }
+
+  for (int i = 0; i < nRows; i++)
+  {
+    double x = Rand01(), y = Rand01();
+    TRfile.SetAt(i, 0, x, 0);
+    TRfile.SetAt(i, 1, y, 0);
+    TRfile.SetAt(i, 2, sin(4 * x) * cos(3 * y), 0);
+  }
+
+  // pieces split while their training MSE is above MSEorF
+  ALNDATAINFO datainfo;
+  memset(&datainfo, 0, sizeof(datainfo));
+  datainfo.nPoints = nRows;
+  datainfo.adblData = TRfile.GetDataPtr();
+  datainfo.nCols = 3;
+  datainfo.MSEorF = 1e-5;
+
+  nDim = 3;
+  ALNSetGrowable(pALN, pALN->pTree);
+  for (int nRound = 0; nRound < nRounds; nRound++)
+  {
+    if ((nRet = ALNTrain(pALN, &datainfo, NULL, 10, 0, 0.2, FALSE)) != ALN_NOERROR)
+    {
+      printf("ALNTrain failed with %d\n", nRet);
+      return 1;
+    }
+  }
+
+  double dblVisits;
+  if (EvalGrid(pALN, adblBefore, apBefore, &dblVisits) != 0)
+  {
+    printf("the counting evaluator differs from ALNQuickEval\n");
+    nFailed++;
+  }
+  Report("before", pALN, dblVisits);
+
+  if ((nRet = ALNRebalance(pALN)) != ALN_NOERROR)
+  {
+    printf("ALNRebalance failed with %d\n", nRet);
+    return 1;
+  }
+
+  if (EvalGrid(pALN, adblAfter, apAfter, &dblVisits) != 0)
+  {
+    printf("the counting evaluator differs from ALNQuickEval\n");
+    nFailed++;
+  }
+  Report("after", pALN, dblVisits);
+
+  // values must not change; the active LFN only between exact ties
+  int nValueDiffs = 0, nLFNDiffs = 0;
+  for (int n = 0; n < GRIDSIZE * GRIDSIZE; n++)
+  {
+    if (memcmp(&adblBefore[n], &adblAfter[n], sizeof(double)) != 0)
+      nValueDiffs++;
+    else if (apBefore[n] != apAfter[n])
+    {
+      double adblX[3] = { (n / GRIDSIZE + 0.5) / GRIDSIZE,
+                          (n % GRIDSIZE + 0.5) / GRIDSIZE, 0 };
+      ALNNODE* pLFN;
+      if (CutoffEvalLFN(apBefore[n], pALN, adblX, &pLFN) !=
+          CutoffEvalLFN(apAfter[n], pALN, adblX, &pLFN))
+        nLFNDiffs++;
+    }
+  }
+  printf("%d of %d values and %d active LFNs differ\n",
+         nValueDiffs, GRIDSIZE * GRIDSIZE, nLFNDiffs);
+  if (nValueDiffs != 0 || nLFNDiffs != 0)
+    nFailed++;
+
+  ALNDestroyALN(pALN);
+  free(adblBefore);
+  free(adblAfter);
+  free(apBefore);
+  free(apAfter);
+  printf(nFailed ? "FAILED\n" : "passed\n");
+  return nFailed ? 1 : 0;
+}
@@ -0,0 +1,208 @@
+// ALN Library sample
+// Training schedule benchmark.
+// ALNfit Learning Engine for approximation of functions defined by samples.
+// Copyright (C) 2018 William W. Armstrong
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// Version 3 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// For further information contact
+// William W. Armstrong
+// 3624 - 108 Street NW
+// Edmonton, Alberta, Canada  T6J 1B4
+
+// schedbench.cpp
+// Usage: schedbench [rows [datasets]]
+// Runs approximate() on synthetic data sets, z = sin(6x)cos(4y) on the
+// unit square plus uniform noise of width 0.05, once with the adaptive
+// schedule and once with the fixed schedule of nMaxEpochs epochs per
+// iteration, both from the same random seed.  For each data set and in
+// total it reports the epochs used, the wall-clock seconds, the number of
+// active pieces, the training RMSE and the RMSE against the noise-free
+// function on a 200 x 200 grid.  The protocol of approximate() goes to
+// schedbench.txt.  Build like ALNfitDeep and link with libaln.
+
+#include <stdafx.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include <aln.h>
+#include <alnpp.h>
+#include <datafile.h>
+#include ".\cmyaln.h"
+#include "alnextern.h"
+#include "alnintern.h"
+
+extern CMyAln* pBaseNeuron;
+extern BOOL bAdaptiveSchedule;
+extern double* aNoiseSampleTool;
+
+static unsigned int _nSeed = 12345;
+
+static double Rand01()
+{
+  _nSeed = _nSeed * 1103515245u + 12345u;
+  return (_nSeed >> 8) / 16777216.0;
+}
+
+static double Target(double x, double y)
+{
+  return sin(6 * x) * cos(4 * y);
+}
+
+static double Seconds()
+{
+#ifdef _OPENMP
+  return omp_get_wtime();
+#else
+  return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+struct RESULT
+{
+  int nEpochs;
+  double dblSeconds;
+  int nLFNs;
+  double dblTrainErr;
+  double dblGridErr;
+};
+
+// trains with the given schedule and measures the result
+static void Run(BOOL bAdaptive, unsigned int nALNSeed, RESULT& result)
+{
+  bAdaptiveSchedule = bAdaptive;
+  ALNSRand(nALNSeed);
+  double dblStart = Seconds();
+  approximate();
+  result.dblSeconds = Seconds() - dblStart;
+  result.nEpochs = nTotalEpochs;
+  result.dblTrainErr = dblTrainErr;
+
+  result.nLFNs = nNumberLFNs;
+
+  double x[3], dblSum = 0;
+  for (int i = 0; i < 200; i++)
+  {
+    for (int j = 0; j < 200; j++)
+    {
+      x[0] = i / 199.0;
+      x[1] = j / 199.0;
+      x[2] = 0;
+      double d = pBaseNeuron->QuickEval(x) - Target(x[0], x[1]);
+      dblSum += d * d;
+    }
+  }
+  result.dblGridErr = sqrt(dblSum / 40000);
+
+  delete pBaseNeuron;
+  pBaseNeuron = NULL;
+}
+
+static void Print(const char* pszName, const RESULT& r)
+{
+  printf("  %-9s %7d epochs %8.2f s %6d LFNs  train RMSE %.5f  grid RMSE %.5f\n",
+         pszName, r.nEpochs, r.dblSeconds, r.nLFNs, r.dblTrainErr, r.dblGridErr);
+}
+
+int main(int argc, char* argv[])
+{
+  long nRows = 3000;
+  int nDataSets = 5;
+  int i, k;
+
+  if (argc > 1)
+    nRows = atol(argv[1]);
+  if (argc > 2)
+    nDataSets = atoi(argv[2]);
+  if (nRows < 100)
+    nRows = 100;
+  if (nDataSets < 1)
+    nDataSets = 1;
+
+  fpProtocol = fopen("schedbench.txt", "w");
+  if (fpProtocol == NULL)
+  {
+    printf("cannot open schedbench.txt\n");
+    return 1;
+  }
+  bCheckpoint = FALSE;
+
+  nDim = 3;
+  nRowsTV = nRows;
+  adblEpsilon = new double[3];
+  adblMinVar = new double[3];
+  adblMaxVar = new double[3];
+  adblStdevVar = new double[3];
+  for (k = 0; k < 3; k++)
+  {
+    adblEpsilon[k] = 0.01;
+    adblMinVar[k] = k < 2 ? 0 : -1;
+    adblMaxVar[k] = 1;
+    adblStdevVar[k] = k < 2 ? 0.29 : 0.5;
+    dblMinWeight[k] = -1e10;
+    dblMaxWeight[k] = 1e10;
+  }
+
+  RESULT total[2];
+  memset(total, 0, sizeof(total));
+  printf("%ld rows, %d data sets\n", nRows, nDataSets);
+  for (int nSet = 0; nSet < nDataSets; nSet++)
+  {
+    TVfile.Create(nRows, nDim);
+    for (i = 0; i < nRows; i++)
+    {
+      double x = Rand01();
+      double y = Rand01();
+      double dblNoise = (Rand01() - 0.5) * 0.05;
+      TVfile.SetAt(i, 0, x, 0);
+      TVfile.SetAt(i, 1, y, 0);
+      TVfile.SetAt(i, 2, Target(x, y) + dblNoise, 0);
+    }
+    free(aNoiseSampleTool);
+    aNoiseSampleTool = NULL;
+    createNoiseVarianceTool();
+
+    RESULT aResult[2];
+    Run(TRUE, 1000 + nSet, aResult[0]);
+    Run(FALSE, 1000 + nSet, aResult[1]);
+    printf("data set %d\n", nSet);
+    Print("adaptive", aResult[0]);
+    Print("fixed", aResult[1]);
+    for (k = 0; k < 2; k++)
+    {
+      total[k].nEpochs += aResult[k].nEpochs;
+      total[k].dblSeconds += aResult[k].dblSeconds;
+      total[k].nLFNs += aResult[k].nLFNs;
+      total[k].dblTrainErr += aResult[k].dblTrainErr / nDataSets;
+      total[k].dblGridErr += aResult[k].dblGridErr / nDataSets;
+    }
+  }
+  printf("total (LFNs summed, RMSE averaged)\n");
+  Print("adaptive", total[0]);
+  Print("fixed", total[1]);
+  if (total[0].nEpochs > 0 && total[0].dblSeconds > 0)
+  {
+    printf("the fixed schedule used %.2f times the epochs and %.2f times the time\n",
+           (double)total[1].nEpochs / total[0].nEpochs,
+           total[1].dblSeconds / total[0].dblSeconds);
+  }
+
+  fclose(fpProtocol);
+  return 0;
+}
@@ -37,7 +37,7 @@
 static char THIS_FILE[] = __FILE__;
 #endif
 
-const double** ALNAPI AllocColumnBase(int nStart,
+const double** ALNAPI AllocColumnBase(long long nStart,
                                       const ALN* pALN,
                                       const ALNDATAINFO* pDataInfo)
 {
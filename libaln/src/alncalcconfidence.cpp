@@ -28,6 +28,7 @@
 
 #include <aln.h>
 #include "alnpriv.h"
+#include <algorithm>
 
 #ifdef _DEBUG
 #undef THIS_FILE
@@ -46,19 +47,6 @@ static void DebugValidateALNCalcConfidence(const ALN* pALN,
                                      ALNCONFIDENCE* pConfidence);
 #endif
 
-static int __cdecl CompareErrors(const void* pElem1, const void* pElem2)
-{
-  double dbl1 = *(double*)pElem1;
-  double dbl2 = *(double*)pElem2;
-
-  if (dbl1 < dbl2)
-    return -1;
-  else if (dbl1 > dbl2)
-    return 1;
-
-  return 0;
-}
-
 // set ALN confidence intervals based on a data set
 // much of this is derived from theory documented in Master95 p302-323
 // and Press et al p228-229
@@ -82,13 +70,13 @@ ALNIMP int ALNAPI ALNCalcConfidence(const ALN* pALN,
   try
   {
     // see how many points there are
-    int nPoints = pDataInfo->nPoints;
+    long long nPoints = pDataInfo->nPoints;
 
     // allocate results array
     adblResult = new double[nPoints];
     
     // evaluate on data
-    int nStart, nEnd;
+    long long nStart, nEnd;
     nReturn = EvalTree(pALN->pTree, pALN, pDataInfo, pCallbackInfo, 
                        adblResult, &nStart, &nEnd, TRUE);
     if (nReturn != ALN_NOERROR)
@@ -97,37 +85,43 @@ ALNIMP int ALNAPI ALNCalcConfidence(const ALN* pALN,
     }
 
     // set the number of errors and error vector
-    int nErr = (nEnd - nStart + 1);
+    long long nErr = (nEnd - nStart + 1);
     double* adblErr = adblResult + nStart;
     if (nErr <= 0)
     {
       ThrowALNException();  // bad error count
     }
 
-    // EvalTree returned the errors in adblResult... now we sort them!
-    qsort(adblErr, nErr, sizeof(double), CompareErrors);
-
     // calculate upper an lower bound indexes by discarding np-1 from each end
     // (conservative approach.. see Masters95 p305)
-    int nDiscard = (int)floor((float)nErr * pConfidence->dblP - 1);
+    // nErr goes through float as it always has, so the bounds do not move
+    long long nDiscard = (long long)floor((float)nErr * pConfidence->dblP - 1);
     
     // if nErr * pConfidence->dblP is less than 1, then nDiscard will be less than 0
     if (nDiscard < 0)
       nDiscard = 0;
 
-    ASSERT(nDiscard >= 0 && nDiscard < nErr / 2);
+    ASSERT(nDiscard >= 0 && nDiscard <= nErr / 2);
     
     // set number of samples used 
     pConfidence->nSamples = nErr;
 
+    // EvalTree returned the errors in adblResult... only the two ranks are
+    // needed, so we select them in linear time instead of sorting: the
+    // first selection leaves larger errors above nLower
+    long long nLower = nDiscard;
+    long long nUpper = nErr - nDiscard - 1;
+    ASSERT(nLower >= 0 && nLower <= nUpper && nUpper < nErr);
+
     // set lower bound
-    int nLower = nDiscard;
-    ASSERT(nLower >= 0 && nLower < nErr);
+    std::nth_element(adblErr, adblErr + nLower, adblErr + nErr);
     pConfidence->dblLowerBound = adblErr[nLower];
     
     // set upper bound
-    int nUpper = nErr - nDiscard - 1;
-    ASSERT(nUpper >= 0 && nUpper < nErr);
+    if (nUpper > nLower)
+    {
+      std::nth_element(adblErr + nLower + 1, adblErr + nUpper, adblErr + nErr);
+    }
     pConfidence->dblUpperBound = adblErr[nUpper];
   }
   catch (CALNUserException* e)	  // user abort exception
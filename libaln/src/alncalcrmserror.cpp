@@ -85,7 +85,7 @@ double ALNAPI DoCalcRMSError(const ALN* pALN,
   DebugValidateALNDataInfo(pALN, pDataInfo, pCallbackInfo);
 #endif
 
-  long nStart, nEnd;
+  long long nStart, nEnd;
   CalcDataEndPoints(nStart, nEnd, pALN, pDataInfo);
   
   double dblRMSError = -1.0;
@@ -109,12 +109,12 @@ double ALNAPI DoCalcRMSError(const ALN* pALN,
     aCutoffInfo = new CCutoffInfo[nEnd - nStart + 1];
     if (!aCutoffInfo) ThrowALNMemoryException();
 		
-    for (int i = nStart; i <= nEnd; i++)
+    for (long long i = nStart; i <= nEnd; i++)
 			aCutoffInfo[i - nStart].pLFN = NULL;
 
     // calc rms error
     double dblSqErrorSum = 0;
-    for (int nPoint = nStart; nPoint <= nEnd; nPoint++)
+    for (long long nPoint = nStart; nPoint <= nEnd; nPoint++)
 	  {
       // get vector (cvt to zero based point index)
       FillInputVector(pALN, adblX, nPoint - nStart, nStart, apdblBase, 
@@ -60,7 +60,7 @@ ALNIMP int ALNAPI ALNConfidencePLimit(const ALNCONFIDENCE* pConfidence,
   #endif
 
   // calc number of samples in tail
-  int nTailSamples = (int)floor((float)pConfidence->nSamples * pConfidence->dblP - 1);
+  long long nTailSamples = (long long)floor((double)pConfidence->nSamples * pConfidence->dblP - 1);
   
   // calculate limit at desired significance level
 	*pdblPLimit = PLimit(pConfidence->nSamples, nTailSamples + 1, dblSignificance);
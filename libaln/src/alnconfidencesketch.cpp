@@ -0,0 +1,385 @@
+// ALN Library
+// Copyright (C) 2018 William W. Armstrong.
+// 
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// Version 3 of the License, or (at your option) any later version.
+// 
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+// 
+// For further information contact 
+// William W. Armstrong
+// 3624 - 108 Street NW
+// Edmonton, Alberta, Canada  T6J 1B4
+
+
+// alnconfidencesketch.cpp
+
+#ifdef ALNDLL
+#define ALNIMP __declspec(dllexport)
+#endif
+
+#include <aln.h>
+#include "alnpriv.h"
+#include <algorithm>
+
+#ifdef _DEBUG
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+// streaming confidence intervals
+// the errors are summarized in the quantile sketch of Greenwald and Khanna,
+// "Space-Efficient Online Computation of Quantile Summaries", SIGMOD 2001:
+// a sorted list of tuples (v, g, delta) where the rank of v among the n
+// errors added lies between rmin(v) = sum of g up to v and rmin(v) + delta;
+// keeping g + delta <= 2 epsilon n for each tuple guarantees that a value
+// within epsilon n of any rank can be returned; compressing by bands of
+// delta, as in the paper, keeps the list to O(1/epsilon log(epsilon n))
+// tuples
+
+// points evaluated at a time by ALNConfidenceSketchAdd
+#define SKETCHEVALPOINTS 65536
+
+// largest buffer of errors not yet merged into the tuples
+#define SKETCHMAXBUFFER 65536
+
+struct GKTUPLE
+{
+  double dblV;          // error value
+  long long nG;         // rmin(v) - rmin(previous v)
+  long long nDelta;     // rmax(v) - rmin(v)
+};
+
+struct CONFSKETCH
+{
+  double dblEpsilon;    // rank error as a fraction of nCount
+  long long nCount;     // number of errors in the tuples
+  GKTUPLE* aTuple;      // tuples sorted by value
+  long lTuples;         // number of tuples
+  long lTupleAlloc;     // allocated tuples
+  double* adblBuffer;   // errors not yet merged, in the order added
+  long lBuffer;         // number of buffered errors
+  long lBufferSize;     // buffer capacity, about 1 / (2 epsilon)
+};
+
+// band of a tuple with the given delta when 2 epsilon n is nThreshold:
+// band 0 is delta = nThreshold, band a > 0 holds the deltas with
+//   nThreshold - 2^a - (nThreshold mod 2^a) < delta
+//     <= nThreshold - 2^(a-1) - (nThreshold mod 2^(a-1))
+// so tuples inserted earlier, with smaller deltas, are in higher bands
+static int SketchBand(long long nDelta, long long nThreshold)
+{
+  if (nDelta >= nThreshold)
+    return 0;
+
+  int nBand = 1;
+  for (long long nPow = 2; nDelta <= nThreshold - nPow - nThreshold % nPow; nPow *= 2)
+  {
+    nBand++;
+  }
+  return nBand;
+}
+
+// merges the buffered errors into the tuples, then compresses them
+static BOOL FlushSketch(CONFSKETCH* pSketch)
+{
+  if (pSketch->lBuffer == 0)
+    return TRUE;
+
+  double* adblBuffer = pSketch->adblBuffer;
+  long lBuffer = pSketch->lBuffer;
+  std::sort(adblBuffer, adblBuffer + lBuffer);
+
+  long lTuples = pSketch->lTuples + lBuffer;
+  if (lTuples > pSketch->lTupleAlloc)
+  {
+    long lAlloc = std::max(lTuples, 2 * pSketch->lTupleAlloc);
+    GKTUPLE* aTuple = (GKTUPLE*)realloc(pSketch->aTuple, lAlloc * sizeof(GKTUPLE));
+    if (aTuple == NULL)
+      return FALSE;
+    pSketch->aTuple = aTuple;
+    pSketch->lTupleAlloc = lAlloc;
+  }
+
+  // merge from the top so the old tuples move up in place, as if the
+  // errors were inserted one at a time in decreasing order; an error above
+  // every tuple is a new maximum, one below every old tuple a new minimum,
+  // both with known rank
+  GKTUPLE* aTuple = pSketch->aTuple;
+  long j = pSketch->lTuples - 1;    // old tuple
+  long k = lBuffer - 1;             // buffered error
+  long o = lTuples - 1;             // merged tuple
+  long long nCount = pSketch->nCount;
+  while (k >= 0)
+  {
+    if (j >= 0 && aTuple[j].dblV > adblBuffer[k])
+    {
+      aTuple[o--] = aTuple[j--];
+    }
+    else
+    {
+      nCount++;
+      BOOL bEnd = (o == lTuples - 1 || j < 0);  // new maximum or minimum
+      GKTUPLE& tuple = aTuple[o--];
+      tuple.dblV = adblBuffer[k--];
+      tuple.nG = 1;
+      if (bEnd)
+      {
+        tuple.nDelta = 0;
+      }
+      else
+      {
+        tuple.nDelta = (long long)floor(2.0 * pSketch->dblEpsilon * (double)nCount) - 1;
+        if (tuple.nDelta < 0)
+          tuple.nDelta = 0;
+      }
+    }
+  }
+  ASSERT(o == j);
+
+  pSketch->nCount = nCount;
+  pSketch->lBuffer = 0;
+
+  // compress: from the top, a tuple and its descendants (the run of tuples
+  // just below it in lower bands) are merged into the successor if the
+  // tuple's band is not above the successor's and the successor's g + delta
+  // stays within 2 epsilon n; the minimum is kept.  Merging only into
+  // tuples of the same or an older band is what bounds the tuple count.
+  long long nThreshold = (long long)floor(2.0 * pSketch->dblEpsilon * (double)nCount);
+  long lOut = lTuples - 1;          // successor, the top is kept
+  long i = lTuples - 2;
+  while (i >= 1)
+  {
+    GKTUPLE& next = aTuple[lOut];
+    int nBand = SketchBand(aTuple[i].nDelta, nThreshold);
+    long long nGStar = aTuple[i].nG;
+    long j = i - 1;
+    while (j >= 1 && SketchBand(aTuple[j].nDelta, nThreshold) < nBand)
+    {
+      nGStar += aTuple[j--].nG;
+    }
+    if (nBand <= SketchBand(next.nDelta, nThreshold) &&
+        nGStar + next.nG + next.nDelta <= nThreshold)
+    {
+      next.nG += nGStar;
+      i = j;
+    }
+    else
+    {
+      aTuple[--lOut] = aTuple[i--];
+    }
+  }
+  if (lTuples > 1)
+  {
+    aTuple[--lOut] = aTuple[0];
+  }
+
+  // shift down
+  pSketch->lTuples = lTuples - lOut;
+  memmove(aTuple, aTuple + lOut, pSketch->lTuples * sizeof(GKTUPLE));
+
+  return TRUE;
+}
+
+// value whose rank is within epsilon n of nRank, counting from 0
+static double QuerySketch(const CONFSKETCH* pSketch, long long nRank)
+{
+  ASSERT(pSketch->lBuffer == 0 && pSketch->lTuples > 0);
+
+  double dblRank = (double)(nRank + 1);
+  double dblBound = pSketch->dblEpsilon * (double)pSketch->nCount;
+  double dblBestMiss = HUGE_VAL;
+  double dblBest = pSketch->aTuple[0].dblV;
+  long long nRMin = 0;
+  for (long i = 0; i < pSketch->lTuples; i++)
+  {
+    const GKTUPLE& tuple = pSketch->aTuple[i];
+    nRMin += tuple.nG;
+    double dblMiss = std::max(dblRank - (double)nRMin,
+                              (double)(nRMin + tuple.nDelta) - dblRank);
+    if (dblMiss <= dblBound)
+      return tuple.dblV;
+
+    // the guarantee says we return above, but keep the closest
+    if (dblMiss < dblBestMiss)
+    {
+      dblBestMiss = dblMiss;
+      dblBest = tuple.dblV;
+    }
+  }
+
+  return dblBest;
+}
+
+// create a sketch whose bounds have rank error at most dblEpsilon times
+// the number of errors added, 0 < dblEpsilon < 0.5
+// returns ALN_* error code, (ALN_NOERROR on success)
+ALNIMP int ALNAPI ALNConfidenceSketchCreate(double dblEpsilon, void** ppvSketch)
+{
+  if (ppvSketch == NULL || !(dblEpsilon > 0.0 && dblEpsilon < 0.5))
+    return ALN_GENERIC;
+
+  *ppvSketch = NULL;
+
+  CONFSKETCH* pSketch = (CONFSKETCH*)calloc(1, sizeof(CONFSKETCH));
+  if (pSketch == NULL)
+    return ALN_OUTOFMEM;
+
+  pSketch->dblEpsilon = dblEpsilon;
+  double dblBufferSize = ceil(1.0 / (2.0 * dblEpsilon));
+  pSketch->lBufferSize = (dblBufferSize < SKETCHMAXBUFFER) ?
+                         (long)dblBufferSize : SKETCHMAXBUFFER;
+  pSketch->adblBuffer = (double*)malloc(pSketch->lBufferSize * sizeof(double));
+  if (pSketch->adblBuffer == NULL)
+  {
+    free(pSketch);
+    return ALN_OUTOFMEM;
+  }
+
+  *ppvSketch = pSketch;
+  return ALN_NOERROR;
+}
+
+// add errors computed by the application, eg on live traffic
+// returns ALN_* error code, (ALN_NOERROR on success)
+ALNIMP int ALNAPI ALNConfidenceSketchAddErrors(void* pvSketch,
+                                               const double* adblErr,
+                                               long long nErr)
+{
+  if (pvSketch == NULL || (adblErr == NULL && nErr > 0) || nErr < 0)
+    return ALN_GENERIC;
+
+  CONFSKETCH* pSketch = (CONFSKETCH*)pvSketch;
+  for (long long i = 0; i < nErr; i++)
+  {
+    if (adblErr[i] != adblErr[i])
+      continue;           // NaN has no rank
+
+    if (pSketch->lBuffer == pSketch->lBufferSize && !FlushSketch(pSketch))
+      return ALN_OUTOFMEM;
+
+    pSketch->adblBuffer[pSketch->lBuffer++] = adblErr[i];
+  }
+
+  return ALN_NOERROR;
+}
+
+// evaluate the ALN on a data set and add its errors, SKETCHEVALPOINTS at
+// a time, so the data can be larger than memory when supplied through
+// the AN_VECTORINFO callback
+// returns ALN_* error code, (ALN_NOERROR on success)
+ALNIMP int ALNAPI ALNConfidenceSketchAdd(const ALN* pALN,
+                                         const ALNDATAINFO* pDataInfo,
+                                         const ALNCALLBACKINFO* pCallbackInfo,
+                                         void* pvSketch)
+{
+  if (pvSketch == NULL)
+    return ALN_GENERIC;
+
+	int nReturn = ValidateALNDataInfo(pALN, pDataInfo, pCallbackInfo);
+  if (nReturn != ALN_NOERROR)
+    return nReturn;
+
+  #ifdef _DEBUG
+    DebugValidateALNDataInfo(pALN, pDataInfo, pCallbackInfo);
+  #endif
+
+  long long nStart, nEnd;
+  CalcDataEndPoints(nStart, nEnd, pALN, pDataInfo);
+  if (nEnd < nStart)
+    return ALN_GENERIC;   // bad error count
+
+  double* adblErr = (double*)malloc((size_t)std::min(nEnd - nStart + 1,
+                                                     (long long)SKETCHEVALPOINTS) *
+                                    sizeof(double));
+  if (adblErr == NULL)
+    return ALN_OUTOFMEM;
+
+  for (long long nFirst = nStart; nFirst <= nEnd && nReturn == ALN_NOERROR;
+       nFirst += SKETCHEVALPOINTS)
+  {
+    long long nLast = std::min(nFirst + SKETCHEVALPOINTS - 1, nEnd);
+    nReturn = EvalTreeRange(pALN, pDataInfo, pCallbackInfo, nFirst, nLast,
+                            adblErr, TRUE);
+    if (nReturn == ALN_NOERROR)
+      nReturn = ALNConfidenceSketchAddErrors(pvSketch, adblErr, nLast - nFirst + 1);
+  }
+
+  free(adblErr);
+  return nReturn;
+}
+
+// set the confidence intervals from the errors added so far, as
+// ALNCalcConfidence does from all the errors; pConfidence->dblP must be
+// initialized, greater than 0 and less than 0.5
+// returns ALN_* error code, (ALN_NOERROR on success)
+ALNIMP int ALNAPI ALNConfidenceSketchCalc(void* pvSketch,
+                                          ALNCONFIDENCE* pConfidence)
+{
+  if (pvSketch == NULL || pConfidence == NULL)
+    return ALN_GENERIC;
+
+  if (pConfidence->dblP <= 0.0 || pConfidence->dblP >= 0.5)
+    return ALN_GENERIC;
+
+  CONFSKETCH* pSketch = (CONFSKETCH*)pvSketch;
+  if (!FlushSketch(pSketch))
+    return ALN_OUTOFMEM;
+
+  long long nErr = pSketch->nCount;
+  if (nErr <= 0)
+    return ALN_GENERIC;   // bad error count
+
+  // discard np-1 from each end exactly as ALNCalcConfidence
+  long long nDiscard = (long long)floor((float)nErr * pConfidence->dblP - 1);
+  if (nDiscard < 0)
+    nDiscard = 0;
+
+  pConfidence->nSamples = nErr;
+  pConfidence->dblLowerBound = QuerySketch(pSketch, nDiscard);
+  pConfidence->dblUpperBound = QuerySketch(pSketch, nErr - nDiscard - 1);
+
+  return ALN_NOERROR;
+}
+
+// number of errors added, and of tuples kept
+ALNIMP int ALNAPI ALNConfidenceSketchInfo(void* pvSketch,
+                                          long long* pnErrors,
+                                          long* plTuples)
+{
+  if (pvSketch == NULL)
+    return ALN_GENERIC;
+
+  CONFSKETCH* pSketch = (CONFSKETCH*)pvSketch;
+  if (!FlushSketch(pSketch))
+    return ALN_OUTOFMEM;
+
+  if (pnErrors != NULL)
+    *pnErrors = pSketch->nCount;
+  if (plTuples != NULL)
+    *plTuples = pSketch->lTuples;
+
+  return ALN_NOERROR;
+}
+
+ALNIMP int ALNAPI ALNConfidenceSketchFree(void* pvSketch)
+{
+  if (pvSketch != NULL)
+  {
+    CONFSKETCH* pSketch = (CONFSKETCH*)pvSketch;
+    free(pSketch->adblBuffer);
+    free(pSketch->aTuple);
+    free(pSketch);
+  }
+
+  return ALN_NOERROR;
+}
@@ -62,7 +62,7 @@ ALNIMP int ALNAPI ALNConfidenceTLimit(const ALNCONFIDENCE* pConfidence,
   #endif
 
   // calc number of samples in tail
-  int nTailSamples = (int)floor((float)pConfidence->nSamples * pConfidence->dblP - 1);
+  long long nTailSamples = (long long)floor((double)pConfidence->nSamples * pConfidence->dblP - 1);
   
   // calculate probablity of exceeding desired interval
   *pdblTLimit = (double)1.0 - ibeta((double)(pConfidence->nSamples - 2 * nTailSamples + 1), // need incomp beta fn
@@ -28,6 +28,7 @@
 
 #include <aln.h>
 #include "alnpriv.h"
+#include <limits.h>
 
 #ifdef _DEBUG
 #undef THIS_FILE
@@ -61,4 +62,98 @@ ALNIMP int ALNAPI ALNConvertDtree(const ALN* pALN, int nMaxDepth,
     nResult = ALN_OUTOFMEM;
   
   return nResult;
-}
\ No newline at end of file
+}
+// conversion to dtree guided by a sample of the inputs it will be evaluated on
+// samples are read from pDataInfo like training data
+// nMaxBlocks limits the blocks made, 0 for no limit besides nMaxDepth
+// pointer to constructed DTREE returned in ppDtree
+// returns ALN_* error code, (ALN_NOERROR on success)
+ALNIMP int ALNAPI ALNConvertDtreeEx(const ALN* pALN, int nMaxDepth,
+                                    DTREE** ppDtree,
+                                    const ALNDATAINFO* pDataInfo,
+                                    const ALNCALLBACKINFO* pCallbackInfo,
+                                    int nMaxBlocks)
+{
+  // parameter variance
+  if (pALN == NULL)
+    return ALN_GENERIC;
+
+  if (ppDtree == NULL)
+    return ALN_GENERIC;
+
+  if (nMaxDepth < DTREE_MINDEPTH || nMaxDepth > DTREE_MAXDEPTH)
+    return ALN_GENERIC;
+
+  if (nMaxBlocks < 0)
+    return ALN_GENERIC;
+
+  if (pDataInfo == NULL)
+    return ALNConvertDtree(pALN, nMaxDepth, ppDtree);
+
+  int nResult = ValidateALNDataInfo(pALN, pDataInfo, pCallbackInfo);
+  if (nResult != ALN_NOERROR)
+    return nResult;
+
+  *ppDtree = NULL;
+  double* adblSamples = NULL;
+  const double** apdblBase = NULL;
+
+  try
+  {
+    // gather the samples as input vectors
+    long long nStart, nEnd;
+    CalcDataEndPoints(nStart, nEnd, pALN, pDataInfo);
+    int nDim = pALN->nDim;
+    if (nEnd - nStart + 1 <= 0)
+      return ALNConvertDtree(pALN, nMaxDepth, ppDtree);
+
+    // BuildDtree takes an int sample count
+    if (nEnd - nStart + 1 > INT_MAX)
+      return ALN_GENERIC;
+    int nSamples = (int)(nEnd - nStart + 1);
+
+    adblSamples = new double[(size_t)nSamples * nDim];
+    if (!adblSamples) ThrowALNMemoryException();
+    memset(adblSamples, 0, sizeof(double) * nSamples * nDim);
+
+    apdblBase = AllocColumnBase(nStart, pALN, pDataInfo);
+
+    for (long long nPoint = nStart; nPoint <= nEnd; nPoint++)
+    {
+      FillInputVector(pALN, adblSamples + (nPoint - nStart) * nDim, 
+                      nPoint - nStart, nStart, apdblBase, 
+                      pDataInfo, pCallbackInfo);
+    }
+
+    // build dtree
+    *ppDtree = BuildDtree(pALN, nMaxDepth, adblSamples, nSamples, nMaxBlocks);
+    if (*ppDtree == NULL && dtree_errno != DTR_NOERROR)
+      nResult = ALN_GENERIC;  // dtree lib error
+    else if (*ppDtree == NULL)
+      nResult = ALN_OUTOFMEM;
+  }
+  catch(CALNUserException* e)
+  {
+    nResult = ALN_USERABORT;
+    e->Delete();
+  }
+  catch (CALNMemoryException* e)
+  {
+    nResult = ALN_OUTOFMEM;
+    e->Delete();
+  }
+  catch (CALNException* e)
+  {
+    nResult = ALN_GENERIC;
+    e->Delete();
+  }
+  catch(...)
+  {
+    nResult = ALN_GENERIC;
+  }
+
+  delete[] adblSamples;
+  FreeColumnBase(apdblBase);
+
+  return nResult;
+}
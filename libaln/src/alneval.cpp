@@ -39,7 +39,7 @@ static int ALNAPI ValidateALNEvalInfo(const ALN* pALN,
                                       const ALNDATAINFO* pDataInfo,
                                       const ALNCALLBACKINFO* pCallbackInfo,
                                       double* adblResult,
-                                      int* pnStart, int* pnEnd);
+                                      long long* pnStart, long long* pnEnd);
 
 // evaluation of ALN on data
 
@@ -47,7 +47,7 @@ ALNIMP int ALNAPI ALNEval(const ALN* pALN,
                           const ALNDATAINFO* pDataInfo,
                           const ALNCALLBACKINFO* pCallbackInfo,
                           double* adblResult,
-                          int* pnStart, int* pnEnd)
+                          long long* pnStart, long long* pnEnd)
 {
 	int nReturn = ValidateALNEvalInfo(pALN, pDataInfo, pCallbackInfo,
                                     adblResult, pnStart, pnEnd);
@@ -66,7 +66,7 @@ static int ALNAPI ValidateALNEvalInfo(const ALN* pALN,
                                       const ALNDATAINFO* pDataInfo,
                                       const ALNCALLBACKINFO* pCallbackInfo,
                                       double* adblResult,
-                                      int* pnStart, int* pnEnd)
+                                      long long* pnStart, long long* pnEnd)
 {
   int nReturn = ValidateALNDataInfo(pALN, pDataInfo, pCallbackInfo);
   if (nReturn != ALN_NOERROR)
@@ -200,6 +200,7 @@ static char THIS_FILE[] = __FILE__;
 #include <iostream>
 #include <fstream>
 #include <stdlib.h>
+#include <limits.h>
 #include <math.h>
 #include <string.h>
 #include <alnpp.h>
@@ -422,18 +423,14 @@ void ALNAPI ALNfitSetup() // routine
 	// ***************** SET UP THE FILES *************************
 	// create the necessary files: UNfile PreprocessedDataFile, TVfile, TSfile
   // the UN file just copies the input file,EXCLUDING the header(if present)
-  UNfile.Create(nRowsUniv,nColsUniv + 1); // we add an extra column for an evaluated output
-	for(int k = 0; k < nColsUniv; k++)
-	{
-		for(int nrow = 0; nrow < nRowsUniv; nrow++)
-		{
-			UNfile.SetAt(nrow,k,0,0);
-		}
-	}
-	// initialize the extra column to 0
-	for(int nrow = 0; nrow < nRowsUniv; nrow++)
+  // Create zeroes it, including the extra column
+  // PreprocessedDataFile is the only other copy of the data; the TVfile, TSfile
+  // and TRfile are views of its rows
+  if (!UNfile.Create(nRowsUniv,nColsUniv + 1)) // we add an extra column for an evaluated output
   {
-	  UNfile.SetAt(nrow,nColsUniv,0,0);
+		fprintf(fpProtocol, "Creating internal data file UNfile failed!\n");
+		fflush(fpProtocol);
+		exit(0);
   }
 	fprintf(fpProtocol,"Preprocessing splits data file into TVfile and TSfile (for testing). \n");
 	preprocessDataFile();
@@ -709,15 +706,13 @@ void ALNAPI preprocessDataFile()  // routine input: szDataFileName file outputs:
 	{
 		if (nLag[ninput] > nMaxLag) nMaxLag = nLag[ninput];
 	}
-	PreprocessedDataFile.Create(nRowsUniv, nALNinputs); // this file may contain some rows with missing values
-	// at the end in the reverse order encountered
-	// we first zero it out
-	for (int k = 0; k < nRowsUniv; k++)
+	// this file may contain some rows with missing values
+	// at the end in the reverse order encountered; Create zeroes it
+	if (!PreprocessedDataFile.Create(nRowsUniv, nALNinputs))
 	{
-		for (int ninput = 0; ninput < nALNinputs; ninput++)
-		{
-			PreprocessedDataFile.SetAt(k, ninput, 0, 0);
-		}
+		fprintf(fpProtocol, "Creating internal data file PreprocessedDataFile failed!\n");
+		fflush(fpProtocol);
+		exit(0);
 	}
 	double dblValue = 0;
 	int k = 0; // this is the row in the file PreprocessedDataFile. If there are undefined items
@@ -825,23 +820,15 @@ void ALNAPI createTVTSfiles()  // routine
   // Now we produce the TV file (only the the case of training)
  	// get the remaining rows of the PreprocessedDataFile and produce the TVfile
 	// which is written to disk
+	// The TVfile and TSfile are views of rows of the PreprocessedDataFile, which is
+	// rearranged so the rows of each are together; nothing else is copied.
 	if(bTrain) // TVfile is created only when training
 	{
 		if (nRowsTS == 0) // nothing goes into the TSfile
 		{
 			// in this case, we can take all of the preprocessed data file for the TV file
-			TVfile.Create(nRowsPP, nALNinputs);
 			nRowsTV = nRowsPP;
-			double dblVal;
-			for (i = 0; i < nRowsPP; i++)
-			{
-				for (int j = 0; j < nALNinputs; j++)
-				{
-
-					dblVal = PreprocessedDataFile.GetAt(i, j, 0);
-					TVfile.SetAt(i, j, dblVal, 0);
-				}
-			}
+			TVfile.CreateView(PreprocessedDataFile, 0, nRowsTV);
 		}
 		else // nRowsTS > 0
 		{
@@ -861,35 +848,43 @@ void ALNAPI createTVTSfiles()  // routine
 				anInTest[nRandomRow] = 0; // then set that to 0
 			}
 			// anInTest now has nRowsTS 0 values and the rest 1's
-			// TVfile is all of the PPfile except what went to the TSfile
+			// TVfile is all of the PPfile except what went to the TSfile.
+			// The TV rows are moved up in order, and the TS rows, held aside
+			// meanwhile, follow them in order.
 			nRowsTV = nRowsPP - nRowsTS;
-			TVfile.Create(nRowsTV, nALNinputs);
-			TSfile.Create(nRowsTS, nALNinputs);
-			double dblVal;
+			CDataFile TestRows;
+			if (!TestRows.Create(nRowsTS, nALNinputs))
+			{
+				fprintf(fpProtocol, "Creating internal data file TSfile failed!\n");
+				fflush(fpProtocol);
+				exit(0);
+			}
+			size_t nRowBytes = nALNinputs * sizeof(double);
 			long TVrows = 0;
 			long TSrows = 0;
 			for (i = 0; i < nRowsPP; i++)
 			{
+				const double* pdblRow = PreprocessedDataFile.GetRowAt(i);
 				if (anInTest[i] == 1)
 				{ // case anInTest[i] == 1 and the row goes into TVfile
-					for (int j = 0; j < nALNinputs; j++)
+					if (TVrows != i)
 					{
-						dblVal = PreprocessedDataFile.GetAt(i, j, 0);
-						TVfile.SetAt(TVrows, j, dblVal, 0);
+						memcpy(PreprocessedDataFile.GetRowAt(TVrows), pdblRow, nRowBytes);
 					}
 					TVrows++;
 				}
 				else
 				{ // case anInTest[i] == 0 and the row goes into TSfile
-					for (int j = 0; j < nALNinputs; j++)
-					{
-						dblVal = PreprocessedDataFile.GetAt(i, j, 0);
-						TSfile.SetAt(TSrows, j, dblVal, 0);
-					}
+					memcpy(TestRows.GetRowAt(TSrows), pdblRow, nRowBytes);
 					TSrows++;
 				}
-			} // end of writing TVfile and TSfile
+			} // end of arranging TVfile and TSfile rows
 			ASSERT((TVrows == nRowsTV) && (TSrows == nRowsTS));
+			memcpy(PreprocessedDataFile.GetRowAt(nRowsTV), TestRows.GetDataPtr(), nRowsTS * nRowBytes);
+			TestRows.Destroy();
+			free(anInTest);
+			TVfile.CreateView(PreprocessedDataFile, 0, nRowsTV);
+			TSfile.CreateView(PreprocessedDataFile, nRowsTV, nRowsTS);
 		}
 		if (bPrint && bDiagnostics)
 		{
@@ -905,16 +900,7 @@ void ALNAPI createTVTSfiles()  // routine
 	{
 		// This is an evaluation.
 		nRowsTS = nRowsPP;
-		TSfile.Create(nRowsTS, nALNinputs);
-		double dblVal;
-		for (int i = 0; i < nRowsPP; i++)
-		{
-			for (int j = 0; j < nALNinputs; j++)
-			{
-				dblVal = PreprocessedDataFile.GetAt(i, j, 0);
-				TSfile.SetAt(i, j, dblVal, 0);
-			}
-		}
+		TSfile.CreateView(PreprocessedDataFile, 0, nRowsTS);
 	} // end of writingTSfile
 	if (bPrint && bDiagnostics)
 	{
@@ -943,49 +929,52 @@ void ALNAPI analyzeTV() // routine
 	adblEpsilon = (double *) malloc((nDim) * sizeof(double));
   // we compute the variance of each column of TV,
 	// and the maximum, minimum and standard deviation of each variable
+	// in one pass over the rows, keeping a running mean and sum of squared
+	// deviations from it (Welford) for each variable
+	double* adblMean = (double*) malloc(nDim * sizeof(double));
+	double* adblM2 = (double*) malloc(nDim * sizeof(double));
+	if (adblMean == NULL || adblM2 == NULL)
+	{
+		fprintf(fpProtocol, "Allocating the TVfile statistics failed!\n");
+		fflush(fpProtocol);
+		exit(0);
+	}
+	const double* adblRow = TVfile.GetRowAt(0);
 	for(int k = 0; k < nDim; k++)
 	{
 		// initialize the min and max variables
-		adblMinVar[k] = adblMaxVar[k] = TVfile.GetAt(0,k,0);
+		adblMinVar[k] = adblMaxVar[k] = adblRow[k];
+		adblMean[k] = adblM2[k] = 0;
 	}
   bRegress = FALSE; // if it can't be a classification problem, it must be regression
+	for(long j = 0; j < nRowsTV; j++)
+	{
+		adblRow = TVfile.GetRowAt(j);
+		double dblN = (double) (j + 1);
+		for(int k = 0; k < nDim; k++)
+		{
+			double value = adblRow[k];
+			if(value > adblMaxVar[k]) adblMaxVar[k] = value;
+			if(value < adblMinVar[k]) adblMinVar[k] = value;
+			double dblDelta = value - adblMean[k];
+			adblMean[k] += dblDelta / dblN;
+			adblM2[k] += dblDelta * (value - adblMean[k]);
+		}
+    // we want to see whether the output variable forces a regression since it is not an integer
+		if(fabs(floor(adblRow[nDim - 1] + 0.5) - adblRow[nDim - 1]) > 1e-10)
+		{
+			bRegress = TRUE;
+		}
+	}
+	// or an integer but out of range
+	if(adblMaxVar[nDim - 1] > 3.5 || adblMinVar[nDim - 1] < -3.) // we can only classify into classes numbered -3, -2, ...2, 3
+	{
+		bRegress = TRUE;
+	}
   for(int k = 0; k < nDim; k++) // do each variable k
   {
-    //compute the max and min and average of variable k in TVfile
-    double desired = 0,se  = 0, value = 0;
-
-    for(int j = 0; j < nRowsTV; j++) 
-    {
-			value =  TVfile.GetAt(j,k,0);
-      desired += value;
-			if(value > adblMaxVar[k])
-			{
-				adblMaxVar[k] = value;
-			}
-			if(value < adblMinVar[k])
-			{
-				adblMinVar[k] = value;
-			}
-      // we want to see whether the output variable forces a regression since it is not an integer or an integer but out of range
-      if((k == nDim - 1) && (fabs(floor(value + 0.5) - value)  > 1e-10))
-      {
-        bRegress = TRUE;
-      }
-      if((k == nDim - 1) && (value >3.5 || value < -3.)) // we can only classify into classes numbered -3, -2, ...2, 3
-      {
-        bRegress = TRUE;
-      }
-    }
-    desired /= nRowsTV; // now desired holds the average for variable k
     // compute the standard deviation of variable k in TVset
-    se = 0;
-    double temp;
-    for(int j=0; j < nRowsTV; j++) 
-    {
-      temp = TVfile.GetAt(j,k,0);
-      se += ( temp - desired) * (temp - desired);
-    }
-    se /= ((double) nRowsTV - 1.0); // sample variance of variable k
+    double se = adblM2[k] / ((double) nRowsTV - 1.0); // sample variance of variable k
 		adblStdevVar[k] = sqrt(se);
 		if(k < nDim - 1)
 		{
@@ -1008,6 +997,8 @@ void ALNAPI analyzeTV() // routine
 			fprintf(fpProtocol, "The Epsilons above are sides of boxes per point in units of the particular input\n");
 		}
   }
+	free(adblMean);
+	free(adblM2);
   fflush(fpProtocol);
 }
 
@@ -1041,7 +1032,7 @@ void getTSfile()
 		fprintf(fpProtocol,"Reading TSfile succeeded!\n");
   }
   ASSERT(!bTrain ||(TSfile.ColumnCount() == nDim) && ((TSfile.ColumnCount() == nDim)||(TSfile.ColumnCount() == nDim-1)));
-	fprintf(fpProtocol,"TSfile has %d rows.\n",TSfile.RowCount());
+	fprintf(fpProtocol,"TSfile has %lld rows.\n",TSfile.RowCount());
   ASSERT(TSfile.RowCount() == nRowsTS);
 	fflush(fpProtocol);
 }
@@ -1084,7 +1075,7 @@ void ALNAPI evaluate() // routine
 	// now look at the data file
 
 	int ncols = nALNinputs; // during evaluation this may be different from nDim
-	int nrows = nRowsTS;
+	long nrows = nRowsTS;
 	/* compare the output variable index and nDim -- use ncols from analyzeinputfile*/
 	if ((nALNinputs != pDtree->nOutputIndex + 1) && (nALNinputs != pDtree->nOutputIndex))
 	{
@@ -1138,7 +1129,7 @@ void ALNAPI evaluate() // routine
 	// copy the test file into the output data file
 	ASSERT((ncols == nDim) || (ncols == nDim - 1));
 	double value;
-	for (int j = 0; j < nrows; j++)
+	for (long j = 0; j < nrows; j++)
 	{
 		for (k = 0; k < ncols; k++)
 		{
@@ -1148,21 +1139,33 @@ void ALNAPI evaluate() // routine
 	}
 	int nCountMisclassifications = 0;
 	double dblSE = 0, dblMAE = 0, dblMAXE = 0; // three error accumulators  N.B. this local dblSE has nothing to do with the SmoothingEpsilon abbreviation used elsewhere. 
-	double * adblX = (double *)malloc((nDim) * sizeof(double));
-	for (int j = 0; j < nRowsTS; j++)
+	// evaluate all the rows of TSfile in place, its output column (if present) is not read
+	double * adblTSOutput = NULL;
+	if (nRowsTS > 0)
 	{
-		/* get DTREE evaluation (dblOutput) */
-		for (k = 0; k < nDim - 1; k++)
+		adblTSOutput = (double *)malloc(nRowsTS * sizeof(double));
+		if (adblTSOutput == NULL)
 		{
-			/* get inputs*/
-			adblX[k] = TSfile.GetAt(j, k, 0);
+			fprintf(fpProtocol, "Allocating the test set outputs failed!\n");
+			fflush(fpProtocol);
+			exit(0);
 		}
-		adblX[nDim - 1] = 0; // File value not used 
-		if ((nErrCode = EvalDtree(pDtree, adblX, &dblOutput, NULL)) != DTR_NOERROR)
+		// EvalDtreeBatch takes an int row count, so a long test set goes in pieces
+		for (long nDone = 0; nDone < nRowsTS; )
 		{
-			GetDtreeError(nErrCode, szErrMsg, sizeof(szErrMsg));
-			fprintf(fpProtocol, "\nError (%d): %s\n", dtree_lineno, szErrMsg);
+			int nBatch = (nRowsTS - nDone > INT_MAX) ? INT_MAX : (int)(nRowsTS - nDone);
+			if ((nErrCode = EvalDtreeBatch(pDtree, TSfile.GetRowAt(nDone), nBatch, (int)TSfile.ColumnCount(), adblTSOutput + nDone, NULL)) != DTR_NOERROR)
+			{
+				GetDtreeError(nErrCode, szErrMsg, sizeof(szErrMsg));
+				fprintf(fpProtocol, "\nError (%d): %s\n", dtree_lineno, szErrMsg);
+			}
+			nDone += nBatch;
 		}
+	}
+	for (long j = 0; j < nRowsTS; j++)
+	{
+		/* get DTREE evaluation (dblOutput) */
+		dblOutput = adblTSOutput[j];
 		// put the result into the output data file(round to integer if classification)
 		if (bClassify)
 		{
@@ -1265,7 +1268,7 @@ void ALNAPI evaluate() // routine
 	double dblValue;
 	char szValue[32];
 	int charcount;
-	for (int linenum = 0; linenum < nRowsTS; linenum++)
+	for (long linenum = 0; linenum < nRowsTS; linenum++)
 	{
 		for (k = 0; k < nDim + 1; k++)
 		{
@@ -1309,8 +1312,21 @@ void ALNAPI evaluate() // routine
 	{
 		if (nLag[ninput] > nMaxLag) nMaxLag = nLag[ninput];
 	}
+	// gather the rows that need a DTREE value, then evaluate them together
+	int nGoodRows = 0;
+	int * anGoodRow = (int *)malloc(nRowsUniv * sizeof(int));
+	double * adblGoodX = (double *)malloc((size_t)nRowsUniv * nALNinputs * sizeof(double));
+	double * adblGoodOutput = (double *)malloc(nRowsUniv * sizeof(double));
+	if (nRowsUniv > 0 && (anGoodRow == NULL || adblGoodX == NULL || adblGoodOutput == NULL))
+	{
+		fprintf(fpProtocol, "Allocating the rows for replacing missing values failed!\n");
+		fflush(fpProtocol);
+		exit(0);
+	}
 	for (int i = nMaxLag; i < nRowsUniv; i++)
 	{
+		// the row is built in place and kept if it turns out good
+		double * adblX = adblGoodX + (size_t)nGoodRows * nALNinputs;
 		BOOL bRowGood = TRUE; // this means the DTREE can be used to compute an output value and the value in the file is undefined
 		// see if the output value in the file is already defined
 		ASSERT(nLag[nALNinputs - 1] == 0); // a non-zero lag on the output variable is not allowed
@@ -1335,25 +1351,40 @@ void ALNAPI evaluate() // routine
 		{
 			// in this case we have the information necessary to compute a substitute for
 			// the missing output value
-			if ((nErrCode = EvalDtree(pDtree, adblX, &dblOutput, NULL)) != DTR_NOERROR)
+			anGoodRow[nGoodRows++] = i;
+		}
+	}
+	if (nGoodRows > 0 && EvalDtreeBatch(pDtree, adblGoodX, nGoodRows, nALNinputs, adblGoodOutput, NULL) != DTR_NOERROR)
+	{
+		// some row failed; evaluate them one at a time so only the failing rows are reported and skipped
+		for (int n = 0; n < nGoodRows; n++)
+		{
+			if ((nErrCode = EvalDtree(pDtree, adblGoodX + (size_t)n * nALNinputs, adblGoodOutput + n, NULL)) != DTR_NOERROR)
 			{
 				GetDtreeError(nErrCode, szErrMsg, sizeof(szErrMsg));
 				fprintf(fpProtocol, "\nError (%d): %s\n", dtree_lineno, szErrMsg);
+				anGoodRow[n] = -1;
 			}
-			else
-			{
-				// put the generated value in the right place
-				if (bReplaceUndefined)
-				{
-					UNfile.SetAt(i - nLag[nALNinputs - 1], nInputCol[nALNinputs - 1], dblOutput, 0);
-				}
-				else
-				{
-					UNfile.SetAt(i - nLag[nALNinputs - 1], nColsUniv, dblOutput, 0);
-				}
-			}
 		}
 	}
+	for (int n = 0; n < nGoodRows; n++)
+	{
+		int i = anGoodRow[n];
+		if (i < 0) continue;
+		dblOutput = adblGoodOutput[n];
+		// put the generated value in the right place
+		if (bReplaceUndefined)
+		{
+			UNfile.SetAt(i - nLag[nALNinputs - 1], nInputCol[nALNinputs - 1], dblOutput, 0);
+		}
+		else
+		{
+			UNfile.SetAt(i - nLag[nALNinputs - 1], nColsUniv, dblOutput, 0);
+		}
+	}
+	free(anGoodRow);
+	free(adblGoodX);
+	free(adblGoodOutput);
 	//UNfile.Write(szR_or_E_FileName); // changed to include header
 	if ((fpReplacement = fopen(szR_or_E_FileName, "w")) != NULL)
 	{
@@ -1442,7 +1473,7 @@ void ALNAPI evaluate() // routine
 	fclose(fpReplacement);
 	// cleanup
 	DestroyDtree(pDtree);
-	free(adblX);
+	free(adblTSOutput);
 	UNfile.Destroy();
 	OutputData.Destroy();
 } // end evaluate
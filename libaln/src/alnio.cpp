@@ -29,19 +29,52 @@
 #include <aln.h>
 #include "alnpriv.h"
 
+#ifdef _WIN32
+#define WIN32_EXTRA_LEAN
+#define WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #ifdef _DEBUG
 #undef THIS_FILE
 static char THIS_FILE[] = __FILE__;
 #endif
 
 
-static int ALNAPI DoALNWrite(FILE* pFile, const ALN* pALN);
-static int ALNAPI DoALNRead(FILE* pFile, ALN** ppALN);
+static int ALNAPI DoALNWrite(FILE* pFile, const ALN* pALN, BOOL bState);
+static int ALNAPI DoALNRead(FILE* pFile, ALN** ppALN, BOOL bState);
+static int ALNAPI DoALNWriteFlat(FILE* pFile, const ALN* pALN);
+static int ALNAPI DoALNReadFlat(const char* pszFileName, ALN** ppALN);
+static BOOL ALNAPI IsFlatFile(FILE* pFile);
+
 
+static int ALNAPI WriteALNFile(const ALN* pALN, const char* pszFileName, BOOL bFlat);
 
-// saving ALN to disk file
+// saving ALN to disk file in the tree (v1) format, which all versions read
 // returns ALN_* error code, (ALN_NOERROR on success)
 ALNIMP int ALNAPI ALNWrite(const ALN* pALN, const char* pszFileName)
+{
+  return WriteALNFile(pALN, pszFileName, FALSE);
+}
+
+// saving ALN to disk file in the flat (v2) format, which only this and
+// later versions read
+// returns ALN_* error code, (ALN_NOERROR on success)
+ALNIMP int ALNAPI ALNWriteFlat(const ALN* pALN, const char* pszFileName)
+{
+  return WriteALNFile(pALN, pszFileName, TRUE);
+}
+
+static int ALNAPI WriteALNFile(const ALN* pALN, const char* pszFileName, BOOL bFlat)
 {
    // parameter variance
   if (pALN == NULL)
@@ -55,13 +88,13 @@ ALNIMP int ALNAPI ALNWrite(const ALN* pALN, const char* pszFileName)
   if(fopen_s(&pFile, pszFileName, "wb") != 0)
     return ALN_ERRFILE;
 
-  int nRet = DoALNWrite(pFile, pALN);
+  int nRet = bFlat ? DoALNWriteFlat(pFile, pALN) : DoALNWrite(pFile, pALN, FALSE);
 
   fclose(pFile);  // will not reset errno
 
   if (nRet != ALN_NOERROR)
   {
-    ASSERT(nRet == ALN_ERRFILE);
+    ASSERT(nRet == ALN_ERRFILE || nRet == ALN_OUTOFMEM);
     int nErr = errno;     // save it
     remove(pszFileName);
     errno = nErr;
@@ -87,7 +120,14 @@ ALNIMP int ALNAPI ALNRead(const char* pszFileName, ALN** ppALN)
   if(fopen_s(&pFile, pszFileName, "rb") != 0 )
     return ALN_ERRFILE;
 
-  int nRet = DoALNRead(pFile, ppALN);
+  // flat files are written by ALNWriteFlat, tree files by ALNWrite
+  if (IsFlatFile(pFile))
+  {
+    fclose(pFile);
+    return DoALNReadFlat(pszFileName, ppALN);
+  }
+
+  int nRet = DoALNRead(pFile, ppALN, FALSE);
 
   fclose(pFile);  // will not reset errno
 
@@ -98,10 +138,11 @@ ALNIMP int ALNAPI ALNRead(const char* pszFileName, ALN** ppALN)
 // NOTE: byte order is a problem and is machine dependent
 
 // helpers
-static int ALNAPI ReadRegion(FILE* pFile, ALN* pALN, ALNREGION* pRegion);
-static int ALNAPI WriteRegion(FILE* pFile, const ALNREGION* pRegion);
-static int ALNAPI ReadTree(FILE* pFile, ALN* pALN, ALNNODE* pNode);
-static int ALNAPI WriteTree(FILE* pFile, const ALN* pALN, const ALNNODE* pNode);
+// bState is TRUE for checkpoints, which also carry the training state
+static int ALNAPI ReadRegion(FILE* pFile, ALN* pALN, ALNREGION* pRegion, BOOL bState);
+static int ALNAPI WriteRegion(FILE* pFile, const ALNREGION* pRegion, BOOL bState);
+static int ALNAPI ReadTree(FILE* pFile, ALN* pALN, ALNNODE* pNode, BOOL bState);
+static int ALNAPI WriteTree(FILE* pFile, const ALN* pALN, const ALNNODE* pNode, BOOL bState);
 
 // following macros won't work if you pass a pointer to be written... 
 // ie, treat param n as a reference to var being written
@@ -111,7 +152,7 @@ static int ALNAPI WriteTree(FILE* pFile, const ALN* pALN, const ALNNODE* pNode);
 #define ALNHDR "ALN35"
 #define ALNHDRSIZE 5
 
-static int ALNAPI DoALNWrite(FILE* pFile, const ALN* pALN)
+static int ALNAPI DoALNWrite(FILE* pFile, const ALN* pALN, BOOL bState)
 {
   ASSERT(pFile);
   ASSERT(pALN);
@@ -128,16 +169,16 @@ static int ALNAPI DoALNWrite(FILE* pFile, const ALN* pALN)
   // write region array
   for (int i = 0; i < pALN->nRegions; i++)
   {
-    int nRet = WriteRegion(pFile, &(pALN->aRegions[i]));
+    int nRet = WriteRegion(pFile, &(pALN->aRegions[i]), bState);
     if (nRet != ALN_NOERROR)
       return nRet;
   }
 
   // write tree
-  return WriteTree(pFile, pALN, pALN->pTree);
+  return WriteTree(pFile, pALN, pALN->pTree, bState);
 }
 
-static int ALNAPI DoALNRead(FILE* pFile, ALN** ppALN)
+static int ALNAPI DoALNRead(FILE* pFile, ALN** ppALN, BOOL bState)
 {
   ASSERT(pFile);
   ASSERT(ppALN);
@@ -196,7 +237,7 @@ static int ALNAPI DoALNRead(FILE* pFile, ALN** ppALN)
   // read region array
   for (int i = 0; i < pALN->nRegions; i++)
   {
-    int nRet = ReadRegion(pFile, pALN, &(pALN->aRegions[i]));
+    int nRet = ReadRegion(pFile, pALN, &(pALN->aRegions[i]), bState);
     if (nRet != ALN_NOERROR)
     {
       ALNDestroyALN(pALN);
@@ -212,7 +253,7 @@ static int ALNAPI DoALNRead(FILE* pFile, ALN** ppALN)
     return ALN_OUTOFMEM;
   }
 
-  int nRet = ReadTree(pFile, pALN, pALN->pTree);
+  int nRet = ReadTree(pFile, pALN, pALN->pTree, bState);
   if (nRet != ALN_NOERROR)
   {
     ALNDestroyALN(pALN);
@@ -228,7 +269,7 @@ static int ALNAPI DoALNRead(FILE* pFile, ALN** ppALN)
   return ALN_NOERROR;
 }
 
-static int ALNAPI WriteRegion(FILE* pFile, const ALNREGION* pRegion)
+static int ALNAPI WriteRegion(FILE* pFile, const ALNREGION* pRegion, BOOL bState)
 {
   ASSERT(pFile);
   ASSERT(pRegion);
@@ -248,10 +289,18 @@ static int ALNAPI WriteRegion(FILE* pFile, const ALNREGION* pRegion)
     if (_WRITE(pFile, pRegion->aConstr[i]) != 1) return ALN_ERRFILE;
   }
 
+  // smoothing
+  if (bState)
+  {
+    if (_WRITE(pFile, pRegion->dblSmoothEpsilon) != 1) return ALN_ERRFILE;
+    if (_WRITE(pFile, pRegion->dbl4SE) != 1) return ALN_ERRFILE;
+    if (_WRITE(pFile, pRegion->dblOV16SE) != 1) return ALN_ERRFILE;
+  }
+
   return ALN_NOERROR;
 }
 
-static int ALNAPI ReadRegion(FILE* pFile, ALN* pALN, ALNREGION* pRegion)
+static int ALNAPI ReadRegion(FILE* pFile, ALN* pALN, ALNREGION* pRegion, BOOL bState)
 {
   ASSERT(pFile);
   ASSERT(pALN);
@@ -306,11 +355,19 @@ static int ALNAPI ReadRegion(FILE* pFile, ALN* pALN, ALNREGION* pRegion)
     }
   }
 
+  // smoothing
+  if (bState)
+  {
+    if (_READ(pFile, pRegion->dblSmoothEpsilon) != 1) return ALN_ERRFILE;
+    if (_READ(pFile, pRegion->dbl4SE) != 1) return ALN_ERRFILE;
+    if (_READ(pFile, pRegion->dblOV16SE) != 1) return ALN_ERRFILE;
+  }
+
   return ALN_NOERROR;
 }
 
 
-static int ALNAPI WriteTree(FILE* pFile, const ALN* pALN, const ALNNODE* pNode)
+static int ALNAPI WriteTree(FILE* pFile, const ALN* pALN, const ALNNODE* pNode, BOOL bState)
 {
   ASSERT(pFile);
   ASSERT(pNode);
@@ -322,6 +379,13 @@ static int ALNAPI WriteTree(FILE* pFile, const ALN* pALN, const ALNNODE* pNode)
   int fNode = pNode->fNode & ~NF_EVAL;  
   if (_WRITE(pFile, fNode) != 1) return ALN_ERRFILE;
 
+  // responsibility counts
+  if (bState)
+  {
+    if (_WRITE(pFile, pNode->nRespCount) != 1) return ALN_ERRFILE;
+    if (_WRITE(pFile, pNode->nRespCountLastEpoch) != 1) return ALN_ERRFILE;
+  }
+
   if (pNode->fNode & NF_LFN)
   {
     // vector dim
@@ -343,7 +407,14 @@ static int ALNAPI WriteTree(FILE* pFile, const ALN* pALN, const ALNNODE* pNode)
     }
 
     // split
-    if (pNode->fNode & LF_SPLIT)
+    if (bState)
+    {
+      // pieces that stopped splitting keep their split structure
+      char c = (LFN_SPLIT(pNode) != NULL) ? 1 : 0;
+      if (_WRITE(pFile, c) != 1) return ALN_ERRFILE;
+      if (c != 0 && _WRITE(pFile, *LFN_SPLIT(pNode)) != 1) return ALN_ERRFILE;
+    }
+    else if (pNode->fNode & LF_SPLIT)
     {
       ASSERT(LFN_CANSPLIT(pNode));
       if (_WRITE(pFile, LFN_SPLIT_COUNT(pNode)) != 1) return ALN_ERRFILE;
@@ -373,7 +444,7 @@ static int ALNAPI WriteTree(FILE* pFile, const ALN* pALN, const ALNNODE* pNode)
 
     for(int i = 0; i < MINMAX_NUMCHILDREN(pNode); i++)
     {
-      int nRet = WriteTree(pFile, pALN, MINMAX_CHILDREN(pNode)[i]);
+      int nRet = WriteTree(pFile, pALN, MINMAX_CHILDREN(pNode)[i], bState);
       if (nRet != ALN_NOERROR) return nRet;
     }
   }
@@ -381,7 +452,7 @@ static int ALNAPI WriteTree(FILE* pFile, const ALN* pALN, const ALNNODE* pNode)
   return ALN_NOERROR;
 }
 
-static int ALNAPI ReadTree(FILE* pFile, ALN* pALN, ALNNODE* pNode)
+static int ALNAPI ReadTree(FILE* pFile, ALN* pALN, ALNNODE* pNode, BOOL bState)
 {
   ASSERT(pFile);
   ASSERT(pALN);
@@ -396,6 +467,13 @@ static int ALNAPI ReadTree(FILE* pFile, ALN* pALN, ALNNODE* pNode)
       (pNode->fNode & (NF_MINMAX | NF_LFN)) == 0)
     return ALN_BADFILEFORMAT;
 
+  // responsibility counts
+  if (bState)
+  {
+    if (_READ(pFile, pNode->nRespCount) != 1) return ALN_ERRFILE;
+    if (_READ(pFile, pNode->nRespCountLastEpoch) != 1) return ALN_ERRFILE;
+  }
+
   if (pNode->fNode & NF_LFN)
   {
     // vector dim
@@ -418,7 +496,21 @@ static int ALNAPI ReadTree(FILE* pFile, ALN* pALN, ALNNODE* pNode)
     }
 
     // split
-    if (pNode->fNode & LF_SPLIT)
+    if (bState)
+    {
+      if (_READ(pFile, c) != 1) return ALN_ERRFILE;
+      if (c != 0)
+      {
+        LFN_SPLIT(pNode) = (ALNLFNSPLIT*)malloc(sizeof(ALNLFNSPLIT));
+        if (LFN_SPLIT(pNode) == NULL)
+          return ALN_OUTOFMEM;
+
+        if (_READ(pFile, *LFN_SPLIT(pNode)) != 1) return ALN_ERRFILE;
+      }
+      else if (pNode->fNode & LF_SPLIT)
+        return ALN_BADFILEFORMAT;
+    }
+    else if (pNode->fNode & LF_SPLIT)
     {
       LFN_SPLIT(pNode) = (ALNLFNSPLIT*)malloc(sizeof(ALNLFNSPLIT));
       if (LFN_SPLIT(pNode) == NULL)
@@ -481,7 +573,7 @@ static int ALNAPI ReadTree(FILE* pFile, ALN* pALN, ALNNODE* pNode)
       // set parent
       NODE_PARENT(MINMAX_CHILDREN(pNode)[i]) = pNode;
 
-      int nRet = ReadTree(pFile, pALN, MINMAX_CHILDREN(pNode)[i]);
+      int nRet = ReadTree(pFile, pALN, MINMAX_CHILDREN(pNode)[i], bState);
       if (nRet != ALN_NOERROR) return nRet;
     }
   }
@@ -489,3 +581,967 @@ static int ALNAPI ReadTree(FILE* pFile, ALN* pALN, ALNNODE* pNode)
   return ALN_NOERROR;
 }
 
+/////////////////////////////////////////////////////////////////////////////
+// flat file format (v2)
+//   The tree format above writes each node with many small writes, and
+//   reading it takes a read and an allocation for every field and vector.
+//   The flat format is a header followed by tables, each at an 8 byte
+//   aligned offset from the start of the file:
+//     regions      ALNFLATREGION[nRegions]
+//     constraints  ALNCONSTRAINT[nConstr], of all regions in order
+//     nodes        ALNFLATNODE[nNodes] in preorder, root first, children
+//                  and parent given by index
+//     LFNs         ALNFLATLFN[nLFNs], with split structure
+//     W            nLFNs x (nDim + 1) doubles, bias weight first
+//     C, D         nLFNs x nDim doubles each
+//     var maps     nVarMaps x MAPBYTECOUNT(nDim) bytes
+//   Since nothing in the file is a pointer, the file can be mapped and the
+//   tables used in place: ALNMapFlat does that for evaluation only, see
+//   below.  ALNRead maps the file and builds a trainable ALN straight from
+//   the tables, with no parsing and no small reads; its nodes and vectors
+//   are still allocated one by one, since training, splitting and
+//   ALNDestroyALN rely on that.  ALNWrite keeps writing the tree format,
+//   which older versions can read; the flat format is written by
+//   ALNWriteFlat.
+
+#define ALNFLATMAGIC "ALNFLAT2"
+#define ALNFLATMAGICSIZE 8
+#define ALNFLATALIGN(n) (((n) + 7) & ~(long long)7)
+
+struct ALNFLATHEADER
+{
+  char achMagic[ALNFLATMAGICSIZE];
+  int nHeaderSize;          // sizeof(ALNFLATHEADER)
+  int nVersion;             // ALN version
+  int nDim;
+  int nOutput;
+  int nRegions;
+  int nConstr;              // total constraints of all regions
+  int nNodes;
+  int nLFNs;
+  int nVarMaps;
+  int nReserved;
+  long long nRegionOffset;  // offsets of the tables from start of file
+  long long nConstrOffset;
+  long long nNodeOffset;
+  long long nLFNOffset;
+  long long nWOffset;
+  long long nCOffset;
+  long long nDOffset;
+  long long nVarMapOffset;
+  long long nFileSize;
+};
+
+struct ALNFLATREGION
+{
+  int nParentRegion;
+  int nConstr;
+  int nFirstConstr;         // index of first constraint in constraint table
+  int nReserved;
+  double dblLearnFactor;
+};
+
+struct ALNFLATNODE
+{
+  int nParentRegion;
+  int fNode;                // without NF_EVAL
+  int nParent;              // -1 for root
+  int nLeft;                // children of minmax nodes, -1 for LFNs
+  int nRight;
+  int nLFN;                 // index in LFN table, -1 for minmax nodes
+};
+
+struct ALNFLATLFN
+{
+  int nNode;                // index in node table
+  int nVDim;
+  int nVarMap;              // index in var map table, -1 if none
+  int bSplit;               // split is valid
+  ALNLFNSPLIT split;
+};
+
+// table layout of an ALN in a flat file
+static void ALNAPI CalcFlatLayout(ALNFLATHEADER& hdr)
+{
+  long long nOffset = ALNFLATALIGN((long long)sizeof(ALNFLATHEADER));
+  hdr.nRegionOffset = nOffset;
+  nOffset = ALNFLATALIGN(nOffset + (long long)hdr.nRegions * sizeof(ALNFLATREGION));
+  hdr.nConstrOffset = nOffset;
+  nOffset = ALNFLATALIGN(nOffset + (long long)hdr.nConstr * sizeof(ALNCONSTRAINT));
+  hdr.nNodeOffset = nOffset;
+  nOffset = ALNFLATALIGN(nOffset + (long long)hdr.nNodes * sizeof(ALNFLATNODE));
+  hdr.nLFNOffset = nOffset;
+  nOffset = ALNFLATALIGN(nOffset + (long long)hdr.nLFNs * sizeof(ALNFLATLFN));
+  hdr.nWOffset = nOffset;
+  nOffset += (long long)hdr.nLFNs * (hdr.nDim + 1) * sizeof(double);
+  hdr.nCOffset = nOffset;
+  nOffset += (long long)hdr.nLFNs * hdr.nDim * sizeof(double);
+  hdr.nDOffset = nOffset;
+  nOffset += (long long)hdr.nLFNs * hdr.nDim * sizeof(double);
+  hdr.nVarMapOffset = nOffset;
+  nOffset = ALNFLATALIGN(nOffset + (long long)hdr.nVarMaps * MAPBYTECOUNT(hdr.nDim));
+  hdr.nFileSize = nOffset;
+}
+
+// counts nodes, LFNs and LFN var maps of a subtree
+static void ALNAPI CountFlatNodes(const ALNNODE* pNode, ALNFLATHEADER& hdr)
+{
+  hdr.nNodes++;
+  if (NODE_ISLFN(pNode))
+  {
+    hdr.nLFNs++;
+    if (LFN_VARMAP(pNode) != NULL)
+      hdr.nVarMaps++;
+  }
+  else
+  {
+    CountFlatNodes(MINMAX_LEFT(pNode), hdr);
+    CountFlatNodes(MINMAX_RIGHT(pNode), hdr);
+  }
+}
+
+// fills the node, LFN, vector and var map tables in preorder,
+// returns index of pNode
+static int ALNAPI FillFlatNodes(const ALN* pALN, const ALNNODE* pNode,
+                                int nParent, char* pImage,
+                                const ALNFLATHEADER& hdr, 
+                                int& nNodes, int& nLFNs, int& nVarMaps)
+{
+  int nDim = pALN->nDim;
+  int nIndex = nNodes++;
+  ALNFLATNODE& node = ((ALNFLATNODE*)(pImage + hdr.nNodeOffset))[nIndex];
+  node.nParentRegion = pNode->nParentRegion;
+  node.fNode = pNode->fNode & ~NF_EVAL;  // do not write eval flag!
+  node.nParent = nParent;
+  node.nLeft = node.nRight = node.nLFN = -1;
+
+  if (NODE_ISLFN(pNode))
+  {
+    int nLFN = nLFNs++;
+    node.nLFN = nLFN;
+
+    ALNFLATLFN& lfn = ((ALNFLATLFN*)(pImage + hdr.nLFNOffset))[nLFN];
+    lfn.nNode = nIndex;
+    lfn.nVDim = LFN_VDIM(pNode);
+    lfn.nVarMap = -1;
+    if (LFN_VARMAP(pNode) != NULL)
+    {
+      lfn.nVarMap = nVarMaps++;
+      memcpy(pImage + hdr.nVarMapOffset + 
+               (long long)lfn.nVarMap * MAPBYTECOUNT(nDim),
+             LFN_VARMAP(pNode), MAPBYTECOUNT(nDim));
+    }
+    if ((pNode->fNode & LF_SPLIT) && LFN_SPLIT(pNode) != NULL)
+    {
+      lfn.bSplit = 1;
+      lfn.split = *LFN_SPLIT(pNode);
+    }
+
+    double* adblW = (double*)(pImage + hdr.nWOffset) + (long long)nLFN * (nDim + 1);
+    double* adblC = (double*)(pImage + hdr.nCOffset) + (long long)nLFN * nDim;
+    double* adblD = (double*)(pImage + hdr.nDOffset) + (long long)nLFN * nDim;
+    memcpy(adblW, LFN_W(pNode), (LFN_VDIM(pNode) + 1) * sizeof(double));
+    memcpy(adblC, LFN_C(pNode), LFN_VDIM(pNode) * sizeof(double));
+    memcpy(adblD, LFN_D(pNode), LFN_VDIM(pNode) * sizeof(double));
+  }
+  else
+  {
+    ASSERT(NODE_ISMINMAX(pNode));
+    int nLeft = FillFlatNodes(pALN, MINMAX_LEFT(pNode), nIndex, pImage, hdr, 
+                              nNodes, nLFNs, nVarMaps);
+    int nRight = FillFlatNodes(pALN, MINMAX_RIGHT(pNode), nIndex, pImage, hdr, 
+                               nNodes, nLFNs, nVarMaps);
+    node.nLeft = nLeft;
+    node.nRight = nRight;
+  }
+
+  return nIndex;
+}
+
+static int ALNAPI DoALNWriteFlat(FILE* pFile, const ALN* pALN)
+{
+  ASSERT(pFile);
+  ASSERT(pALN);
+
+  ALNFLATHEADER hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.achMagic, ALNFLATMAGIC, ALNFLATMAGICSIZE);
+  hdr.nHeaderSize = sizeof(ALNFLATHEADER);
+  hdr.nVersion = pALN->nVersion;
+  hdr.nDim = pALN->nDim;
+  hdr.nOutput = pALN->nOutput;
+  hdr.nRegions = pALN->nRegions;
+  for (int i = 0; i < pALN->nRegions; i++)
+    hdr.nConstr += pALN->aRegions[i].nConstr;
+  CountFlatNodes(pALN->pTree, hdr);
+  CalcFlatLayout(hdr);
+
+  // the file is built in memory and written at once
+  char* pImage = (char*)calloc((size_t)hdr.nFileSize, 1);
+  if (pImage == NULL)
+    return ALN_OUTOFMEM;
+
+  memcpy(pImage, &hdr, sizeof(hdr));
+
+  ALNFLATREGION* aRegions = (ALNFLATREGION*)(pImage + hdr.nRegionOffset);
+  ALNCONSTRAINT* aConstr = (ALNCONSTRAINT*)(pImage + hdr.nConstrOffset);
+  int nConstr = 0;
+  for (int i = 0; i < pALN->nRegions; i++)
+  {
+    const ALNREGION& region = pALN->aRegions[i];
+    aRegions[i].nParentRegion = region.nParentRegion;
+    aRegions[i].nConstr = region.nConstr;
+    aRegions[i].nFirstConstr = nConstr;
+    aRegions[i].dblLearnFactor = region.dblLearnFactor;
+    // don't write var map!
+    if (region.nConstr > 0)
+      memcpy(aConstr + nConstr, region.aConstr, region.nConstr * sizeof(ALNCONSTRAINT));
+    nConstr += region.nConstr;
+  }
+
+  int nNodes = 0, nLFNs = 0, nVarMaps = 0;
+  FillFlatNodes(pALN, pALN->pTree, -1, pImage, hdr, nNodes, nLFNs, nVarMaps);
+  ASSERT(nNodes == hdr.nNodes && nLFNs == hdr.nLFNs && nVarMaps == hdr.nVarMaps);
+
+  int nRet = ALN_NOERROR;
+  if (fwrite(pImage, (size_t)hdr.nFileSize, 1, pFile) != 1)
+    nRet = ALN_ERRFILE;
+
+  free(pImage);
+  return nRet;
+}
+
+// checks for flat file magic, leaves file at start
+static BOOL ALNAPI IsFlatFile(FILE* pFile)
+{
+  char achMagic[ALNFLATMAGICSIZE];
+  BOOL bFlat = fread(achMagic, ALNFLATMAGICSIZE, 1, pFile) == 1 &&
+               memcmp(achMagic, ALNFLATMAGIC, ALNFLATMAGICSIZE) == 0;
+  rewind(pFile);
+  return bFlat;
+}
+
+// checks that a table of nCount elements of nSize bytes lies in the image
+inline BOOL IsFlatTableValid(const ALNFLATHEADER& hdr, long long nOffset, 
+                             int nCount, long long nSize)
+{
+  return nCount >= 0 && nOffset >= hdr.nHeaderSize && (nOffset & 7) == 0 &&
+         nOffset + nCount * nSize <= hdr.nFileSize;
+}
+
+// checks header, tables and tree structure of a flat image
+static int ALNAPI ValidateFlatImage(const char* pImage, long long nImageSize)
+{
+  const ALNFLATHEADER& hdr = *(const ALNFLATHEADER*)pImage;
+  if (nImageSize < (long long)sizeof(ALNFLATHEADER) ||
+      memcmp(hdr.achMagic, ALNFLATMAGIC, ALNFLATMAGICSIZE) != 0 ||
+      hdr.nHeaderSize != sizeof(ALNFLATHEADER) ||
+      hdr.nFileSize != nImageSize)
+    return ALN_BADFILEFORMAT;
+
+  if (hdr.nVersion > ALNVER || hdr.nDim < 0 ||
+      hdr.nOutput < 0 || hdr.nOutput >= hdr.nDim ||
+      hdr.nRegions <= 0 || hdr.nNodes <= 0 || hdr.nLFNs <= 0 ||
+      hdr.nLFNs > hdr.nNodes || hdr.nVarMaps > hdr.nLFNs)
+    return ALN_BADFILEFORMAT;
+
+  int nDim = hdr.nDim;
+  if (!IsFlatTableValid(hdr, hdr.nRegionOffset, hdr.nRegions, sizeof(ALNFLATREGION)) ||
+      !IsFlatTableValid(hdr, hdr.nConstrOffset, hdr.nConstr, sizeof(ALNCONSTRAINT)) ||
+      !IsFlatTableValid(hdr, hdr.nNodeOffset, hdr.nNodes, sizeof(ALNFLATNODE)) ||
+      !IsFlatTableValid(hdr, hdr.nLFNOffset, hdr.nLFNs, sizeof(ALNFLATLFN)) ||
+      !IsFlatTableValid(hdr, hdr.nWOffset, hdr.nLFNs, (nDim + 1) * sizeof(double)) ||
+      !IsFlatTableValid(hdr, hdr.nCOffset, hdr.nLFNs, nDim * sizeof(double)) ||
+      !IsFlatTableValid(hdr, hdr.nDOffset, hdr.nLFNs, nDim * sizeof(double)) ||
+      hdr.nVarMapOffset < hdr.nHeaderSize ||
+      hdr.nVarMapOffset + (long long)hdr.nVarMaps * MAPBYTECOUNT(nDim) > hdr.nFileSize)
+    return ALN_BADFILEFORMAT;
+
+  // regions and their constraints
+  const ALNFLATREGION* aRegions = (const ALNFLATREGION*)(pImage + hdr.nRegionOffset);
+  const ALNCONSTRAINT* aConstr = (const ALNCONSTRAINT*)(pImage + hdr.nConstrOffset);
+  for (int i = 0; i < hdr.nRegions; i++)
+  {
+    const ALNFLATREGION& region = aRegions[i];
+    if (region.nParentRegion < -1 || region.nParentRegion >= hdr.nRegions ||
+        region.dblLearnFactor < 0 ||
+        region.nConstr < 0 || region.nConstr > nDim ||
+        region.nFirstConstr < 0 || region.nFirstConstr + region.nConstr > hdr.nConstr)
+      return ALN_BADFILEFORMAT;
+
+    for (int j = 0; j < region.nConstr; j++)
+    {
+      int nVarIndex = aConstr[region.nFirstConstr + j].nVarIndex;
+      if (nVarIndex < 0 || nVarIndex >= nDim)
+        return ALN_BADFILEFORMAT;
+    }
+  }
+
+  // nodes: children follow their parent in preorder and point back to it,
+  // so the links form one tree rooted at node 0
+  const ALNFLATNODE* aNodes = (const ALNFLATNODE*)(pImage + hdr.nNodeOffset);
+  const ALNFLATLFN* aLFNs = (const ALNFLATLFN*)(pImage + hdr.nLFNOffset);
+  if (aNodes[0].nParent != -1)
+    return ALN_BADFILEFORMAT;
+
+  for (int i = 0; i < hdr.nNodes; i++)
+  {
+    const ALNFLATNODE& node = aNodes[i];
+    if (node.nParentRegion < 0 || node.nParentRegion >= hdr.nRegions)
+      return ALN_BADFILEFORMAT;
+
+    if (i > 0)
+    {
+      int nParent = node.nParent;
+      if (nParent < 0 || nParent >= i ||
+          (aNodes[nParent].nLeft != i && aNodes[nParent].nRight != i))
+        return ALN_BADFILEFORMAT;
+    }
+
+    if (node.fNode & NF_LFN)
+    {
+      if (node.nLFN < 0 || node.nLFN >= hdr.nLFNs || 
+          aLFNs[node.nLFN].nNode != i)
+        return ALN_BADFILEFORMAT;
+
+      const ALNFLATLFN& lfn = aLFNs[node.nLFN];
+      if (lfn.nVDim < 0 || lfn.nVDim > nDim ||
+          lfn.nVarMap < -1 || lfn.nVarMap >= hdr.nVarMaps)
+        return ALN_BADFILEFORMAT;
+    }
+    else if (node.fNode & NF_MINMAX)
+    {
+      if (node.nLeft <= i || node.nLeft >= hdr.nNodes ||
+          node.nRight <= i || node.nRight >= hdr.nNodes ||
+          node.nLeft == node.nRight ||
+          aNodes[node.nLeft].nParent != i || aNodes[node.nRight].nParent != i)
+        return ALN_BADFILEFORMAT;
+    }
+    else
+      return ALN_BADFILEFORMAT;
+  }
+
+  return ALN_NOERROR;
+}
+
+// builds regions of pALN from a validated flat image
+static int ALNAPI BuildFlatRegions(const char* pImage, ALN* pALN)
+{
+  const ALNFLATHEADER& hdr = *(const ALNFLATHEADER*)pImage;
+  const ALNFLATREGION* aRegions = (const ALNFLATREGION*)(pImage + hdr.nRegionOffset);
+  const ALNCONSTRAINT* aConstr = (const ALNCONSTRAINT*)(pImage + hdr.nConstrOffset);
+
+  pALN->aRegions = (ALNREGION*)malloc(pALN->nRegions * sizeof(ALNREGION));
+  if (pALN->aRegions == NULL)
+  {
+    pALN->nRegions = 0;
+    return ALN_OUTOFMEM;
+  }
+  memset(pALN->aRegions, 0, pALN->nRegions * sizeof(ALNREGION));
+
+  for (int i = 0; i < pALN->nRegions; i++)
+  {
+    ALNREGION* pRegion = &(pALN->aRegions[i]);
+    pRegion->nParentRegion = aRegions[i].nParentRegion;
+    pRegion->dblLearnFactor = aRegions[i].dblLearnFactor;
+
+    // alloc var map?
+    int nConstr = aRegions[i].nConstr;
+    if (nConstr > 0 && nConstr < pALN->nDim)
+    {
+      pRegion->afVarMap = (char*)malloc(MAPBYTECOUNT(pALN->nDim));
+        // failure tolerable, since we can always search for constraint
+      if (pRegion->afVarMap)
+        memset(pRegion->afVarMap, 0, MAPBYTECOUNT(pALN->nDim));
+    }
+
+    // alloc constraints, none for a region without constraints, where
+    // malloc(0) may return NULL
+    if (nConstr == 0)
+      continue;
+    pRegion->aConstr = (ALNCONSTRAINT*)malloc(nConstr * sizeof(ALNCONSTRAINT));
+    if (pRegion->aConstr == NULL)
+      return ALN_OUTOFMEM;
+    pRegion->nConstr = nConstr;
+    memcpy(pRegion->aConstr, aConstr + aRegions[i].nFirstConstr, 
+           nConstr * sizeof(ALNCONSTRAINT));
+
+    if (pRegion->afVarMap)
+    {
+      for (int j = 0; j < nConstr; j++)
+      {
+        if (TESTMAP(pRegion->afVarMap, pRegion->aConstr[j].nVarIndex))
+          return ALN_BADFILEFORMAT; // dup var index!
+
+        SETMAP(pRegion->afVarMap, pRegion->aConstr[j].nVarIndex);
+      }
+    }
+  }
+
+  return ALN_NOERROR;
+}
+
+// builds tree of pALN from a validated flat image
+static int ALNAPI BuildFlatTree(const char* pImage, ALN* pALN)
+{
+  const ALNFLATHEADER& hdr = *(const ALNFLATHEADER*)pImage;
+  const ALNFLATNODE* aNodes = (const ALNFLATNODE*)(pImage + hdr.nNodeOffset);
+  const ALNFLATLFN* aLFNs = (const ALNFLATLFN*)(pImage + hdr.nLFNOffset);
+  int nDim = hdr.nDim;
+
+  ALNNODE** apNodes = (ALNNODE**)malloc(hdr.nNodes * sizeof(ALNNODE*));
+  if (apNodes == NULL)
+    return ALN_OUTOFMEM;
+
+  // allocate and link all nodes first, so the tree is complete and can be
+  // destroyed normally if allocating a vector fails
+  for (int i = 0; i < hdr.nNodes; i++)
+  {
+    apNodes[i] = (ALNNODE*)malloc(sizeof(ALNNODE));
+    if (apNodes[i] == NULL)
+    {
+      while (--i >= 0)
+        free(apNodes[i]);
+      free(apNodes);
+      return ALN_OUTOFMEM;
+    }
+    memset(apNodes[i], 0, sizeof(ALNNODE));
+  }
+
+  for (int i = 0; i < hdr.nNodes; i++)
+  {
+    ALNNODE* pNode = apNodes[i];
+    const ALNFLATNODE& node = aNodes[i];
+    pNode->nParentRegion = node.nParentRegion;
+    pNode->fNode = node.fNode;
+    NODE_PARENT(pNode) = (node.nParent >= 0) ? apNodes[node.nParent] : NULL;
+    if (NODE_ISMINMAX(pNode))
+    {
+      MINMAX_LEFT(pNode) = apNodes[node.nLeft];
+      MINMAX_RIGHT(pNode) = apNodes[node.nRight];
+    }
+  }
+  pALN->pTree = apNodes[0];
+
+  int nRet = ALN_NOERROR;
+  for (int i = 0; i < hdr.nNodes && nRet == ALN_NOERROR; i++)
+  {
+    ALNNODE* pNode = apNodes[i];
+    if (!NODE_ISLFN(pNode))
+      continue;
+
+    int nLFN = aNodes[i].nLFN;
+    const ALNFLATLFN& lfn = aLFNs[nLFN];
+    int nVDim = lfn.nVDim;
+    LFN_VDIM(pNode) = nVDim;
+
+    // var map
+    if (lfn.nVarMap >= 0)
+    {
+      LFN_VARMAP(pNode) = (char*)malloc(MAPBYTECOUNT(nDim));
+      if (LFN_VARMAP(pNode) == NULL)
+      {
+        nRet = ALN_OUTOFMEM;
+        break;
+      }
+      memcpy(LFN_VARMAP(pNode), 
+             pImage + hdr.nVarMapOffset + (long long)lfn.nVarMap * MAPBYTECOUNT(nDim),
+             MAPBYTECOUNT(nDim));
+    }
+
+    // split
+    if (pNode->fNode & LF_SPLIT)
+    {
+      LFN_SPLIT(pNode) = (ALNLFNSPLIT*)malloc(sizeof(ALNLFNSPLIT));
+      if (LFN_SPLIT(pNode) == NULL)
+      {
+        nRet = ALN_OUTOFMEM;
+        break;
+      }
+      if (lfn.bSplit)
+        *LFN_SPLIT(pNode) = lfn.split;
+      else
+        memset(LFN_SPLIT(pNode), 0, sizeof(ALNLFNSPLIT));
+    }
+
+    // vectors
+    LFN_W(pNode) = (double*)malloc((nVDim + 1) * sizeof(double));
+    LFN_C(pNode) = (double*)malloc(nVDim * sizeof(double));
+    LFN_D(pNode) = (double*)malloc(nVDim * sizeof(double));
+    if (LFN_W(pNode) == NULL || LFN_C(pNode) == NULL || LFN_D(pNode) == NULL)
+    {
+      nRet = ALN_OUTOFMEM;
+      break;
+    }
+    memcpy(LFN_W(pNode), 
+           (const double*)(pImage + hdr.nWOffset) + (long long)nLFN * (nDim + 1),
+           (nVDim + 1) * sizeof(double));
+    memcpy(LFN_C(pNode), 
+           (const double*)(pImage + hdr.nCOffset) + (long long)nLFN * nDim,
+           nVDim * sizeof(double));
+    memcpy(LFN_D(pNode), 
+           (const double*)(pImage + hdr.nDOffset) + (long long)nLFN * nDim,
+           nVDim * sizeof(double));
+  }
+
+  free(apNodes);
+  return nRet;
+}
+
+// maps a file read-only, returns NULL on failure
+static const char* ALNAPI MapFlatFile(const char* pszFileName, long long& nSize)
+{
+  const char* pImage = NULL;
+  nSize = 0;
+#ifdef _WIN32
+  HANDLE hFile = CreateFileA(pszFileName, GENERIC_READ, FILE_SHARE_READ, NULL,
+                             OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (hFile == INVALID_HANDLE_VALUE)
+    return NULL;
+
+  LARGE_INTEGER size;
+  if (GetFileSizeEx(hFile, &size) && size.QuadPart > 0)
+  {
+    HANDLE hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (hMapping != NULL)
+    {
+      // the view keeps the mapping alive
+      pImage = (const char*)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+      CloseHandle(hMapping);
+      if (pImage != NULL)
+        nSize = size.QuadPart;
+    }
+  }
+  CloseHandle(hFile);
+#else
+  int fd = open(pszFileName, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size > 0)
+  {
+    void* pv = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (pv != MAP_FAILED)
+    {
+      pImage = (const char*)pv;
+      nSize = st.st_size;
+    }
+  }
+  close(fd);
+#endif
+  return pImage;
+}
+
+static void ALNAPI UnmapFlatFile(const char* pImage, long long nSize)
+{
+#ifdef _WIN32
+  UnmapViewOfFile(pImage);
+#else
+  munmap((void*)pImage, (size_t)nSize);
+#endif
+}
+
+static int ALNAPI DoALNReadFlat(const char* pszFileName, ALN** ppALN)
+{
+  ASSERT(pszFileName);
+  ASSERT(ppALN);
+
+  *ppALN = NULL;
+
+  // the tables are used straight from the mapped file
+  long long nSize;
+  const char* pImage = MapFlatFile(pszFileName, nSize);
+  if (pImage == NULL)
+    return ALN_ERRFILE;
+
+  int nRet = ValidateFlatImage(pImage, nSize);
+  if (nRet != ALN_NOERROR)
+  {
+    UnmapFlatFile(pImage, nSize);
+    return nRet;
+  }
+
+  // alloc aln
+  const ALNFLATHEADER& hdr = *(const ALNFLATHEADER*)pImage;
+  ALN* pALN = (ALN*)malloc(sizeof(ALN));
+  if (pALN == NULL)
+  {
+    UnmapFlatFile(pImage, nSize);
+    return ALN_OUTOFMEM;
+  }
+  memset(pALN, 0, sizeof(ALN));
+  pALN->nVersion = hdr.nVersion;
+  pALN->nDim = hdr.nDim;
+  pALN->nOutput = hdr.nOutput;
+  pALN->nRegions = hdr.nRegions;
+
+  nRet = BuildFlatRegions(pImage, pALN);
+  if (nRet == ALN_NOERROR)
+    nRet = BuildFlatTree(pImage, pALN);
+
+  UnmapFlatFile(pImage, nSize);
+
+  if (nRet != ALN_NOERROR)
+  {
+    ALNDestroyALN(pALN);
+    return nRet;
+  }
+
+  // set new version number
+  pALN->nVersion = ALNVER;
+
+  // assign to output param
+  *ppALN = pALN;
+
+  return ALN_NOERROR;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// mapped flat files
+//   ALNMapFlat maps a flat file and evaluates it in place: the node table
+//   is walked by index and the weights are read from the W matrix, so
+//   nothing is allocated per node and loading costs the validation pass.
+//   The evaluation is that of ALNQuickEval on the ALN ALNRead builds from
+//   the file: left children first and no smoothing, which files do not
+//   carry.
+
+// as Cutoff, for a flat node
+static BOOL ALNAPI FlatCutoff(double dbl, BOOL bMax, CEvalCutoff& cutoff)
+{
+  if (bMax)
+  {
+    if (cutoff.bMin && (dbl >= cutoff.dblMin))
+      return TRUE;
+
+    if (!cutoff.bMax || dbl > cutoff.dblMax)
+    {
+      cutoff.bMax = TRUE;
+      cutoff.dblMax = dbl;
+    }
+  }
+  else
+  {
+    if (cutoff.bMax && (dbl <= cutoff.dblMax))
+      return TRUE;
+
+    if (!cutoff.bMin || dbl < cutoff.dblMin)
+    {
+      cutoff.bMin = TRUE;
+      cutoff.dblMin = dbl;
+    }
+  }
+  return FALSE;
+}
+
+// as CutoffEval, for node nNode of a flat image
+static double ALNAPI FlatEval(const ALNFLATNODE* aNodes, const double* adblWTable,
+                              int nDim, int nNode, const double* adblX,
+                              CEvalCutoff cutoff, int* pnActiveLFN)
+{
+  const ALNFLATNODE& node = aNodes[nNode];
+  if (node.fNode & NF_LFN)
+  {
+    *pnActiveLFN = node.nLFN;
+
+    const double* adblW = adblWTable + (long long)node.nLFN * (nDim + 1);
+    double dblA = *adblW++;               // skip past bias weight
+    for (int i = 0; i < nDim; i++)
+    {
+      dblA += adblW[i] * adblX[i];
+    }
+    return dblA;
+  }
+
+  BOOL bMax = (node.fNode & GF_MAX) != 0;
+
+  int nActive0;
+  double dbl0 = FlatEval(aNodes, adblWTable, nDim, node.nLeft, adblX, cutoff,
+                         &nActive0);
+  if (FlatCutoff(dbl0, bMax, cutoff))
+  {
+    *pnActiveLFN = nActive0;
+    return dbl0;
+  }
+
+  int nActive1;
+  double dbl1 = FlatEval(aNodes, adblWTable, nDim, node.nRight, adblX, cutoff,
+                         &nActive1);
+  if (bMax == (dbl1 > dbl0))
+  {
+    *pnActiveLFN = nActive1;
+    return dbl1;
+  }
+  *pnActiveLFN = nActive0;
+  return dbl0;
+}
+
+// mapping a flat file for evaluation
+// the mapped ALN is placed in *ppFlat - use ALNUnmapFlat to release it
+// returns ALN_* error code, (ALN_NOERROR on success)
+ALNIMP int ALNAPI ALNMapFlat(const char* pszFileName, ALNFLAT** ppFlat)
+{
+  // parameter variance
+  if (ppFlat == NULL)
+    return ALN_GENERIC;
+
+  if (pszFileName == NULL)
+    return ALN_GENERIC;
+
+  *ppFlat = NULL;
+
+  long long nSize;
+  const char* pImage = MapFlatFile(pszFileName, nSize);
+  if (pImage == NULL)
+    return ALN_ERRFILE;
+
+  int nRet = ValidateFlatImage(pImage, nSize);
+
+  // the evaluation, like CutoffEvalLFN, takes full weight vectors only
+  const ALNFLATHEADER& hdr = *(const ALNFLATHEADER*)pImage;
+  if (nRet == ALN_NOERROR)
+  {
+    const ALNFLATLFN* aLFNs = (const ALNFLATLFN*)(pImage + hdr.nLFNOffset);
+    for (int i = 0; i < hdr.nLFNs; i++)
+    {
+      if (aLFNs[i].nVDim != hdr.nDim || aLFNs[i].nVarMap != -1)
+      {
+        nRet = ALN_BADFILEFORMAT;
+        break;
+      }
+    }
+  }
+
+  ALNFLAT* pFlat = NULL;
+  if (nRet == ALN_NOERROR)
+  {
+    pFlat = (ALNFLAT*)malloc(sizeof(ALNFLAT));
+    if (pFlat == NULL)
+      nRet = ALN_OUTOFMEM;
+  }
+
+  if (nRet != ALN_NOERROR)
+  {
+    UnmapFlatFile(pImage, nSize);
+    return nRet;
+  }
+
+  pFlat->nDim = hdr.nDim;
+  pFlat->nOutput = hdr.nOutput;
+  pFlat->nLFNs = hdr.nLFNs;
+  pFlat->pvImage = pImage;
+  pFlat->nImageSize = nSize;
+
+  *ppFlat = pFlat;
+  return ALN_NOERROR;
+}
+
+// evaluation of a mapped flat file on single vector, which must contain
+// pFlat->nDim elements
+// the index of the active LFN, counting the LFNs of the tree from left to
+// right, is returned in pnActiveLFN if it is non-NULL
+// NOTE: as in ALNQuickEval, there is _no_ parameter checking performed
+ALNIMP double ALNAPI ALNQuickEvalFlat(const ALNFLAT* pFlat, const double* adblX,
+                                      int* pnActiveLFN)
+{
+  ASSERT(pFlat);
+  ASSERT(adblX);
+
+  const char* pImage = (const char*)pFlat->pvImage;
+  const ALNFLATHEADER& hdr = *(const ALNFLATHEADER*)pImage;
+
+  int nActiveLFN;
+  double dbl = adblX[pFlat->nOutput] +
+               FlatEval((const ALNFLATNODE*)(pImage + hdr.nNodeOffset),
+                        (const double*)(pImage + hdr.nWOffset), pFlat->nDim,
+                        0, adblX, CEvalCutoff(), &nActiveLFN);
+  if (pnActiveLFN)
+    *pnActiveLFN = nActiveLFN;
+
+  return dbl;
+}
+
+// unmapping a flat file mapped by ALNMapFlat
+// returns ALN_* error code, (ALN_NOERROR on success)
+ALNIMP int ALNAPI ALNUnmapFlat(ALNFLAT* pFlat)
+{
+  if (pFlat == NULL)
+    return ALN_GENERIC;
+
+  UnmapFlatFile((const char*)pFlat->pvImage, pFlat->nImageSize);
+  free(pFlat);
+  return ALN_NOERROR;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// checkpoints
+//   A checkpoint holds everything needed to continue training exactly where
+//   it stopped: the ALN with the responsibility counts and split structures
+//   of all pieces, the state of the ALN random number generator and a block
+//   of caller data (eg iteration number and learning rate).  It is written
+//   to a temporary file which then replaces the checkpoint in one step.
+
+#define ALNCKHDR "ALNCK"
+#define ALNCKHDRSIZE 5
+#define ALNCKTEMPEXT ".tmp"
+
+// pushes the temporary file to the disk; otherwise the rename below can
+// reach the disk before the data and a crash leaves a truncated checkpoint
+static int ALNAPI SyncCheckpointFile(FILE* pFile)
+{
+  if (fflush(pFile) != 0)
+    return ALN_ERRFILE;
+#ifdef _WIN32
+  if (_commit(_fileno(pFile)) != 0)
+    return ALN_ERRFILE;
+#else
+  if (fsync(fileno(pFile)) != 0)
+    return ALN_ERRFILE;
+#endif
+  return ALN_NOERROR;
+}
+
+// replaces pszFileName by pszTempName so that a crash leaves one of the two
+// complete files in place
+static int ALNAPI CommitCheckpointFile(const char* pszTempName, const char* pszFileName)
+{
+#ifdef _WIN32
+  if (!MoveFileExA(pszTempName, pszFileName,
+                   MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+    return ALN_ERRFILE;
+#else
+  if (rename(pszTempName, pszFileName) != 0)
+    return ALN_ERRFILE;
+#endif
+  return ALN_NOERROR;
+}
+
+static int ALNAPI DoALNWriteCheckpoint(FILE* pFile, const ALN* pALN,
+                                       const void* pvUserData, int nUserBytes)
+{
+  if (fwrite(ALNCKHDR, ALNCKHDRSIZE, 1, pFile) != 1) return ALN_ERRFILE;
+
+  int nVersion = ALNVER;
+  unsigned int nSeed = ALNGetRandSeed();
+  if (_WRITE(pFile, nVersion) != 1) return ALN_ERRFILE;
+  if (_WRITE(pFile, nSeed) != 1) return ALN_ERRFILE;
+  if (_WRITE(pFile, nUserBytes) != 1) return ALN_ERRFILE;
+  if (nUserBytes > 0 && fwrite(pvUserData, nUserBytes, 1, pFile) != 1)
+    return ALN_ERRFILE;
+
+  return DoALNWrite(pFile, pALN, TRUE);
+}
+
+// saving ALN and training state to a checkpoint file
+// returns ALN_* error code, (ALN_NOERROR on success)
+ALNIMP int ALNAPI ALNWriteCheckpoint(const ALN* pALN, const char* pszFileName,
+                                     const void* pvUserData, int nUserBytes)
+{
+  // parameter variance
+  if (pALN == NULL)
+    return ALN_GENERIC;
+
+  if (pszFileName == NULL)
+    return ALN_GENERIC;
+
+  if (nUserBytes < 0 || (nUserBytes > 0 && pvUserData == NULL))
+    return ALN_GENERIC;
+
+  char* pszTempName = (char*)malloc(strlen(pszFileName) + sizeof(ALNCKTEMPEXT));
+  if (pszTempName == NULL)
+    return ALN_OUTOFMEM;
+  strcpy(pszTempName, pszFileName);
+  strcat(pszTempName, ALNCKTEMPEXT);
+
+  // open a file -- binary mode
+  FILE* pFile;
+  if(fopen_s(&pFile, pszTempName, "wb") != 0)
+  {
+    free(pszTempName);
+    return ALN_ERRFILE;
+  }
+
+  // the tree is written in many small pieces
+  setvbuf(pFile, NULL, _IOFBF, 0x10000);
+
+  int nRet = DoALNWriteCheckpoint(pFile, pALN, pvUserData, nUserBytes);
+
+  if (nRet == ALN_NOERROR)
+    nRet = SyncCheckpointFile(pFile);
+
+  if (fclose(pFile) != 0 && nRet == ALN_NOERROR)
+    nRet = ALN_ERRFILE;
+
+  if (nRet == ALN_NOERROR)
+    nRet = CommitCheckpointFile(pszTempName, pszFileName);
+
+  if (nRet != ALN_NOERROR)
+  {
+    int nErr = errno;     // save it
+    remove(pszTempName);
+    errno = nErr;
+  }
+
+  free(pszTempName);
+  return nRet;
+}
+
+// loading ALN and training state from a checkpoint file
+// pointer to loaded ALN returned in ppALN
+// returns ALN_* error code, (ALN_NOERROR on success)
+ALNIMP int ALNAPI ALNReadCheckpoint(const char* pszFileName, ALN** ppALN,
+                                    void* pvUserData, int nUserBytes)
+{
+  // parameter variance
+  if (ppALN == NULL)
+    return ALN_GENERIC;
+
+  if (pszFileName == NULL)
+    return ALN_GENERIC;
+
+  if (nUserBytes < 0 || (nUserBytes > 0 && pvUserData == NULL))
+    return ALN_GENERIC;
+
+  *ppALN = NULL;
+
+  // open a file -- binary mode
+  FILE* pFile;
+  if(fopen_s(&pFile, pszFileName, "rb") != 0 )
+    return ALN_ERRFILE;
+
+  setvbuf(pFile, NULL, _IOFBF, 0x10000);
+
+  int nRet = ALN_NOERROR;
+  char szHdr[ALNCKHDRSIZE];
+  int nVersion, nFileUserBytes;
+  unsigned int nSeed;
+  if (fread(szHdr, ALNCKHDRSIZE, 1, pFile) != 1 ||
+      _READ(pFile, nVersion) != 1 || 
+      _READ(pFile, nSeed) != 1 ||
+      _READ(pFile, nFileUserBytes) != 1)
+  {
+    nRet = ALN_ERRFILE;
+  }
+  else if (strncmp(szHdr, ALNCKHDR, ALNCKHDRSIZE) != 0 || 
+           nVersion != ALNVER || nFileUserBytes != nUserBytes)
+  {
+    // checkpoints are not meant to outlive the library that wrote them
+    nRet = ALN_BADFILEFORMAT;
+  }
+  else if (nUserBytes > 0 && fread(pvUserData, nUserBytes, 1, pFile) != 1)
+  {
+    nRet = ALN_ERRFILE;
+  }
+  else
+  {
+    nRet = DoALNRead(pFile, ppALN, TRUE);
+  }
+
+  fclose(pFile);  // will not reset errno
+
+  // training continues with the same random sequence
+  if (nRet == ALN_NOERROR)
+    ALNSRand(nSeed);
+
+  return nRet;  
+}
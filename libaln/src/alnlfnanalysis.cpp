@@ -29,8 +29,13 @@
 
 #include <aln.h>
 #include "alnpriv.h"
+#include <limits.h>
 #include <boost/math/special_functions/beta.hpp>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 using namespace boost::math; 
 
 #ifdef _DEBUG
@@ -53,15 +58,16 @@ static void DebugValidateALNLFNAnalysis(const ALN* pALN,
 #endif
 
 
-// helper to sort data set by active LFN
-struct LFNSORT
+// helpers to number the LFNs left to right and look up the leaf id of an
+// active LFN; the lookup table is sorted by LFN address
+struct LFNID
 {
-  ALNNODE* pActiveLFN;
-  double* adblInputRow;
-  double* adblOutputRow;
-	double* adblResultRow; //Added August 28, 1999.
+  ALNNODE* pLFN;
+  int nLeaf;
 };
+static void CollectLFNs(ALNNODE* pNode, ALNNODE** apLFN, int& nLFN);
 static int __cdecl CompareLFNs(const void* pElem1, const void* pElem2);
+static int LeafId(const LFNID* aLFNId, int nLFNs, const ALNNODE* pLFN);
 
 // helpers to calc T and F probability functions
 static double CalcProbF(double dblF, double dblV1, double dblV2);
@@ -69,7 +75,7 @@ static double CalcProbT(double dblT, double dblV);
 
 // helpers to calc error, regression, and total sum of squares
 static void CalcSquares(double* adblDesired, double* adblResult,
-                        int nStart, int nEnd,
+                        long long nStart, long long nEnd,
                         double& dblESS, double& dblRSS, double& dblTSS);
 
 // helpers to allocate / deallocate analysis storage
@@ -97,6 +103,12 @@ LFNINFO* GetLFNInfo(LFNANALYSIS* pLFNAnalysis, int nLFN)
   return (LFNINFO*)(((char*)(pLFNAnalysis->aLFNInfo)) + (nLFN * pLFNAnalysis->nLFNInfoSize));
 }
 
+// helper to fit and analyze the points of one LFN
+static int AnalyzeLFNBlock(const ALN* pALN, ALNNODE* pLFN,
+                           const long long* anPoints, int nBlockPoints,
+                           const double* adblInput, const double* adblOutput,
+                           const double* adblResult, LFNINFO* pLFNInfo);
+
 
 // analyze LFNs
 ALNIMP int ALNAPI ALNLFNAnalysis(const ALN* pALN,
@@ -123,20 +135,14 @@ ALNIMP int ALNAPI ALNLFNAnalysis(const ALN* pALN,
   ALNNODE** apActiveLFNs = NULL;
   double* adblInput = NULL;
   double* adblOutput = NULL;
-  LFNSORT* aLFNSort = NULL;
 
-  // covariance calculation (on single block of inputs and outputs for one LFN)
-  double* adblX = NULL;      // RMA based ALN input vectors (nRows * nCols); nCols = nDim
-  double* adblY = NULL;      // RMA based desired column vector (nRows); nRows = #points this LFN
-  double* adblC = NULL;      // RMA covariance matrix (nCols * nCols)
-  double* adblA = NULL;      // RMA fitted parameter vector (nCols); adblA can be computed by SVD
-  double* adblS = NULL;      // RMA std dev vector (nRows); output of SVD using adblX
-  double* adblU = NULL;      // RMA U matrix (nRows * nCols); output of SVD using adblX
-  double* adblV = NULL;      // RMA V matrix (nCols * nCols); output of SVD using adblX
-  double* adblW = NULL;      // RMA W matrix (nCols); singular values from the SVD of matrix adblX 
-  double* adblALN = NULL;    // RMA based ALN result column vector (nRows); the given fit to the data
-
-	// idea: Use  std::vector< std::vector<Indices> > indices(layers, std::vector<Indices>(corrections));
+  // points sorted by leaf id
+  ALNNODE** apLFN = NULL;       // LFNs left to right, indexed by leaf id
+  LFNID* aLFNId = NULL;         // leaf ids sorted by LFN address
+  int* anLeaf = NULL;           // leaf id of the active LFN of each point
+  long long* anLeafStart = NULL;// first sorted point of each leaf id, and end
+  long long* anOrder = NULL;    // point indices in order of leaf id
+  int* anBlockLeaf = NULL;      // leaf ids that have points
 
   // LFN analysis
   LFNANALYSIS* pLFNAnalysis = NULL;
@@ -149,46 +155,31 @@ ALNIMP int ALNAPI ALNLFNAnalysis(const ALN* pALN,
       ThrowALNMemoryException();
 
     // see how many points there are
-    int nPoints = pDataInfo->nPoints;
-    
-    // get dim... we use all the input variables of the ALN,
-    // plus an explicit bias variable always equal to one,
+    long long nPoints = pDataInfo->nPoints;
     int nDim = pALN->nDim;
-		int nCols = nDim - 1;
-		int nOutput = pALN->nOutput;
+    int nLFNs = pLFNAnalysis->nLFNInfo;
 
-    // allocate arrays
+    // allocate arrays; memory is linear in nPoints * nDim, the per LFN
+    // scratch is allocated by each block
     adblResult = new double[nPoints];
     apActiveLFNs = new ALNNODE*[nPoints];
     adblInput = new double[nPoints * nDim];
     adblOutput = new double[nPoints];
-    aLFNSort = new LFNSORT[nPoints];
-    adblX = new double[nPoints * nCols];
-		adblY = new double[nPoints];
-    adblC = new double[nCols * nCols];
-    adblA = new double[nCols];
-    adblS = new double[nPoints];
-    adblU = new double[nPoints * nPoints];
-    adblV = new double[nCols * nCols];
-    adblW = new double[nCols];
-    adblALN = new double[nPoints];
-
+    apLFN = new ALNNODE*[nLFNs];
+    aLFNId = new LFNID[nLFNs];
+    anLeaf = new int[nPoints];
+    anLeafStart = new long long[nLFNs + 1];
+    anOrder = new long long[nPoints];
+    anBlockLeaf = new int[nLFNs];
 
     if (!(adblResult && apActiveLFNs && adblInput && adblOutput && 
-          aLFNSort && adblX && adblALN && adblC && adblA && adblS &&
-          adblU && adblV && adblW && adblY))
+          apLFN && aLFNId && anLeaf && anLeafStart && anOrder && anBlockLeaf))
     {
       ThrowALNMemoryException();
     }
 
-    // init S
-    for (int i = 0; i < nPoints; i++)
-    {
-      adblS[i] = 1.0; // start off with std dev 1.0 in each axis
-    }
-    
     // evaluate on data
-    int nStart, nEnd;
+    long long nStart, nEnd;
     nReturn = EvalTree(pALN->pTree, pALN, pDataInfo, pCallbackInfo, 
                        adblResult, &nStart, &nEnd, FALSE,
                        apActiveLFNs, adblInput, adblOutput);
@@ -197,179 +188,65 @@ ALNIMP int ALNAPI ALNLFNAnalysis(const ALN* pALN,
       ThrowALNException();
     }
 
-    // sort input/output arrays by responsible LFN
-		// pointers in LFNSORT entries refer to  *unsorted* arrays
+    // number the LFNs left to right
+    int nLeaf = 0;
+    CollectLFNs(pALN->pTree, apLFN, nLeaf);
+    ASSERT(nLeaf == nLFNs);
+    for (int k = 0; k < nLFNs; k++)
+    {
+      aLFNId[k].pLFN = apLFN[k];
+      aLFNId[k].nLeaf = k;
+    }
+    qsort(aLFNId, (size_t)nLFNs, sizeof(LFNID), CompareLFNs);
+
+    // counting sort of the points by leaf id of the responsible LFN
 		// In the adblInput array, the nOutput components have been set to 1.0 by EvalTree.
-    for (int i = nStart; i <= nEnd; i++)
+    memset(anLeafStart, 0, (nLFNs + 1) * sizeof(long long));
+    for (long long i = nStart; i <= nEnd; i++)
     {
-      LFNSORT& lfnsort = aLFNSort[i];
-      lfnsort.pActiveLFN = apActiveLFNs[i];
-      lfnsort.adblInputRow = adblInput + (i * nDim);
-			// WWA I think it would be better to use adblOutputCol and adblResultCol as names:
-			// The way the SVD is presented as
-			// Matrix of input rows x parameter column = Result column.
-			// The Output column is originally in the matrix of input rows
-			// as the column of desired values (later replaced during evaluation of the DTREE)
-      lfnsort.adblOutputRow = adblOutput+i; // desired
-			adblOutput[i];
-			lfnsort.adblResultRow = adblResult+i; // ALN output
+      anLeaf[i] = LeafId(aLFNId, nLFNs, apActiveLFNs[i]);
+      anLeafStart[anLeaf[i] + 1]++;
     }
-    // sort the LFN index structure
-    qsort(aLFNSort + nStart, nEnd - nStart + 1, sizeof(LFNSORT), CompareLFNs);
-  
-    // calc covariance matrix for each block of data points
-    int nBlockStart = nStart; // Monroe had 0, changed by wwa Aug 21 1999
-    ALNNODE* pBlockLFN = aLFNSort[nStart].pActiveLFN;
     nLFNStats = 0;
-    for (int i = nStart; i <= nEnd; i++)
+    for (int k = 0; k < nLFNs; k++)
+    {
+      if (anLeafStart[k + 1] > 0)
+        anBlockLeaf[nLFNStats++] = k;
+      anLeafStart[k + 1] += anLeafStart[k];
+    }
+    for (long long i = nStart; i <= nEnd; i++)
+    {
+      anOrder[anLeafStart[anLeaf[i]]++] = i;
+    }
+    for (int k = nLFNs; k > 0; k--)  // undo the increments above
     {
-      if (i == nEnd || aLFNSort[i + 1].pActiveLFN != pBlockLFN)
+      anLeafStart[k] = anLeafStart[k - 1];
+    }
+    anLeafStart[0] = 0;
+
+    // calc covariance matrix for each block of data points, in parallel;
+    // the LFN stats are in order of leaf id
+    int nBlockReturn = ALN_NOERROR;
+    int b;
+    #pragma omp parallel for schedule(dynamic)
+    for (b = 0; b < nLFNStats; b++)
+    {
+      int k = anBlockLeaf[b];
+      long long nBlockPoints = anLeafStart[k + 1] - anLeafStart[k];
+      ASSERT(nBlockPoints > 0 && nBlockPoints <= INT_MAX);
+      int nErr = AnalyzeLFNBlock(pALN, apLFN[k], anOrder + anLeafStart[k],
+                                 (int)nBlockPoints, adblInput, adblOutput,
+                                 adblResult, GetLFNInfo(pLFNAnalysis, b));
+      if (nErr != ALN_NOERROR)
       {
-        // get pointer to current LFN info
-        LFNINFO* pLFNInfo = GetLFNInfo(pLFNAnalysis, nLFNStats);
-
-        // increment LFN stat count
-        nLFNStats += 1;
-
-        // end of LFN block... copy data to scratch input and output
-        int nBlockPoints = i - nBlockStart + 1;
-        for (int j = 0; j < nBlockPoints; j++)
-        {
-          // input row (with 1.0 in nOutput component)  WWA we don't copy the 1.0 into X
-          memcpy(adblX + j * nCols,                             
-                 aLFNSort[nBlockStart + j].adblInputRow, 
-                 nCols * sizeof(double)); 
-          // ALN output
-          adblALN[j] = *(aLFNSort[nBlockStart + j].adblResultRow); //contains ALN output
-
-				  // desired output
-					adblY[j] = *(aLFNSort[nBlockStart + j].adblOutputRow); // contains desired
-        }
-				// The result of t4 above is correct
-        // calc covariance
-
-				// NB The actual ALN outputs play no role in the covariance calculation
-				// Y below is the desired output
-				// The ALN outputs could be compared to the outputs using parameter vector A found below
-        double dblChiSq = 0;
-        BOOL bSuccess = CalcCovariance(nCols,
-                                       nBlockPoints, 
-                                       adblX,
-                                       adblY,
-                                       adblC,
-                                       adblA,
-                                       adblS,
-                                       adblU,
-                                       adblV,
-                                       adblW,
-                                       dblChiSq);
-        // redo the Y copy,just in case it changed WWA because of a memcpy that had nDim instead of nCols in
-				// some places, the Y values for j = 0 to j = 4 were wrong, both inside and leaving the calc routine.
-				// After correction, this part is no longer necessary.
-        // for (int j = 0; j < nBlockPoints; j++)
-				//           
-				  // desired 
-					// 	adblY[j] = *(aLFNSort[nBlockStart + j].adblOutputRow); 
-
-          // ALN output
-					//    adblALN[j] = *(aLFNSort[nBlockStart + j].adblResultRow); 
-					// }
-
-        // calc RSS, ESS, TSS
-        double dblRSS, dblESS, dblTSS;
-        CalcSquares(adblY, adblALN, 0, nBlockPoints -1, dblESS, dblRSS, dblTSS);
-        
-        pLFNInfo->LFNStats.dblRSS = dblRSS;
-        pLFNInfo->LFNStats.dblESS = dblESS;
-        
-        // calc R2 for the LFN
-        pLFNInfo->LFNStats.dblR2 = dblRSS / dblTSS;
-
-        // calc degrees of freedom
-        pLFNInfo->LFNStats.dblDF = nBlockPoints - nDim; 
-
-				pLFNInfo->LFNStats.dblSEE = NAN; // set to NAN if we don't have dblDF>0
-        pLFNInfo->LFNStats.dblF   = NAN;
-        pLFNInfo->LFNStats.dblFp  = NAN;
-        if (pLFNInfo->LFNStats.dblDF > 0)
-        {
-          ASSERT(nDim >= 1);
-          double dblV1 = nDim - 1;
-          double dblV2 = pLFNInfo->LFNStats.dblDF;
-
-          // calc SEE "standard error of estimate" for the LFN
-					pLFNInfo->LFNStats.dblSEE = sqrt(dblESS / dblV2);
-
-					// calc F and corresponding p value for the LFN
-          pLFNInfo->LFNStats.dblF = (dblRSS / dblV1) / (dblESS / dblV2);
-          pLFNInfo->LFNStats.dblFp = CalcProbF(pLFNInfo->LFNStats.dblF, dblV1, dblV2);
-        }
-              
-        // set the node
-        pLFNInfo->pLFN = pBlockLFN;
-
-        // set number of weight stats
-        pLFNInfo->nWStats = nDim;
-
-        // calc T, and corresponding p values for each LFN weight
-        const double* adblLFNW = LFN_W(pBlockLFN);
-        double dblBias = *adblLFNW++;  // skip past bias
-        double dblV = pLFNInfo->LFNStats.dblDF;
-				double dblLFNweight; // used for ALN weights to be compared to SVD result
-        for (int k = 0; k < nDim; k++)
-				{
-          // get LFNWEIGHTSTATS pointer
-          LFNWEIGHTSTATS* pWStat = &(pLFNInfo->aWStats[k]);
-
-          // set weights from LFN!!!
-          if (k == pALN->nOutput)
-          dblLFNweight = dblBias;		// bias replaces output weight for stats
-          else
-          dblLFNweight = adblLFNW[k];	// kth input weight
-
-				 // the weights are now obtained from SVD and are in adblA
-				 // (as Monroe suggested doing). 
-				 // dblBias should approximate adblA[k]if k = nOutput 
-				 pWStat->dblW = adblA[k];
-
-          // set T stat
-          pWStat->dblSEw = 0;
-          pWStat->dblT = NAN;
-          pWStat->dblTp = 1.0;
-          if (pLFNInfo->LFNStats.dblDF > 0)
-          {
-            // calc standard error
-            double dblCkk = adblC[k*nDim + k];  // diagonal element Ckk 
-
-            pWStat->dblSEw = sqrt(dblCkk) * pLFNInfo->LFNStats.dblSEE;
-
-            if (pWStat->dblSEw != 0.0)
-            {
-              // calc T, Tp
-							// WWA the following line didn't include the term adblLFNW[k],
-							// thus making it refer to the k-th weight, not to the
-							// difference of ALN computed and SVD computed weights.
-							// In the original interpretation, that would decide whether
-							// the weight could just as well be zero, ie not significant.
-							// Now we want to use it to say if the difference of ALN
-							// weight from the SVD computed one is significant.  If ALN
-							// does well, then all of the T's should be less than 2.0 or 3.0 
-							// and the probabilities Tp should be not to far from 1.0.
-							// Is this OK?
-              pWStat->dblT = (dblLFNweight - pWStat->dblW) / pWStat->dblSEw;
-              pWStat->dblTp = CalcProbT(fabs(pWStat->dblT), dblV);
-            }
-          }
-        }
-        
-        // start of new LFN block
-        if (i < nEnd)
-        {
-          nBlockStart = i + 1;  
-          pBlockLFN = aLFNSort[nBlockStart].pActiveLFN;
-        }
-      }   
-    }          
+        #pragma omp critical
+        nBlockReturn = nErr;
+      }
+    }
+    if (nBlockReturn == ALN_OUTOFMEM)
+      ThrowALNMemoryException();
+    else if (nBlockReturn != ALN_NOERROR)
+      ThrowALNException();
 	}
 
   catch (CALNUserException* e)	  // user abort exception
@@ -392,16 +269,12 @@ ALNIMP int ALNAPI ALNLFNAnalysis(const ALN* pALN,
 		nReturn = ALN_GENERIC;
 	}
 	// deallocate mem
-	delete[] adblALN;
-	delete[] adblW;
-	delete[] adblV;
-	delete[] adblU; // this is where the heap corruption happens
-	delete[] adblS;
-	delete[] adblA;
-	delete[] adblC;
-	delete[] adblY;
-	delete[] adblX;
-	delete[] aLFNSort;
+	delete[] anBlockLeaf;
+	delete[] anOrder;
+	delete[] anLeafStart;
+	delete[] anLeaf;
+	delete[] aLFNId;
+	delete[] apLFN;
 	delete[] adblOutput;
 	delete[] adblInput;
 	delete[] apActiveLFNs;
@@ -420,6 +293,164 @@ ALNIMP int ALNAPI ALNLFNAnalysis(const ALN* pALN,
   return nReturn;
 }
 
+// fit the points of one LFN and fill in its stats; the scratch arrays are
+// local so that blocks can run in parallel, and no exception leaves
+// returns ALN_* error code, (ALN_NOERROR on success)
+static int AnalyzeLFNBlock(const ALN* pALN, ALNNODE* pLFN,
+                           const long long* anPoints, int nBlockPoints,
+                           const double* adblInput, const double* adblOutput,
+                           const double* adblResult, LFNINFO* pLFNInfo)
+{
+  // we use all the input variables of the ALN, with an explicit bias
+  // variable always equal to one in the output position
+  int nDim = pALN->nDim;
+  int nCols = nDim;
+
+  // covariance calculation (on single block of inputs and outputs for one LFN)
+  double* adblX = (double*)malloc((size_t)nBlockPoints * nCols * sizeof(double));  // RMA based ALN input vectors (nRows * nCols)
+  double* adblY = (double*)malloc((size_t)nBlockPoints * sizeof(double));   // desired column vector (nRows)
+  double* adblALN = (double*)malloc((size_t)nBlockPoints * sizeof(double)); // ALN result column vector (nRows); the given fit to the data
+  double* adblC = (double*)malloc(nCols * nCols * sizeof(double)); // RMA covariance matrix (nCols * nCols)
+  double* adblA = (double*)malloc(nCols * sizeof(double));         // fitted parameter vector (nCols), computed by SVD
+  double* adblV = (double*)malloc(nCols * nCols * sizeof(double)); // RMA V matrix (nCols * nCols); output of SVD using adblX
+  double* adblW = (double*)malloc(nCols * sizeof(double));         // singular values from the SVD of matrix adblX
+  int nReturn = ALN_NOERROR;
+  if (!(adblX && adblY && adblALN && adblC && adblA && adblV && adblW))
+    nReturn = ALN_OUTOFMEM;
+
+  try
+  {
+    if (nReturn == ALN_NOERROR)
+    {
+      // copy data to scratch input and output
+      for (int j = 0; j < nBlockPoints; j++)
+      {
+        long long i = anPoints[j];
+        // input row (with 1.0 in nOutput component)
+        memcpy(adblX + j * nCols, adblInput + i * nDim, nCols * sizeof(double)); 
+        adblALN[j] = adblResult[i]; // ALN output
+        adblY[j] = adblOutput[i];   // desired output
+      }
+
+      // calc covariance
+      // NB The actual ALN outputs play no role in the covariance calculation
+      // Y below is the desired output
+      double dblChiSq = 0;
+      if (!CalcCovariance(nCols, nBlockPoints, adblX, adblY, adblC,
+                          adblA, NULL, adblV, adblW, dblChiSq))
+      {
+        nReturn = ALN_GENERIC;
+      }
+    }
+
+    if (nReturn == ALN_NOERROR)
+    {
+      // calc RSS, ESS, TSS
+      double dblRSS, dblESS, dblTSS;
+      CalcSquares(adblY, adblALN, 0, nBlockPoints - 1, dblESS, dblRSS, dblTSS);
+    
+      pLFNInfo->LFNStats.dblRSS = dblRSS;
+      pLFNInfo->LFNStats.dblESS = dblESS;
+    
+      // calc R2 for the LFN
+      pLFNInfo->LFNStats.dblR2 = dblRSS / dblTSS;
+
+      // calc degrees of freedom
+      pLFNInfo->LFNStats.dblDF = nBlockPoints - nDim; 
+
+      pLFNInfo->LFNStats.dblSEE = NAN; // set to NAN if we don't have dblDF>0
+      pLFNInfo->LFNStats.dblF   = NAN;
+      pLFNInfo->LFNStats.dblFp  = NAN;
+      if (pLFNInfo->LFNStats.dblDF > 0)
+      {
+        ASSERT(nDim >= 1);
+        double dblV1 = nDim - 1;
+        double dblV2 = pLFNInfo->LFNStats.dblDF;
+
+        // calc SEE "standard error of estimate" for the LFN
+        pLFNInfo->LFNStats.dblSEE = sqrt(dblESS / dblV2);
+
+        // calc F and corresponding p value for the LFN
+        pLFNInfo->LFNStats.dblF = (dblRSS / dblV1) / (dblESS / dblV2);
+        pLFNInfo->LFNStats.dblFp = CalcProbF(pLFNInfo->LFNStats.dblF, dblV1, dblV2);
+      }
+          
+      // set the node
+      pLFNInfo->pLFN = pLFN;
+
+      // set number of weight stats
+      pLFNInfo->nWStats = nDim;
+
+      // calc T, and corresponding p values for each LFN weight
+      const double* adblLFNW = LFN_W(pLFN);
+      double dblBias = *adblLFNW++;  // skip past bias
+      double dblV = pLFNInfo->LFNStats.dblDF;
+      double dblLFNweight; // used for ALN weights to be compared to SVD result
+      for (int k = 0; k < nDim; k++)
+      {
+        // get LFNWEIGHTSTATS pointer
+        LFNWEIGHTSTATS* pWStat = &(pLFNInfo->aWStats[k]);
+
+        // set weights from LFN!!!
+        if (k == pALN->nOutput)
+          dblLFNweight = dblBias;		// bias replaces output weight for stats
+        else
+          dblLFNweight = adblLFNW[k];	// kth input weight
+
+        // the weights are now obtained from SVD and are in adblA
+        // (as Monroe suggested doing). 
+        // dblBias should approximate adblA[k]if k = nOutput 
+        pWStat->dblW = adblA[k];
+
+        // set T stat
+        pWStat->dblSEw = 0;
+        pWStat->dblT = NAN;
+        pWStat->dblTp = 1.0;
+        if (pLFNInfo->LFNStats.dblDF > 0)
+        {
+          // calc standard error
+          double dblCkk = adblC[k*nCols + k];  // diagonal element Ckk 
+
+          pWStat->dblSEw = sqrt(dblCkk) * pLFNInfo->LFNStats.dblSEE;
+
+          if (pWStat->dblSEw != 0.0)
+          {
+            // calc T, Tp
+            // T refers to the difference of ALN computed and SVD computed
+            // weights.  In the original interpretation, without the term
+            // adblLFNW[k], it would decide whether the weight could just as
+            // well be zero, ie not significant.  Now we use it to say if the
+            // difference of ALN weight from the SVD computed one is
+            // significant.  If ALN does well, then all of the T's should be
+            // less than 2.0 or 3.0 and the probabilities Tp should be not
+            // too far from 1.0.
+            pWStat->dblT = (dblLFNweight - pWStat->dblW) / pWStat->dblSEw;
+            pWStat->dblTp = CalcProbT(fabs(pWStat->dblT), dblV);
+          }
+        }
+      }
+    }
+  }
+  catch (std::bad_alloc&)   // Eigen allocations
+  {
+    nReturn = ALN_OUTOFMEM;
+  }
+  catch (...)                // anything else, eg from ibeta
+  {
+    nReturn = ALN_GENERIC;
+  }
+
+  free(adblW);
+  free(adblV);
+  free(adblA);
+  free(adblC);
+  free(adblALN);
+  free(adblY);
+  free(adblX);
+
+  return nReturn;
+}
+
 // get LFN stats
 ALNIMP int ALNAPI ALNLFNStats(void* pvAnalysis, 
                               int nLFNStat,
@@ -519,19 +550,50 @@ static void DebugValidateALNLFNAnalysis(const ALN* pALN,
 }
 #endif
 
+static void CollectLFNs(ALNNODE* pNode, ALNNODE** apLFN, int& nLFN)
+{
+  if (NODE_ISLFN(pNode))
+  {
+    apLFN[nLFN++] = pNode;
+  }
+  else
+  {
+    ASSERT(NODE_ISMINMAX(pNode));
+    CollectLFNs(MINMAX_LEFT(pNode), apLFN, nLFN);
+    CollectLFNs(MINMAX_RIGHT(pNode), apLFN, nLFN);
+  }
+}
+
 static int __cdecl CompareLFNs(const void* pElem1, const void* pElem2)
 {
-  LFNSORT& lfnsort1 = *(LFNSORT*)pElem1;
-  LFNSORT& lfnsort2 = *(LFNSORT*)pElem2;
+  LFNID& lfnid1 = *(LFNID*)pElem1;
+  LFNID& lfnid2 = *(LFNID*)pElem2;
 
-  if (lfnsort1.pActiveLFN < lfnsort2.pActiveLFN)
+  if (lfnid1.pLFN < lfnid2.pLFN)
     return -1;
-  else if (lfnsort1.pActiveLFN > lfnsort2.pActiveLFN)
+  else if (lfnid1.pLFN > lfnid2.pLFN)
     return 1;
 
   return 0;
 }
 
+static int LeafId(const LFNID* aLFNId, int nLFNs, const ALNNODE* pLFN)
+{
+  // binary search of the table sorted by address
+  int nLo = 0, nHi = nLFNs - 1;
+  while (nLo < nHi)
+  {
+    int nMid = (nLo + nHi) / 2;
+    if (aLFNId[nMid].pLFN < pLFN)
+      nLo = nMid + 1;
+    else
+      nHi = nMid;
+  }
+
+  ASSERT(aLFNId[nLo].pLFN == pLFN);
+  return aLFNId[nLo].nLeaf;
+}
+
 // helpers to calc T and F probability functions
 static double CalcProbF(double dblF, double dblV1, double dblV2)
 {
@@ -553,7 +615,7 @@ static double CalcProbT(double dblT, double dblV)
 
 // helpers to calc error, regression, and total sum of squares
 static void CalcSquares(double* adblDesired, double* adblResult,
-                        int nStart, int nEnd,
+                        long long nStart, long long nEnd,
                         double& dblESS, double& dblRSS, double& dblTSS)
 {
   ASSERT(adblDesired && adblResult);
@@ -564,11 +626,11 @@ static void CalcSquares(double* adblDesired, double* adblResult,
   dblRSS = 0;
 
   double dblMeanDes = 0;
-  int nElem = nEnd - nStart + 1;
+  long long nElem = nEnd - nStart + 1;
   ASSERT(nElem >= 1);
 
   // calc error sum of squares and average of desired
-  for (int i = nStart; i <= nEnd ;i++)
+  for (long long i = nStart; i <= nEnd ;i++)
   {
     dblMeanDes += adblDesired[i];
     double dblError = adblResult[i] - adblDesired[i];
@@ -577,7 +639,7 @@ static void CalcSquares(double* adblDesired, double* adblResult,
   dblMeanDes /= nElem;
 
   // calc total sum of squares
-  for (int i = nStart; i <= nEnd; i++)
+  for (long long i = nStart; i <= nEnd; i++)
   {
     double dblError = adblDesired[i] - dblMeanDes; // Monroe had adblResult[i] - dblMeanDes;
     dblTSS += dblError * dblError;
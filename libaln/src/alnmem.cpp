@@ -170,6 +170,73 @@ int ALNAPI DestroyTree(ALNNODE* pTree)
   return 1;
 }
 
+// helper: places the LFNs of the subtree at pNode in the leaf index
+static void IndexLFNs(ALN* pALN, ALNNODE* pNode)
+{
+  if (NODE_ISMINMAX(pNode))
+  {
+    IndexLFNs(pALN, MINMAX_LEFT(pNode));
+    IndexLFNs(pALN, MINMAX_RIGHT(pNode));
+  }
+  else
+  {
+    ASSERT(NODE_ISLFN(pNode));
+    LFN_INDEX(pNode) = pALN->nLFNs;
+    pALN->apLFNs[pALN->nLFNs++] = pNode;
+  }
+}
+
+// builds the leaf index of an ALN if it has none, with room for at least
+// nReserve more LFNs
+//   ... returns FALSE if out of memory
+// once built, ALNAddLFNs keeps the index up to date as LFNs split, so
+// passes over the LFNs need not walk the tree
+BOOL ALNAPI BuildLFNIndex(ALN* pALN, int nReserve /*= 0*/)
+{
+  ASSERT(pALN != NULL && pALN->pTree != NULL);
+  ASSERT(nReserve >= 0);
+
+  if (pALN->apLFNs == NULL)
+  {
+    int nLFNs = 0;
+    int nAdapted = 0;
+    CountLFNs(pALN->pTree, nLFNs, nAdapted);
+
+    // room to double before the first reallocation
+    int nAlloc = 2 * nLFNs;
+    pALN->apLFNs = (ALNNODE**)malloc(nAlloc * sizeof(ALNNODE*));
+    if (pALN->apLFNs == NULL)
+      return FALSE;
+    pALN->nLFNAlloc = nAlloc;
+    pALN->nLFNs = 0;
+    IndexLFNs(pALN, pALN->pTree);
+    ASSERT(pALN->nLFNs == nLFNs);
+  }
+
+  if (pALN->nLFNs + nReserve > pALN->nLFNAlloc)
+  {
+    int nAlloc = pALN->nLFNs + nReserve;
+    ALNNODE** apIndex = (ALNNODE**)realloc(pALN->apLFNs, nAlloc * sizeof(ALNNODE*));
+    if (apIndex == NULL)
+      return FALSE;
+    pALN->apLFNs = apIndex;
+    pALN->nLFNAlloc = nAlloc;
+  }
+
+  return TRUE;
+}
+
+// frees the leaf index of an ALN
+void ALNAPI FreeLFNIndex(ALN* pALN)
+{
+  ASSERT(pALN != NULL);
+  if (pALN->apLFNs != NULL)
+    free(pALN->apLFNs);
+  pALN->apLFNs = NULL;
+  pALN->nLFNs = 0;
+  pALN->nLFNAlloc = 0;
+}
+
 // destroys an ALN
 //   ... returns 0 on failure, non-zero on success
 ALNIMP int ALNAPI ALNDestroyALN(ALN* pALN)
@@ -194,6 +261,9 @@ ALNIMP int ALNAPI ALNDestroyALN(ALN* pALN)
   if (pALN->pTree)
     DestroyTree(pALN->pTree);
 
+  // leaf index
+  FreeLFNIndex(pALN);
+
   // ALN
   free(pALN);
 
@@ -467,11 +537,29 @@ ALNIMP int ALNAPI ALNAddLFNs(ALN* pALN, ALNNODE* pParent,
     }
   }
 
+  // make room in the leaf index for the second child; if that fails the
+  // index is dropped and rebuilt when next needed
+  if (pALN->apLFNs != NULL && pALN->nLFNs == pALN->nLFNAlloc)
+  {
+    int nAlloc = 2 * pALN->nLFNAlloc;
+    ALNNODE** apIndex = (ALNNODE**)realloc(pALN->apLFNs, nAlloc * sizeof(ALNNODE*));
+    if (apIndex != NULL)
+    {
+      pALN->apLFNs = apIndex;
+      pALN->nLFNAlloc = nAlloc;
+    }
+    else
+    {
+      FreeLFNIndex(pALN);
+    }
+  }
+
   // pParent is unmodified at this point
   // no further memory allocations are required, so it is safe to convert
   // LFN to a minmax without any errors or exceptions
 
   ASSERT(NODE_ISLFN(pParent));
+  int nParentIndex = LFN_INDEX(pParent);
   
   // free existing vectors
   if (LFN_VARMAP(pParent)) free(LFN_VARMAP(pParent));
@@ -498,6 +586,19 @@ ALNIMP int ALNAPI ALNAddLFNs(ALN* pALN, ALNNODE* pParent,
   
   ASSERT(NODE_ISMINMAX(pParent) && MINMAX_TYPE(pParent) == nParentMinMaxType);
 
+  // the left child takes the place of the parent in the leaf index, the
+  // right child goes at the end
+  if (pALN->apLFNs != NULL)
+  {
+    ASSERT(nParentIndex >= 0 && nParentIndex < pALN->nLFNs);
+    ASSERT(pALN->apLFNs[nParentIndex] == pParent);
+    ASSERT(pALN->nLFNs < pALN->nLFNAlloc);
+    LFN_INDEX(apChildren[0]) = nParentIndex;
+    pALN->apLFNs[nParentIndex] = apChildren[0];
+    LFN_INDEX(apChildren[1]) = pALN->nLFNs;
+    pALN->apLFNs[pALN->nLFNs++] = apChildren[1];
+  }
+
   int nResult = ALN_NOERROR;
   
   if (nLFNs > 2)
@@ -635,7 +736,9 @@ ALNIMP int ALNAPI ALNAddMultiLayer(ALN* pALN, ALNNODE* pParent,
 
       if (nResult != ALN_NOERROR)
       {
-        // unsuccessful... destroy allocated children
+        // unsuccessful... destroy allocated children, and with them the
+        // leaf index
+        FreeLFNIndex(pALN);
         for (int j = 0; j < nFanin; j++)
         {
           pChild = apLFNs[j];
@@ -29,6 +29,7 @@
 #include <aln.h>
 #include "alnpriv.h"
 #include <errno.h>
+#include <stdlib.h>
 
 #ifdef _DEBUG
 #undef THIS_FILE
@@ -65,3 +66,137 @@ ALNIMP double ALNAPI ALNQuickEval(const ALN* pALN, const double* adblX,
 
   return dbl;
 }
+
+// hinted evaluation
+// the route is the path from the root to the hinted LFN; min/max nodes on
+// it evaluate the child on the route first, as AdaptEval does after
+// BuildCutoffRoute, but without writing MINMAX_EVAL into the tree; nodes
+// off the route evaluate as in ALNQuickEval
+
+// longest route kept on the stack
+#define HINTROUTELOCAL 64
+
+// pNode is apRoute[nDepth] and is not the last node of the route
+static double HintedEvalMinMax(const ALNNODE* pNode, const ALN* pALN,
+  const double* adblX, CEvalCutoff cutoff, ALNNODE* const* apRoute,
+  int nRoute, int nDepth, ALNNODE** ppActiveLFN)
+{
+  ASSERT(NODE_ISMINMAX(pNode));
+  ASSERT(apRoute[nDepth] == pNode && nDepth + 1 < nRoute);
+
+  // the child on the route goes first
+  const ALNNODE* pChild0 = apRoute[nDepth + 1];
+  const ALNNODE* pChild1;
+  if (pChild0 == MINMAX_LEFT(pNode))
+    pChild1 = MINMAX_RIGHT(pNode);
+  else
+    pChild1 = MINMAX_LEFT(pNode);
+
+  const ALNREGION& region = pALN->aRegions[NODE_REGION(pNode)];
+  double dblDist, dblRespActive;
+
+  // eval first child, following the route
+  ALNNODE* pActiveLFN0;
+  double dbl0;
+  if (nDepth + 2 < nRoute && NODE_ISMINMAX(pChild0))
+    dbl0 = HintedEvalMinMax(pChild0, pALN, adblX, cutoff, apRoute, nRoute,
+                            nDepth + 1, &pActiveLFN0);
+  else
+    dbl0 = CutoffEval(pChild0, pALN, adblX, cutoff, &pActiveLFN0);
+
+  // see if we can cutoff...
+  if (Cutoff(dbl0, pNode, cutoff, region.dbl4SE > 0.0 ? region.dbl4SE : 0.0))
+  {
+    *ppActiveLFN = pActiveLFN0;
+    return dbl0;
+  }
+
+  // eval second child
+  ALNNODE* pActiveLFN1;
+  double dbl1 = CutoffEval(pChild1, pALN, adblX, cutoff, &pActiveLFN1);
+
+  // calc active child and distance exactly as CutoffEvalMinMax does
+  if (region.dbl4SE > 0.0)
+  {
+    int nActive = CalcActiveChild(dblRespActive, dblDist, dbl0, dbl1, pNode,
+                                  region.dblSmoothEpsilon,
+                                  region.dbl4SE, region.dblOV16SE);
+    *ppActiveLFN = (nActive == 0) ? pActiveLFN0 : pActiveLFN1;
+  }
+  else if ((MINMAX_ISMAX(pNode) > 0) == (dbl1 > dbl0))
+  {
+    *ppActiveLFN = pActiveLFN1;
+    dblDist = dbl1;
+  }
+  else
+  {
+    *ppActiveLFN = pActiveLFN0;
+    dblDist = dbl0;
+  }
+
+  return dblDist;
+}
+
+ALNIMP double ALNAPI ALNQuickEvalHinted(const ALN* pALN, const double* adblX,
+                                        ALNEVALHINT* pHint)
+{
+  ASSERT(pALN);
+  ASSERT(adblX);
+  ASSERT(pHint);
+
+  ALNNODE* apLocal[HINTROUTELOCAL];
+  ALNNODE** apRoute = apLocal;
+  int nRoute = 0;
+
+  // route from the root to the hinted LFN, ignored if the LFN is not in
+  // this ALN
+  if (pHint->pLFN != NULL)
+  {
+    ALNNODE* pNode = pHint->pLFN;
+    while (NODE_PARENT(pNode) != NULL)
+    {
+      pNode = NODE_PARENT(pNode);
+      nRoute++;
+    }
+    nRoute++;
+    if (pNode != pALN->pTree)
+      nRoute = 0;
+    else if (nRoute > HINTROUTELOCAL)
+    {
+      apRoute = (ALNNODE**)malloc(nRoute * sizeof(ALNNODE*));
+      if (apRoute == NULL)
+      {
+        apRoute = apLocal;
+        nRoute = 0;
+      }
+    }
+
+    int i = nRoute;
+    for (pNode = pHint->pLFN; i > 0; pNode = NODE_PARENT(pNode))
+      apRoute[--i] = pNode;
+  }
+
+  ALNNODE* pActiveLFN;
+  double dbl;
+  if (nRoute > 1)
+    dbl = HintedEvalMinMax(pALN->pTree, pALN, adblX, CEvalCutoff(), apRoute,
+                           nRoute, 0, &pActiveLFN);
+  else
+    dbl = CutoffEval(pALN->pTree, pALN, adblX, CEvalCutoff(), &pActiveLFN);
+
+  if (apRoute != apLocal)
+    free(apRoute);
+
+#ifdef _DEBUG
+  ALNNODE* pLFNCheck = NULL;
+  double dblCheck = DebugEval(pALN->pTree, pALN, adblX, &pLFNCheck);
+  ASSERT(dbl == dblCheck && pLFNCheck == pActiveLFN);
+#endif
+
+  // as in ALNQuickEval, add in the output value to get the surface value
+  dbl += adblX[pALN->nOutput];
+  pHint->pLFN = pActiveLFN;
+  pHint->dblValue = dbl;
+
+  return dbl;
+}
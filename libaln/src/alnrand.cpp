@@ -57,6 +57,13 @@ ALNIMP void ALNAPI ALNSRand(unsigned int nSeed)
   g_nFastRandSeed = nSeed;
 }
 
+// current state of ALN internal pseudo-random number generator
+// passing it to ALNSRand continues the same sequence
+ALNIMP unsigned int ALNAPI ALNGetRandSeed()
+{
+  return (unsigned int)g_nFastRandSeed;
+}
+
 ALNIMP unsigned long ALNAPI ALNRand()
 {
 	return DoFastRand();
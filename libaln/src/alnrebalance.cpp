@@ -0,0 +1,343 @@
+// ALN Library
+// Copyright (C) 2018 William W. Armstrong.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// Version 3 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// For further information contact
+// William W. Armstrong
+// 3624 - 108 Street NW
+// Edmonton, Alberta, Canada  T6J 1B4
+
+// alnrebalance.cpp
+
+#ifdef ALNDLL
+#define ALNIMP __declspec(dllexport)
+#endif
+
+#include <aln.h>
+#include "alnpriv.h"
+
+#ifdef _DEBUG
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// Comments
+//   Repeated splitting of a leaf by SplitLFN produces long chains of minmax
+//   nodes of the same type, eg MAX(MAX(MAX(L0, L1), L2), L3).  MIN and MAX are
+//   associative and commutative, so any binary tree over the same operands
+//   computes the same function when there is no smoothing.
+//   A maximal connected group of minmax nodes of one type (a "group") with
+//   k operands always has exactly k - 1 internal nodes; we rebuild the group
+//   in place from those same nodes as a Huffman tree weighted by the
+//   responsibility counts of the operands.  Operands that win often end up
+//   near the top of the group, and the heavier child of each node is put on
+//   the left so it is evaluated first and can trigger a cutoff of its
+//   sibling.  LFNs are never moved, so pointers to them (eg in CCutoffInfo)
+//   stay valid.
+//   Huffman trees on very skewed counts are chains again, so each operand
+//   weight is mixed with the mean weight of the group: an operand then has
+//   at least a 1 / (2k) share and the group depth stays within about
+//   1.44 log2(2k), while frequent winners still end up near the top.
+//   Operands of a group are rebalanced first, and the new shape of a group
+//   is only taken if it is no deeper than the old one, counting the heights
+//   of the operands, and lowers the weighted depth; trees grown by SplitLFN
+//   are mostly balanced already and Huffman trees ignore operand heights.
+//   A group is rebuilt only if all its internal nodes belong to one region
+//   and that region has a zero smoothing epsilon: smoothed minmax nodes are
+//   not associative, and a reused internal node keeps its region index
+//   while covering a different set of operands.
+
+// group operand with its weight and original order for stable tie breaking
+struct CGroupEntry
+{
+  ALNNODE* pNode;
+  double dblWeight;
+  int nSeq;
+  int nHeight;        // height of the subtree below the operand
+  int nDepth;         // depth of the operand in the group
+};
+
+// a merge of the planned group: pNode gets children pLeft and pRight
+struct CGroupMerge
+{
+  ALNNODE* pNode;
+  ALNNODE* pLeft;
+  ALNNODE* pRight;
+};
+
+static int __cdecl CompareGroupEntry(const void* pv1, const void* pv2)
+{
+  const CGroupEntry* p1 = (const CGroupEntry*)pv1;
+  const CGroupEntry* p2 = (const CGroupEntry*)pv2;
+  if (p1->dblWeight < p2->dblWeight)
+    return -1;
+  if (p1->dblWeight > p2->dblWeight)
+    return 1;
+  return p1->nSeq - p2->nSeq;
+}
+
+// win frequency of a subtree: number of useful adapts passing through its root
+inline double GroupWeight(const ALNNODE* pNode)
+{
+  return (double)NODE_RESPCOUNT(pNode) + (double)NODE_RESPCOUNTLASTEPOCH(pNode);
+}
+
+// counts operands of the group rooted at pNode
+static int CountGroupOperands(const ALNNODE* pNode, int nType)
+{
+  if (NODE_ISMINMAX(pNode) && MINMAX_TYPE(pNode) == nType)
+  {
+    return CountGroupOperands(MINMAX_LEFT(pNode), nType) +
+           CountGroupOperands(MINMAX_RIGHT(pNode), nType);
+  }
+  return 1;
+}
+
+// collects operands, with their depth in the group, and internal nodes of
+// the group rooted at pNode
+static void CollectGroup(ALNNODE* pNode, int nType, int nDepth,
+                         CGroupEntry* aOperands, int& nOperands,
+                         ALNNODE** apInternal, int& nInternal)
+{
+  if (NODE_ISMINMAX(pNode) && MINMAX_TYPE(pNode) == nType)
+  {
+    apInternal[nInternal++] = pNode;
+    CollectGroup(MINMAX_LEFT(pNode), nType, nDepth + 1, aOperands, nOperands,
+                 apInternal, nInternal);
+    CollectGroup(MINMAX_RIGHT(pNode), nType, nDepth + 1, aOperands, nOperands,
+                 apInternal, nInternal);
+  }
+  else
+  {
+    CGroupEntry& entry = aOperands[nOperands];
+    entry.pNode = pNode;
+    entry.dblWeight = GroupWeight(pNode);
+    entry.nSeq = nOperands;
+    entry.nHeight = 0;
+    entry.nDepth = nDepth;
+    nOperands++;
+  }
+}
+
+// checks that the internal nodes of a group are in one unsmoothed region
+static BOOL IsGroupRebuildable(const ALN* pALN, ALNNODE* const* apInternal,
+                               int nInternal)
+{
+  int nRegion = NODE_REGION(apInternal[0]);
+  if (pALN->aRegions[nRegion].dblSmoothEpsilon != 0.0)
+    return FALSE;
+
+  for (int i = 1; i < nInternal; i++)
+  {
+    if (NODE_REGION(apInternal[i]) != nRegion)
+      return FALSE;
+  }
+  return TRUE;
+}
+
+// plans the Huffman tree of a group into aMerges, the last merge being the
+// root; returns the height of the planned group with its operands and sets
+// the weighted depth of its operands in dblCost
+static int PlanGroup(CGroupEntry* aOperands, int nOperands, CGroupEntry* aMerged,
+                     ALNNODE* pRoot, ALNNODE* const* apInternal,
+                     CGroupMerge* aMerges, double& dblCost)
+{
+  // two queue Huffman construction: operands sorted ascending, merged
+  // nodes are produced in non-decreasing weight order; the weight of a
+  // merged node is the sum of the weights below it, so the sum of the
+  // merged weights is the weighted depth of the operands
+  qsort(aOperands, nOperands, sizeof(CGroupEntry), CompareGroupEntry);
+
+  int nNextOperand = 0, nNextMerged = 0, nMerged = 0;
+  int nSeq = nOperands;
+  dblCost = 0;
+  for (int nMerge = 0; nMerge < nOperands - 1; nMerge++)
+  {
+    CGroupEntry aPair[2];
+    for (int i = 0; i < 2; i++)
+    {
+      if (nNextMerged >= nMerged || (nNextOperand < nOperands &&
+          CompareGroupEntry(&aOperands[nNextOperand],
+                            &aMerged[nNextMerged]) <= 0))
+      {
+        aPair[i] = aOperands[nNextOperand++];
+      }
+      else
+      {
+        aPair[i] = aMerged[nNextMerged++];
+      }
+    }
+
+    // the root is reused for the final merge so the group stays
+    // attached to its parent; heavier child on the left, it is
+    // evaluated first
+    CGroupMerge& merge = aMerges[nMerge];
+    merge.pNode = (nMerge == nOperands - 2) ? pRoot : apInternal[nMerge + 1];
+    merge.pLeft = aPair[1].pNode;
+    merge.pRight = aPair[0].pNode;
+
+    CGroupEntry& merged = aMerged[nMerged++];
+    merged.pNode = merge.pNode;
+    merged.dblWeight = aPair[0].dblWeight + aPair[1].dblWeight;
+    merged.nSeq = nSeq++;
+    merged.nHeight = 1 + ((aPair[0].nHeight > aPair[1].nHeight) ?
+                          aPair[0].nHeight : aPair[1].nHeight);
+    dblCost += merged.dblWeight;
+  }
+  ASSERT(nMerged == nOperands - 1 && aMerged[nMerged - 1].pNode == pRoot);
+  return aMerged[nMerged - 1].nHeight;
+}
+
+// relinks the group as planned
+static void BuildGroup(const CGroupMerge* aMerges, int nMerges)
+{
+  for (int i = 0; i < nMerges; i++)
+  {
+    ALNNODE* pNode = aMerges[i].pNode;
+    ALNNODE* pLeft = aMerges[i].pLeft;
+    ALNNODE* pRight = aMerges[i].pRight;
+    MINMAX_LEFT(pNode) = pLeft;
+    MINMAX_RIGHT(pNode) = pRight;
+    NODE_PARENT(pLeft) = pNode;
+    NODE_PARENT(pRight) = pNode;
+
+    // eval route and adapt state refer to the old shape
+    MINMAX_EVAL(pNode) = NULL;
+    MINMAX_ACTIVE(pNode) = NULL;
+    MINMAX_GOAL(pNode) = NULL;
+    NODE_FLAGS(pNode) &= ~NF_EVAL;
+
+    NODE_RESPCOUNT(pNode) = NODE_RESPCOUNT(pLeft) + NODE_RESPCOUNT(pRight);
+    NODE_RESPCOUNTLASTEPOCH(pNode) = NODE_RESPCOUNTLASTEPOCH(pLeft) +
+                                     NODE_RESPCOUNTLASTEPOCH(pRight);
+  }
+}
+
+// rebalances the operands of the group rooted at pRoot, then the group
+// itself; returns the height of the subtree
+static int RebalanceGroup(ALNNODE* pRoot, ALN* pALN)
+{
+  ASSERT(pRoot);
+  if (NODE_ISLFN(pRoot))
+    return 0;
+
+  ASSERT(NODE_ISMINMAX(pRoot));
+  int nType = MINMAX_TYPE(pRoot);
+  int nOperands = CountGroupOperands(pRoot, nType);
+  ASSERT(nOperands >= 2);
+
+  CGroupEntry* aOperands = NULL;
+  CGroupEntry* aMerged = NULL;
+  ALNNODE** apInternal = NULL;
+  CGroupMerge* aMerges = NULL;
+  int nHeight = 0;
+
+  try
+  {
+    aOperands = (CGroupEntry*)malloc(nOperands * sizeof(CGroupEntry));
+    aMerged = (CGroupEntry*)malloc((nOperands - 1) * sizeof(CGroupEntry));
+    apInternal = (ALNNODE**)malloc((nOperands - 1) * sizeof(ALNNODE*));
+    aMerges = (CGroupMerge*)malloc((nOperands - 1) * sizeof(CGroupMerge));
+    if (aOperands == NULL || aMerged == NULL || apInternal == NULL || aMerges == NULL)
+      ThrowALNMemoryException();
+
+    int nCollected = 0;
+    int nInternal = 0;
+    CollectGroup(pRoot, nType, 0, aOperands, nCollected, apInternal, nInternal);
+    ASSERT(nCollected == nOperands && nInternal == nOperands - 1);
+    ASSERT(apInternal[0] == pRoot);
+
+    // operands are either LFNs or roots of groups of the other type
+    double dblMean = 0;
+    for (int i = 0; i < nOperands; i++)
+    {
+      CGroupEntry& entry = aOperands[i];
+      entry.nHeight = RebalanceGroup(entry.pNode, pALN);
+      if (entry.nDepth + entry.nHeight > nHeight)
+        nHeight = entry.nDepth + entry.nHeight;
+      dblMean += entry.dblWeight;
+    }
+    dblMean /= nOperands;
+
+    // mixing in the mean weight bounds the depth of the group; the current
+    // shape gives the weighted depth to beat
+    double dblOldCost = 0;
+    for (int i = 0; i < nOperands; i++)
+    {
+      aOperands[i].dblWeight += dblMean;
+      dblOldCost += aOperands[i].dblWeight * aOperands[i].nDepth;
+    }
+
+    // the planned shape is taken if it is no deeper, operands included, and
+    // lowers the weighted depth; otherwise the group is left as it is
+    if (IsGroupRebuildable(pALN, apInternal, nInternal))
+    {
+      double dblNewCost;
+      int nNewHeight = PlanGroup(aOperands, nOperands, aMerged, pRoot, apInternal,
+                                 aMerges, dblNewCost);
+      if (nNewHeight <= nHeight && dblNewCost < dblOldCost)
+      {
+        BuildGroup(aMerges, nOperands - 1);
+        nHeight = nNewHeight;
+      }
+    }
+  }
+  catch (CALNException* e)
+  {
+    // tree is still consistent: groups are only relinked after allocation
+    free(aOperands);
+    free(aMerged);
+    free(apInternal);
+    free(aMerges);
+    throw e;
+  }
+
+  free(aOperands);
+  free(aMerged);
+  free(apInternal);
+  free(aMerges);
+  return nHeight;
+}
+
+// rebalancing of same-type minmax chains
+// the tree is restructured in place; the function computed by the ALN is
+// unchanged (unless there are exact ties between pieces, in which case the
+// reported active LFN may be a different one of the tied pieces)
+// returns ALN_* error code, (ALN_NOERROR on success)
+ALNIMP int ALNAPI ALNRebalance(ALN* pALN)
+{
+  if (pALN == NULL || pALN->pTree == NULL)
+    return ALN_GENERIC;
+
+  int nReturn = ALN_NOERROR;
+  try
+  {
+    RebalanceGroup(pALN->pTree, pALN);
+  }
+  catch (CALNMemoryException* e)
+  {
+    nReturn = ALN_OUTOFMEM;
+    e->Delete();
+  }
+  catch (CALNException* e)
+  {
+    nReturn = ALN_GENERIC;
+    e->Delete();
+  }
+
+  return nReturn;
+}
@@ -33,6 +33,7 @@
 #include <aln.h>
 #include "alnpriv.h"
 #include "alnpp.h"
+#include <limits.h>
 #include ".\cmyaln.h"
 
 #ifdef _DEBUG
@@ -85,6 +86,13 @@ void splitControl(ALN*, double); // This does a test to see if a piece fits well
 extern double dblLimit; // if > 0 pieces split when training MSE > dblLimit; if <= 0 an F test is used. 
 extern BOOL bALNgrowable; //If FALSE, no splitting happens, e.g. for linear regression.
 extern BOOL bStopTraining; // This causes training to stop when all leaf nodes have stopped splitting.
+extern double dblEpochConvergence; // if > 0, the epochs of a call end early once the estimated RMSE improves less than this fraction...
+extern double dblPieceConvergence; // ... and no active piece moved more than this fraction of the estimated RMSE in the last epoch.
+extern int nMinEpochs; // The epochs of a call never end early before this many epochs.
+
+// helpers for detecting that the active pieces have stabilised
+static void SnapshotLFNs(const ALN* pALN, double* pdblSnap);
+static double CalcLFNChange(const ALN* pALN, const double* pdblSnap);
 
 
 ALNIMP int ALNAPI ALNTrain(ALN* pALN,
@@ -133,12 +141,14 @@ static int ALNAPI DoTrainALN(ALN* pALN,
 
   int nReturn = ALN_NOERROR;		    // assume success
 	int nDim = pALN->nDim;
-  int nPoints = pDataInfo->nPoints;
+  long long nPoints = pDataInfo->nPoints;
   ALNNODE* pTree = pALN->pTree;	    
   double* adblX;                    // input vector
-	int* anShuffle = NULL;				    // point index shuffle array
+	int* anShuffle = NULL;				    // point index shuffle array...
+  long long* anShuffle64 = NULL;    // ... or this one past 2^31 points
   const double** apdblBase = NULL;  // data column base pointers
   CCutoffInfo* aCutoffInfo = NULL;  // eval cutoff speedup
+  double* adblSnapshot = NULL;      // LFN state at start of epoch
 
   TRAININFO traininfo;					    // training info
 	EPOCHINFO epochinfo;					    // epoch info
@@ -155,7 +165,7 @@ static int ALNAPI DoTrainALN(ALN* pALN,
 	traindata.pfnNotifyProc = pfnNotifyProc;
 
   // calc start and end points of training
-  long nStart, nEnd;
+  long long nStart, nEnd;
   CalcDataEndPoints(nStart, nEnd, pALN, pDataInfo);
 
 	try	// main processing block
@@ -169,23 +179,45 @@ static int ALNAPI DoTrainALN(ALN* pALN,
 		// allocate column base vector
 		apdblBase = AllocColumnBase(nStart, pALN, pDataInfo);
 
-		// allocate and init shuffle array
-		anShuffle = new int[nEnd - nStart + 1];
-		if (!anShuffle) ThrowALNMemoryException();
-		for (int i = nStart; i <= nEnd; i++)
-			anShuffle[i - nStart] = i - nStart;
+		// allocate and init shuffle array, 32-bit when the indexes fit
+		if (nEnd - nStart < INT_MAX)
+		{
+			anShuffle = new int[nEnd - nStart + 1];
+			if (!anShuffle) ThrowALNMemoryException();
+			for (long long i = nStart; i <= nEnd; i++)
+				anShuffle[i - nStart] = (int)(i - nStart);
+		}
+		else
+		{
+			anShuffle64 = new long long[nEnd - nStart + 1];
+			if (!anShuffle64) ThrowALNMemoryException();
+			for (long long i = nStart; i <= nEnd; i++)
+				anShuffle64[i - nStart] = i - nStart;
+		}
 
 		// allocate and init cutoff info array
 		// pLFN will contain a pointer to the active LFN of a piece
 		// when the input is on that piece.  It will speed up cutoffs in evaluation.
 		aCutoffInfo = new CCutoffInfo[nEnd - nStart + 1];
 		if (!aCutoffInfo) ThrowALNMemoryException();
-		for (int i = nStart; i <= nEnd; i++)
+		for (long long i = nStart; i <= nEnd; i++)
 			aCutoffInfo[i - nStart].pLFN = NULL;
-		// count total number of LFNs in ALN
+		// count total number of LFNs in ALN; the leaf index built here
+		// serves the passes over the LFNs below
+		if (!BuildLFNIndex(pALN)) ThrowALNMemoryException();
 		int nLFNs = 0;
     int nAdaptedLFNs = 0;
-    CountLFNs(pALN->pTree, nLFNs, nAdaptedLFNs);
+    CountLFNs(pALN, nLFNs, nAdaptedLFNs);
+
+		// the tree only grows after the last epoch, so one snapshot buffer
+		// serves all epochs of this call
+		BOOL bCheckConvergence = (dblEpochConvergence > 0 && nMaxEpochs > nMinEpochs);
+		if (bCheckConvergence)
+		{
+			adblSnapshot = new double[nLFNs * (nDim + 2)];
+			if (!adblSnapshot) ThrowALNMemoryException();
+		}
+		double dblLastEstRMSErr = 0.0;
 
 		// init callback info 
 		traininfo.nEpochs = nMaxEpochs;
@@ -227,14 +259,25 @@ static int ALNAPI DoTrainALN(ALN* pALN,
 			double dblSqErrorSum = 0;
 
 			// We prepare a random reordering of the training data for the next epoch
-			Shuffle(nStart, nEnd, anShuffle);
+			if (anShuffle != NULL)
+				Shuffle(nStart, nEnd, anShuffle);
+			else
+				Shuffle(nStart, nEnd, anShuffle64);
 
-			long nPoint; // The number of training samples may be huge.
+			// remember where the pieces are so we can tell how far they move
+			if (bCheckConvergence)
+			{
+				ASSERT(pALN->nLFNs == nLFNs);
+				SnapshotLFNs(pALN, adblSnapshot);
+			}
+
+			long long nPoint; // The number of training samples may be huge.
 				// this does all the samples in an epoch in a randomized order.
 
 			for (nPoint = nStart; nPoint <= nEnd; nPoint++)
 			{
-				int nTrainPoint = anShuffle[nPoint - nStart]; //a sample is picked for training
+				long long nTrainPoint = (anShuffle != NULL) ? anShuffle[nPoint - nStart] :
+					anShuffle64[nPoint - nStart]; //a sample is picked for training
 				ASSERT((nTrainPoint + nStart) <= nEnd);
 
 				// fill input vector
@@ -287,20 +330,31 @@ static int ALNAPI DoTrainALN(ALN* pALN,
 			// estimate RMS error on training set for this epoch
 			epochinfo.dblEstRMSErr = sqrt(dblSqErrorSum / nPoints);
 
+			// End this call's epochs early when the error has levelled off and
+			// none of the pieces trained in this epoch is still moving.
+			BOOL bLastEpoch = (nEpoch == (nMaxEpochs - 1));
+			if (bCheckConvergence && !bLastEpoch && nEpoch + 1 >= nMinEpochs &&
+				  dblLastEstRMSErr - epochinfo.dblEstRMSErr < dblEpochConvergence * dblLastEstRMSErr)
+			{
+				double dblMaxChange = CalcLFNChange(pALN, adblSnapshot);
+				bLastEpoch = (dblMaxChange <= dblPieceConvergence * epochinfo.dblEstRMSErr);
+			}
+			dblLastEstRMSErr = epochinfo.dblEstRMSErr;
+
 			// calc true RMS if estimate below min, or if last epoch, or every 10 epochs when jittering
-			if (epochinfo.dblEstRMSErr <= dblMinRMSErr || nEpoch == (nMaxEpochs - 1))
+			if (epochinfo.dblEstRMSErr <= dblMinRMSErr || bLastEpoch)
 			{
         epochinfo.dblEstRMSErr = DoCalcRMSError(pALN, pDataInfo, pCallbackInfo);
 			}
 
       // notify end of epoch
       nLFNs = nAdaptedLFNs = 0;
-      CountLFNs(pALN->pTree, nLFNs, nAdaptedLFNs);
+      CountLFNs(pALN, nLFNs, nAdaptedLFNs);
 			epochinfo.nLFNs = nLFNs;
       epochinfo.nActiveLFNs = nAdaptedLFNs;
 
       // update train info, too
-      traininfo.nEpochs = nEpoch;
+      traininfo.nEpochs = nEpoch + 1;
 		  traininfo.nLFNs = epochinfo.nLFNs;
       traininfo.nActiveLFNs = epochinfo.nActiveLFNs;
       traininfo.dblRMSErr = epochinfo.dblEstRMSErr;	// used to terminate epoch loop
@@ -312,10 +366,11 @@ static int ALNAPI DoTrainALN(ALN* pALN,
 			}
 
 			// Split candidate LFNs after the last epoch in this call to ALNTrain.
-			if (nEpoch == (nMaxEpochs - 1))
+			if (bLastEpoch)
 			{
 				bStopTraining = TRUE;  // this is set to FALSE by any leaf node needing further training
 				splitControl(pALN, dblLimit);  // This leads to leaf nodes splitting
+				break;
 			}
 		} // end epoch loop
 
@@ -351,12 +406,61 @@ static int ALNAPI DoTrainALN(ALN* pALN,
 	// deallocate mem
   delete[] adblX;
 	delete[] anShuffle;
+	delete[] anShuffle64;
   delete[] aCutoffInfo;
+  delete[] adblSnapshot;
   FreeColumnBase(apdblBase);
 
 	return nReturn;
 }
 
+// copies the response count, output centroid and weights of every LFN
+// (nDim + 2 values per LFN, in leaf index order) to pdblSnap
+static void SnapshotLFNs(const ALN* pALN, double* pdblSnap)
+{
+	ASSERT(pALN->apLFNs != NULL);
+	int nDim = pALN->nDim;
+	for (int i = 0; i < pALN->nLFNs; i++)
+	{
+		const ALNNODE* pNode = pALN->apLFNs[i];
+		ASSERT(NODE_ISLFN(pNode));
+		*pdblSnap++ = NODE_RESPCOUNT(pNode);
+		*pdblSnap++ = LFN_C(pNode)[pALN->nOutput];
+		memcpy(pdblSnap, LFN_W(pNode) + 1, nDim * sizeof(double));
+		pdblSnap += nDim;
+	}
+}
+
+// returns the largest movement since the snapshot of any piece that was
+// trained in between; the movement of a piece is the shift of its output
+// centroid plus the change of each weight times the spread of its inputs
+static double CalcLFNChange(const ALN* pALN, const double* pdblSnap)
+{
+	ASSERT(pALN->apLFNs != NULL);
+	int nDim = pALN->nDim;
+	int nOutput = pALN->nOutput;
+	double dblMaxChange = 0.0;
+	for (int i = 0; i < pALN->nLFNs; i++, pdblSnap += nDim + 2)
+	{
+		const ALNNODE* pNode = pALN->apLFNs[i];
+		ASSERT(NODE_ISLFN(pNode));
+		if (LFN_CANSPLIT(pNode) && NODE_RESPCOUNT(pNode) != pdblSnap[0])
+		{
+			const double* adblW = LFN_W(pNode) + 1;
+			const double* adblD = LFN_D(pNode);
+			double dblChange = fabs(LFN_C(pNode)[nOutput] - pdblSnap[1]);
+			for (int k = 0; k < nDim; k++)
+			{
+				if (k != nOutput)
+					dblChange += fabs(adblW[k] - pdblSnap[2 + k]) * sqrt(adblD[k]);
+			}
+			if (dblChange > dblMaxChange)
+				dblMaxChange = dblChange;
+		}
+	}
+	return dblMaxChange;
+}
+
 // validate ALNTRAININFO struct
 static int ALNAPI ValidateALNTrainInfo(const ALN* pALN,
                                        const ALNDATAINFO* pDataInfo,
@@ -0,0 +1,280 @@
+// ALN Library
+// Copyright (C) 2018 William W. Armstrong.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// Version 3 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// For further information contact
+// William W. Armstrong
+// 3624 - 108 Street NW
+// Edmonton, Alberta, Canada  T6J 1B4
+
+// alnwriteasc.cpp
+
+#ifdef ALNDLL
+#define ALNIMP __declspec(dllexport)
+#endif
+
+#include <aln.h>
+#include "alnpriv.h"
+#include <errno.h>
+#include <float.h>
+#include <time.h>
+
+#ifdef _DEBUG
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+// ALN export as C source
+// each min/max node becomes a static function that evaluates its children
+// in the order CutoffEvalMinMax does (MINMAX_EVAL first if set), with the
+// same cutoffs and smoothing, so results are those of ALNQuickEval; LFNs
+// are written inline as constants times inputs
+
+// writes a double so that it reads back exactly
+static void WriteCDouble(FILE* pFile, double dbl)
+{
+  if (dbl != dbl)
+    fputs("(0.0 / 0.0)", pFile);
+  else if (dbl > DBL_MAX)
+    fputs("HUGE_VAL", pFile);
+  else if (dbl < -DBL_MAX)
+    fputs("(-HUGE_VAL)", pFile);
+  else if (dbl < 0)
+    fprintf(pFile, "(%.17g)", dbl);
+  else
+    fprintf(pFile, "%.17g", dbl);
+}
+
+// writes the evaluation of child pChild into dN and nN; nId is the LFN
+// number of an LFN child or the function number of a min/max child
+static int WriteCChild(FILE* pFile, const ALN* pALN, const ALNNODE* pChild,
+                       int nId, const char* pszFunction, int nN)
+{
+  if (NODE_ISLFN(pChild))
+  {
+    // as CutoffEvalLFN
+    if (LFN_VARMAP(pChild) != NULL || LFN_VDIM(pChild) != pALN->nDim)
+      return ALN_GENERIC;
+
+    const double* adblW = LFN_W(pChild);
+    fprintf(pFile, "  d%d = ", nN);
+    WriteCDouble(pFile, adblW[0]);
+    for (int i = 0; i < pALN->nDim; i++)
+    {
+      fputs(" + ", pFile);
+      WriteCDouble(pFile, adblW[i + 1]);
+      fprintf(pFile, " * x[%d]", i);
+    }
+    fprintf(pFile, ";\n  n%d = %d;\n", nN, nId);
+  }
+  else
+  {
+    fprintf(pFile, "  d%d = %s_n%d(x, c, &n%d);\n", nN, pszFunction, nId, nN);
+  }
+
+  return ALN_NOERROR;
+}
+
+// writes the functions of the min/max nodes below and including pNode in
+// postorder; places in *pnId the LFN number of an LFN, numbered left to
+// right, or the function number of a min/max node
+static int WriteCNode(FILE* pFile, const ALN* pALN, const ALNNODE* pNode,
+                      const char* pszFunction, int* pnLFNs, int* pnNodes,
+                      int* pnId)
+{
+  if (NODE_ISLFN(pNode))
+  {
+    *pnId = (*pnLFNs)++;
+    return ALN_NOERROR;
+  }
+
+  if (!NODE_ISMINMAX(pNode))
+    return ALN_GENERIC;
+
+  int nLeft, nRight, nErr;
+  if ((nErr = WriteCNode(pFile, pALN, MINMAX_LEFT(pNode), pszFunction,
+                         pnLFNs, pnNodes, &nLeft)) != ALN_NOERROR ||
+      (nErr = WriteCNode(pFile, pALN, MINMAX_RIGHT(pNode), pszFunction,
+                         pnLFNs, pnNodes, &nRight)) != ALN_NOERROR)
+  {
+    return nErr;
+  }
+
+  // child order as in CutoffEvalMinMax
+  const ALNNODE* pChild0 = MINMAX_LEFT(pNode);
+  const ALNNODE* pChild1 = MINMAX_RIGHT(pNode);
+  int nId0 = nLeft, nId1 = nRight;
+  if (MINMAX_EVAL(pNode) == MINMAX_RIGHT(pNode))
+  {
+    pChild0 = MINMAX_RIGHT(pNode);
+    pChild1 = MINMAX_LEFT(pNode);
+    nId0 = nRight;
+    nId1 = nLeft;
+  }
+
+  const ALNREGION& region = pALN->aRegions[NODE_REGION(pNode)];
+  BOOL bMax = MINMAX_ISMAX(pNode) ? TRUE : FALSE;
+  BOOL bSmooth = region.dbl4SE > 0.0;
+
+  *pnId = (*pnNodes)++;
+  fprintf(pFile, "/* %s node %d */\n", bMax ? "MAX" : "MIN", *pnId);
+  fprintf(pFile, "static double %s_n%d(const double* x, struct %s_cutoff c, "
+                 "int* pnLFN)\n{\n", pszFunction, *pnId, pszFunction);
+  fprintf(pFile, bSmooth ? "  double d0, d1, dd;\n" : "  double d0, d1;\n");
+  fprintf(pFile, "  int n0, n1;\n\n");
+
+  if ((nErr = WriteCChild(pFile, pALN, pChild0, nId0, pszFunction, 0))
+      != ALN_NOERROR)
+  {
+    return nErr;
+  }
+  fprintf(pFile, "  if (%s_cut%s(d0, &c))\n"
+                 "  {\n    *pnLFN = n0;\n    return d0;\n  }\n",
+          pszFunction, bMax ? "max" : "min");
+  if ((nErr = WriteCChild(pFile, pALN, pChild1, nId1, pszFunction, 1))
+      != ALN_NOERROR)
+  {
+    return nErr;
+  }
+
+  if (bSmooth)
+  {
+    // as CalcActiveChild
+    fprintf(pFile, "  if (d1 %c d0 %c ", bMax ? '>' : '<', bMax ? '+' : '-');
+    WriteCDouble(pFile, region.dbl4SE);
+    fprintf(pFile, ")\n  {\n    *pnLFN = n1;\n    return d1;\n  }\n");
+    fprintf(pFile, "  if (d1 %c d0 %c ", bMax ? '>' : '<', bMax ? '-' : '+');
+    WriteCDouble(pFile, region.dbl4SE);
+    fprintf(pFile, ")\n  {\n    dd = d1 - d0;\n"
+                   "    *pnLFN = d1 %c d0 ? n1 : n0;\n"
+                   "    return 0.5 * (d1 + d0) %c ",
+            bMax ? '>' : '<', bMax ? '+' : '-');
+    WriteCDouble(pFile, region.dblOV16SE);
+    fprintf(pFile, " * dd * dd %c ", bMax ? '+' : '-');
+    WriteCDouble(pFile, region.dblSmoothEpsilon);
+    fprintf(pFile, ";\n  }\n  *pnLFN = n0;\n  return d0;\n}\n\n");
+  }
+  else if (bMax)
+  {
+    fprintf(pFile, "  if (d1 > d0)\n  {\n    *pnLFN = n1;\n    return d1;\n  }\n"
+                   "  *pnLFN = n0;\n  return d0;\n}\n\n");
+  }
+  else
+  {
+    fprintf(pFile, "  if (d1 > d0)\n  {\n    *pnLFN = n0;\n    return d0;\n  }\n"
+                   "  *pnLFN = n1;\n  return d1;\n}\n\n");
+  }
+
+  return ferror(pFile) ? ALN_ERRFILE : ALN_NOERROR;
+}
+
+// cutoff state and tests, as CEvalCutoff and Cutoff
+static void WriteCCutoff(FILE* pFile, const char* pszFunction)
+{
+  fprintf(pFile,
+    "struct %s_cutoff\n{\n  int bMin, bMax;\n  double dblMin, dblMax;\n};\n\n",
+    pszFunction);
+  fprintf(pFile,
+    "static int %s_cutmax(double dbl, struct %s_cutoff* pc)\n{\n"
+    "  if (pc->bMin && dbl >= pc->dblMin)\n    return 1;\n"
+    "  if (!pc->bMax || dbl > pc->dblMax)\n  {\n"
+    "    pc->bMax = 1;\n    pc->dblMax = dbl;\n  }\n  return 0;\n}\n\n",
+    pszFunction, pszFunction);
+  fprintf(pFile,
+    "static int %s_cutmin(double dbl, struct %s_cutoff* pc)\n{\n"
+    "  if (pc->bMax && dbl <= pc->dblMax)\n    return 1;\n"
+    "  if (!pc->bMin || dbl < pc->dblMin)\n  {\n"
+    "    pc->bMin = 1;\n    pc->dblMin = dbl;\n  }\n  return 0;\n}\n\n",
+    pszFunction, pszFunction);
+}
+
+static int DoALNWriteAsC(FILE* pFile, const ALN* pALN,
+                         const char* pszFileName, const char* pszFunction)
+{
+  time_t tNow = time(NULL);
+  char szTime[64];
+  if (strftime(szTime, sizeof(szTime), "%c", localtime(&tNow)) == 0)
+    szTime[0] = '\0';
+
+  fprintf(pFile,
+    "/* %s generated by ALNWriteAsC on %s\n\n"
+    "   double %s(const double* x, int* pnLFN);\n\n"
+    "   evaluates the ALN at x, which holds %d variables, output %d,\n"
+    "   and places the number of the active LFN, counting from 0 left to\n"
+    "   right, in *pnLFN if it is not NULL.  Results equal ALNQuickEval's\n"
+    "   when floating point contraction is off (/fp:precise,\n"
+    "   -ffp-contract=off).\n*/\n\n"
+    "#include <stddef.h>\n#include <math.h>\n\n",
+    pszFileName, szTime, pszFunction, pALN->nDim, pALN->nOutput);
+
+  int nLFNs = 0, nNodes = 0, nRoot, nErr;
+  if (NODE_ISMINMAX(pALN->pTree))
+    WriteCCutoff(pFile, pszFunction);
+  if ((nErr = WriteCNode(pFile, pALN, pALN->pTree, pszFunction, &nLFNs,
+                         &nNodes, &nRoot)) != ALN_NOERROR)
+  {
+    return nErr;
+  }
+
+  // as ALNQuickEval, add in the output value
+  fprintf(pFile, "double %s(const double* x, int* pnLFN)\n{\n", pszFunction);
+  if (NODE_ISMINMAX(pALN->pTree))
+    fprintf(pFile, "  struct %s_cutoff c = { 0, 0, 0, 0 };\n", pszFunction);
+  fprintf(pFile, "  double d0;\n  int n0;\n\n");
+  if ((nErr = WriteCChild(pFile, pALN, pALN->pTree, nRoot, pszFunction, 0))
+      != ALN_NOERROR)
+  {
+    return nErr;
+  }
+  fprintf(pFile, "  if (pnLFN != NULL)\n    *pnLFN = n0;\n"
+                 "  return x[%d] + d0;\n}\n", pALN->nOutput);
+
+  return ferror(pFile) ? ALN_ERRFILE : ALN_NOERROR;
+}
+
+// writes pALN as a self contained C source file defining pszFunction
+// (ALNEvalC if NULL), which evaluates as ALNQuickEval with constant weights
+// returns ALN_* error code, (ALN_NOERROR on success)
+ALNIMP int ALNAPI ALNWriteAsC(const ALN* pALN, const char* pszFileName,
+                              const char* pszFunction)
+{
+  // parameter variance
+  if (pALN == NULL || pALN->pTree == NULL)
+    return ALN_GENERIC;
+
+  if (pszFileName == NULL)
+    return ALN_GENERIC;
+
+  if (pszFunction == NULL)
+    pszFunction = "ALNEvalC";
+
+  FILE* pFile;
+  if (fopen_s(&pFile, pszFileName, "w") != 0)
+    return ALN_ERRFILE;
+
+  int nRet = DoALNWriteAsC(pFile, pALN, pszFileName, pszFunction);
+
+  fclose(pFile);  // will not reset errno
+
+  if (nRet != ALN_NOERROR)
+  {
+    int nErr = errno;     // save it
+    remove(pszFileName);
+    errno = nErr;
+  }
+
+  return nRet;
+}
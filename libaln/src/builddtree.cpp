@@ -29,6 +29,9 @@
 
 #include <aln.h>
 #include "alnpriv.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #ifdef _DEBUG
 #undef THIS_FILE
@@ -46,11 +49,16 @@ MINMAXNODE* ALNAPI CopyALN(const ALNNODE* pNode, const ALN* pALN,
 
 // pSrc points to a dtree with only one node and one block
 // *ppDest will contain the new, optimized, dtree 
+// adblSamples, if not NULL, holds nSamples input vectors guiding the splits,
+// and nBlockBudget, if > 0, limits the blocks they make
 // return DTE_* error code, DTE_NOERR on success
-int ALNAPI SplitDtree(DTREE** ppDest, DTREE* pSrc, int nMaxDepth);
+int ALNAPI SplitDtree(DTREE** ppDest, DTREE* pSrc, int nMaxDepth,
+                      const double* adblSamples, int nSamples, int nBlockBudget);
 
 // building the dtree from an ALN
-DTREE* ALNAPI BuildDtree(const ALN* pALN, int nMaxDepth)
+DTREE* ALNAPI BuildDtree(const ALN* pALN, int nMaxDepth,
+                         const double* adblSamples /*= NULL*/, int nSamples /*= 0*/,
+                         int nBlockBudget /*= 0*/)
 {
   ASSERT(pALN);
   ASSERT(pALN->pTree);
@@ -137,7 +145,8 @@ DTREE* ALNAPI BuildDtree(const ALN* pALN, int nMaxDepth)
 	if(nMaxDepth > 1)
 	{
 		// this does a lot of work
-		dtree_errno = SplitDtree(&pDest, pSrc, nMaxDepth);
+		dtree_errno = SplitDtree(&pDest, pSrc, nMaxDepth, 
+                             adblSamples, nSamples, nBlockBudget);
 		if (dtree_errno != DTR_NOERROR) 
 		{
 			DestroyDtree(pDest);
@@ -326,18 +335,127 @@ MINMAXNODE* ALNAPI CopyALN(const ALNNODE* pNode, const ALN* pALN,
 #define BOUNDSOVERLAP        0
 #define CHILDBELOWBESTBOUND -1
 
+// random stream of one DTREE node: the samples drawn while splitting a node
+// depend only on the seed of the build and the position of the node, so
+// subtrees give the same result whether they are split in order or in parallel
+typedef unsigned long long SPLITRAND;
+
+// a subtree left by the top level run at nTaskDepth, split by one task
+typedef struct tagSPLITTASK
+{
+  int nNode;                      // leaf of the top level run
+  int nDepth;                     // its depth
+  unsigned long nPath;            // its position, 1 at the root, 2p and 2p+1 below p
+  double* adblMin;                // bounds of its box
+  double* adblMax;
+} SPLITTASK;
+
+// state of one splitting run; a task splits its subtree into arrays of
+// its own, which grow as needed and are relocated into serial order later
+typedef struct tagSPLITRUN
+{
+  DTREENODE* aNodes;
+  int nNodes;
+  int nNodeAlloc;
+  BLOCK* aBlocks;
+  int nBlocks;
+  int nBlockAlloc;
+  MINMAXNODE** apSplitTree;       // in parallel runs, the tree of each node
+                                  //   that split, to cut at nMaxNodes later
+  // scratch
+  double* adblMin;
+  double* adblMax;
+  double* adblX;
+  double* adblRespMin;
+  double* adblRespMax;
+  char* aRespLF;
+  double* adblWBound;
+  double dblBiasBound;
+  double dblHalfWidth;
+  BOOL bSmaller;
+  // shared by all runs
+  LINEARFORM* aLF;
+  int nLF;
+  int nDim;
+  int nOutput;
+  int nMaxDepth;
+  int nMaxNodes;
+  int* aNewIndex;                 // NULL in tasks
+  int* pnCount;
+  SPLITRAND nSeed;
+  // top level run only
+  int nTaskDepth;                 // subtrees at this depth are left to tasks
+  SPLITTASK* aTasks;
+  int nTasks;
+} SPLITRUN;
+
+// the top level run splits to a depth giving this many tasks per thread
+#define SPLITTASKSPERTHREAD  8
+#define SPLITMAXTASKDEPTH    10
+
+// a leaf waiting to be split by ProfileSplit
+typedef struct tagPROFILELEAF
+{
+  int nNode;
+  int nDepth;
+  unsigned long nPath;
+  int nFirst;                     // its samples are anSample[nFirst] on
+  int nCount;
+  double dblVolume;               // fraction of the input box it covers
+  int nVarIndex;                  // its split, -1 if none
+  double dblT;
+  double dblGain;                 // expected saving per query of the split
+  double* adblMin;                // its box
+  double* adblMax;
+} PROFILELEAF;
+
+// cost of visiting a DTREE node when profiling, in multiply-adds; a linear
+// piece costs nDim
+#define PROFILENODECOST  2.0
+// thresholds tried per variable when profiling
+#define PROFILEGRID      16
+
 // splitting helper prototypes 
-int Split(int nNode, int nMaxNodes, DTREENODE* aNodes, int* pnNodes, 
-          BLOCK* aBlocks, int* pnBlocks, LINEARFORM* aLF, int nLF, 
-          double* adblMin, double* adblMax, double* adblX,
-          double* adblRespMin, double* adblRespMax, char* aRespLF,
-          double& dblBiasBound, double* adblWBound, double& dblHalfWidth,
-          int nDim, int nOutput, int nDepth, int nMaxDepth,  int* aNewIndex,
-          int* pnCount, BOOL &bSmaller);
+int Split(SPLITRUN* pRun, int nNode, int nDepth, unsigned long nPath);
+
+int InitSplitRun(SPLITRUN* pRun, int nNodeAlloc, int nBlockAlloc, BOOL bParallel);
+
+int InitSplitScratch(SPLITRUN* pRun);
+
+void FreeSplitScratch(SPLITRUN* pRun);
+
+void FreeSplitRun(SPLITRUN* pRun);
+
+int GrowSplitRun(SPLITRUN* pRun);
+
+int SplitTasks(SPLITRUN* pRun);
+
+void RelocateSplit(SPLITRUN* pSrc, int nSrc, const int* anTask, SPLITRUN* aTaskRuns,
+                   SPLITRUN* pDest, int nDest, int nBlock, int nParent);
+
+int ProfileSplit(SPLITRUN* pRun, const double* adblSamples, int nSamples, 
+                 int nMaxBlocks);
+
+void ProfileLeaf(SPLITRUN* pRun, PROFILELEAF* pLeaf, const double* adblSamples, 
+                 const int* anSample, int nSamples);
+
+void ProfileBestSplit(SPLITRUN* pRun, PROFILELEAF* pLeaf, int nLines,
+                      const double* adblSamples, const int* anSample, int nSamples,
+                      SPLITRAND* pnRand);
+
+int PushProfileLeaf(PROFILELEAF** paLeaves, int* pnLeaves, int* pnLeafAlloc, 
+                    PROFILELEAF* pLeaf);
+
+void PopProfileLeaf(PROFILELEAF* aLeaves, int* pnLeaves, PROFILELEAF* pLeaf);
+
+SPLITRAND SplitRandSeed(SPLITRAND nSeed, unsigned long nPath);
+
+float SplitRandFloat(SPLITRAND* pnRand);
 
 void FindBestSplit(int* pnVarIndex, double* pdblT, double* adblMin, 
                    double* adblMax, double* adblRespMin, double* adblRespMax,
-                   char* aRespLF, int nLF, int nDim, int nOutput, int nLines);
+                   char* aRespLF, int nLF, int nDim, int nOutput, int nLines,
+                   SPLITRAND* pnRand);
 
 void FindBestT(int nVarIndex, double* pdblT, double* adblMin, double* adblMax, 
                double* adblRespMin, double* adblRespMax, char* aRespLF, 
@@ -347,7 +465,7 @@ void FindBestT(int nVarIndex, double* pdblT, double* adblMin, double* adblMax,
 void SetResp(MINMAXNODE* pMMN, LINEARFORM* aLF, int nLF, double* adblMin, 
              double* adblMax, double* adblX, double* adblRespMin, 
              double* adblRespMax, char* aRespLF, int nDim, int nOutput, 
-             int nLines);
+             int nLines, SPLITRAND* pnRand);
 
 void CountLeftRightResp(double dblT, int* pnLeft, int* pnRight, char* aRespLF, 
                         double* adblRespMin, double* adblRespMax, 
@@ -378,7 +496,8 @@ int aboveORbelow(double* adblMin, double* adblMax,
                  int nDim, int nOutput, int nMinMaxType);
 
 static
-int ALNAPI SplitDtree(DTREE** ppDest, DTREE* pSrc, int nMaxDepth)
+int ALNAPI SplitDtree(DTREE** ppDest, DTREE* pSrc, int nMaxDepth,
+                      const double* adblSamples, int nSamples, int nBlockBudget)
 {
   // This is the main routine for creating an optimized, multilevel DTREE.
   // pSrc points to a source DTREE with only one block and one DTREE node.
@@ -394,18 +513,11 @@ int ALNAPI SplitDtree(DTREE** ppDest, DTREE* pSrc, int nMaxDepth)
   int nNodes;
   int nMaxNodes;
   int nErr;
-  BOOL bSmaller;
+  int nTaskDepth;
   BLOCK* aBlocks = NULL;
   DTREENODE* aNodes = NULL;
-  double* adblMin = NULL;
-  double* adblMax = NULL;
-  char* aRespLF = NULL;
-  double* adblRespMin = NULL;
-  double* adblRespMax = NULL;
-  double* adblX = NULL;
-  double dblBiasBound = 0;
-  double dblHalfWidth = 0;
-  double* adblWBound = NULL;
+  double* adblTaskBounds = NULL;
+  SPLITRUN run;
   // is the nMaxDepth of the DTREE to be created within bounds?
   if (nMaxDepth < DTREE_MINDEPTH || nMaxDepth > DTREE_MAXDEPTH)
     return DTR_GENERIC;
@@ -501,12 +613,6 @@ int ALNAPI SplitDtree(DTREE** ppDest, DTREE* pSrc, int nMaxDepth)
 	// However, since the splitting of the input space goes to depths that
 	// vary with the complexity of the function on a block being split,
 	// this balanced tree model is poor.  
-  aBlocks = CreateBlockArray(nMaxBlocks);
-  if (aBlocks == NULL)
-  {
-    DestroyDtree(*ppDest);
-    return DTR_MALLOCFAILED;
-  }
   
   // DTREE nodes -- the number of DTREE nodes is limited by the number of blocks.
 	// Here is the reasoning: we allow nMaxBlocks from splitting the original
@@ -517,116 +623,140 @@ int ALNAPI SplitDtree(DTREE** ppDest, DTREE* pSrc, int nMaxDepth)
 	// Since we don't know how many times optimization will split blocks, we have
 	// to allocate the maximum number of blocks at the start of splitting.
 	nMaxNodes = 2* nMaxBlocks - 1; 
-  aNodes = CreateDtreeNodeArray(nMaxNodes);
-  if (aNodes == NULL)
-  {        
-    DestroyBlockArray(aBlocks, nMaxBlocks);
-    DestroyDtree(*ppDest);
-    return DTR_MALLOCFAILED;
+
+  // shared state of the splitting runs
+  run.aLF = (*ppDest)->aLinearForms;
+  run.nLF = (*ppDest)->nLinearForms;
+  run.nDim = nDim;
+  run.nOutput = nOutput;
+  run.nMaxDepth = nMaxDepth;
+  run.nMaxNodes = nMaxNodes;
+  run.aNewIndex = aNewIndex;
+  run.pnCount = &nNewLFCount;
+  run.aTasks = NULL;
+  run.nTasks = 0;
+  // two draws from the ALN random number generator seed the streams of all nodes
+  run.nSeed = ((SPLITRAND)ALNRand() << 32) ^ (SPLITRAND)ALNRand();
+
+  // With several threads the top levels are split first and the subtrees
+  // below nTaskDepth are split in parallel, one task each.  A depth past
+  // nMaxDepth means a serial run.
+  // Profile guided splitting is best first, so it splits one leaf at a time
+  // and ProfileSplit profiles the two children of each split in parallel.
+  nTaskDepth = nMaxDepth + 1;
+#ifdef _OPENMP
+  if (adblSamples == NULL)
+  {
+    int nThreads = omp_get_max_threads();
+    if (nThreads > 1)
+    {
+      int nDepth = 1;
+      while ((1 << nDepth) < SPLITTASKSPERTHREAD * nThreads && nDepth < SPLITMAXTASKDEPTH)
+        nDepth++;
+      if (nDepth <= nMaxDepth - 3)
+        nTaskDepth = nDepth;
+    }
   }
-  
-  // 1st minmax tree
-  nBlocks = 1;
-  aBlocks[0].pMinMaxTree = CopyMinMaxNode(pSrc->aBlocks[0].pMinMaxTree);
-  if (aBlocks[0].pMinMaxTree == NULL)
-  {             
-    DestroyDtreeNodeArray(aNodes);
-    DestroyBlockArray(aBlocks, nMaxBlocks);
-    DestroyDtree(*ppDest);
-    return DTR_MALLOCFAILED;
+#endif
+
+  if (nTaskDepth <= nMaxDepth)
+  {
+    // the top level run has at most one task per leaf at nTaskDepth
+    int nTaskAlloc = 1 << nTaskDepth;
+    run.nTaskDepth = nTaskDepth;
+    nErr = InitSplitRun(&run, 2 * nTaskAlloc - 1, nTaskAlloc, TRUE);
+    if (nErr == DTR_NOERROR)
+    {
+      run.aTasks = (SPLITTASK*)malloc(nTaskAlloc * sizeof(SPLITTASK));
+      adblTaskBounds = (double*)malloc(2 * nTaskAlloc * nDim * sizeof(double));
+      if (run.aTasks == NULL || adblTaskBounds == NULL)
+        nErr = DTR_MALLOCFAILED;
+      else
+      {
+        for (i = 0; i < nTaskAlloc; i++)
+        {
+          run.aTasks[i].adblMin = adblTaskBounds + 2 * i * nDim;
+          run.aTasks[i].adblMax = adblTaskBounds + (2 * i + 1) * nDim;
+        }
+      }
+    }
+  }
+  else
+  {
+    run.nTaskDepth = -1;
+    if (adblSamples != NULL && nBlockBudget > 0 && nBlockBudget < nMaxBlocks)
+    {
+      // the budget bounds the work of a deep profile guided build
+      nMaxBlocks = nBlockBudget;
+      nMaxNodes = 2 * nMaxBlocks - 1;
+      run.nMaxNodes = nMaxNodes;
+    }
+    nErr = InitSplitRun(&run, nMaxNodes, nMaxBlocks, FALSE);
   }
-  aBlocks[0].nDtreeIndex = 0;
-                  
-  // 1st node                  
-  nNodes = 1;
-  aNodes[0].nLeaf = 1;
-  DNODE_BLOCKINDEX(aNodes + 0) = 0;
-  
-  // variable bounds
-  adblMin = (double*)malloc(nDim * sizeof(double));
-  adblMax = (double*)malloc(nDim * sizeof(double));
-  // responsibilty flag map
-  aRespLF = (char*)malloc(MAPBYTECOUNT(pSrc->nLinearForms));
-  // responsibility bounds    
-  adblRespMin = (double*)malloc(pSrc->nLinearForms * nDim * sizeof(double));
-  adblRespMax = (double*)malloc(pSrc->nLinearForms * nDim * sizeof(double));
-  // input vector
-  adblX = (double*)malloc(nDim * sizeof(double));
 
-  // variables and array for storage of bounds in the form of linear functions
-  adblWBound = (double*) malloc(nDim * sizeof(double));
-  // The centroid used for all linear function bounds is the average of the current max and min
-  // bounds of the block in each axis.  This is done to reduce the effect of numerical errors.
-  // There are two types of bounds used for the values in a box.  The max and the min on the box
-  // are the simplest to evaluate.  Two parallel hyperplanes bounding the function values are
-  // also used.  They are defined by giving the bias and weights of a linear function,
-  // and a "half width" which is an offset to be added to the above linear function to
-  // get an upper bound, or subtracted from the linear function to get a lower bound.
-  
-  if (adblMin == NULL || adblMax == NULL || aRespLF == NULL ||
-      adblRespMin == NULL || adblRespMax == NULL || adblX == NULL|| adblWBound == NULL)
-  {
-    if (adblMin != NULL) free(adblMin);
-    if (adblMax != NULL) free(adblMax);
-    if (aRespLF != NULL) free(aRespLF);
-    if (adblRespMin != NULL) free(adblRespMin);
-    if (adblRespMax != NULL) free(adblRespMax);
-    if (adblX != NULL) free(adblX);
-    if (adblWBound != NULL) free(adblWBound);
-    DestroyDtreeNodeArray(aNodes);
-    DestroyBlockArray(aBlocks, nMaxBlocks);
-    DestroyDtree(*ppDest);
-    return DTR_MALLOCFAILED;
+  // 1st minmax tree
+  if (nErr == DTR_NOERROR)
+  {
+    run.nBlocks = 1;
+    run.aBlocks[0].pMinMaxTree = CopyMinMaxNode(pSrc->aBlocks[0].pMinMaxTree);
+    if (run.aBlocks[0].pMinMaxTree == NULL)
+      nErr = DTR_MALLOCFAILED;
+    run.aBlocks[0].nDtreeIndex = 0;
   }
-  
-  // set var bounds
-  for (i = 0; i < nDim; i++)
+
+  if (nErr == DTR_NOERROR)
   {
-    adblMin[i] = pSrc->aVarDefs[i].bound.dblMin;
-    adblMax[i] = pSrc->aVarDefs[i].bound.dblMax;
-  } 
+    // 1st node                  
+    run.nNodes = 1;
+    run.aNodes[0].nLeaf = 1;
+    DNODE_BLOCKINDEX(run.aNodes + 0) = 0;
   
-  // split at node 0
-	// note that this gives us the new indexing of linear forms in
-	// aNewIndex and the count nNewLFCount of the linear forms needed after
-	// optimization
-  if ((nErr = Split(0, nMaxNodes, aNodes, &nNodes, aBlocks, &nBlocks, 
-                    (*ppDest)->aLinearForms, (*ppDest)->nLinearForms,
-                    adblMin, adblMax, adblX, 
-                    adblRespMin, adblRespMax, aRespLF,
-                    dblBiasBound, adblWBound, dblHalfWidth,
-                    nDim, pSrc->nOutputIndex, 0, nMaxDepth, aNewIndex,
-                    &nNewLFCount, bSmaller)) != DTR_NOERROR)
+    // set var bounds
+    for (i = 0; i < nDim; i++)
+    {
+      run.adblMin[i] = pSrc->aVarDefs[i].bound.dblMin;
+      run.adblMax[i] = pSrc->aVarDefs[i].bound.dblMax;
+    } 
+  
+    // split at node 0
+	  // note that this gives us the new indexing of linear forms in
+	  // aNewIndex and the count nNewLFCount of the linear forms needed after
+	  // optimization
+    if (adblSamples != NULL)
+      nErr = ProfileSplit(&run, adblSamples, nSamples, nMaxBlocks);
+    else
+    {
+      nErr = Split(&run, 0, 0, 1);
+      if (nErr == DTR_NOERROR && run.nTasks > 0)
+        nErr = SplitTasks(&run);
+    }
+  }
+  free(run.aTasks);
+  free(adblTaskBounds);
+
+  if (nErr != DTR_NOERROR)
   {
     // case where DTREE formation failed
-    free(adblMin);
-    free(adblMax);
-    free(aRespLF);
-    free(adblRespMin);
-    free(adblRespMax);
-    free(adblX);
-    free(adblWBound);
     free(aNewIndex);
-    DestroyDtreeNodeArray(aNodes);
-    DestroyBlockArray(aBlocks, nMaxBlocks);
+    FreeSplitRun(&run);
     DestroyDtree(*ppDest);
     return DTR_MALLOCFAILED;
   }
+
   // success! clean up some arrays
-  free(adblMin);
-  free(adblMax);
-  free(aRespLF);
-  free(adblRespMin);
-  free(adblRespMax);
-  free(adblX);
-  free(adblWBound);
+  FreeSplitScratch(&run);
+  nBlocks = run.nBlocks;
+  nNodes = run.nNodes;
+  aBlocks = run.aBlocks;
+  aNodes = run.aNodes;
+  nMaxBlocks = run.nBlockAlloc;
 	ASSERT(nNodes == 2 * nBlocks - 1);
     // allocate new space for actual number of blocks
   (*ppDest)->aBlocks = CreateBlockArray(nBlocks);
   if ((*ppDest)->aBlocks == NULL)
   {
     DestroyDtreeNodeArray(aNodes);
-    DestroyBlockArray(aBlocks, nBlocks);
+    DestroyBlockArray(aBlocks, nMaxBlocks);
     DestroyDtree(*ppDest);
     return DTR_MALLOCFAILED;
   }
@@ -695,13 +825,7 @@ int ALNAPI SplitDtree(DTREE** ppDest, DTREE* pSrc, int nMaxDepth)
 // splitting routines
 
 static 
-int Split(int nNode, int nMaxNodes, DTREENODE* aNodes, int* pnNodes, 
-          BLOCK* aBlocks, int* pnBlocks,
-          LINEARFORM* aLF, int nLF, 
-          double* adblMin, double* adblMax, double* adblX,
-          double* adblRespMin, double* adblRespMax, char* aRespLF,
-          double& dblBiasBound, double* adblWBound, double& dblHalfWidth,
-          int nDim, int nOutput, int nDepth, int nMaxDepth, int* aNewIndex, int* pnCount, BOOL &bSmaller)
+int Split(SPLITRUN* pRun, int nNode, int nDepth, unsigned long nPath)
 {                      
   double dblMin;
   double dblMax;
@@ -709,101 +833,132 @@ int Split(int nNode, int nMaxNodes, DTREENODE* aNodes, int* pnNodes,
   int nLines;
   int nBlockIndex;
   int nVarIndex;
+  int nLeft;
+  int nRight;
   // int nReduce;
   int nErr;
+  double* adblMin = pRun->adblMin;
+  double* adblMax = pRun->adblMax;
+  int nOutput = pRun->nOutput;
+  SPLITRAND nRand;
   
-  if (nDepth == nMaxDepth)
+  if (nDepth == pRun->nMaxDepth)
     return DTR_NOERROR;
+
+  if (nDepth == pRun->nTaskDepth)
+  {
+    // leave this subtree to a task
+    SPLITTASK* pTask = pRun->aTasks + pRun->nTasks;
+    pTask->nNode = nNode;
+    pTask->nDepth = nDepth;
+    pTask->nPath = nPath;
+    memcpy(pTask->adblMin, adblMin, pRun->nDim * sizeof(double));
+    memcpy(pTask->adblMax, adblMax, pRun->nDim * sizeof(double));
+    pRun->nTasks++;
+    return DTR_NOERROR;
+  }
   
-  nBlockIndex = DNODE_BLOCKINDEX((aNodes + nNode)); // cache block index
+  nBlockIndex = DNODE_BLOCKINDEX((pRun->aNodes + nNode)); // cache block index
   
   adblMax[nOutput] = 1e38;
   adblMin[nOutput] = -1e38;
   // optimize tree                     
   do
   {
-    bSmaller = FALSE;
-    MinMaxNodeBoundCylinder(aBlocks[nBlockIndex].pMinMaxTree, aLF, 
+    pRun->bSmaller = FALSE;
+    MinMaxNodeBoundCylinder(pRun->aBlocks[nBlockIndex].pMinMaxTree, pRun->aLF, 
                             adblMin, adblMax,
-                            dblBiasBound, adblWBound, dblHalfWidth,
-                            nDim, nOutput, bSmaller);
-    Amalgamate(aBlocks[nBlockIndex].pMinMaxTree, aLF, 
-                             nDim, nOutput, bSmaller);
-  } while(bSmaller == TRUE); // keep doing it if the tree gets smaller
-
-  MapNewLinearForms(aBlocks[nBlockIndex].pMinMaxTree, pnCount, aNewIndex);
-  if (*pnNodes >= nMaxNodes) // should actually never be greater
+                            pRun->dblBiasBound, pRun->adblWBound, pRun->dblHalfWidth,
+                            pRun->nDim, nOutput, pRun->bSmaller);
+    Amalgamate(pRun->aBlocks[nBlockIndex].pMinMaxTree, pRun->aLF, 
+                             pRun->nDim, nOutput, pRun->bSmaller);
+  } while(pRun->bSmaller == TRUE); // keep doing it if the tree gets smaller
+
+  // tasks have no aNewIndex: their trees are prunings of the root's tree,
+  // whose linear forms were all mapped by the top level run
+  if (pRun->aNewIndex != NULL)
+    MapNewLinearForms(pRun->aBlocks[nBlockIndex].pMinMaxTree, pRun->pnCount, pRun->aNewIndex);
+  if (pRun->nNodes >= pRun->nMaxNodes) // should actually never be greater
   {
     return DTR_NOERROR;                 
     // stop splitting; maximum number of nodes reached
   }
   nLines = 0;
-  CountMinMaxTreeLines(aBlocks[nBlockIndex].pMinMaxTree, nLines);
-  if (nLines <= nDim)
+  CountMinMaxTreeLines(pRun->aBlocks[nBlockIndex].pMinMaxTree, nLines);
+  if (nLines <= pRun->nDim)
   {
     return DTR_NOERROR;                 
     // stop splitting; block has no more than nDim linear pieces
   }
                         
   // set responsibility
-  SetResp(aBlocks[nBlockIndex].pMinMaxTree,
-          aLF, nLF, adblMin, adblMax, adblX, adblRespMin, adblRespMax,
-          aRespLF, nDim, nOutput, nLines);
+  nRand = SplitRandSeed(pRun->nSeed, nPath);
+  SetResp(pRun->aBlocks[nBlockIndex].pMinMaxTree,
+          pRun->aLF, pRun->nLF, adblMin, adblMax, pRun->adblX, 
+          pRun->adblRespMin, pRun->adblRespMax,
+          pRun->aRespLF, pRun->nDim, nOutput, nLines, &nRand);
   
   // find best split variable and threshold
-  FindBestSplit(&nVarIndex, &dblT, adblMin, adblMax, adblRespMin, adblRespMax, aRespLF,
-  nLF, nDim, nOutput, nLines);
+  FindBestSplit(&nVarIndex, &dblT, adblMin, adblMax, pRun->adblRespMin, 
+                pRun->adblRespMax, pRun->aRespLF,
+                pRun->nLF, pRun->nDim, nOutput, nLines, &nRand);
   if (nVarIndex == -1) 
   {
     // no good split found
     return DTR_NOERROR;               // could call for  a better split sampling
   }
+  // make room for the children
+  if (pRun->nNodes + 2 > pRun->nNodeAlloc || pRun->nBlocks + 1 > pRun->nBlockAlloc)
+  {
+    if ((nErr = GrowSplitRun(pRun)) != DTR_NOERROR)
+      return nErr;
+  }
   // we split further
+  DTREENODE* aNodes = pRun->aNodes;
+  BLOCK* aBlocks = pRun->aBlocks;
+  nLeft = pRun->nNodes;
+  nRight = pRun->nNodes + 1;
   dblMin = adblMin[nVarIndex];
   dblMax = adblMax[nVarIndex];
   aNodes[nNode].nLeaf = 0;
   DNODE_VARINDEX(aNodes + nNode) = nVarIndex;
   DNODE_THRESHOLD(aNodes + nNode) = dblT;
-  DNODE_LEFTINDEX(aNodes + nNode) = *pnNodes;
-  DNODE_RIGHTINDEX(aNodes + nNode) = *pnNodes + 1;
+  DNODE_LEFTINDEX(aNodes + nNode) = nLeft;
+  DNODE_RIGHTINDEX(aNodes + nNode) = nRight;
   // left child
-  aNodes[*pnNodes].nLeaf = 1;
-  aNodes[*pnNodes].nParentIndex = nNode;
-  DNODE_BLOCKINDEX(aNodes + *pnNodes) = nBlockIndex;     // left child keeps same min max tree
-  aBlocks[nBlockIndex].nDtreeIndex = *pnNodes;
+  aNodes[nLeft].nLeaf = 1;
+  aNodes[nLeft].nParentIndex = nNode;
+  DNODE_BLOCKINDEX(aNodes + nLeft) = nBlockIndex;     // left child keeps same min max tree
+  aBlocks[nBlockIndex].nDtreeIndex = nLeft;
   // right child
-  aNodes[*pnNodes + 1].nLeaf = 1;              
-  aNodes[*pnNodes + 1].nParentIndex = nNode;
-  DNODE_BLOCKINDEX(aNodes + *pnNodes + 1) = *pnBlocks;
-  aBlocks[*pnBlocks].nDtreeIndex = *pnNodes + 1;
-  aBlocks[*pnBlocks].pMinMaxTree = CopyMinMaxNode(aBlocks[nBlockIndex].pMinMaxTree); 
-  if (aBlocks[*pnBlocks].pMinMaxTree == NULL)
+  aNodes[nRight].nLeaf = 1;              
+  aNodes[nRight].nParentIndex = nNode;
+  DNODE_BLOCKINDEX(aNodes + nRight) = pRun->nBlocks;
+  aBlocks[pRun->nBlocks].nDtreeIndex = nRight;
+  aBlocks[pRun->nBlocks].pMinMaxTree = CopyMinMaxNode(aBlocks[nBlockIndex].pMinMaxTree); 
+  if (aBlocks[pRun->nBlocks].pMinMaxTree == NULL)
     return DTR_MALLOCFAILED;
+  if (pRun->apSplitTree != NULL)
+  {
+    // keep the tree in case this node ends up a leaf when relocated
+    if ((pRun->apSplitTree[nNode] = CopyMinMaxNode(aBlocks[nBlockIndex].pMinMaxTree)) == NULL)
+      return DTR_MALLOCFAILED;
+  }
 
   // inc number of blocks and nodes  
-  *pnBlocks += 1;
-  *pnNodes += 2;
+  pRun->nBlocks += 1;
+  pRun->nNodes += 2;
   
   // split left child
   adblMax[nVarIndex] = dblT;   // decrease max
-  nErr = Split(DNODE_LEFTINDEX(aNodes + nNode), nMaxNodes, aNodes, pnNodes,
-               aBlocks, pnBlocks, aLF, nLF,
-               adblMin, adblMax, adblX, 
-               adblRespMin, adblRespMax, aRespLF,
-               dblBiasBound, adblWBound, dblHalfWidth,
-               nDim, nOutput, nDepth + 1, nMaxDepth, aNewIndex, pnCount, bSmaller);
+  nErr = Split(pRun, nLeft, nDepth + 1, 2 * nPath);
   adblMax[nVarIndex] = dblMax; // restore max                               
   if (nErr != DTR_NOERROR)
     return nErr;
   
   // split right child 
   adblMin[nVarIndex] = dblT;   // increase min
-  nErr = Split(DNODE_RIGHTINDEX(aNodes + nNode), nMaxNodes, aNodes, pnNodes,
-               aBlocks, pnBlocks, aLF, nLF,
-               adblMin, adblMax, adblX, 
-               adblRespMin, adblRespMax, aRespLF,
-               dblBiasBound, adblWBound, dblHalfWidth,
-               nDim, nOutput, nDepth + 1, nMaxDepth, aNewIndex, pnCount, bSmaller);
+  nErr = Split(pRun, nRight, nDepth + 1, 2 * nPath + 1);
   adblMin[nVarIndex] = dblMin; // restore min                              
   if (nErr != DTR_NOERROR)
     return nErr;
@@ -811,12 +966,723 @@ int Split(int nNode, int nMaxNodes, DTREENODE* aNodes, int* pnNodes,
   return DTR_NOERROR;
 }
 
+static
+int InitSplitRun(SPLITRUN* pRun, int nNodeAlloc, int nBlockAlloc, BOOL bParallel)
+{
+  // allocates the node and block arrays and the scratch of a run;
+  // the shared members must already be set
+  pRun->nNodes = 0;
+  pRun->nBlocks = 0;
+  pRun->nNodeAlloc = nNodeAlloc;
+  pRun->nBlockAlloc = nBlockAlloc;
+  pRun->apSplitTree = NULL;
+  pRun->aNodes = CreateDtreeNodeArray(nNodeAlloc);
+  pRun->aBlocks = CreateBlockArray(nBlockAlloc);
+  if (bParallel)
+    pRun->apSplitTree = (MINMAXNODE**)calloc(nNodeAlloc, sizeof(MINMAXNODE*));
+  if (InitSplitScratch(pRun) != DTR_NOERROR ||
+      pRun->aNodes == NULL || pRun->aBlocks == NULL || 
+      (bParallel && pRun->apSplitTree == NULL))
+  {
+    FreeSplitRun(pRun);
+    return DTR_MALLOCFAILED;
+  }
+  return DTR_NOERROR;
+}
+
+static
+int InitSplitScratch(SPLITRUN* pRun)
+{
+  // allocates the scratch of a run
+  int nDim = pRun->nDim;
+  pRun->dblBiasBound = 0;
+  pRun->dblHalfWidth = 0;
+  pRun->bSmaller = FALSE;
+  // variable bounds
+  pRun->adblMin = (double*)malloc(nDim * sizeof(double));
+  pRun->adblMax = (double*)malloc(nDim * sizeof(double));
+  // responsibilty flag map
+  pRun->aRespLF = (char*)malloc(MAPBYTECOUNT(pRun->nLF));
+  // responsibility bounds    
+  pRun->adblRespMin = (double*)malloc(pRun->nLF * nDim * sizeof(double));
+  pRun->adblRespMax = (double*)malloc(pRun->nLF * nDim * sizeof(double));
+  // input vector
+  pRun->adblX = (double*)malloc(nDim * sizeof(double));
+
+  // variables and array for storage of bounds in the form of linear functions
+  pRun->adblWBound = (double*) malloc(nDim * sizeof(double));
+  // The centroid used for all linear function bounds is the average of the current max and min
+  // bounds of the block in each axis.  This is done to reduce the effect of numerical errors.
+  // There are two types of bounds used for the values in a box.  The max and the min on the box
+  // are the simplest to evaluate.  Two parallel hyperplanes bounding the function values are
+  // also used.  They are defined by giving the bias and weights of a linear function,
+  // and a "half width" which is an offset to be added to the above linear function to
+  // get an upper bound, or subtracted from the linear function to get a lower bound.
+  
+  if (pRun->adblMin == NULL || pRun->adblMax == NULL || pRun->aRespLF == NULL ||
+      pRun->adblRespMin == NULL || pRun->adblRespMax == NULL || 
+      pRun->adblX == NULL|| pRun->adblWBound == NULL)
+  {
+    FreeSplitScratch(pRun);
+    return DTR_MALLOCFAILED;
+  }
+  return DTR_NOERROR;
+}
+
+static
+void FreeSplitScratch(SPLITRUN* pRun)
+{
+  free(pRun->adblMin);
+  free(pRun->adblMax);
+  free(pRun->aRespLF);
+  free(pRun->adblRespMin);
+  free(pRun->adblRespMax);
+  free(pRun->adblX);
+  free(pRun->adblWBound);
+  pRun->adblMin = pRun->adblMax = pRun->adblRespMin = pRun->adblRespMax = NULL;
+  pRun->adblX = pRun->adblWBound = NULL;
+  pRun->aRespLF = NULL;
+}
+
+static
+void FreeSplitRun(SPLITRUN* pRun)
+{
+  int i;
+  FreeSplitScratch(pRun);
+  if (pRun->apSplitTree != NULL)
+  {
+    for (i = 0; i < pRun->nNodeAlloc; i++)
+      DestroyMinMaxNode(pRun->apSplitTree[i]);
+    free(pRun->apSplitTree);
+    pRun->apSplitTree = NULL;
+  }
+  DestroyDtreeNodeArray(pRun->aNodes);
+  DestroyBlockArray(pRun->aBlocks, pRun->nBlockAlloc);
+  pRun->aNodes = NULL;
+  pRun->aBlocks = NULL;
+  pRun->nNodes = pRun->nNodeAlloc = 0;
+  pRun->nBlocks = pRun->nBlockAlloc = 0;
+}
+
+static
+int GrowSplitRun(SPLITRUN* pRun)
+{
+  // doubles the node and block arrays of a task; the top level
+  // run is allocated for the largest tree it can build
+  int nNodeAlloc = 2 * pRun->nNodeAlloc + 1;
+  int nBlockAlloc = 2 * pRun->nBlockAlloc;
+  DTREENODE* aNodes;
+  BLOCK* aBlocks;
+  MINMAXNODE** apSplitTree;
+  if (pRun->apSplitTree != NULL)
+  {
+    if ((apSplitTree = (MINMAXNODE**)realloc(pRun->apSplitTree, 
+                                             nNodeAlloc * sizeof(MINMAXNODE*))) == NULL)
+      return DTR_MALLOCFAILED;
+    memset(apSplitTree + pRun->nNodeAlloc, 0, 
+           (nNodeAlloc - pRun->nNodeAlloc) * sizeof(MINMAXNODE*));
+    pRun->apSplitTree = apSplitTree;
+  }
+  if ((aNodes = (DTREENODE*)realloc(pRun->aNodes, nNodeAlloc * sizeof(DTREENODE))) == NULL)
+    return DTR_MALLOCFAILED;
+  memset(aNodes + pRun->nNodeAlloc, 0, (nNodeAlloc - pRun->nNodeAlloc) * sizeof(DTREENODE));
+  pRun->aNodes = aNodes;
+  pRun->nNodeAlloc = nNodeAlloc;
+  if ((aBlocks = (BLOCK*)realloc(pRun->aBlocks, nBlockAlloc * sizeof(BLOCK))) == NULL)
+    return DTR_MALLOCFAILED;
+  memset(aBlocks + pRun->nBlockAlloc, 0, (nBlockAlloc - pRun->nBlockAlloc) * sizeof(BLOCK));
+  pRun->aBlocks = aBlocks;
+  pRun->nBlockAlloc = nBlockAlloc;
+  return DTR_NOERROR;
+}
+
+static
+int SplitTasks(SPLITRUN* pRun)
+{
+  // Splits the subtrees the top level run left at nTaskDepth, one task per
+  // subtree, then relocates the results into new arrays numbered exactly as
+  // a serial run numbers them: when a node splits its children take the next
+  // two node indexes, the left child keeps the block and the right child
+  // takes the next block, then the left subtree is numbered before the right.
+  // A serial run stops splitting once nMaxNodes are used, which depends on the
+  // order of splitting, so the relocation makes a leaf of any node reached
+  // after that point, using the tree the node kept when it split.
+  int i;
+  int nErr = DTR_NOERROR;
+  int nNodes;
+  int* anTask = NULL;
+  SPLITRUN dest;
+  SPLITRUN* aTaskRuns = (SPLITRUN*)calloc(pRun->nTasks, sizeof(SPLITRUN));
+  if (aTaskRuns == NULL)
+    return DTR_MALLOCFAILED;
+
+  // tasks share everything but the arrays and scratch
+  for (i = 0; i < pRun->nTasks; i++)
+  {
+    SPLITRUN* pTaskRun = aTaskRuns + i;
+    *pTaskRun = *pRun;
+    pTaskRun->aNewIndex = NULL;
+    pTaskRun->pnCount = NULL;
+    pTaskRun->nTaskDepth = -1;
+    pTaskRun->aTasks = NULL;
+    pTaskRun->nTasks = 0;
+    pTaskRun->aNodes = NULL;
+    pTaskRun->aBlocks = NULL;
+    pTaskRun->apSplitTree = NULL;
+    pTaskRun->nNodeAlloc = pTaskRun->nBlockAlloc = 0;
+    pTaskRun->adblMin = pTaskRun->adblMax = pTaskRun->adblRespMin = NULL;
+    pTaskRun->adblRespMax = pTaskRun->adblX = pTaskRun->adblWBound = NULL;
+    pTaskRun->aRespLF = NULL;
+  }
+
+  #pragma omp parallel for schedule(dynamic)
+  for (i = 0; i < pRun->nTasks; i++)
+  {
+    SPLITTASK* pTask = pRun->aTasks + i;
+    SPLITRUN* pTaskRun = aTaskRuns + i;
+    int nTaskErr = InitSplitRun(pTaskRun, 15, 8, TRUE);
+    if (nTaskErr == DTR_NOERROR)
+    {
+      // the task's block 0 takes the min/max tree of its leaf
+      BLOCK* pBlock = pRun->aBlocks + DNODE_BLOCKINDEX(pRun->aNodes + pTask->nNode);
+      pTaskRun->aBlocks[0].pMinMaxTree = pBlock->pMinMaxTree;
+      pBlock->pMinMaxTree = NULL;
+      pTaskRun->nBlocks = 1;
+      pTaskRun->nNodes = 1;
+      pTaskRun->aNodes[0].nLeaf = 1;
+      DNODE_BLOCKINDEX(pTaskRun->aNodes + 0) = 0;
+      memcpy(pTaskRun->adblMin, pTask->adblMin, pRun->nDim * sizeof(double));
+      memcpy(pTaskRun->adblMax, pTask->adblMax, pRun->nDim * sizeof(double));
+      nTaskErr = Split(pTaskRun, 0, pTask->nDepth, pTask->nPath);
+      FreeSplitScratch(pTaskRun);
+    }
+    if (nTaskErr != DTR_NOERROR)
+    {
+      #pragma omp critical
+      nErr = nTaskErr;
+    }
+  }
+
+  if (nErr == DTR_NOERROR)
+  {
+    // size of the whole tree, at most nMaxNodes
+    nNodes = pRun->nNodes;
+    for (i = 0; i < pRun->nTasks; i++)
+      nNodes += aTaskRuns[i].nNodes - 1;
+    if (nNodes > pRun->nMaxNodes)
+      nNodes = pRun->nMaxNodes;
+    dest.nMaxNodes = pRun->nMaxNodes;
+    dest.nNodeAlloc = nNodes;
+    dest.nBlockAlloc = (nNodes + 1) / 2;
+    dest.aNodes = CreateDtreeNodeArray(dest.nNodeAlloc);
+    dest.aBlocks = CreateBlockArray(dest.nBlockAlloc);
+    anTask = (int*)malloc(pRun->nNodes * sizeof(int));
+    if (dest.aNodes == NULL || dest.aBlocks == NULL || anTask == NULL)
+    {
+      DestroyDtreeNodeArray(dest.aNodes);
+      DestroyBlockArray(dest.aBlocks, dest.nBlockAlloc);
+      nErr = DTR_MALLOCFAILED;
+    }
+    else
+    {
+      for (i = 0; i < pRun->nNodes; i++)
+        anTask[i] = -1;
+      for (i = 0; i < pRun->nTasks; i++)
+        anTask[pRun->aTasks[i].nNode] = i;
+
+      // the root keeps block 0
+      dest.nNodes = 1;
+      dest.nBlocks = 1;
+      RelocateSplit(pRun, 0, anTask, aTaskRuns, &dest, 0, 0, 
+                    pRun->aNodes[0].nParentIndex);
+      ASSERT(dest.nNodes == 2 * dest.nBlocks - 1 && dest.nNodes <= nNodes);
+
+      // the top level run takes the relocated arrays
+      FreeSplitRun(pRun);
+      pRun->aNodes = dest.aNodes;
+      pRun->nNodes = dest.nNodes;
+      pRun->nNodeAlloc = dest.nNodeAlloc;
+      pRun->aBlocks = dest.aBlocks;
+      pRun->nBlocks = dest.nBlocks;
+      pRun->nBlockAlloc = dest.nBlockAlloc;
+    }
+    free(anTask);
+  }
+
+  for (i = 0; i < pRun->nTasks; i++)
+    FreeSplitRun(aTaskRuns + i);
+  free(aTaskRuns);
+  return nErr;
+}
+
+static
+void RelocateSplit(SPLITRUN* pSrc, int nSrc, const int* anTask, SPLITRUN* aTaskRuns,
+                   SPLITRUN* pDest, int nDest, int nBlock, int nParent)
+{
+  // moves node nSrc of pSrc and its subtree to node nDest and block nBlock
+  // of pDest, allocating the children's indexes in serial order
+  DTREENODE* pSrcNode = pSrc->aNodes + nSrc;
+  DTREENODE* pDestNode = pDest->aNodes + nDest;
+  MINMAXNODE** ppTree;
+  int nLeft;
+  int nRight;
+  int nRightBlock;
+  if (pSrcNode->nLeaf && anTask != NULL && anTask[nSrc] >= 0)
+  {
+    // the rest of this subtree was split by a task
+    RelocateSplit(aTaskRuns + anTask[nSrc], 0, NULL, NULL, 
+                  pDest, nDest, nBlock, nParent);
+    return;
+  }
+  pDestNode->nParentIndex = nParent;
+  if (pSrcNode->nLeaf || pDest->nNodes >= pDest->nMaxNodes)
+  {
+    // a leaf, or a serial run would have stopped splitting here
+    if (pSrcNode->nLeaf)
+      ppTree = &pSrc->aBlocks[DNODE_BLOCKINDEX(pSrcNode)].pMinMaxTree;
+    else
+      ppTree = pSrc->apSplitTree + nSrc;
+    pDestNode->nLeaf = 1;
+    DNODE_BLOCKINDEX(pDestNode) = nBlock;
+    pDest->aBlocks[nBlock].pMinMaxTree = *ppTree;
+    pDest->aBlocks[nBlock].nDtreeIndex = nDest;
+    *ppTree = NULL;
+    return;
+  }
+  nLeft = pDest->nNodes;
+  nRight = pDest->nNodes + 1;
+  nRightBlock = pDest->nBlocks;
+  pDest->nNodes += 2;
+  pDest->nBlocks += 1;
+  pDestNode->nLeaf = 0;
+  DNODE_VARINDEX(pDestNode) = DNODE_VARINDEX(pSrcNode);
+  DNODE_THRESHOLD(pDestNode) = DNODE_THRESHOLD(pSrcNode);
+  DNODE_LEFTINDEX(pDestNode) = nLeft;
+  DNODE_RIGHTINDEX(pDestNode) = nRight;
+  RelocateSplit(pSrc, DNODE_LEFTINDEX(pSrcNode), anTask, aTaskRuns,
+                pDest, nLeft, nBlock, nDest);
+  RelocateSplit(pSrc, DNODE_RIGHTINDEX(pSrcNode), anTask, aTaskRuns,
+                pDest, nRight, nRightBlock, nDest);
+}
+
+/////////////////////////////////////////////////////////////////////
+// profile guided splitting
+
+static
+int ProfileSplit(SPLITRUN* pRun, const double* adblSamples, int nSamples, 
+                 int nMaxBlocks)
+{
+  // Best first splitting guided by samples of the inputs the DTREE will
+  // be evaluated on.  Each leaf is optimized and given the split that
+  // minimizes the expected cost of evaluating a sample reaching it, then
+  // the leaf whose split saves most over all the samples is split next,
+  // until no leaf is worth splitting or nMaxBlocks blocks have been made.
+  // pRun holds the root node and block and the bounds of the input box.
+  // With several threads the two children of a split are profiled in
+  // parallel, the right one in the scratch of a copy of pRun; the linear
+  // forms are numbered afterwards in serial order, so the DTREE is the
+  // same for any number of threads.
+  int i;
+  int nErr = DTR_NOERROR;
+  int nDim = pRun->nDim;
+  int nLeaves = 0;
+  int nLeafAlloc = 64;
+  BOOL bParallel = FALSE;
+  PROFILELEAF leaf;
+  SPLITRUN child = *pRun;         // the arrays of the run never grow here
+  SPLITRUN* apChildRun[2];
+  PROFILELEAF* aLeaves = (PROFILELEAF*)malloc(nLeafAlloc * sizeof(PROFILELEAF));
+  int* anSample = (int*)malloc(nSamples * sizeof(int));
+  leaf.adblMin = (double*)malloc(nDim * sizeof(double));
+  leaf.adblMax = (double*)malloc(nDim * sizeof(double));
+  if (aLeaves == NULL || anSample == NULL || leaf.adblMin == NULL || leaf.adblMax == NULL)
+  {
+    free(aLeaves);
+    free(anSample);
+    free(leaf.adblMin);
+    free(leaf.adblMax);
+    return DTR_MALLOCFAILED;
+  }
+  for (i = 0; i < nSamples; i++)
+    anSample[i] = i;
+  apChildRun[0] = apChildRun[1] = pRun;
+#ifdef _OPENMP
+  if (omp_get_max_threads() > 1 && InitSplitScratch(&child) == DTR_NOERROR)
+  {
+    bParallel = TRUE;
+    apChildRun[1] = &child;
+  }
+#endif
+  
+  // the root holds all the samples
+  leaf.nNode = 0;
+  leaf.nDepth = 0;
+  leaf.nPath = 1;
+  leaf.nFirst = 0;
+  leaf.nCount = nSamples;
+  leaf.dblVolume = 1;
+  memcpy(leaf.adblMin, pRun->adblMin, nDim * sizeof(double));
+  memcpy(leaf.adblMax, pRun->adblMax, nDim * sizeof(double));
+  ProfileLeaf(pRun, &leaf, adblSamples, anSample, nSamples);
+  MapNewLinearForms(pRun->aBlocks[0].pMinMaxTree, pRun->pnCount, pRun->aNewIndex);
+  nErr = PushProfileLeaf(&aLeaves, &nLeaves, &nLeafAlloc, &leaf);
+
+  while (nErr == DTR_NOERROR && nLeaves > 0 && 
+         pRun->nBlocks < nMaxBlocks && pRun->nNodes + 2 <= pRun->nMaxNodes)
+  {
+    PROFILELEAF left;
+    PROFILELEAF right;
+    PROFILELEAF* apChild[2];
+    DTREENODE* aNodes = pRun->aNodes;
+    BLOCK* aBlocks = pRun->aBlocks;
+    int nVarIndex;
+    int nBlockIndex;
+    int nLeft;
+    int nRight;
+    int nLast;
+    double dblT;
+    double dblFraction;
+
+    PopProfileLeaf(aLeaves, &nLeaves, &leaf);
+    nVarIndex = leaf.nVarIndex;
+    dblT = leaf.dblT;
+    nBlockIndex = DNODE_BLOCKINDEX(aNodes + leaf.nNode);
+    nLeft = pRun->nNodes;
+    nRight = pRun->nNodes + 1;
+
+    // split the node as Split does
+    aNodes[leaf.nNode].nLeaf = 0;
+    DNODE_VARINDEX(aNodes + leaf.nNode) = nVarIndex;
+    DNODE_THRESHOLD(aNodes + leaf.nNode) = dblT;
+    DNODE_LEFTINDEX(aNodes + leaf.nNode) = nLeft;
+    DNODE_RIGHTINDEX(aNodes + leaf.nNode) = nRight;
+    aNodes[nLeft].nLeaf = 1;
+    aNodes[nLeft].nParentIndex = leaf.nNode;
+    DNODE_BLOCKINDEX(aNodes + nLeft) = nBlockIndex;
+    aBlocks[nBlockIndex].nDtreeIndex = nLeft;
+    aNodes[nRight].nLeaf = 1;              
+    aNodes[nRight].nParentIndex = leaf.nNode;
+    DNODE_BLOCKINDEX(aNodes + nRight) = pRun->nBlocks;
+    aBlocks[pRun->nBlocks].nDtreeIndex = nRight;
+    aBlocks[pRun->nBlocks].pMinMaxTree = CopyMinMaxNode(aBlocks[nBlockIndex].pMinMaxTree); 
+    if (aBlocks[pRun->nBlocks].pMinMaxTree == NULL)
+    {
+      free(leaf.adblMin);
+      free(leaf.adblMax);
+      nErr = DTR_MALLOCFAILED;
+      break;
+    }
+    pRun->nBlocks += 1;
+    pRun->nNodes += 2;
+
+    // samples with x <= T go left, as in EvalDtree
+    i = leaf.nFirst;
+    nLast = leaf.nFirst + leaf.nCount - 1;
+    while (i <= nLast)
+    {
+      if (adblSamples[anSample[i] * nDim + nVarIndex] <= dblT)
+        i++;
+      else
+      {
+        int n = anSample[i];
+        anSample[i] = anSample[nLast];
+        anSample[nLast--] = n;
+      }
+    }
+
+    // the left child reuses the leaf's bounds
+    dblFraction = (dblT - leaf.adblMin[nVarIndex]) / 
+                  (leaf.adblMax[nVarIndex] - leaf.adblMin[nVarIndex]);
+    right = leaf;
+    right.adblMin = (double*)malloc(nDim * sizeof(double));
+    right.adblMax = (double*)malloc(nDim * sizeof(double));
+    if (right.adblMin == NULL || right.adblMax == NULL)
+    {
+      free(right.adblMin);
+      free(right.adblMax);
+      free(leaf.adblMin);
+      free(leaf.adblMax);
+      nErr = DTR_MALLOCFAILED;
+      break;
+    }
+    memcpy(right.adblMin, leaf.adblMin, nDim * sizeof(double));
+    memcpy(right.adblMax, leaf.adblMax, nDim * sizeof(double));
+    right.adblMin[nVarIndex] = dblT;
+    right.nNode = nRight;
+    right.nDepth = leaf.nDepth + 1;
+    right.nPath = 2 * leaf.nPath + 1;
+    right.nFirst = i;
+    right.nCount = leaf.nFirst + leaf.nCount - i;
+    right.dblVolume = leaf.dblVolume * (1 - dblFraction);
+    left = leaf;
+    left.adblMax[nVarIndex] = dblT;
+    left.nNode = nLeft;
+    left.nDepth = leaf.nDepth + 1;
+    left.nPath = 2 * leaf.nPath;
+    left.nCount = i - leaf.nFirst;
+    left.dblVolume = leaf.dblVolume * dblFraction;
+
+    apChild[0] = &left;
+    apChild[1] = &right;
+    #pragma omp parallel for if (bParallel)
+    for (i = 0; i < 2; i++)
+      ProfileLeaf(apChildRun[i], apChild[i], adblSamples, anSample, nSamples);
+    MapNewLinearForms(aBlocks[nBlockIndex].pMinMaxTree, pRun->pnCount, pRun->aNewIndex);
+    MapNewLinearForms(aBlocks[DNODE_BLOCKINDEX(aNodes + nRight)].pMinMaxTree, 
+                      pRun->pnCount, pRun->aNewIndex);
+    nErr = PushProfileLeaf(&aLeaves, &nLeaves, &nLeafAlloc, &left);
+    if (nErr == DTR_NOERROR)
+      nErr = PushProfileLeaf(&aLeaves, &nLeaves, &nLeafAlloc, &right);
+    else
+    {
+      free(right.adblMin);
+      free(right.adblMax);
+    }
+  }
+
+  for (i = 0; i < nLeaves; i++)
+  {
+    free(aLeaves[i].adblMin);
+    free(aLeaves[i].adblMax);
+  }
+  free(aLeaves);
+  free(anSample);
+  if (bParallel)
+    FreeSplitScratch(&child);
+  return nErr;
+}
+
+static
+void ProfileLeaf(SPLITRUN* pRun, PROFILELEAF* pLeaf, const double* adblSamples, 
+                 const int* anSample, int nSamples)
+{
+  // optimizes the leaf's min/max tree and chooses its split, if any;
+  // it only uses the scratch of pRun, so the two children of a split can
+  // be profiled at once in the scratch of two runs
+  int nLines;
+  int nOutput = pRun->nOutput;
+  int nBlockIndex = DNODE_BLOCKINDEX(pRun->aNodes + pLeaf->nNode);
+  double* adblMin = pRun->adblMin;
+  double* adblMax = pRun->adblMax;
+  SPLITRAND nRand;
+
+  memcpy(adblMin, pLeaf->adblMin, pRun->nDim * sizeof(double));
+  memcpy(adblMax, pLeaf->adblMax, pRun->nDim * sizeof(double));
+  adblMax[nOutput] = 1e38;
+  adblMin[nOutput] = -1e38;
+  do
+  {
+    pRun->bSmaller = FALSE;
+    MinMaxNodeBoundCylinder(pRun->aBlocks[nBlockIndex].pMinMaxTree, pRun->aLF, 
+                            adblMin, adblMax,
+                            pRun->dblBiasBound, pRun->adblWBound, pRun->dblHalfWidth,
+                            pRun->nDim, nOutput, pRun->bSmaller);
+    Amalgamate(pRun->aBlocks[nBlockIndex].pMinMaxTree, pRun->aLF, 
+                             pRun->nDim, nOutput, pRun->bSmaller);
+  } while(pRun->bSmaller == TRUE);
+
+  pLeaf->nVarIndex = -1;
+  pLeaf->dblGain = 0;
+  if (pLeaf->nDepth >= pRun->nMaxDepth)
+    return;                 // as in Split
+  nLines = 0;
+  CountMinMaxTreeLines(pRun->aBlocks[nBlockIndex].pMinMaxTree, nLines);
+  if (nLines <= pRun->nDim)
+    return;
+
+  nRand = SplitRandSeed(pRun->nSeed, pLeaf->nPath);
+  SetResp(pRun->aBlocks[nBlockIndex].pMinMaxTree,
+          pRun->aLF, pRun->nLF, adblMin, adblMax, pRun->adblX, 
+          pRun->adblRespMin, pRun->adblRespMax,
+          pRun->aRespLF, pRun->nDim, nOutput, nLines, &nRand);
+  ProfileBestSplit(pRun, pLeaf, nLines, adblSamples, anSample, nSamples, &nRand);
+}
+
+static
+void ProfileBestSplit(SPLITRUN* pRun, PROFILELEAF* pLeaf, int nLines,
+                      const double* adblSamples, const int* anSample, int nSamples,
+                      SPLITRAND* pnRand)
+{
+  // A query reaching the leaf now evaluates nLines pieces.  After a split
+  // at T it visits one more node and evaluates the pieces not entirely on
+  // the other side of T, so the expected cost of a split is
+  //   PROFILENODECOST + nDim * (wL * nLinesL + wR * nLinesR) / (wL + wR)
+  // where wL and wR weigh the leaf's samples on each side plus one sample
+  // spread evenly over the input box, so empty regions still count a bit.
+  // We try PROFILEGRID - 1 evenly spaced thresholds and the one FindBestT
+  // gives for each variable; the gain is the expected saving per query.
+  int i, j, k;
+  int nDim = pRun->nDim;
+  int nOutput = pRun->nOutput;
+  int nLeft, nRight;
+  int anCell[PROFILEGRID];
+  double* adblMin = pRun->adblMin;
+  double* adblMax = pRun->adblMax;
+  double dblLineCost = nDim;
+  double dblWeight = pLeaf->nCount + pLeaf->dblVolume;
+  double dblBest = nLines * dblLineCost;
+
+  for (i = 0; i < nDim; i++)
+  {
+    double dblWidth = adblMax[i] - adblMin[i];
+    if (i == nOutput || !(dblWidth > 0))
+      continue;
+
+    // samples in each grid cell
+    memset(anCell, 0, sizeof(anCell));
+    for (k = pLeaf->nFirst; k < pLeaf->nFirst + pLeaf->nCount; k++)
+    {
+      double dblCell = (adblSamples[anSample[k] * nDim + i] - adblMin[i]) * 
+                       PROFILEGRID / dblWidth;
+      // NaN, from an unbounded variable, goes to cell 0
+      int nCell = !(dblCell >= 0) ? 0 : (dblCell >= PROFILEGRID) ? PROFILEGRID - 1 : (int)dblCell;
+      anCell[nCell]++;
+    }
+
+    for (j = 0; j < PROFILEGRID; j++)
+    {
+      double dblT;
+      double dblFraction;
+      double dblLeft;
+      double dblRight;
+      double dblCost;
+      int nBelow = 0;
+      if (j == 0)
+      {
+        // the threshold balancing the pieces, samples counted exactly
+        FindBestT(i, &dblT, adblMin, adblMax, pRun->adblRespMin, pRun->adblRespMax,
+                  pRun->aRespLF, pRun->nLF, nDim, nOutput, nLines, &nLeft, &nRight);
+        for (k = pLeaf->nFirst; k < pLeaf->nFirst + pLeaf->nCount; k++)
+        {
+          if (adblSamples[anSample[k] * nDim + i] <= dblT)
+            nBelow++;
+        }
+      }
+      else
+      {
+        dblT = adblMin[i] + dblWidth * j / PROFILEGRID;
+        CountLeftRightResp(dblT, &nLeft, &nRight, pRun->aRespLF, 
+                           pRun->adblRespMin, pRun->adblRespMax, i, nDim, pRun->nLF);
+        for (k = 0; k < j; k++)
+          nBelow += anCell[k];
+      }
+      dblFraction = (dblT - adblMin[i]) / dblWidth;
+      dblLeft = nBelow + pLeaf->dblVolume * dblFraction;
+      dblRight = (pLeaf->nCount - nBelow) + pLeaf->dblVolume * (1 - dblFraction);
+      dblCost = PROFILENODECOST + dblLineCost * 
+                (dblLeft * (nLines - nRight) + dblRight * (nLines - nLeft)) / dblWeight;
+      if (dblCost < dblBest)
+      {
+        dblBest = dblCost;
+        pLeaf->nVarIndex = i;
+        pLeaf->dblT = dblT;
+      }
+    }
+  }
+
+  if (pLeaf->nVarIndex >= 0)
+  {
+    pLeaf->dblGain = (nLines * dblLineCost - dblBest) * dblWeight / (nSamples + 1);
+  }
+  else if (nLines >= 2 * nDim)
+  {
+    // as in FindBestSplit, halve a block with many pieces along a random
+    // axis; it is split only after all the profitable ones
+    i = nOutput;
+    while (i == nOutput)
+    {
+      i = (int) (nDim * SplitRandFloat(pnRand));
+    }
+    pLeaf->nVarIndex = i;
+    pLeaf->dblT = 0.5 * (adblMin[i] + adblMax[i]);
+    pLeaf->dblGain = 1e-12 * dblWeight / (nSamples + 1);
+  }
+}
+
+static
+int PushProfileLeaf(PROFILELEAF** paLeaves, int* pnLeaves, int* pnLeafAlloc, 
+                    PROFILELEAF* pLeaf)
+{
+  // adds a leaf to the heap of leaves ordered by gain; a leaf with nothing
+  // to gain is dropped and its bounds freed
+  int i;
+  PROFILELEAF* aLeaves = *paLeaves;
+  if (pLeaf->nVarIndex < 0)
+  {
+    free(pLeaf->adblMin);
+    free(pLeaf->adblMax);
+    return DTR_NOERROR;
+  }
+  if (*pnLeaves == *pnLeafAlloc)
+  {
+    if ((aLeaves = (PROFILELEAF*)realloc(aLeaves, 2 * *pnLeafAlloc * sizeof(PROFILELEAF))) == NULL)
+    {
+      free(pLeaf->adblMin);
+      free(pLeaf->adblMax);
+      return DTR_MALLOCFAILED;
+    }
+    *paLeaves = aLeaves;
+    *pnLeafAlloc *= 2;
+  }
+  i = (*pnLeaves)++;
+  while (i > 0 && aLeaves[(i - 1) / 2].dblGain < pLeaf->dblGain)
+  {
+    aLeaves[i] = aLeaves[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  aLeaves[i] = *pLeaf;
+  return DTR_NOERROR;
+}
+
+static
+void PopProfileLeaf(PROFILELEAF* aLeaves, int* pnLeaves, PROFILELEAF* pLeaf)
+{
+  // removes the leaf with the greatest gain
+  int i = 0;
+  int nLeaves = --(*pnLeaves);
+  PROFILELEAF last = aLeaves[nLeaves];
+  *pLeaf = aLeaves[0];
+  while (2 * i + 1 < nLeaves)
+  {
+    int nChild = 2 * i + 1;
+    if (nChild + 1 < nLeaves && aLeaves[nChild + 1].dblGain > aLeaves[nChild].dblGain)
+      nChild++;
+    if (aLeaves[nChild].dblGain <= last.dblGain)
+      break;
+    aLeaves[i] = aLeaves[nChild];
+    i = nChild;
+  }
+  if (nLeaves > 0)
+    aLeaves[i] = last;
+}
+
+static
+SPLITRAND SplitRandSeed(SPLITRAND nSeed, unsigned long nPath)
+{
+  // start of the random stream of the node at nPath
+  SPLITRAND nRand = nSeed ^ ((SPLITRAND)nPath * 0x9E3779B97F4A7C15ULL);
+  SplitRandFloat(&nRand);
+  return nRand;
+}
+
+static
+float SplitRandFloat(SPLITRAND* pnRand)
+{
+  // splitmix64 step, top 24 bits as a float in [0, 1)
+  SPLITRAND n = (*pnRand += 0x9E3779B97F4A7C15ULL);
+  n = (n ^ (n >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  n = (n ^ (n >> 27)) * 0x94D049BB133111EBULL;
+  n ^= n >> 31;
+  return (float)(n >> 40) * (1.0f / 16777216.0f);
+}
+
 static 
 void FindBestSplit(int* pnVarIndex, double* pdblT, 
                    double* adblMin, double* adblMax, 
                    double* adblRespMin, 
                    double* adblRespMax, char* aRespLF,
-                   int nLF, int nDim, int nOutput, int nLines)
+                   int nLF, int nDim, int nOutput, int nLines,
+                   SPLITRAND* pnRand)
 { 
   // best threshold over all vars is when we have
   // min(max(Nl + No, Nr + No)
@@ -861,7 +1727,7 @@ void FindBestSplit(int* pnVarIndex, double* pdblT,
       // pick a random axis, not the output
       while(i == nOutput)
       {
-        i = (int) (nDim * ALNRandFloat());
+        i = (int) (nDim * SplitRandFloat(pnRand));
       }
       *pnVarIndex = i;
       ASSERT((0 <= i) && (i <= nDim -1) && (i != nOutput));
@@ -920,7 +1786,8 @@ static
 void SetResp(MINMAXNODE* pMMN, LINEARFORM* aLF, int nLF,
              double* adblMin, double* adblMax, double* adblX,
              double* adblRespMin, double* adblRespMax,
-             char* aRespLF, int nDim, int nOutput, int nLines)
+             char* aRespLF, int nDim, int nOutput, int nLines,
+             SPLITRAND* pnRand)
 {   
   int i;
   int nPoints;
@@ -938,7 +1805,7 @@ void SetResp(MINMAXNODE* pMMN, LINEARFORM* aLF, int nLF,
     double dblResult;
     for (j = 0; j < nDim; j++)
     {    
-      double dblFactor = (double)ALNRandFloat();
+      double dblFactor = (double)SplitRandFloat(pnRand);
       adblX[j] = adblMin[j] + dblFactor * (adblMax[j] - adblMin[j]);
     }
     EvalMinMaxTree(pMMN, aLF, nDim, nOutput,
@@ -108,45 +108,41 @@ void ALNAPI dumpCMA(const MatrixXd &X, double* adblX)
 }
 
 
-BOOL ALNAPI CalcCovariance(int nCols, // number of input vars = number of ALN inputs - 1
+BOOL ALNAPI CalcCovariance(int nCols, // number of input vars, including a bias column of ones
                     int nRows,        // number of rows, i.e. input vectors for a given LFN
-                    double* adblX,    // RMA based input vectors (nRows * nCols)
-                    double* adblY,    // RMA based result vector (nRows)
+                    const double* adblX, // RMA based input vectors (nRows * nCols)
+                    const double* adblY, // RMA based result vector (nRows)
                     double* adblC,    // RMA covariance matrix as array (nCols * nCols), is returned
                     double* adblA,    // RMA fitted parameter vector (nCols)
-                    double* adblS,    // RMA std dev vector (nRows) (a weighting on points) 
-                    double* adblU,    // RMA U matrix (nRows * nRows)
+                    const double* adblS, // RMA std dev vector (nRows) (a weighting on points), NULL for all 1.0
                     double* adblV,    // RMA V matrix (nCols * nCols)
                     double* adblW,    // RMA W array (singvals = min(nRows,nCols))containing singular values
                     double& dblChiSq) // chi square of fit
 {
-	// implementation based on SVD in Eigen
-	// note that matrices below are stored in row-major order (RMA)
-  ASSERT(adblX && adblY && adblC && adblA && adblS && adblU && adblV && adblW);
+	// implementation based on the thin SVD in Eigen, X = U W V^T with U only
+	// nRows * singvals, so memory is linear in nRows; with fewer rows than
+	// columns the thin V would be only nCols * nRows, so the full V is
+	// computed for adblV, and only its first singvals columns enter A and C
+	// note that the arrays are stored in row-major order (RMA)
+  ASSERT(adblX && adblY && adblC && adblA && adblV && adblW);
   BOOL bSuccess = TRUE;
-	MatrixXd X(nRows,nCols);
-	fillRMA(X,adblX);
-	MatrixXd U(nRows,nRows);
-	MatrixXd V(nCols,nCols);
+	Map<const Matrix<double, Dynamic, Dynamic, RowMajor> > X(adblX, nRows, nCols);
+	Map<const VectorXd> Y(adblY, nRows);
 	int singvals = std::min(nRows, nCols);
-	VectorXd  s(singvals);  // the singular values s
 	VectorXd  sinv(nCols);  
 	// inverses of the singular values s, but inverse of a very small s is 0 
-	// We should solve for fitting parameters A then compare it to the ALNresult
-	// We get A = V W^(-1)U^T Y.  This works for square X but here
-	// we would get UWV^TA = UWV^TVW^(-1)U^T Y =Y except for the zeroed  W entries
+	// We solve for fitting parameters A = V W^(-1)U^T Y, except for the zeroed W entries
 
 	try
 	{
 		double smax, tmp, thresh;
-		// in a try/catch block to free b in case exception occurs
 		// now we do the SVD on X
-		JacobiSVD<MatrixXd> svd(X, Eigen::ComputeFullU | Eigen::ComputeFullV);
-		U = svd.matrixU();
-		V = svd.matrixV();
-		s = svd.singularValues();
-		// put result of the SVD into the arrays in the call
-		dumpRMA(U, adblU);
+		JacobiSVD<MatrixXd> svd(X, Eigen::ComputeThinU | 
+		                        (nRows < nCols ? Eigen::ComputeFullV : Eigen::ComputeThinV));
+		const MatrixXd& U = svd.matrixU();
+		const MatrixXd& V = svd.matrixV();
+		VectorXd s = svd.singularValues();
+		// put V into the array in the call
 		dumpRMA(V, adblV);
 		// find the maximal singular value
 		smax = 0.0;
@@ -170,36 +166,22 @@ BOOL ALNAPI CalcCovariance(int nCols, // number of input vars = number of ALN in
 			}
 		}
 
-		// compute the fitting parameters for rNows of output values
-		// First make a vector out of Y
-		VectorXd Y(nRows);
-		for (int sr = 0; sr < nRows; sr++)
-		{
-			Y(sr) = adblY[sr]; // this Y is incorrect for the entries j = 0 to j = 4  Something is overwriting the Y array!!!!
-		}
-		MatrixXd UT(nRows, nRows);
-		UT = U.transpose();  // This is the inverse of U
-		VectorXd tempY(nRows);
-		tempY = UT * Y; // This should be the output of the diagonal matrix in the middle of the svd
-		VectorXd tempV(nCols); 
+		// compute the fitting parameters for nRows of output values
+		VectorXd tempY = U.transpose() * Y; // This should be the output of the diagonal matrix in the middle of the svd
+		VectorXd tempV(singvals); 
 		// Instead of taking the inverse of the diagonal matrix and multiplying by tempY we do the components
-		for (int sr = 0; sr < nCols; sr++){
-			if(sr < singvals){
-				tempV(sr) = sinv(sr) * tempY(sr);
-			}
-			else {
-				tempV(sr) = 0;
-			}
+		for (int sr = 0; sr < singvals; sr++){
+			tempV(sr) = sinv(sr) * tempY(sr);
 		}
 		VectorXd A(nCols); // A is the solution of the least-squares problem, i.e. the ideal weights on the LFN
-		A = V * tempV; // V is the inverse of V^T
+		A = V.leftCols(singvals) * tempV; // V is the inverse of V^T
 		// return the values in A to the pointer structure
 		for (int i = 0; i < nCols; i++)
 		{
 			adblA[i] = A(i);
 		}
 		// finding the measure of error of the fit by chi-squared 
-		double dblChiSq=0.0;
+		dblChiSq = 0.0;
 		for (int i = 0; i < nRows; i++) 
 		{
 			double sum = 0.0;
@@ -207,7 +189,9 @@ BOOL ALNAPI CalcCovariance(int nCols, // number of input vars = number of ALN in
 			{
 				sum += X(i,j)* A(j);
 			}
-			tmp=(Y(i) - sum)/adblS[i]; // adblS[i] is a weight on input vector i, usually 1.0
+			tmp = Y(i) - sum;
+			if (adblS != NULL)
+				tmp /= adblS[i]; // adblS[i] is a weight on input vector i, usually 1.0
 			dblChiSq += tmp*tmp;
 		}
 
@@ -217,7 +201,7 @@ BOOL ALNAPI CalcCovariance(int nCols, // number of input vars = number of ALN in
 			for(int i = 0; i <= k; i++)		// use symmetry
 			{
 				double sum = 0.0;
-				for(int j = 0; j < nCols; j++)
+				for(int j = 0; j < singvals; j++)
 				{
 					sum += V(k,j) * V(i,j) * sinv(j) * sinv(j);
 				}
@@ -60,3 +60,24 @@ void ALNAPI CountLFNs(const ALNNODE* pNode, int& nTotal, int& nAdapted)
   }
 }
 
+
+///////////////////////////////////////////////////////////////////////////////
+// count number of LFNs in an ALN from its leaf index
+
+void ALNAPI CountLFNs(ALN* pALN, int& nTotal, int& nAdapted)
+{
+	ASSERT(pALN != NULL && pALN->pTree != NULL);
+
+  if (!BuildLFNIndex(pALN))
+  {
+    // no memory for the index, walk the tree
+    CountLFNs(pALN->pTree, nTotal, nAdapted);
+    return;
+  }
+
+  nTotal += pALN->nLFNs;
+  for (int i = 0; i < pALN->nLFNs; i++)
+  {
+    nAdapted += !(NODE_RESPCOUNT(pALN->apLFNs[i]) == 0);
+  }
+}
@@ -0,0 +1,388 @@
+// dtr_cach.c
+// DTREE cached evaluation of slowly moving inputs
+
+// ALNfit Learning Engine for approximation of functions defined by samples.
+// Copyright (C) 2018 William W. Armstrong.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// Version 3 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// For further information contact
+// William W. Armstrong
+
+// 3624 - 108 Street NW
+// Edmonton, Alberta, Canada  T6J 1B4
+
+#ifdef DTREEDLL
+#define DTRIMP __declspec(dllexport)
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include <dtree.h>
+#include "dtr_priv.h"
+
+/*
+/////////////////////////////////////////////////////////////////////
+// why a hit is exact
+
+   Every form of a block is Lipschitz in the max norm with constant
+   sum |w[i]| / |w[nOutput]| over the inputs, so every min/max subtree
+   is too with the block's largest such constant L.  If at x0 the winning
+   child of each min/max node on the winner's path beats its best sibling
+   by at least g, then within ||x - x0|| < g / 2L no sibling can catch up.
+   Computed values carry a rounding error below (nDim + 2) u times the sum
+   of the magnitudes of their terms; the allowance subtracted from g, and
+   the halved radius, cover that error at x0 and at x.  Ties give a zero
+   margin, so a form that only wins by its position never hits.
+*/
+
+struct tagDTREECACHE
+{
+  DTREE* pDtree;                  /* evaluated DTREE                        */
+  int bValid;                     /* the fields below describe a leaf       */
+  int nBlock;                     /* block of the cached leaf               */
+  int nLF;                        /* linear form that won at adblX0         */
+  double dblRadius;               /* max norm radius around adblX0          */
+  double* adblLo;                 /* leaf box, exclusive lower bounds       */
+  double* adblHi;                 /* leaf box, inclusive upper bounds       */
+  double* adblX0;                 /* input of the last miss                 */
+  double* adblSlope;              /* largest form slope of each block, or   */
+                                  /*   negative if not yet computed         */
+  DTREECACHESTATS stats;
+};
+
+/* largest slope of the forms of a min/max tree */
+static int MinMaxTreeSlope(MINMAXNODE* pMMN, const DTREE* pDtree,
+                           double* pdblSlope)
+{
+  if (pMMN->nType == DTREE_LINEAR)
+  {
+    LINEARFORM* pLF = pDtree->aLinearForms + MMN_LFINDEX(pMMN);
+    double dblSum = 0;
+    int i;
+
+    if (pLF->adblW[pDtree->nOutputIndex] == 0)
+      return DTR_ZEROOUTPUTWEIGHT;
+    for (i = 0; i < pDtree->nDim; i++)
+    {
+      if (i == pDtree->nOutputIndex) continue;
+      dblSum += fabs(pLF->adblW[i]);
+    }
+    dblSum /= fabs(pLF->adblW[pDtree->nOutputIndex]);
+    if (dblSum > *pdblSlope)
+      *pdblSlope = dblSum;
+    return DTR_NOERROR;
+  }
+  else if (pMMN->nType == DTREE_MIN || pMMN->nType == DTREE_MAX)
+  {
+    MINMAXNODE* pList;
+    int nErr;
+    for (pList = MMN_CHILDLIST(pMMN); pList != NULL; pList = pList->pNext)
+    {
+      if ((nErr = MinMaxTreeSlope(pList, pDtree, pdblSlope)) != DTR_NOERROR)
+        return nErr;
+    }
+    return DTR_NOERROR;
+  }
+
+  return DTR_GENERIC; /* unknown node type */
+}
+
+/* EvalMinMaxTree, also returning in *pdblMargin the smallest margin of a
+   winner over its siblings on the winner's path and raising *pdblMag to
+   the largest sum of term magnitudes of a form; values and ties are
+   exactly those of EvalMinMaxTree and EvalLinearForm */
+static int MarginMinMaxTree(MINMAXNODE* pMMN, const DTREE* pDtree,
+                            const double* adblInput, double* pdblResult,
+                            int* pnLinearIndex, double* pdblMargin,
+                            double* pdblMag)
+{
+  if (pMMN->nType == DTREE_LINEAR)
+  {
+    LINEARFORM* pLF = pDtree->aLinearForms + MMN_LFINDEX(pMMN);
+    int nOutput = pDtree->nOutputIndex;
+    double dblMag;
+    int i;
+
+    if (pLF->adblW[nOutput] == 0)
+      return DTR_ZEROOUTPUTWEIGHT;
+    *pdblResult = pLF->dblBias;
+    dblMag = fabs(pLF->dblBias);
+    for (i = 0; i < pDtree->nDim; i++)
+    {
+      if (i == nOutput) continue;
+      *pdblResult += adblInput[i] * pLF->adblW[i];
+      dblMag += fabs(adblInput[i] * pLF->adblW[i]);
+    }
+    *pdblResult /= -pLF->adblW[nOutput];
+    dblMag /= fabs(pLF->adblW[nOutput]);
+    if (dblMag > *pdblMag)
+      *pdblMag = dblMag;
+
+    *pnLinearIndex = MMN_LFINDEX(pMMN);
+    *pdblMargin = HUGE_VAL;
+    return DTR_NOERROR;
+  }
+  else if (pMMN->nType == DTREE_MIN || pMMN->nType == DTREE_MAX)
+  {
+    MINMAXNODE* pList = MMN_CHILDLIST(pMMN);
+    int bMin = (pMMN->nType == DTREE_MIN);
+    int bOther = 0;               /* a sibling of the winner has been seen  */
+    double dblOther = 0;          /* best value among the winner's siblings */
+    double dblMargin = HUGE_VAL;  /* margin inside the winning child        */
+
+    /* EvalMinMaxTree leaves the result unset for an empty node */
+    if (pList == NULL)
+      return DTR_GENERIC;
+
+    for (; pList != NULL; pList = pList->pNext)
+    {
+      double dbl, dblChildMargin;
+      int nIndex, nErr;
+      if ((nErr = MarginMinMaxTree(pList, pDtree, adblInput, &dbl, &nIndex,
+                                   &dblChildMargin, pdblMag)) != DTR_NOERROR)
+        return nErr;
+
+      if ((pList == MMN_CHILDLIST(pMMN)) ||
+          (bMin && dbl < *pdblResult) ||
+          (!bMin && dbl > *pdblResult))
+      {
+        /* the displaced winner becomes a sibling */
+        if (pList != MMN_CHILDLIST(pMMN))
+        {
+          if (!bOther || (bMin ? *pdblResult < dblOther : *pdblResult > dblOther))
+            dblOther = *pdblResult;
+          bOther = 1;
+        }
+        *pdblResult = dbl;
+        *pnLinearIndex = nIndex;
+        dblMargin = dblChildMargin;
+      }
+      else
+      {
+        if (!bOther || (bMin ? dbl < dblOther : dbl > dblOther))
+          dblOther = dbl;
+        bOther = 1;
+      }
+    }
+
+    /* NaN values give a NaN margin, which never allows a hit */
+    if (bOther)
+    {
+      double dblGap = bMin ? dblOther - *pdblResult : *pdblResult - dblOther;
+      if (!(dblGap >= dblMargin))
+        dblMargin = dblGap;
+    }
+    *pdblMargin = dblMargin;
+    return DTR_NOERROR;
+  }
+
+  return DTR_GENERIC; /* unknown node type */
+}
+
+/* non-zero if adblInput is inside the cached leaf box and radius */
+static int CacheHit(const DTREECACHE* pCache, const double* adblInput)
+{
+  int nDim = pCache->pDtree->nDim;
+  int nOutput = pCache->pDtree->nOutputIndex;
+  int i;
+
+  if (!pCache->bValid)
+    return 0;
+  for (i = 0; i < nDim; i++)
+  {
+    double dbl = adblInput[i];
+    if (!(dbl > pCache->adblLo[i] && dbl <= pCache->adblHi[i]))
+      return 0;
+    if (i != nOutput && !(fabs(dbl - pCache->adblX0[i]) < pCache->dblRadius))
+      return 0;
+  }
+  return 1;
+}
+
+/* descends to the leaf of adblInput, recording its box, and evaluates its
+   block while measuring the radius */
+static int CacheMiss(DTREECACHE* pCache, double* adblInput,
+                     double* pdblResult, int* pnLF)
+{
+  DTREE* pDtree = pCache->pDtree;
+  DTREENODE* pNode = pDtree->aNodes;
+  int nDim = pDtree->nDim;
+  double dblMargin, dblMag = 0, dblSlope, dblAllow;
+  int nErr, i;
+
+  pCache->bValid = 0;
+  for (i = 0; i < nDim; i++)
+  {
+    pCache->adblLo[i] = -HUGE_VAL;
+    pCache->adblHi[i] = HUGE_VAL;
+  }
+
+  /* find leaf, the same descent as EvalDtree */
+  while (pNode->nLeaf == 0)
+  {
+    int nVar = DNODE_VARINDEX(pNode);
+    double dblT = DNODE_THRESHOLD(pNode);
+    if (adblInput[nVar] <= dblT)
+    {
+      if (dblT < pCache->adblHi[nVar])
+        pCache->adblHi[nVar] = dblT;
+      pNode = pDtree->aNodes + DNODE_LEFTINDEX(pNode);
+    }
+    else
+    {
+      if (dblT > pCache->adblLo[nVar])
+        pCache->adblLo[nVar] = dblT;
+      pNode = pDtree->aNodes + DNODE_RIGHTINDEX(pNode);
+    }
+  }
+  pCache->nBlock = DNODE_BLOCKINDEX(pNode);
+
+  if ((nErr = MarginMinMaxTree(pDtree->aBlocks[pCache->nBlock].pMinMaxTree,
+                               pDtree, adblInput, pdblResult, pnLF,
+                               &dblMargin, &dblMag)) != DTR_NOERROR)
+  {
+    return nErr;
+  }
+
+  dblSlope = pCache->adblSlope[pCache->nBlock];
+  if (dblSlope < 0)
+  {
+    dblSlope = 0;
+    if ((nErr = MinMaxTreeSlope(pDtree->aBlocks[pCache->nBlock].pMinMaxTree,
+                                pDtree, &dblSlope)) != DTR_NOERROR)
+      return nErr;
+    pCache->adblSlope[pCache->nBlock] = dblSlope;
+  }
+
+  /* rounding allowance for the winner and a sibling, at x0 and at x */
+  dblAllow = 4.0 * (nDim + 2) * DBL_EPSILON * dblMag;
+  if (!(dblMargin > 2.0 * dblAllow))
+    pCache->dblRadius = 0;
+  else if (dblSlope == 0)
+    pCache->dblRadius = HUGE_VAL;
+  else
+    pCache->dblRadius = (dblMargin - 2.0 * dblAllow) / (4.0 * dblSlope);
+
+  memcpy(pCache->adblX0, adblInput, nDim * sizeof(double));
+  pCache->nLF = *pnLF;
+  pCache->bValid = 1;
+  return DTR_NOERROR;
+}
+
+DTRIMP DTREECACHE* DTREEAPI CreateDtreeCache(DTREE* pDtree)
+{
+  DTREECACHE* pCache;
+
+  if (pDtree == NULL || pDtree->nDim < 1 || pDtree->nBlocks < 1)
+    return NULL;
+
+  pCache = (DTREECACHE*)calloc(1, sizeof(DTREECACHE));
+  if (pCache == NULL)
+    return NULL;
+
+  pCache->pDtree = pDtree;
+  pCache->adblLo = (double*)malloc(pDtree->nDim * 3 * sizeof(double));
+  pCache->adblSlope = (double*)malloc(pDtree->nBlocks * sizeof(double));
+  if (pCache->adblLo == NULL || pCache->adblSlope == NULL)
+  {
+    DestroyDtreeCache(pCache);
+    return NULL;
+  }
+  pCache->adblHi = pCache->adblLo + pDtree->nDim;
+  pCache->adblX0 = pCache->adblHi + pDtree->nDim;
+
+  ResetDtreeCache(pCache, 1);
+  return pCache;
+}
+
+DTRIMP void DTREEAPI DestroyDtreeCache(DTREECACHE* pCache)
+{
+  if (pCache == NULL)
+    return;
+  free(pCache->adblLo);
+  free(pCache->adblSlope);
+  free(pCache);
+}
+
+DTRIMP int DTREEAPI EvalDtreeCached(DTREECACHE* pCache, double* adblInput,
+                                    double* pdblResult, int* pnLinearIndex)
+{
+  DTREE* pDtree;
+  VARBOUND* pBound;
+  int nLF = -1;
+  int nErr = DTR_NOERROR;
+
+  if (pCache == NULL || adblInput == NULL || pdblResult == NULL)
+    return DTR_GENERIC;
+  pDtree = pCache->pDtree;
+
+  if (CacheHit(pCache, adblInput))
+  {
+    nLF = pCache->nLF;
+    nErr = EvalLinearForm(pDtree->aLinearForms + nLF, pDtree->nDim,
+                          pDtree->nOutputIndex, adblInput, pdblResult);
+    pCache->stats.nHits++;
+  }
+  else
+  {
+    nErr = CacheMiss(pCache, adblInput, pdblResult, &nLF);
+    if (nErr != DTR_NOERROR)
+    {
+      /* leave the evaluation and its error to EvalDtree */
+      pCache->bValid = 0;
+      nErr = EvalDtree(pDtree, adblInput, pdblResult, &nLF);
+    }
+    pCache->stats.nMisses++;
+  }
+
+  if (nErr == DTR_NOERROR)
+  {
+    /* bound output, as EvalDtree does */
+    pBound = &pDtree->aVarDefs[pDtree->nOutputIndex].bound;
+    if (*pdblResult < pBound->dblMin)
+      *pdblResult = pBound->dblMin;
+    else if (*pdblResult > pBound->dblMax)
+      *pdblResult = pBound->dblMax;
+    if (pnLinearIndex != NULL)
+      *pnLinearIndex = nLF;
+  }
+
+  return nErr;
+}
+
+DTRIMP void DTREEAPI ResetDtreeCache(DTREECACHE* pCache, int bStats)
+{
+  int i;
+  if (pCache == NULL)
+    return;
+  pCache->bValid = 0;
+  for (i = 0; i < pCache->pDtree->nBlocks; i++)
+    pCache->adblSlope[i] = -1;
+  if (bStats)
+    memset(&pCache->stats, 0, sizeof(pCache->stats));
+}
+
+DTRIMP void DTREEAPI GetDtreeCacheStats(const DTREECACHE* pCache,
+                                        DTREECACHESTATS* pStats)
+{
+  if (pCache == NULL || pStats == NULL)
+    return;
+  *pStats = pCache->stats;
+}
@@ -0,0 +1,345 @@
+// dtr_cgen.c
+// DTREE export as C source
+
+// ALNfit Learning Engine for approximation of functions defined by samples.
+// Copyright (C) 2018 William W. Armstrong.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// Version 3 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// For further information contact
+// William W. Armstrong
+
+// 3624 - 108 Street NW
+// Edmonton, Alberta, Canada  T6J 1B4
+
+#ifdef DTREEDLL
+#define DTRIMP __declspec(dllexport)
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <time.h>
+
+#include <dtree.h>
+#include "dtr_priv.h"
+
+/*
+/////////////////////////////////////////////////////////////////////
+// generated code
+
+   The descent is a run of tests in preorder: each internal node falls
+   through to its left child and jumps to a label on its right child, so
+   deep trees do not nest.  Each block is a static function that computes
+   the forms of its min/max tree as constants times inputs, in the order
+   EvalLinearForm uses, then the min/max nodes in postorder with ties
+   keeping the earlier child.
+*/
+
+/* writes a double so that it reads back exactly */
+static void WriteCDouble(FILE* pFile, double dbl)
+{
+  if (dbl != dbl)
+    fputs("(0.0 / 0.0)", pFile);
+  else if (dbl > DBL_MAX)
+    fputs("HUGE_VAL", pFile);
+  else if (dbl < -DBL_MAX)
+    fputs("(-HUGE_VAL)", pFile);
+  else if (dbl < 0)
+    fprintf(pFile, "(%.17g)", dbl);
+  else
+    fprintf(pFile, "%.17g", dbl);
+}
+
+/* first pass over a block's min/max tree: numbers its forms in anLocal
+   (-1 if unused) and writes their declarations */
+static int WriteCForms(FILE* pFile, DTREE* pDtree, MINMAXNODE* pMMN,
+                       int* anLocal, int* anBlockLF, int* pnForms)
+{
+  if (pMMN->nType == DTREE_LINEAR)
+  {
+    int nLF = MMN_LFINDEX(pMMN);
+    LINEARFORM* pLF;
+    int i;
+
+    if (nLF < 0 || nLF >= pDtree->nLinearForms)
+      return DTR_UNDEFINEDLINEARFORM;
+    if (anLocal[nLF] >= 0)
+      return DTR_NOERROR;
+    pLF = pDtree->aLinearForms + nLF;
+    if (pLF->adblW[pDtree->nOutputIndex] == 0)
+      return DTR_ZEROOUTPUTWEIGHT;
+
+    anLocal[nLF] = *pnForms;
+    anBlockLF[(*pnForms)++] = nLF;
+    fprintf(pFile, "  const double f%d = (", anLocal[nLF]);
+    WriteCDouble(pFile, pLF->dblBias);
+    for (i = 0; i < pDtree->nDim; i++)
+    {
+      if (i == pDtree->nOutputIndex) continue;
+      fprintf(pFile, " + x[%d] * ", i);
+      WriteCDouble(pFile, pLF->adblW[i]);
+    }
+    fputs(") / ", pFile);
+    WriteCDouble(pFile, -pLF->adblW[pDtree->nOutputIndex]);
+    fprintf(pFile, ";\n");
+    return DTR_NOERROR;
+  }
+  else if (pMMN->nType == DTREE_MIN || pMMN->nType == DTREE_MAX)
+  {
+    MINMAXNODE* pList = MMN_CHILDLIST(pMMN);
+    int nErr;
+
+    /* EvalMinMaxTree leaves the result unset for an empty node */
+    if (pList == NULL)
+      return DTR_GENERIC;
+
+    for (; pList != NULL; pList = pList->pNext)
+    {
+      if ((nErr = WriteCForms(pFile, pDtree, pList, anLocal, anBlockLF,
+                              pnForms)) != DTR_NOERROR)
+        return nErr;
+    }
+    return DTR_NOERROR;
+  }
+
+  return DTR_GENERIC; /* unknown node type */
+}
+
+/* second pass: writes the min/max nodes in postorder; places in
+   pszValue and pszIndex the expressions of the value and the form index
+   of pMMN */
+static void WriteCMinMax(FILE* pFile, MINMAXNODE* pMMN, const int* anLocal,
+                         const int* anBlockLF, int* pnNodes, char* pszValue,
+                         char* pszIndex)
+{
+  MINMAXNODE* pList;
+  char szValue[32], szIndex[32];
+  int nNode;
+
+  if (pMMN->nType == DTREE_LINEAR)
+  {
+    int nForm = anLocal[MMN_LFINDEX(pMMN)];
+    sprintf(pszValue, "f%d", nForm);
+    sprintf(pszIndex, "%d", anBlockLF[nForm]);
+    return;
+  }
+
+  /* the first child initializes the node, later ones replace it when
+     strictly better */
+  pList = MMN_CHILDLIST(pMMN);
+  WriteCMinMax(pFile, pList, anLocal, anBlockLF, pnNodes, szValue, szIndex);
+  nNode = (*pnNodes)++;
+  fprintf(pFile, "  m%d = %s; n%d = %s;\n", nNode, szValue, nNode, szIndex);
+  for (pList = pList->pNext; pList != NULL; pList = pList->pNext)
+  {
+    WriteCMinMax(pFile, pList, anLocal, anBlockLF, pnNodes, szValue, szIndex);
+    fprintf(pFile, "  if (%s %c m%d) { m%d = %s; n%d = %s; }\n", szValue,
+            pMMN->nType == DTREE_MIN ? '<' : '>', nNode, nNode, szValue,
+            nNode, szIndex);
+  }
+  sprintf(pszValue, "m%d", nNode);
+  sprintf(pszIndex, "n%d", nNode);
+}
+
+/* number of min/max nodes in a tree */
+static int CountCMinMax(MINMAXNODE* pMMN)
+{
+  MINMAXNODE* pList;
+  int nCount = 1;
+  if (pMMN->nType == DTREE_LINEAR)
+    return 0;
+  for (pList = MMN_CHILDLIST(pMMN); pList != NULL; pList = pList->pNext)
+    nCount += CountCMinMax(pList);
+  return nCount;
+}
+
+static int WriteCBlock(FILE* pFile, DTREE* pDtree, const char* pszFunction,
+                       int nBlock, int* anLocal, int* anBlockLF)
+{
+  MINMAXNODE* pMMN = pDtree->aBlocks[nBlock].pMinMaxTree;
+  char szValue[32], szIndex[32];
+  int nForms = 0, nNodes, i;
+  int nErr;
+
+  fprintf(pFile, "\n/* block %d */\n", nBlock);
+  fprintf(pFile, "static double %s_b%d(const double* x, int* pnLF)\n{\n",
+          pszFunction, nBlock);
+  if ((nErr = WriteCForms(pFile, pDtree, pMMN, anLocal, anBlockLF,
+                          &nForms)) != DTR_NOERROR)
+  {
+    for (i = 0; i < nForms; i++)
+      anLocal[anBlockLF[i]] = -1;
+    return nErr;
+  }
+
+  nNodes = CountCMinMax(pMMN);
+  for (i = 0; i < nNodes; i++)
+    fprintf(pFile, "  double m%d; int n%d;\n", i, i);
+  nNodes = 0;
+  WriteCMinMax(pFile, pMMN, anLocal, anBlockLF, &nNodes, szValue, szIndex);
+  fprintf(pFile, "  *pnLF = %s;\n  return %s;\n}\n", szIndex, szValue);
+
+  for (i = 0; i < nForms; i++)
+    anLocal[anBlockLF[i]] = -1;
+  return DTR_NOERROR;
+}
+
+/* writes the descent; anStack holds 2 * nNodes + 2 ints */
+static int WriteCDescent(FILE* pFile, DTREE* pDtree, const char* pszFunction,
+                         int* anStack)
+{
+  int nStack = 0, nVisited = 0;
+
+  anStack[nStack++] = 0;          /* dtree node                             */
+  anStack[nStack++] = 0;          /* non-zero if reached by a jump          */
+  while (nStack > 0)
+  {
+    int bLabel = anStack[--nStack];
+    int nIndex = anStack[--nStack];
+    DTREENODE* pNode;
+
+    if (nIndex < 0 || nIndex >= pDtree->nNodes || ++nVisited > pDtree->nNodes)
+      return DTR_GENERIC;
+    pNode = pDtree->aNodes + nIndex;
+    if (bLabel)
+      fprintf(pFile, "node%d:\n", nIndex);
+
+    if (pNode->nLeaf)
+    {
+      if (DNODE_BLOCKINDEX(pNode) < 0 ||
+          DNODE_BLOCKINDEX(pNode) >= pDtree->nBlocks)
+        return DTR_UNDEFINEDREGION;
+      fprintf(pFile, "  dbl = %s_b%d(x, &nLF);\n", pszFunction,
+              DNODE_BLOCKINDEX(pNode));
+      if (nStack > 0)
+        fputs("  goto done;\n", pFile);
+    }
+    else
+    {
+      if (DNODE_VARINDEX(pNode) < 0 || DNODE_VARINDEX(pNode) >= pDtree->nDim)
+        return DTR_GENERIC;
+      fprintf(pFile, "  if (!(x[%d] <= ", DNODE_VARINDEX(pNode));
+      WriteCDouble(pFile, DNODE_THRESHOLD(pNode));
+      fprintf(pFile, ")) goto node%d;\n", DNODE_RIGHTINDEX(pNode));
+      anStack[nStack++] = DNODE_RIGHTINDEX(pNode);
+      anStack[nStack++] = 1;
+      anStack[nStack++] = DNODE_LEFTINDEX(pNode);
+      anStack[nStack++] = 0;
+    }
+  }
+  return DTR_NOERROR;
+}
+
+DTRIMP int DTREEAPI WriteDtreeAsC(const char* pszFileName, DTREE* pDtree,
+                                  const char* pszFunction)
+{
+  FILE* pFile = NULL;
+  int* anLocal = NULL;            /* linear form to block form map          */
+  int* anBlockLF = NULL;          /* forms of the block being written       */
+  int* anStack = NULL;            /* descent stack                          */
+  VARBOUND* pBound;
+  time_t t;
+  int i;
+  int nErr = DTR_NOERROR;
+
+  if (pszFileName == NULL || pDtree == NULL || pDtree->nDim < 1 ||
+      pDtree->nBlocks < 1 || pDtree->nNodes < 1)
+  {
+    return DTR_GENERIC;
+  }
+  if (pszFunction == NULL)
+    pszFunction = "EvalDtreeC";
+
+  anLocal = (int*)malloc(pDtree->nLinearForms * sizeof(int));
+  anBlockLF = (int*)malloc(pDtree->nLinearForms * sizeof(int));
+  anStack = (int*)malloc((2 * pDtree->nNodes + 2) * sizeof(int));
+  if (anLocal == NULL || anBlockLF == NULL || anStack == NULL)
+  {
+    nErr = DTR_MALLOCFAILED;
+    goto done;
+  }
+  for (i = 0; i < pDtree->nLinearForms; i++)
+    anLocal[i] = -1;
+
+  if (fopen_s(&pFile, pszFileName, "w") != 0)
+  {
+    nErr = DTR_FILEERR;
+    goto done;
+  }
+
+  time(&t);
+  fprintf(pFile, "/* %s generated by WriteDtreeAsC on %s", pszFileName,
+          ctime(&t));
+  fprintf(pFile, "\n   double %s(const double* x, int* pnLinearIndex);\n\n",
+          pszFunction);
+  fprintf(pFile, "   evaluates the DTREE at x, which holds %d variables:\n",
+          pDtree->nDim);
+  for (i = 0; i < pDtree->nDim; i++)
+  {
+    fprintf(pFile, "     x[%d] %s [%.17g, %.17g]%s\n", i,
+            pDtree->aVarDefs[i].pszName ? pDtree->aVarDefs[i].pszName : "",
+            pDtree->aVarDefs[i].bound.dblMin, pDtree->aVarDefs[i].bound.dblMax,
+            i == pDtree->nOutputIndex ? " output, not read" : "");
+  }
+  fprintf(pFile, "   and places the responsible linear form index in\n"
+                 "   *pnLinearIndex if it is not NULL.  Results equal EvalDtree's\n"
+                 "   when floating point contraction is off (/fp:precise,\n"
+                 "   -ffp-contract=off).\n*/\n\n#include <stddef.h>\n#include <math.h>\n");
+
+  /* blocks */
+  for (i = 0; i < pDtree->nBlocks; i++)
+  {
+    if ((nErr = WriteCBlock(pFile, pDtree, pszFunction, i, anLocal,
+                            anBlockLF)) != DTR_NOERROR)
+      goto done;
+  }
+
+  /* descent and output bound */
+  fprintf(pFile, "\ndouble %s(const double* x, int* pnLinearIndex)\n{\n"
+                 "  double dbl;\n  int nLF;\n\n", pszFunction);
+  if ((nErr = WriteCDescent(pFile, pDtree, pszFunction, anStack)) != DTR_NOERROR)
+    goto done;
+  pBound = &pDtree->aVarDefs[pDtree->nOutputIndex].bound;
+  if (pDtree->nNodes > 1)
+    fputs("done:\n", pFile);
+  fputs("  if (dbl < ", pFile);
+  WriteCDouble(pFile, pBound->dblMin);
+  fputs(")\n    dbl = ", pFile);
+  WriteCDouble(pFile, pBound->dblMin);
+  fputs(";\n  else if (dbl > ", pFile);
+  WriteCDouble(pFile, pBound->dblMax);
+  fputs(")\n    dbl = ", pFile);
+  WriteCDouble(pFile, pBound->dblMax);
+  fputs(";\n  if (pnLinearIndex != NULL)\n    *pnLinearIndex = nLF;\n"
+        "  return dbl;\n}\n", pFile);
+
+  if (ferror(pFile))
+    nErr = DTR_FILEWRITEERR;
+
+done:
+  if (pFile != NULL)
+  {
+    fclose(pFile);
+    if (nErr != DTR_NOERROR)
+      remove(pszFileName);
+  }
+  free(anLocal);
+  free(anBlockLF);
+  free(anStack);
+  return nErr;
+}
@@ -0,0 +1,712 @@
+// dtr_cmpt.c
+// DTREE reduced precision compact copy
+
+// ALNfit Learning Engine for approximation of functions defined by samples.
+// Copyright (C) 2018 William W. Armstrong.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// Version 3 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// For further information contact
+// William W. Armstrong
+
+// 3624 - 108 Street NW
+// Edmonton, Alberta, Canada  T6J 1B4
+
+#ifdef DTREEDLL
+#define DTRIMP __declspec(dllexport)
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <dtree.h>
+#include "dtr_priv.h"
+
+/*
+/////////////////////////////////////////////////////////////////////
+// compact layout
+
+   Nodes are stored in preorder so the left child of a node is the next
+   node.  nInfo of an internal node holds the right child index shifted
+   left by nVarBits, or'ed with the variable index; a leaf holds
+   -1 - block index.
+
+   Form k over input column j is
+     afltBias[k] + sum_j W[k * nInputs + j] * u[j]
+   with u[j] = x[j] - adblCenter[j], times adblScale[j] in int16 mode.
+   The output weight is divided out when the form is stored.
+
+   The blocks share the forms.  anBlockForms holds, from anFormStart[b],
+   the block's form count and DTREE linear form indexes; anProgram holds,
+   from anProgramStart[b], its min/max node count and then the nodes as in
+   dtr_comp.c: type, child count, child registers, in 16 bits.  The form
+   values are the first registers and each node, in postorder, writes the
+   next one.  Ties keep the earlier child.
+*/
+
+#define DTRK_LOCALMAX 256         /* registers and inputs on the C stack    */
+#define DTRK_INT16MAX 32767       /* largest int16 weight                   */
+#define DTRK_REGMAX 65535         /* most registers of a block              */
+
+typedef struct tagDTRKNODE        /* compact dtree node                     */
+{
+  float fltT;                     /* threshold                              */
+  int nInfo;                      /* right child and variable, or leaf      */
+} DTRKNODE;                       /* 8 bytes                                */
+
+struct tagDTREECOMPACT
+{
+  int nFlags;                     /* DTR_COMPACT_FLOAT or DTR_COMPACT_INT16 */
+  int nDim;                       /* dimension of space                     */
+  int nInputs;                    /* nDim - 1                               */
+  int nVarBits;                   /* bits of nInfo holding the variable     */
+  int nForms;                     /* linear forms                           */
+  int nBlocks;                    /* blocks                                 */
+  int nMaxRegs;                   /* most registers used by a block         */
+  double dblMin;                  /* output bound                           */
+  double dblMax;
+  size_t cbSize;                  /* bytes allocated                        */
+  int* anVarIndex;                /* variable index of each input column    */
+  double* adblCenter;             /* center of each input column            */
+  double* adblScale;              /* int16 weight scale of each column      */
+  float* afltBias;                /* bias of each form at the center        */
+  float* afltW;                   /* float weights, form major              */
+  short* anW;                     /* int16 weights, form major              */
+  DTRKNODE* aNodes;               /* nodes in preorder                      */
+  int* anFormStart;               /* anBlockForms start of each block       */
+  int* anProgramStart;            /* anProgram start of each block          */
+  int* anBlockForms;              /* form counts and forms of the blocks    */
+  unsigned short* anProgram;      /* min/max programs of the blocks         */
+};
+
+/* rounds up to a multiple of 8 bytes */
+#define DTRK_ALIGN(cb) (((cb) + 7) & ~(size_t)7)
+
+/* counts the distinct forms, min/max nodes and program ints of a min/max
+   tree; anLocal maps linear form indexes to block registers (-1 if
+   unused) */
+static int CountCompactTree(MINMAXNODE* pMMN, int* anLocal, int* anBlockLF,
+                            int* pnForms, int* pnNodes, int* pnProgram)
+{
+  if (pMMN->nType == DTREE_LINEAR)
+  {
+    int nLF = MMN_LFINDEX(pMMN);
+    if (anLocal[nLF] < 0)
+    {
+      anLocal[nLF] = *pnForms;
+      anBlockLF[(*pnForms)++] = nLF;
+    }
+    return DTR_NOERROR;
+  }
+  else if (pMMN->nType == DTREE_MIN || pMMN->nType == DTREE_MAX)
+  {
+    MINMAXNODE* pList = MMN_CHILDLIST(pMMN);
+    int nChildren = 0, nErr;
+
+    /* EvalMinMaxTree leaves the result unset for an empty node */
+    if (pList == NULL)
+      return DTR_GENERIC;
+
+    (*pnNodes)++;
+    *pnProgram += 2;
+    for (; pList != NULL; pList = pList->pNext)
+    {
+      if ((nErr = CountCompactTree(pList, anLocal, anBlockLF, pnForms, pnNodes,
+                                   pnProgram)) != DTR_NOERROR)
+        return nErr;
+      (*pnProgram)++;
+      if (++nChildren > DTRK_REGMAX)
+        return DTR_COMPACTLIMIT;
+    }
+    return DTR_NOERROR;
+  }
+
+  return DTR_GENERIC; /* unknown node type */
+}
+
+/* emits the nodes of a min/max tree and returns the register of pMMN;
+   anPending holds the registers of children not yet emitted */
+static int EmitCompactTree(MINMAXNODE* pMMN, const int* anLocal, int nForms,
+                           unsigned short* anProgram, int* pnProgram, int* pnNodes,
+                           int* anPending, int* pnPending)
+{
+  MINMAXNODE* pList;
+  int nBase, i;
+
+  if (pMMN->nType == DTREE_LINEAR)
+    return anLocal[MMN_LFINDEX(pMMN)];
+
+  nBase = *pnPending;
+  for (pList = MMN_CHILDLIST(pMMN); pList != NULL; pList = pList->pNext)
+  {
+    int nReg = EmitCompactTree(pList, anLocal, nForms, anProgram, pnProgram,
+                               pnNodes, anPending, pnPending);
+    anPending[(*pnPending)++] = nReg;
+  }
+
+  anProgram[(*pnProgram)++] = (unsigned short)pMMN->nType;
+  anProgram[(*pnProgram)++] = (unsigned short)(*pnPending - nBase);
+  for (i = nBase; i < *pnPending; i++)
+    anProgram[(*pnProgram)++] = (unsigned short)anPending[i];
+  *pnPending = nBase;
+
+  return nForms + (*pnNodes)++;
+}
+
+/* stores the dtree nodes in preorder; anStack holds 2 * nNodes + 2 ints */
+static int StoreCompactNodes(DTREECOMPACT* pCompact, DTREE* pDtree,
+                             int* anStack)
+{
+  int nStack = 0, nNext = 0;
+
+  anStack[nStack++] = 0;          /* dtree node                             */
+  anStack[nStack++] = -1;         /* compact node whose right child it is   */
+  while (nStack > 0)
+  {
+    int nParent = anStack[--nStack];
+    int nIndex = anStack[--nStack];
+    DTREENODE* pNode;
+    DTRKNODE* pKNode;
+
+    if (nIndex < 0 || nIndex >= pDtree->nNodes || nNext >= pDtree->nNodes)
+      return DTR_GENERIC;
+    pNode = pDtree->aNodes + nIndex;
+    pKNode = pCompact->aNodes + nNext;
+
+    if (nParent >= 0)
+      pCompact->aNodes[nParent].nInfo |= nNext << pCompact->nVarBits;
+
+    if (pNode->nLeaf)
+    {
+      if (DNODE_BLOCKINDEX(pNode) < 0 ||
+          DNODE_BLOCKINDEX(pNode) >= pDtree->nBlocks)
+        return DTR_GENERIC;
+      pKNode->fltT = 0;
+      pKNode->nInfo = -1 - DNODE_BLOCKINDEX(pNode);
+    }
+    else
+    {
+      pKNode->fltT = (float)DNODE_THRESHOLD(pNode);
+      pKNode->nInfo = DNODE_VARINDEX(pNode);
+      anStack[nStack++] = DNODE_RIGHTINDEX(pNode);
+      anStack[nStack++] = nNext;
+      anStack[nStack++] = DNODE_LEFTINDEX(pNode);
+      anStack[nStack++] = -1;
+    }
+    nNext++;
+  }
+  return DTR_NOERROR;
+}
+
+DTRIMP int DTREEAPI CreateCompactDtree(DTREE* pDtree, int nFlags,
+                                       DTREECOMPACT** ppCompact)
+{
+  DTREECOMPACT* pCompact = NULL;
+  int* anLocal = NULL;            /* linear form to block register map      */
+  int* anBlockLF = NULL;          /* forms of the block being counted       */
+  int* anWork = NULL;             /* child registers, then node stack       */
+  double* adblA = NULL;           /* solved weights of one form             */
+  size_t cbW, cbInts, cb;
+  char* pb;
+  int nDim, nOutput, nInputs, nBlockForms, nProgram, nMaxTree, nMaxWork;
+  int i, j, k;
+  int nErr = DTR_NOERROR;
+
+  if (ppCompact == NULL)
+    return DTR_GENERIC;
+  *ppCompact = NULL;
+  if (pDtree == NULL || pDtree->nDim < 2 || pDtree->nBlocks < 1 ||
+      pDtree->nNodes < 1 || pDtree->aBlocks == NULL ||
+      pDtree->aLinearForms == NULL ||
+      (nFlags != DTR_COMPACT_FLOAT && nFlags != DTR_COMPACT_INT16))
+  {
+    return DTR_GENERIC;
+  }
+
+  nDim = pDtree->nDim;
+  nOutput = pDtree->nOutputIndex;
+  nInputs = nDim - 1;
+
+  anLocal = (int*)malloc(pDtree->nLinearForms * sizeof(int));
+  anBlockLF = (int*)malloc(pDtree->nLinearForms * sizeof(int));
+  adblA = (double*)malloc(nInputs * sizeof(double));
+  if (anLocal == NULL || anBlockLF == NULL || adblA == NULL)
+  {
+    nErr = DTR_MALLOCFAILED;
+    goto done;
+  }
+  for (i = 0; i < pDtree->nLinearForms; i++)
+    anLocal[i] = -1;
+
+  /* size the programs; registers and child counts must fit 16 bits */
+  nBlockForms = 0;
+  nProgram = 0;
+  nMaxTree = 0;
+  for (i = 0; i < pDtree->nBlocks; i++)
+  {
+    int nForms = 0, nNodes = 0, nBlockProgram = 0;
+    if ((nErr = CountCompactTree(pDtree->aBlocks[i].pMinMaxTree, anLocal,
+                                 anBlockLF, &nForms, &nNodes,
+                                 &nBlockProgram)) != DTR_NOERROR)
+      goto done;
+    for (j = 0; j < nForms; j++)
+      anLocal[anBlockLF[j]] = -1;
+    nBlockForms += 1 + nForms;
+    nProgram += 1 + nBlockProgram;
+    if (nForms + nNodes > nMaxTree)
+      nMaxTree = nForms + nNodes;
+  }
+  if (nMaxTree > DTRK_REGMAX)
+  {
+    nErr = DTR_COMPACTLIMIT;
+    goto done;
+  }
+
+  /* one allocation: header, doubles, nodes, floats, ints, then the 16 bit
+     programs and weights */
+  cbW = (size_t)pDtree->nLinearForms * nInputs *
+          (nFlags == DTR_COMPACT_INT16 ? sizeof(short) : sizeof(float));
+  cbInts = ((size_t)pDtree->nBlocks * 2 + nBlockForms + nInputs) * sizeof(int);
+  cb = DTRK_ALIGN(sizeof(DTREECOMPACT)) +
+       DTRK_ALIGN((size_t)nInputs * 2 * sizeof(double)) +
+       DTRK_ALIGN((size_t)pDtree->nNodes * sizeof(DTRKNODE)) +
+       DTRK_ALIGN((size_t)pDtree->nLinearForms * sizeof(float)) +
+       DTRK_ALIGN(cbInts) +
+       DTRK_ALIGN((size_t)nProgram * sizeof(unsigned short)) + cbW;
+  if ((pb = (char*)malloc(cb)) == NULL)
+  {
+    nErr = DTR_MALLOCFAILED;
+    goto done;
+  }
+  pCompact = (DTREECOMPACT*)pb;
+  memset(pCompact, 0, sizeof(DTREECOMPACT));
+  pCompact->nFlags = nFlags;
+  pCompact->nDim = nDim;
+  pCompact->nInputs = nInputs;
+  pCompact->nForms = pDtree->nLinearForms;
+  pCompact->nBlocks = pDtree->nBlocks;
+  pCompact->nMaxRegs = nMaxTree;
+  pCompact->dblMin = pDtree->aVarDefs[nOutput].bound.dblMin;
+  pCompact->dblMax = pDtree->aVarDefs[nOutput].bound.dblMax;
+  pCompact->cbSize = cb;
+  pb += DTRK_ALIGN(sizeof(DTREECOMPACT));
+  pCompact->adblCenter = (double*)pb;
+  pCompact->adblScale = pCompact->adblCenter + nInputs;
+  pb += DTRK_ALIGN((size_t)nInputs * 2 * sizeof(double));
+  pCompact->aNodes = (DTRKNODE*)pb;
+  pb += DTRK_ALIGN((size_t)pDtree->nNodes * sizeof(DTRKNODE));
+  pCompact->afltBias = (float*)pb;
+  pb += DTRK_ALIGN((size_t)pDtree->nLinearForms * sizeof(float));
+  pCompact->anFormStart = (int*)pb;
+  pCompact->anProgramStart = pCompact->anFormStart + pDtree->nBlocks;
+  pCompact->anBlockForms = pCompact->anProgramStart + pDtree->nBlocks;
+  pCompact->anVarIndex = pCompact->anBlockForms + nBlockForms;
+  pb += DTRK_ALIGN(cbInts);
+  pCompact->anProgram = (unsigned short*)pb;
+  pb += DTRK_ALIGN((size_t)nProgram * sizeof(unsigned short));
+  if (nFlags == DTR_COMPACT_INT16)
+    pCompact->anW = (short*)pb;
+  else
+    pCompact->afltW = (float*)pb;
+
+  /* input columns skip the output variable and are centered on the
+     middle of the variable bounds */
+  for (i = 0, j = 0; i < nDim; i++)
+  {
+    if (i == nOutput)
+      continue;
+    pCompact->anVarIndex[j] = i;
+    pCompact->adblCenter[j] = 0.5 * (pDtree->aVarDefs[i].bound.dblMin +
+                                     pDtree->aVarDefs[i].bound.dblMax);
+    pCompact->adblScale[j] = 0;
+    j++;
+  }
+
+  /* the int16 scale of a column covers its largest solved weight */
+  for (k = 0; k < pDtree->nLinearForms; k++)
+  {
+    LINEARFORM* pLF = pDtree->aLinearForms + k;
+    if (pLF->adblW[nOutput] == 0)
+    {
+      nErr = DTR_ZEROOUTPUTWEIGHT;
+      goto done;
+    }
+    for (j = 0; j < nInputs; j++)
+    {
+      double dblA = fabs(pLF->adblW[pCompact->anVarIndex[j]] / pLF->adblW[nOutput]);
+      if (dblA > pCompact->adblScale[j])
+        pCompact->adblScale[j] = dblA;
+    }
+  }
+  for (j = 0; j < nInputs; j++)
+  {
+    pCompact->adblScale[j] /= DTRK_INT16MAX;
+    if (pCompact->adblScale[j] == 0)
+      pCompact->adblScale[j] = 1;
+  }
+
+  /* forms, solved for the output and centered */
+  for (k = 0; k < pDtree->nLinearForms; k++)
+  {
+    LINEARFORM* pLF = pDtree->aLinearForms + k;
+    double dblDiv = -pLF->adblW[nOutput];
+    double dblBias = pLF->dblBias;
+    for (j = 0; j < nInputs; j++)
+    {
+      int nVar = pCompact->anVarIndex[j];
+      dblBias += pLF->adblW[nVar] * pCompact->adblCenter[j];
+      adblA[j] = pLF->adblW[nVar] / dblDiv;
+    }
+    pCompact->afltBias[k] = (float)(dblBias / dblDiv);
+    for (j = 0; j < nInputs; j++)
+    {
+      if (nFlags == DTR_COMPACT_INT16)
+      {
+        pCompact->anW[(size_t)k * nInputs + j] =
+          (short)floor(adblA[j] / pCompact->adblScale[j] + 0.5);
+      }
+      else
+        pCompact->afltW[(size_t)k * nInputs + j] = (float)adblA[j];
+    }
+  }
+
+  /* nodes; the right child index must fit beside the variable */
+  for (pCompact->nVarBits = 1; (1 << pCompact->nVarBits) < nDim;
+       pCompact->nVarBits++);
+  if (pCompact->nVarBits > 30 ||
+      pDtree->nNodes - 1 > (0x7fffffff >> pCompact->nVarBits))
+  {
+    nErr = DTR_COMPACTLIMIT;
+    goto done;
+  }
+  nMaxWork = 2 * pDtree->nNodes + 2 > nMaxTree ? 2 * pDtree->nNodes + 2 : nMaxTree;
+  if ((anWork = (int*)malloc(nMaxWork * sizeof(int))) == NULL)
+  {
+    nErr = DTR_MALLOCFAILED;
+    goto done;
+  }
+  if ((nErr = StoreCompactNodes(pCompact, pDtree, anWork)) != DTR_NOERROR)
+    goto done;
+
+  /* block forms and programs */
+  nBlockForms = 0;
+  nProgram = 0;
+  for (i = 0; i < pDtree->nBlocks; i++)
+  {
+    int nForms = 0, nNodes = 0, nBlockProgram = 0, nPending = 0;
+
+    CountCompactTree(pDtree->aBlocks[i].pMinMaxTree, anLocal, anBlockLF,
+                     &nForms, &nNodes, &nBlockProgram);
+    pCompact->anFormStart[i] = nBlockForms;
+    pCompact->anBlockForms[nBlockForms] = nForms;
+    memcpy(pCompact->anBlockForms + nBlockForms + 1, anBlockLF,
+           nForms * sizeof(int));
+    nBlockForms += 1 + nForms;
+
+    pCompact->anProgramStart[i] = nProgram;
+    pCompact->anProgram[nProgram] = (unsigned short)nNodes;
+    nBlockProgram = 0;
+    nNodes = 0;
+    EmitCompactTree(pDtree->aBlocks[i].pMinMaxTree, anLocal, nForms,
+                    pCompact->anProgram + nProgram + 1, &nBlockProgram,
+                    &nNodes, anWork, &nPending);
+    nProgram += 1 + nBlockProgram;
+
+    for (j = 0; j < nForms; j++)
+      anLocal[anBlockLF[j]] = -1;
+  }
+
+  *ppCompact = pCompact;
+  pCompact = NULL;
+
+done:
+  free(pCompact);
+  free(anLocal);
+  free(anBlockLF);
+  free(anWork);
+  free(adblA);
+  return nErr;
+}
+
+DTRIMP void DTREEAPI DestroyCompactDtree(DTREECOMPACT* pCompact)
+{
+  free(pCompact);
+}
+
+DTRIMP size_t DTREEAPI GetCompactDtreeSize(const DTREECOMPACT* pCompact)
+{
+  return pCompact != NULL ? pCompact->cbSize : 0;
+}
+
+DTRIMP int DTREEAPI EvalCompactDtree(const DTREECOMPACT* pCompact,
+                                     const double* adblInput,
+                                     double* pdblResult, int* pnLinearIndex)
+{
+  double adblLocal[DTRK_LOCALMAX];
+  int anLocal[DTRK_LOCALMAX];
+  double* adblU = adblLocal;      /* centered, scaled inputs                */
+  double* adblReg = adblLocal;    /* form and node values                   */
+  int* anReg = anLocal;           /* form responsible for a register        */
+  const DTRKNODE* pNode;
+  const int* pnForms;
+  const unsigned short* pnNode;
+  int nInputs, nBlock, nForms, nNodes, nRoot, i, j, k;
+
+  if (pCompact == NULL || adblInput == NULL || pdblResult == NULL)
+    return DTR_GENERIC;
+  nInputs = pCompact->nInputs;
+
+  /* find leaf */
+  pNode = pCompact->aNodes;
+  while (pNode->nInfo >= 0)
+  {
+    int nVar = pNode->nInfo & ((1 << pCompact->nVarBits) - 1);
+    if (adblInput[nVar] <= pNode->fltT)
+      pNode++;
+    else
+      pNode = pCompact->aNodes + (pNode->nInfo >> pCompact->nVarBits);
+  }
+  nBlock = -1 - pNode->nInfo;
+  pnForms = pCompact->anBlockForms + pCompact->anFormStart[nBlock];
+  nForms = pnForms[0];
+  pnNode = pCompact->anProgram + pCompact->anProgramStart[nBlock];
+  nNodes = *pnNode++;
+
+  /* the inputs take the front of the local array, the registers the rest */
+  if (nInputs + pCompact->nMaxRegs > DTRK_LOCALMAX)
+  {
+    adblU = (double*)malloc((nInputs + pCompact->nMaxRegs) * sizeof(double));
+    anReg = (int*)malloc(pCompact->nMaxRegs * sizeof(int));
+    if (adblU == NULL || anReg == NULL)
+    {
+      free(adblU);
+      free(anReg);
+      return DTR_MALLOCFAILED;
+    }
+  }
+  adblReg = adblU + nInputs;
+
+  for (j = 0; j < nInputs; j++)
+  {
+    adblU[j] = adblInput[pCompact->anVarIndex[j]] - pCompact->adblCenter[j];
+    if (pCompact->nFlags == DTR_COMPACT_INT16)
+      adblU[j] *= pCompact->adblScale[j];
+  }
+
+  /* forms */
+  for (k = 0; k < nForms; k++)
+  {
+    int nLF = pnForms[1 + k];
+    double dbl = pCompact->afltBias[nLF];
+    if (pCompact->nFlags == DTR_COMPACT_INT16)
+    {
+      const short* anW = pCompact->anW + (size_t)nLF * nInputs;
+      for (j = 0; j < nInputs; j++)
+        dbl += anW[j] * adblU[j];
+    }
+    else
+    {
+      const float* afltW = pCompact->afltW + (size_t)nLF * nInputs;
+      for (j = 0; j < nInputs; j++)
+        dbl += afltW[j] * adblU[j];
+    }
+    adblReg[k] = dbl;
+    anReg[k] = nLF;
+  }
+
+  /* min/max nodes, the first of equal values wins */
+  for (i = 0; i < nNodes; i++)
+  {
+    int nChildren = pnNode[1];
+    const unsigned short* pnChild = pnNode + 2;
+    double dbl = adblReg[pnChild[0]];
+    int nIndex = anReg[pnChild[0]];
+
+    for (k = 1; k < nChildren; k++)
+    {
+      if (pnNode[0] == DTREE_MIN ? adblReg[pnChild[k]] < dbl :
+                                   adblReg[pnChild[k]] > dbl)
+      {
+        dbl = adblReg[pnChild[k]];
+        nIndex = anReg[pnChild[k]];
+      }
+    }
+    adblReg[nForms + i] = dbl;
+    anReg[nForms + i] = nIndex;
+    pnNode += 2 + nChildren;
+  }
+
+  /* a block that is a single form has no nodes */
+  nRoot = nNodes > 0 ? nForms + nNodes - 1 : 0;
+  *pdblResult = adblReg[nRoot];
+  if (pnLinearIndex != NULL)
+    *pnLinearIndex = anReg[nRoot];
+
+  if (adblU != adblLocal)
+  {
+    free(adblU);
+    free(anReg);
+  }
+
+  /* bound output */
+  if (*pdblResult < pCompact->dblMin)
+    *pdblResult = pCompact->dblMin;
+  else if (*pdblResult > pCompact->dblMax)
+    *pdblResult = pCompact->dblMax;
+
+  return DTR_NOERROR;
+}
+
+/*
+/////////////////////////////////////////////////////////////////////
+// deviation from the double DTREE
+*/
+
+typedef struct tagDTRKMEASURE     /* state of MeasureCompactDtree           */
+{
+  const DTREECOMPACT* pCompact;
+  DTREE* pDtree;
+  double* adblLo;                 /* box of the current node                */
+  double* adblHi;
+  double* adblX;                  /* point being compared                   */
+  double dblMaxDev;
+} DTRKMEASURE;
+
+/* compares the two DTREEs at adblX */
+static int MeasureCompactPoint(DTRKMEASURE* pMeasure)
+{
+  double dbl, dblCompact;
+  int nErr;
+
+  if ((nErr = EvalDtree(pMeasure->pDtree, pMeasure->adblX, &dbl,
+                        NULL)) != DTR_NOERROR ||
+      (nErr = EvalCompactDtree(pMeasure->pCompact, pMeasure->adblX,
+                               &dblCompact, NULL)) != DTR_NOERROR)
+  {
+    return nErr;
+  }
+  if (fabs(dbl - dblCompact) > pMeasure->dblMaxDev)
+    pMeasure->dblMaxDev = fabs(dbl - dblCompact);
+  return DTR_NOERROR;
+}
+
+/* sets adblX to the center of the current box */
+static void CenterCompactPoint(DTRKMEASURE* pMeasure)
+{
+  int i;
+  for (i = 0; i < pMeasure->pDtree->nDim; i++)
+    pMeasure->adblX[i] = 0.5 * (pMeasure->adblLo[i] + pMeasure->adblHi[i]);
+}
+
+/* visits the subtree of nIndex within the current box: leaf centers, and
+   for each threshold the double and the float thresholds and a point
+   just above the larger of them */
+static int MeasureCompactNode(DTRKMEASURE* pMeasure, int nIndex)
+{
+  DTREENODE* pNode = pMeasure->pDtree->aNodes + nIndex;
+  double dblT, dblSave, adblT[3];
+  int nVar, nErr, i;
+
+  if (pNode->nLeaf)
+  {
+    CenterCompactPoint(pMeasure);
+    return MeasureCompactPoint(pMeasure);
+  }
+
+  nVar = DNODE_VARINDEX(pNode);
+  dblT = DNODE_THRESHOLD(pNode);
+  adblT[0] = dblT;
+  adblT[1] = (float)dblT;
+  adblT[2] = adblT[0] > adblT[1] ? adblT[0] : adblT[1];
+  adblT[2] += fabs(adblT[2]) * 1e-12 + 1e-300;
+  CenterCompactPoint(pMeasure);
+  for (i = 0; i < 3; i++)
+  {
+    if (adblT[i] < pMeasure->adblLo[nVar] || adblT[i] > pMeasure->adblHi[nVar])
+      continue;
+    pMeasure->adblX[nVar] = adblT[i];
+    if ((nErr = MeasureCompactPoint(pMeasure)) != DTR_NOERROR)
+      return nErr;
+  }
+
+  /* children, skipping boxes outside the variable bounds */
+  dblSave = pMeasure->adblHi[nVar];
+  if (dblT < dblSave)
+    pMeasure->adblHi[nVar] = dblT;
+  if (pMeasure->adblLo[nVar] <= pMeasure->adblHi[nVar] &&
+      (nErr = MeasureCompactNode(pMeasure, DNODE_LEFTINDEX(pNode))) != DTR_NOERROR)
+    return nErr;
+  pMeasure->adblHi[nVar] = dblSave;
+
+  dblSave = pMeasure->adblLo[nVar];
+  if (dblT > dblSave)
+    pMeasure->adblLo[nVar] = dblT;
+  if (pMeasure->adblLo[nVar] <= pMeasure->adblHi[nVar] &&
+      (nErr = MeasureCompactNode(pMeasure, DNODE_RIGHTINDEX(pNode))) != DTR_NOERROR)
+    return nErr;
+  pMeasure->adblLo[nVar] = dblSave;
+
+  return DTR_NOERROR;
+}
+
+DTRIMP int DTREEAPI MeasureCompactDtree(const DTREECOMPACT* pCompact,
+                                        DTREE* pDtree, int nSamples,
+                                        double* pdblMaxDev)
+{
+  DTRKMEASURE measure;
+  unsigned int nSeed = 12345;
+  int nDim, i, j;
+  int nErr = DTR_NOERROR;
+
+  if (pCompact == NULL || pDtree == NULL || pdblMaxDev == NULL ||
+      pDtree->nDim != pCompact->nDim || pDtree->nBlocks != pCompact->nBlocks)
+  {
+    return DTR_GENERIC;
+  }
+  nDim = pDtree->nDim;
+
+  measure.pCompact = pCompact;
+  measure.pDtree = pDtree;
+  measure.dblMaxDev = 0;
+  measure.adblLo = (double*)malloc(nDim * 3 * sizeof(double));
+  if (measure.adblLo == NULL)
+    return DTR_MALLOCFAILED;
+  measure.adblHi = measure.adblLo + nDim;
+  measure.adblX = measure.adblHi + nDim;
+  for (i = 0; i < nDim; i++)
+  {
+    measure.adblLo[i] = pDtree->aVarDefs[i].bound.dblMin;
+    measure.adblHi[i] = pDtree->aVarDefs[i].bound.dblMax;
+  }
+
+  nErr = MeasureCompactNode(&measure, 0);
+
+  for (i = 0; i < nSamples && nErr == DTR_NOERROR; i++)
+  {
+    for (j = 0; j < nDim; j++)
+    {
+      nSeed = nSeed * 1103515245u + 12345u;
+      measure.adblX[j] = measure.adblLo[j] + (measure.adblHi[j] -
+        measure.adblLo[j]) * ((nSeed >> 8) / 16777216.0);
+    }
+    nErr = MeasureCompactPoint(&measure);
+  }
+
+  *pdblMaxDev = measure.dblMaxDev;
+  free(measure.adblLo);
+  return nErr;
+}
@@ -0,0 +1,707 @@
+// dtr_comp.c
+// DTREE compiled block evaluation
+
+// ALNfit Learning Engine for approximation of functions defined by samples.
+// Copyright (C) 2018 William W. Armstrong.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// Version 3 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// For further information contact
+// William W. Armstrong
+
+// 3624 - 108 Street NW
+// Edmonton, Alberta, Canada  T6J 1B4
+
+#ifdef DTREEDLL
+#define DTRIMP __declspec(dllexport)
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dtree.h>
+#include "dtr_priv.h"
+
+#ifdef _WIN32
+#include <windows.h>  // for InterlockedExchange
+#endif
+
+/*
+/////////////////////////////////////////////////////////////////////
+// compiled layout
+
+   Each block keeps its own copy of the linear forms its min/max tree
+   references, stored variable major: for input column j the weights of
+   all the block's forms are contiguous, so one pass over the columns
+   evaluates every form of the block with independent lanes that the
+   compiler can vectorize.  The output column is removed; in strict mode
+   the divisor -w[nOutput] is kept so each form is computed with exactly
+   the operations of EvalLinearForm, in fast mode it is folded into the
+   weights and bias.  Form counts are padded to DTRC_LANES with zero
+   weights and unit divisors.
+
+   The min/max tree becomes a program over registers: registers below
+   nFormsPad hold the form values, and the min/max nodes, in postorder,
+   each write the next register.  A node is stored as its type, its child
+   count and its children's registers.  Ties keep the earlier child, as in
+   EvalMinMaxTree.  EvalCompiledBlock keeps up to DTRC_LOCALMAX registers
+   on the stack; a DTREE with larger blocks gets one register scratch area
+   with the compiled data, which an evaluation claims with an atomic flag.
+   While another thread holds it, large blocks are left to the tree walk.
+
+   The compiled data records the arrays and min/max roots it was built from,
+   and the evaluation falls back to the tree walk when they have changed.
+   Weights changed in place are not noticed.
+*/
+
+#define DTRC_LANES 4              /* form count granularity                 */
+#define DTRC_LOCALMAX 256         /* registers kept on the C stack          */
+
+typedef struct tagDTRCBLOCK       /* compiled block                         */
+{
+  int nForms;                     /* distinct linear forms used             */
+  int nFormsPad;                  /* nForms rounded up to DTRC_LANES        */
+  int nNodes;                     /* min/max nodes in the program           */
+  int nRoot;                      /* register holding the block value       */
+  int bZeroWeight;                /* a form has a zero output weight        */
+  MINMAXNODE* pMinMaxTree;        /* min/max tree compiled                  */
+  double* adblBias;               /* nFormsPad biases                       */
+  double* adblDiv;                /* nFormsPad divisors (strict mode)       */
+  double* adblW;                  /* (nDim - 1) * nFormsPad weights         */
+  int* anLFIndex;                 /* DTREE linear form index of each form   */
+  int* anProgram;                 /* min/max nodes                          */
+} DTRCBLOCK;
+
+typedef struct tagDTRCOMPILED     /* compiled DTREE                         */
+{
+  int nFlags;                     /* DTR_COMPILE_STRICT or DTR_COMPILE_FAST */
+  int nInputs;                    /* nDim - 1                               */
+  int nBlocks;                    /* number of blocks                       */
+  int nMaxRegs;                   /* most registers used by a block         */
+  volatile long lScratchBusy;     /* adblScratch is in use                  */
+  double* adblScratch;            /* registers of blocks too large for the  */
+  int* anScratch;                 /*   stack, NULL if there are none        */
+  int nDim;                       /* DTREE compiled, to detect changes      */
+  int nOutputIndex;
+  int nLinearForms;
+  LINEARFORM* aLinearForms;
+  int nDtreeBlocks;
+  BLOCK* aDtreeBlocks;
+  int* anVarIndex;                /* variable index of each input column    */
+  DTRCBLOCK* aBlocks;             /* compiled blocks                        */
+} DTRCOMPILED;
+
+/* rounds up to a multiple of 8 bytes */
+#define DTRC_ALIGN(cb) (((cb) + 7) & ~(size_t)7)
+
+/* first pass: counts distinct forms, min/max nodes, program ints and tree
+   nodes of a min/max tree; anLocal maps linear form indexes to block form
+   indexes (-1 if unused) */
+static int CountMinMaxTree(MINMAXNODE* pMMN, int* anLocal, int* anBlockLF,
+                           int* pnForms, int* pnNodes, int* pnProgram,
+                           int* pnTree)
+{
+  (*pnTree)++;
+  if (pMMN->nType == DTREE_LINEAR)
+  {
+    int nLF = MMN_LFINDEX(pMMN);
+    if (anLocal[nLF] < 0)
+    {
+      anLocal[nLF] = *pnForms;
+      anBlockLF[(*pnForms)++] = nLF;
+    }
+    return DTR_NOERROR;
+  }
+  else if (pMMN->nType == DTREE_MIN || pMMN->nType == DTREE_MAX)
+  {
+    MINMAXNODE* pList = MMN_CHILDLIST(pMMN);
+    int nErr;
+
+    /* EvalMinMaxTree leaves the result unset for an empty node; such
+       trees are left to it */
+    if (pList == NULL)
+      return DTR_GENERIC;
+
+    (*pnNodes)++;
+    *pnProgram += 2;
+    for (; pList != NULL; pList = pList->pNext)
+    {
+      if ((nErr = CountMinMaxTree(pList, anLocal, anBlockLF, pnForms, pnNodes,
+                                  pnProgram, pnTree)) != DTR_NOERROR)
+        return nErr;
+      (*pnProgram)++;
+    }
+    return DTR_NOERROR;
+  }
+
+  return DTR_GENERIC; /* unknown node type */
+}
+
+/* second pass: emits the program and returns the register of pMMN;
+   anPending holds the registers of children not yet emitted */
+static int EmitMinMaxTree(MINMAXNODE* pMMN, const int* anLocal, int nFormsPad,
+                          int* anProgram, int* pnProgram, int* pnNodes,
+                          int* anPending, int* pnPending)
+{
+  MINMAXNODE* pList;
+  int nBase, i;
+
+  if (pMMN->nType == DTREE_LINEAR)
+    return anLocal[MMN_LFINDEX(pMMN)];
+
+  nBase = *pnPending;
+  for (pList = MMN_CHILDLIST(pMMN); pList != NULL; pList = pList->pNext)
+  {
+    int nReg = EmitMinMaxTree(pList, anLocal, nFormsPad, anProgram, pnProgram,
+                              pnNodes, anPending, pnPending);
+    anPending[(*pnPending)++] = nReg;
+  }
+
+  anProgram[(*pnProgram)++] = pMMN->nType;
+  anProgram[(*pnProgram)++] = *pnPending - nBase;
+  for (i = nBase; i < *pnPending; i++)
+    anProgram[(*pnProgram)++] = anPending[i];
+  *pnPending = nBase;
+
+  return nFormsPad + (*pnNodes)++;
+}
+
+DTRIMP int DTREEAPI CompileDtree(DTREE* pDtree, int nFlags)
+{
+  DTRCOMPILED* pComp = NULL;
+  int* anLocal = NULL;            /* linear form to block form map          */
+  int* anBlockLF = NULL;          /* forms of the block being counted       */
+  int* anCounts = NULL;           /* forms, nodes, program ints per block   */
+  int* anPending = NULL;          /* child registers while emitting         */
+  size_t cbBlocks, cbDoubles, cbInts, cbVars, cbScratch;
+  double* pdbl;
+  int* pn;
+  char* pb;
+  int nDim, nOutput, nInputs, nMaxTree, nMaxRegs;
+  int i, j, k;
+  int nErr = DTR_NOERROR;
+
+  if (pDtree == NULL || pDtree->nDim < 1 || pDtree->nBlocks < 1 ||
+      pDtree->aBlocks == NULL || pDtree->aLinearForms == NULL ||
+      (nFlags != DTR_COMPILE_STRICT && nFlags != DTR_COMPILE_FAST))
+  {
+    return DTR_GENERIC;
+  }
+
+  /* replace any previous compilation */
+  UncompileDtree(pDtree);
+
+  nDim = pDtree->nDim;
+  nOutput = pDtree->nOutputIndex;
+  nInputs = nDim - 1;
+
+  anLocal = (int*)malloc(pDtree->nLinearForms * sizeof(int));
+  anBlockLF = (int*)malloc(pDtree->nLinearForms * sizeof(int));
+  anCounts = (int*)malloc(pDtree->nBlocks * 3 * sizeof(int));
+  if (anLocal == NULL || anBlockLF == NULL || anCounts == NULL)
+  {
+    nErr = DTR_MALLOCFAILED;
+    goto done;
+  }
+  for (i = 0; i < pDtree->nLinearForms; i++)
+    anLocal[i] = -1;
+
+  /* size everything */
+  cbDoubles = 0;
+  cbInts = 0;
+  nMaxTree = 0;
+  nMaxRegs = 0;
+  for (i = 0; i < pDtree->nBlocks; i++)
+  {
+    int* pnCounts = anCounts + 3 * i;
+    int nTree = 0, nPad;
+    pnCounts[0] = pnCounts[1] = pnCounts[2] = 0;
+    if ((nErr = CountMinMaxTree(pDtree->aBlocks[i].pMinMaxTree, anLocal,
+                                anBlockLF, pnCounts, pnCounts + 1,
+                                pnCounts + 2, &nTree)) != DTR_NOERROR)
+      goto done;
+    for (j = 0; j < pnCounts[0]; j++)
+      anLocal[anBlockLF[j]] = -1;
+
+    nPad = (pnCounts[0] + DTRC_LANES - 1) / DTRC_LANES * DTRC_LANES;
+    cbDoubles += (size_t)nPad * (2 + nInputs) * sizeof(double);
+    cbInts += ((size_t)pnCounts[0] + pnCounts[2]) * sizeof(int);
+    if (nTree > nMaxTree)
+      nMaxTree = nTree;
+    if (nPad + pnCounts[1] > nMaxRegs)
+      nMaxRegs = nPad + pnCounts[1];
+  }
+
+  if ((anPending = (int*)malloc(nMaxTree * sizeof(int))) == NULL)
+  {
+    nErr = DTR_MALLOCFAILED;
+    goto done;
+  }
+
+  /* one allocation: header, blocks, doubles, ints, then the register
+     scratch if the stack is too small for a block */
+  cbBlocks = DTRC_ALIGN(sizeof(DTRCOMPILED)) +
+             DTRC_ALIGN(pDtree->nBlocks * sizeof(DTRCBLOCK));
+  cbVars = (size_t)nInputs * sizeof(int);
+  cbScratch = 0;
+  if (nMaxRegs > DTRC_LOCALMAX)
+    cbScratch = DTRC_ALIGN(cbInts + cbVars) - (cbInts + cbVars) +
+                (size_t)nMaxRegs * (sizeof(double) + sizeof(int));
+  if ((pb = (char*)malloc(cbBlocks + cbDoubles + cbInts + cbVars + cbScratch)) == NULL)
+  {
+    nErr = DTR_MALLOCFAILED;
+    goto done;
+  }
+  pComp = (DTRCOMPILED*)pb;
+  pComp->nFlags = nFlags;
+  pComp->nInputs = nInputs;
+  pComp->nBlocks = pDtree->nBlocks;
+  pComp->nMaxRegs = 0;
+  pComp->lScratchBusy = 0;
+  pComp->adblScratch = NULL;
+  pComp->anScratch = NULL;
+  if (cbScratch > 0)
+  {
+    pComp->adblScratch = (double*)(pb + cbBlocks + cbDoubles +
+                                   DTRC_ALIGN(cbInts + cbVars));
+    pComp->anScratch = (int*)(pComp->adblScratch + nMaxRegs);
+  }
+  pComp->nDim = nDim;
+  pComp->nOutputIndex = nOutput;
+  pComp->nLinearForms = pDtree->nLinearForms;
+  pComp->aLinearForms = pDtree->aLinearForms;
+  pComp->nDtreeBlocks = pDtree->nBlocks;
+  pComp->aDtreeBlocks = pDtree->aBlocks;
+  pComp->aBlocks = (DTRCBLOCK*)(pb + DTRC_ALIGN(sizeof(DTRCOMPILED)));
+  pdbl = (double*)(pb + cbBlocks);
+  pn = (int*)(pb + cbBlocks + cbDoubles);
+
+  /* input columns skip the output variable */
+  pComp->anVarIndex = pn;
+  for (i = 0, j = 0; i < nDim; i++)
+  {
+    if (i != nOutput)
+      pComp->anVarIndex[j++] = i;
+  }
+  pn += nInputs;
+
+  for (i = 0; i < pDtree->nBlocks; i++)
+  {
+    DTRCBLOCK* pBlock = pComp->aBlocks + i;
+    int nForms = 0, nNodes = 0, nProgram = 0, nTree = 0, nPending = 0;
+
+    /* recount to rebuild the form map for this block */
+    CountMinMaxTree(pDtree->aBlocks[i].pMinMaxTree, anLocal, anBlockLF,
+                    &nForms, &nNodes, &nProgram, &nTree);
+
+    pBlock->nForms = nForms;
+    pBlock->nFormsPad = (nForms + DTRC_LANES - 1) / DTRC_LANES * DTRC_LANES;
+    pBlock->bZeroWeight = 0;
+    pBlock->pMinMaxTree = pDtree->aBlocks[i].pMinMaxTree;
+    pBlock->adblBias = pdbl;
+    pBlock->adblDiv = pdbl + pBlock->nFormsPad;
+    pBlock->adblW = pdbl + 2 * pBlock->nFormsPad;
+    pdbl += (size_t)pBlock->nFormsPad * (2 + nInputs);
+    pBlock->anLFIndex = pn;
+    pBlock->anProgram = pn + nForms;
+    pn += nForms + nProgram;
+
+    /* forms, variable major */
+    for (k = 0; k < pBlock->nFormsPad; k++)
+    {
+      if (k < nForms)
+      {
+        LINEARFORM* pLF = pDtree->aLinearForms + anBlockLF[k];
+        double dblDiv = -pLF->adblW[nOutput];
+        pBlock->anLFIndex[k] = anBlockLF[k];
+        if (pLF->adblW[nOutput] == 0)
+        {
+          pBlock->bZeroWeight = 1;
+          dblDiv = 1;
+        }
+        if (nFlags == DTR_COMPILE_FAST)
+        {
+          pBlock->adblBias[k] = pLF->dblBias / dblDiv;
+          pBlock->adblDiv[k] = 1;
+          for (j = 0; j < nInputs; j++)
+            pBlock->adblW[j * pBlock->nFormsPad + k] =
+              pLF->adblW[pComp->anVarIndex[j]] / dblDiv;
+        }
+        else
+        {
+          pBlock->adblBias[k] = pLF->dblBias;
+          pBlock->adblDiv[k] = dblDiv;
+          for (j = 0; j < nInputs; j++)
+            pBlock->adblW[j * pBlock->nFormsPad + k] =
+              pLF->adblW[pComp->anVarIndex[j]];
+        }
+      }
+      else
+      {
+        pBlock->adblBias[k] = 0;
+        pBlock->adblDiv[k] = 1;
+        for (j = 0; j < nInputs; j++)
+          pBlock->adblW[j * pBlock->nFormsPad + k] = 0;
+      }
+    }
+
+    /* program */
+    nProgram = 0;
+    pBlock->nNodes = 0;
+    pBlock->nRoot = EmitMinMaxTree(pDtree->aBlocks[i].pMinMaxTree, anLocal,
+                                   pBlock->nFormsPad, pBlock->anProgram,
+                                   &nProgram, &pBlock->nNodes,
+                                   anPending, &nPending);
+
+    for (j = 0; j < nForms; j++)
+      anLocal[anBlockLF[j]] = -1;
+
+    if (pBlock->nFormsPad + pBlock->nNodes > pComp->nMaxRegs)
+      pComp->nMaxRegs = pBlock->nFormsPad + pBlock->nNodes;
+  }
+
+  pDtree->pvCompiled = pComp;
+
+done:
+  free(anLocal);
+  free(anBlockLF);
+  free(anCounts);
+  free(anPending);
+  return nErr;
+}
+
+DTRIMP void DTREEAPI UncompileDtree(DTREE* pDtree)
+{
+  if (pDtree == NULL)
+    return;
+
+  free(pDtree->pvCompiled);
+  pDtree->pvCompiled = NULL;
+}
+
+/* the DTREE still has the arrays and sizes pComp was compiled from */
+static int IsCompiledShapeCurrent(const DTREE* pDtree, const DTRCOMPILED* pComp)
+{
+  return pDtree->nDim == pComp->nDim &&
+         pDtree->nOutputIndex == pComp->nOutputIndex &&
+         pDtree->nLinearForms == pComp->nLinearForms &&
+         pDtree->aLinearForms == pComp->aLinearForms &&
+         pDtree->nBlocks == pComp->nDtreeBlocks &&
+         pDtree->aBlocks == pComp->aDtreeBlocks;
+}
+
+int IsCompiledCurrent(const DTREE* pDtree)
+{
+  const DTRCOMPILED* pComp = (const DTRCOMPILED*)pDtree->pvCompiled;
+  int i;
+
+  if (pComp == NULL || !IsCompiledShapeCurrent(pDtree, pComp))
+    return 0;
+  for (i = 0; i < pComp->nBlocks; i++)
+  {
+    if (pComp->aBlocks[i].pMinMaxTree != pDtree->aBlocks[i].pMinMaxTree)
+      return 0;
+  }
+  return 1;
+}
+
+/* claims the register scratch of pComp, returns 0 if it is in use */
+static int ClaimScratch(DTRCOMPILED* pComp)
+{
+#ifdef _WIN32
+  return InterlockedExchange((volatile LONG*)&pComp->lScratchBusy, 1) == 0;
+#else
+  return __sync_lock_test_and_set(&pComp->lScratchBusy, 1) == 0;
+#endif
+}
+
+static void ReleaseScratch(DTRCOMPILED* pComp)
+{
+#ifdef _WIN32
+  InterlockedExchange((volatile LONG*)&pComp->lScratchBusy, 0);
+#else
+  __sync_lock_release(&pComp->lScratchBusy);
+#endif
+}
+
+/* evaluates block nBlock of a compiled DTREE */
+int EvalCompiledBlock(const DTREE* pDtree, int nBlock, const double* adblInput,
+                      double* pdblResult, int* pnLinearIndex)
+{
+  DTRCOMPILED* pComp = (DTRCOMPILED*)pDtree->pvCompiled;
+  const DTRCBLOCK* pBlock = pComp->aBlocks + nBlock;
+  double adblRegLocal[DTRC_LOCALMAX];
+  int anRegLocal[DTRC_LOCALMAX];
+  double* adblReg = adblRegLocal;
+  int* anReg = anRegLocal;        /* block form responsible for a register  */
+  const int* pnNode;
+  int nPad = pBlock->nFormsPad;
+  int i, j, k;
+
+  if (!IsCompiledShapeCurrent(pDtree, pComp) ||
+      pBlock->pMinMaxTree != pDtree->aBlocks[nBlock].pMinMaxTree)
+    return DTRC_TREEWALK;
+
+  if (pBlock->bZeroWeight)
+    return DTR_ZEROOUTPUTWEIGHT;
+
+  /* very large blocks use the scratch registers */
+  if (nPad + pBlock->nNodes > DTRC_LOCALMAX)
+  {
+    if (!ClaimScratch(pComp))
+      return DTRC_TREEWALK;
+    adblReg = pComp->adblScratch;
+    anReg = pComp->anScratch;
+  }
+
+  /* all forms of the block in one pass; each lane performs the operations
+     of EvalLinearForm in the same order */
+  for (k = 0; k < nPad; k++)
+  {
+    adblReg[k] = pBlock->adblBias[k];
+    anReg[k] = k;
+  }
+  for (j = 0; j < pComp->nInputs; j++)
+  {
+    const double dblX = adblInput[pComp->anVarIndex[j]];
+    const double* adblW = pBlock->adblW + (size_t)j * nPad;
+    for (k = 0; k < nPad; k += DTRC_LANES)
+    {
+      adblReg[k] += dblX * adblW[k];
+      adblReg[k + 1] += dblX * adblW[k + 1];
+      adblReg[k + 2] += dblX * adblW[k + 2];
+      adblReg[k + 3] += dblX * adblW[k + 3];
+    }
+  }
+  if (pComp->nFlags == DTR_COMPILE_STRICT)
+  {
+    for (k = 0; k < nPad; k++)
+      adblReg[k] /= pBlock->adblDiv[k];
+  }
+
+  /* min/max nodes, branch free, the first of equal values wins */
+  pnNode = pBlock->anProgram;
+  for (i = 0; i < pBlock->nNodes; i++)
+  {
+    int nChildren = pnNode[1];
+    const int* pnChild = pnNode + 2;
+    double dbl = adblReg[pnChild[0]];
+    int nIndex = anReg[pnChild[0]];
+
+    if (pnNode[0] == DTREE_MIN)
+    {
+      for (k = 1; k < nChildren; k++)
+      {
+        int bTake = adblReg[pnChild[k]] < dbl;
+        dbl = bTake ? adblReg[pnChild[k]] : dbl;
+        nIndex = bTake ? anReg[pnChild[k]] : nIndex;
+      }
+    }
+    else
+    {
+      for (k = 1; k < nChildren; k++)
+      {
+        int bTake = adblReg[pnChild[k]] > dbl;
+        dbl = bTake ? adblReg[pnChild[k]] : dbl;
+        nIndex = bTake ? anReg[pnChild[k]] : nIndex;
+      }
+    }
+    adblReg[nPad + i] = dbl;
+    anReg[nPad + i] = nIndex;
+    pnNode += 2 + nChildren;
+  }
+
+  *pdblResult = adblReg[pBlock->nRoot];
+  if (pnLinearIndex != NULL)
+    *pnLinearIndex = pBlock->anLFIndex[anReg[pBlock->nRoot]];
+
+  if (adblReg != adblRegLocal)
+    ReleaseScratch(pComp);
+  return DTR_NOERROR;
+}
+
+/*
+/////////////////////////////////////////////////////////////////////
+// batch evaluation
+
+   Rows that reach the same block are evaluated DTRC_TILE at a time: their
+   inputs are gathered column major, then each form and each min/max node
+   is one loop over the tile's rows, with one register per row.  Per row
+   the operations are those of EvalCompiledBlock.
+*/
+
+#define DTRC_TILE 64              /* rows evaluated together                */
+
+size_t CompiledScratchSize(const void* pvCompiled)
+{
+  const DTRCOMPILED* pComp = (const DTRCOMPILED*)pvCompiled;
+  return (size_t)(pComp->nInputs + pComp->nMaxRegs) * DTRC_TILE *
+           (sizeof(double) + sizeof(int));
+}
+
+int EvalCompiledRows(const void* pvCompiled, int nBlock, const double* adblRows,
+                     int nStride, const int* anRows, int nRows,
+                     double* adblOut, int* anLFIndex, void* pvScratch)
+{
+  const DTRCOMPILED* pComp = (const DTRCOMPILED*)pvCompiled;
+  const DTRCBLOCK* pBlock = pComp->aBlocks + nBlock;
+  double* adblX = (double*)pvScratch;
+  double* adblReg = adblX + (size_t)pComp->nInputs * DTRC_TILE;
+  int* anReg = (int*)(adblReg + (size_t)pComp->nMaxRegs * DTRC_TILE);
+  int nPad = pBlock->nFormsPad;
+  int nTile, r, i, j, k;
+
+  if (pBlock->bZeroWeight)
+    return DTR_ZEROOUTPUTWEIGHT;
+
+  for (nTile = 0; nTile < nRows; nTile += DTRC_TILE)
+  {
+    const int* pnNode;
+    int m = nRows - nTile;
+    if (m > DTRC_TILE)
+      m = DTRC_TILE;
+
+    /* gather the tile's inputs, column major; a partial tile is padded
+       with zeros so every loop below runs the full tile */
+    for (r = 0; r < m; r++)
+    {
+      const double* pRow = adblRows + (size_t)anRows[nTile + r] * nStride;
+      for (j = 0; j < pComp->nInputs; j++)
+        adblX[j * DTRC_TILE + r] = pRow[pComp->anVarIndex[j]];
+    }
+    for (j = 0; j < pComp->nInputs; j++)
+    {
+      for (r = m; r < DTRC_TILE; r++)
+        adblX[j * DTRC_TILE + r] = 0;
+    }
+
+    /* every form over every row of the tile, DTRC_LANES rows at a time
+       in locals so the sums stay in registers */
+    for (k = 0; k < pBlock->nForms; k++)
+    {
+      double* pVal = adblReg + k * DTRC_TILE;
+      const double* pW = pBlock->adblW + k;
+      const double dblBias = pBlock->adblBias[k];
+      const double dblDiv = pBlock->adblDiv[k];
+      for (r = 0; r < DTRC_TILE; r += DTRC_LANES)
+      {
+        const double* pX = adblX + r;
+        double dbl0 = dblBias, dbl1 = dblBias, dbl2 = dblBias, dbl3 = dblBias;
+        for (j = 0; j < pComp->nInputs; j++, pX += DTRC_TILE)
+        {
+          const double dblW = pW[(size_t)j * nPad];
+          dbl0 += pX[0] * dblW;
+          dbl1 += pX[1] * dblW;
+          dbl2 += pX[2] * dblW;
+          dbl3 += pX[3] * dblW;
+        }
+        if (pComp->nFlags == DTR_COMPILE_STRICT)
+        {
+          dbl0 /= dblDiv;
+          dbl1 /= dblDiv;
+          dbl2 /= dblDiv;
+          dbl3 /= dblDiv;
+        }
+        pVal[r] = dbl0;
+        pVal[r + 1] = dbl1;
+        pVal[r + 2] = dbl2;
+        pVal[r + 3] = dbl3;
+      }
+      if (anLFIndex != NULL)
+      {
+        int* pIndex = anReg + k * DTRC_TILE;
+        for (r = 0; r < DTRC_TILE; r++)
+          pIndex[r] = k;
+      }
+    }
+
+    /* min/max nodes, tracking the responsible forms only when asked */
+    pnNode = pBlock->anProgram;
+    for (i = 0; i < pBlock->nNodes; i++)
+    {
+      int nChildren = pnNode[1];
+      const int* pnChild = pnNode + 2;
+      double* pD = adblReg + (nPad + i) * DTRC_TILE;
+      int* pDI = anReg + (nPad + i) * DTRC_TILE;
+      const double* pS = adblReg + pnChild[0] * DTRC_TILE;
+
+      for (r = 0; r < DTRC_TILE; r++)
+        pD[r] = pS[r];
+      if (anLFIndex != NULL)
+      {
+        const int* pSI = anReg + pnChild[0] * DTRC_TILE;
+        for (r = 0; r < DTRC_TILE; r++)
+          pDI[r] = pSI[r];
+      }
+
+      for (k = 1; k < nChildren; k++)
+      {
+        pS = adblReg + pnChild[k] * DTRC_TILE;
+        if (anLFIndex == NULL)
+        {
+          if (pnNode[0] == DTREE_MIN)
+          {
+            for (r = 0; r < DTRC_TILE; r++)
+              pD[r] = pS[r] < pD[r] ? pS[r] : pD[r];
+          }
+          else
+          {
+            for (r = 0; r < DTRC_TILE; r++)
+              pD[r] = pS[r] > pD[r] ? pS[r] : pD[r];
+          }
+        }
+        else
+        {
+          const int* pSI = anReg + pnChild[k] * DTRC_TILE;
+          if (pnNode[0] == DTREE_MIN)
+          {
+            for (r = 0; r < DTRC_TILE; r++)
+            {
+              int bTake = pS[r] < pD[r];
+              pD[r] = bTake ? pS[r] : pD[r];
+              pDI[r] = bTake ? pSI[r] : pDI[r];
+            }
+          }
+          else
+          {
+            for (r = 0; r < DTRC_TILE; r++)
+            {
+              int bTake = pS[r] > pD[r];
+              pD[r] = bTake ? pS[r] : pD[r];
+              pDI[r] = bTake ? pSI[r] : pDI[r];
+            }
+          }
+        }
+      }
+      pnNode += 2 + nChildren;
+    }
+
+    /* scatter results */
+    {
+      const double* pRoot = adblReg + pBlock->nRoot * DTRC_TILE;
+      for (r = 0; r < m; r++)
+        adblOut[anRows[nTile + r]] = pRoot[r];
+      if (anLFIndex != NULL)
+      {
+        const int* pRootI = anReg + pBlock->nRoot * DTRC_TILE;
+        for (r = 0; r < m; r++)
+          anLFIndex[anRows[nTile + r]] = pBlock->anLFIndex[pRootI[r]];
+      }
+    }
+  }
+
+  return DTR_NOERROR;
+}
@@ -47,6 +47,9 @@ DTR_ERR _DTRErr[] =
   DTR_FILEREADERR,            "file read failure",
   DTR_FILETYPEERR,            "not a valid DTREE binary file",
   DTR_ENDIANERR,              "binary file endian mismatch",
+  DTR_BADFLATIMAGE,           "flat DTREE image is corrupt or not 8 byte aligned",
+  DTR_FLATLAYOUTERR,          "flat DTREE image was written with a different node layout",
+  DTR_COMPACTLIMIT,           "too many DTREE nodes for the compact node layout",
   DTR_MALLOCFAILED,           "memory allocation error", 
                                      
   DTR_BADVERSIONDEF,          "bad version defintion statement", 
@@ -0,0 +1,659 @@
+// dtr_flat.c
+// DTREE flat (memory mappable) binary image routines
+
+// ALNfit Learning Engine for approximation of functions defined by samples.
+// Copyright (C) 2018 William W. Armstrong.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// Version 3 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// For further information contact
+// William W. Armstrong
+
+// 3624 - 108 Street NW
+// Edmonton, Alberta, Canada  T6J 1B4
+
+#ifdef DTREEDLL
+#define DTRIMP __declspec(dllexport)
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#include <dtree.h>
+#include "dtr_priv.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>  // for file mapping
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/* make sure we know the "endian"-ness of the target patform */
+#if (!defined(BIG_ENDIAN) && !defined(LITTLE_ENDIAN))
+#error Either BIG_ENDIAN or LITTLE_ENDIAN must be defined
+#endif
+
+#define BIG_ENDIAN_FLAG 0
+#define LITTLE_ENDIAN_FLAG 1
+
+/*
+/////////////////////////////////////////////////////////////////////
+// flat image layout
+
+   The image is a header followed by tables at 8 byte aligned offsets
+   from the start of the image.  Nothing in the image is a pointer: min/max
+   children and siblings, block roots and variable names are all stored as
+   indexes or offsets, so the image can be mapped anywhere, shared between
+   processes through the page cache, or linked into a binary as data.
+
+   The bulk of a DTREE (weights, centroids and the dtree node array) is
+   used in place.  Only the small pointer based structs (VARDEF,
+   LINEARFORM, BLOCK and MINMAXNODE) are rebuilt, all in one allocation.
+   The dtree node array is stored with the native DTREENODE layout, which
+   is recorded in the header and checked on load.
+*/
+
+static char _szDTRFlatIdent[] = "DTRFLAT\r";
+
+#define DTRFLATALIGN 8
+#define DTRFLAT_ALIGNUP(n) (((n) + (DTRFLATALIGN - 1)) & ~(long long)(DTRFLATALIGN - 1))
+
+typedef struct tagDTRFLATHEADER
+{
+  char achIdent[8];               /* "DTRFLAT\r"                            */
+  int nEndian;                    /* BIG_ENDIAN_FLAG or LITTLE_ENDIAN_FLAG  */
+  int nVersion;                   /* GetDtreeVersion() of the writer        */
+  int nDim;
+  int nOutputIndex;
+  int nLinearForms;
+  int nBlocks;
+  int nNodes;
+  int nMinMaxNodes;               /* total min/max nodes in all blocks      */
+  int nNodeSize;                  /* sizeof(DTREENODE) of the writer        */
+  int nReserved;
+  long long offVarDefs;           /* DTRFLATVARDEF[nDim]                    */
+  long long offBias;              /* double[nLinearForms]                   */
+  long long offWeights;           /* double[nLinearForms][nDim]             */
+  long long offCentroids;         /* double[nLinearForms][nDim]             */
+  long long offBlocks;            /* DTRFLATBLOCK[nBlocks]                  */
+  long long offMinMaxNodes;       /* DTRFLATMINMAX[nMinMaxNodes]            */
+  long long offNodes;             /* DTREENODE[nNodes]                      */
+  long long offNames;             /* NULL terminated variable names         */
+  long long cbImage;              /* total image size in bytes              */
+} DTRFLATHEADER;
+
+typedef struct tagDTRFLATVARDEF
+{
+  double dblMin;
+  double dblMax;
+  long long offName;              /* 0 if the variable has no name          */
+} DTRFLATVARDEF;
+
+typedef struct tagDTRFLATBLOCK
+{
+  int nDtreeIndex;
+  int nMinMaxRoot;                /* index of root in min/max node table    */
+} DTRFLATBLOCK;
+
+typedef struct tagDTRFLATMINMAX
+{
+  int nType;                      /* DTREE_MIN, DTREE_MAX or DTREE_LINEAR   */
+  int nInfo;                      /* linear form index, or first child      */
+  int nNext;                      /* next sibling, -1 if none               */
+} DTRFLATMINMAX;
+
+/* a DTREE loaded from a flat image: the DTREE and its rebuilt pointer based
+   arrays live in one allocation, starting with the DTREE itself */
+typedef struct tagDTRFLATTREE
+{
+  DTREE dtree;                    /* must be first                          */
+  void* pvView;                   /* mapped file view, NULL if the image    */
+                                  /*   belongs to the caller                */
+  size_t cbView;
+} DTRFLATTREE;
+
+
+/* flat image export */
+
+static int CountMinMaxNodes(MINMAXNODE* pMMN)
+{
+  int nCount = 1;
+  if (pMMN->nType != DTREE_LINEAR)
+  {
+    MINMAXNODE* pList;
+    for (pList = MMN_CHILDLIST(pMMN); pList != NULL; pList = pList->pNext)
+      nCount += CountMinMaxNodes(pList);
+  }
+  return nCount;
+}
+
+/* stores the min/max tree in preorder; children and siblings always get
+   larger indexes than the node referring to them */
+static int StoreMinMaxNode(MINMAXNODE* pMMN, DTRFLATMINMAX* aMM, int* pnNext)
+{
+  int nIndex = (*pnNext)++;
+  aMM[nIndex].nType = pMMN->nType;
+  aMM[nIndex].nNext = -1;
+  if (pMMN->nType == DTREE_LINEAR)
+  {
+    aMM[nIndex].nInfo = MMN_LFINDEX(pMMN);
+  }
+  else
+  {
+    int nPrev = -1;
+    MINMAXNODE* pList;
+    aMM[nIndex].nInfo = -1;
+    for (pList = MMN_CHILDLIST(pMMN); pList != NULL; pList = pList->pNext)
+    {
+      int nChild = StoreMinMaxNode(pList, aMM, pnNext);
+      if (nPrev < 0)
+        aMM[nIndex].nInfo = nChild;
+      else
+        aMM[nPrev].nNext = nChild;
+      nPrev = nChild;
+    }
+  }
+  return nIndex;
+}
+
+int WriteFlatDtreeFile(FILE* pFile, DTREE* pDtree)
+{
+  DTRFLATHEADER hdr;
+  char* pImage;
+  long long cb;
+  int i, j, nMinMax, nNext;
+  DTRFLATVARDEF* aVars;
+  double* adblBias;
+  double* adblW;
+  double* adblC;
+  DTRFLATBLOCK* aBlocks;
+  DTRFLATMINMAX* aMM;
+  DTREENODE* aNodes;
+  char* pszNames;
+
+  nMinMax = 0;
+  for (i = 0; i < pDtree->nBlocks; i++)
+    nMinMax += CountMinMaxNodes(pDtree->aBlocks[i].pMinMaxTree);
+
+  /* lay out the image */
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.achIdent, _szDTRFlatIdent, sizeof(hdr.achIdent));
+  #if defined(BIG_ENDIAN)
+  hdr.nEndian = BIG_ENDIAN_FLAG;
+  #elif defined(LITTLE_ENDIAN)
+  hdr.nEndian = LITTLE_ENDIAN_FLAG;
+  #endif
+  hdr.nVersion = GetDtreeVersion();
+  hdr.nDim = pDtree->nDim;
+  hdr.nOutputIndex = pDtree->nOutputIndex;
+  hdr.nLinearForms = pDtree->nLinearForms;
+  hdr.nBlocks = pDtree->nBlocks;
+  hdr.nNodes = pDtree->nNodes;
+  hdr.nMinMaxNodes = nMinMax;
+  hdr.nNodeSize = (int)sizeof(DTREENODE);
+
+  cb = DTRFLAT_ALIGNUP((long long)sizeof(DTRFLATHEADER));
+  hdr.offVarDefs = cb;
+  cb = DTRFLAT_ALIGNUP(cb + (long long)hdr.nDim * sizeof(DTRFLATVARDEF));
+  hdr.offBias = cb;
+  cb = DTRFLAT_ALIGNUP(cb + (long long)hdr.nLinearForms * sizeof(double));
+  hdr.offWeights = cb;
+  cb = DTRFLAT_ALIGNUP(cb + (long long)hdr.nLinearForms * hdr.nDim * sizeof(double));
+  hdr.offCentroids = cb;
+  cb = DTRFLAT_ALIGNUP(cb + (long long)hdr.nLinearForms * hdr.nDim * sizeof(double));
+  hdr.offBlocks = cb;
+  cb = DTRFLAT_ALIGNUP(cb + (long long)hdr.nBlocks * sizeof(DTRFLATBLOCK));
+  hdr.offMinMaxNodes = cb;
+  cb = DTRFLAT_ALIGNUP(cb + (long long)nMinMax * sizeof(DTRFLATMINMAX));
+  hdr.offNodes = cb;
+  cb = DTRFLAT_ALIGNUP(cb + (long long)hdr.nNodes * sizeof(DTREENODE));
+  hdr.offNames = cb;
+  for (i = 0; i < pDtree->nDim; i++)
+  {
+    if (pDtree->aVarDefs[i].pszName != NULL)
+      cb += (long long)strlen(pDtree->aVarDefs[i].pszName) + 1;
+  }
+  cb = DTRFLAT_ALIGNUP(cb);
+  hdr.cbImage = cb;
+
+  if ((unsigned long long)cb > (unsigned long long)(size_t)-1)
+    return DTR_MALLOCFAILED;
+
+  /* build the image; zero filled so padding is deterministic */
+  pImage = (char*)calloc((size_t)cb, 1);
+  if (pImage == NULL)
+    return DTR_MALLOCFAILED;
+
+  memcpy(pImage, &hdr, sizeof(hdr));
+
+  aVars = (DTRFLATVARDEF*)(pImage + hdr.offVarDefs);
+  pszNames = pImage + hdr.offNames;
+  for (i = 0; i < pDtree->nDim; i++)
+  {
+    aVars[i].dblMin = pDtree->aVarDefs[i].bound.dblMin;
+    aVars[i].dblMax = pDtree->aVarDefs[i].bound.dblMax;
+    if (pDtree->aVarDefs[i].pszName != NULL)
+    {
+      size_t nLen = strlen(pDtree->aVarDefs[i].pszName) + 1;
+      aVars[i].offName = (long long)(pszNames - pImage);
+      memcpy(pszNames, pDtree->aVarDefs[i].pszName, nLen);
+      pszNames += nLen;
+    }
+  }
+
+  adblBias = (double*)(pImage + hdr.offBias);
+  adblW = (double*)(pImage + hdr.offWeights);
+  adblC = (double*)(pImage + hdr.offCentroids);
+  for (i = 0; i < pDtree->nLinearForms; i++)
+  {
+    adblBias[i] = pDtree->aLinearForms[i].dblBias;
+    for (j = 0; j < pDtree->nDim; j++)
+    {
+      adblW[(size_t)i * pDtree->nDim + j] = pDtree->aLinearForms[i].adblW[j];
+      adblC[(size_t)i * pDtree->nDim + j] = pDtree->aLinearForms[i].adblC[j];
+    }
+  }
+
+  aBlocks = (DTRFLATBLOCK*)(pImage + hdr.offBlocks);
+  aMM = (DTRFLATMINMAX*)(pImage + hdr.offMinMaxNodes);
+  nNext = 0;
+  for (i = 0; i < pDtree->nBlocks; i++)
+  {
+    aBlocks[i].nDtreeIndex = pDtree->aBlocks[i].nDtreeIndex;
+    aBlocks[i].nMinMaxRoot = StoreMinMaxNode(pDtree->aBlocks[i].pMinMaxTree,
+                                             aMM, &nNext);
+  }
+
+  /* nodes are copied field by field so unused union bytes are zero */
+  aNodes = (DTREENODE*)(pImage + hdr.offNodes);
+  for (i = 0; i < pDtree->nNodes; i++)
+  {
+    DTREENODE* pSrc = pDtree->aNodes + i;
+    DTREENODE* pDst = aNodes + i;
+    pDst->nLeaf = pSrc->nLeaf;
+    pDst->nParentIndex = pSrc->nParentIndex;
+    if (pSrc->nLeaf != 0)
+    {
+      DNODE_BLOCKINDEX(pDst) = DNODE_BLOCKINDEX(pSrc);
+    }
+    else
+    {
+      DNODE_THRESHOLD(pDst) = DNODE_THRESHOLD(pSrc);
+      DNODE_VARINDEX(pDst) = DNODE_VARINDEX(pSrc);
+      DNODE_LEFTINDEX(pDst) = DNODE_LEFTINDEX(pSrc);
+      DNODE_RIGHTINDEX(pDst) = DNODE_RIGHTINDEX(pSrc);
+    }
+  }
+
+  /* one write for the whole image */
+  if (fwrite(pImage, 1, (size_t)cb, pFile) != (size_t)cb)
+  {
+    free(pImage);
+    return DTR_FILEWRITEERR;
+  }
+
+  free(pImage);
+  return DTR_NOERROR;
+}
+
+
+/* flat image import */
+
+/* checks that a table of nCount elements of cbElem bytes fits in the image */
+static int TableFits(long long off, long long nCount, long long cbElem,
+                     long long cbImage)
+{
+  if (off < (long long)sizeof(DTRFLATHEADER) || (off % DTRFLATALIGN) != 0)
+    return 0;
+  if (nCount < 0 || off > cbImage)
+    return 0;
+  return nCount * cbElem <= cbImage - off;
+}
+
+static int ValidateFlatImage(const char* pImage, size_t cbImage)
+{
+  const DTRFLATHEADER* pHdr = (const DTRFLATHEADER*)pImage;
+  const DTRFLATVARDEF* aVars;
+  const DTRFLATBLOCK* aBlocks;
+  const DTRFLATMINMAX* aMM;
+  const DTREENODE* aNodes;
+  long long cb = (long long)cbImage;
+  int i;
+
+  if (cbImage < sizeof(DTRFLATHEADER))
+    return DTR_FILETYPEERR;
+  if (memcmp(pHdr->achIdent, _szDTRFlatIdent, sizeof(pHdr->achIdent)) != 0)
+    return DTR_FILETYPEERR;
+
+  #if defined(BIG_ENDIAN)
+  if (pHdr->nEndian != BIG_ENDIAN_FLAG)
+    return DTR_ENDIANERR;
+  #elif defined(LITTLE_ENDIAN)
+  if (pHdr->nEndian != LITTLE_ENDIAN_FLAG)
+    return DTR_ENDIANERR;
+  #endif
+
+  if (pHdr->nVersion > GetDtreeVersion())
+    return DTR_UNKNOWNVERSION;
+  if (pHdr->nNodeSize != (int)sizeof(DTREENODE))
+    return DTR_FLATLAYOUTERR;
+
+  if (pHdr->cbImage > cb ||
+      pHdr->nDim < 1 || pHdr->nOutputIndex < 0 || pHdr->nOutputIndex >= pHdr->nDim ||
+      pHdr->nLinearForms < 1 || pHdr->nBlocks < 1 || pHdr->nNodes < 1 ||
+      pHdr->nMinMaxNodes < pHdr->nBlocks)
+    return DTR_BADFLATIMAGE;
+  cb = pHdr->cbImage;
+
+  if (!TableFits(pHdr->offVarDefs, pHdr->nDim, sizeof(DTRFLATVARDEF), cb) ||
+      !TableFits(pHdr->offBias, pHdr->nLinearForms, sizeof(double), cb) ||
+      !TableFits(pHdr->offWeights, (long long)pHdr->nLinearForms * pHdr->nDim, sizeof(double), cb) ||
+      !TableFits(pHdr->offCentroids, (long long)pHdr->nLinearForms * pHdr->nDim, sizeof(double), cb) ||
+      !TableFits(pHdr->offBlocks, pHdr->nBlocks, sizeof(DTRFLATBLOCK), cb) ||
+      !TableFits(pHdr->offMinMaxNodes, pHdr->nMinMaxNodes, sizeof(DTRFLATMINMAX), cb) ||
+      !TableFits(pHdr->offNodes, pHdr->nNodes, sizeof(DTREENODE), cb))
+    return DTR_BADFLATIMAGE;
+
+  /* names must be NULL terminated inside the image */
+  aVars = (const DTRFLATVARDEF*)(pImage + pHdr->offVarDefs);
+  for (i = 0; i < pHdr->nDim; i++)
+  {
+    if (aVars[i].offName != 0)
+    {
+      if (aVars[i].offName < pHdr->offNames || aVars[i].offName >= cb ||
+          memchr(pImage + aVars[i].offName, '\0',
+                 (size_t)(cb - aVars[i].offName)) == NULL)
+        return DTR_BADFLATIMAGE;
+    }
+  }
+
+  /* min/max links always point forward, so the trees cannot be circular */
+  aMM = (const DTRFLATMINMAX*)(pImage + pHdr->offMinMaxNodes);
+  for (i = 0; i < pHdr->nMinMaxNodes; i++)
+  {
+    if (aMM[i].nType == DTREE_LINEAR)
+    {
+      if (aMM[i].nInfo < 0 || aMM[i].nInfo >= pHdr->nLinearForms)
+        return DTR_BADFLATIMAGE;
+    }
+    else if (aMM[i].nType == DTREE_MIN || aMM[i].nType == DTREE_MAX)
+    {
+      if (aMM[i].nInfo <= i || aMM[i].nInfo >= pHdr->nMinMaxNodes)
+        return DTR_BADFLATIMAGE;
+    }
+    else return DTR_BADFLATIMAGE;
+
+    if (aMM[i].nNext != -1 &&
+        (aMM[i].nNext <= i || aMM[i].nNext >= pHdr->nMinMaxNodes))
+      return DTR_BADFLATIMAGE;
+  }
+
+  /* blocks refer back to a leaf of the dtree */
+  aBlocks = (const DTRFLATBLOCK*)(pImage + pHdr->offBlocks);
+  aNodes = (const DTREENODE*)(pImage + pHdr->offNodes);
+  for (i = 0; i < pHdr->nBlocks; i++)
+  {
+    if (aBlocks[i].nMinMaxRoot < 0 || aBlocks[i].nMinMaxRoot >= pHdr->nMinMaxNodes)
+      return DTR_BADFLATIMAGE;
+    if (aBlocks[i].nDtreeIndex < 0 || aBlocks[i].nDtreeIndex >= pHdr->nNodes ||
+        aNodes[aBlocks[i].nDtreeIndex].nLeaf == 0)
+      return DTR_BADFLATIMAGE;
+  }
+
+  /* dtree children follow their parents, as in the text format, and
+     point back to them; the text reader leaves the root's parent 0 */
+  for (i = 0; i < pHdr->nNodes; i++)
+  {
+    const DTREENODE* pNode = aNodes + i;
+    int nParent = pNode->nParentIndex;
+    if (i == 0)
+    {
+      if (nParent != -1 && nParent != 0)
+        return DTR_BADFLATIMAGE;
+    }
+    else if (nParent < 0 || nParent >= i || aNodes[nParent].nLeaf != 0 ||
+             (DNODE_LEFTINDEX(aNodes + nParent) != i &&
+              DNODE_RIGHTINDEX(aNodes + nParent) != i))
+    {
+      return DTR_BADFLATIMAGE;
+    }
+
+    if (pNode->nLeaf != 0)
+    {
+      if (DNODE_BLOCKINDEX(pNode) < 0 || DNODE_BLOCKINDEX(pNode) >= pHdr->nBlocks)
+        return DTR_BADFLATIMAGE;
+    }
+    else if (DNODE_VARINDEX(pNode) < 0 || DNODE_VARINDEX(pNode) >= pHdr->nDim ||
+             DNODE_LEFTINDEX(pNode) <= i || DNODE_LEFTINDEX(pNode) >= pHdr->nNodes ||
+             DNODE_RIGHTINDEX(pNode) <= i || DNODE_RIGHTINDEX(pNode) >= pHdr->nNodes)
+    {
+      return DTR_BADFLATIMAGE;
+    }
+  }
+
+  return DTR_NOERROR;
+}
+
+/* builds a DTREE over a validated image */
+static int BuildFlatDtree(const char* pImage, DTREE** ppDtree)
+{
+  const DTRFLATHEADER* pHdr = (const DTRFLATHEADER*)pImage;
+  const DTRFLATVARDEF* aFlatVars = (const DTRFLATVARDEF*)(pImage + pHdr->offVarDefs);
+  const DTRFLATBLOCK* aFlatBlocks = (const DTRFLATBLOCK*)(pImage + pHdr->offBlocks);
+  const DTRFLATMINMAX* aMM = (const DTRFLATMINMAX*)(pImage + pHdr->offMinMaxNodes);
+  double* adblBias = (double*)(pImage + pHdr->offBias);
+  double* adblW = (double*)(pImage + pHdr->offWeights);
+  double* adblC = (double*)(pImage + pHdr->offCentroids);
+  DTRFLATTREE* pFlat;
+  DTREE* pDtree;
+  MINMAXNODE* aMMN;
+  size_t cb, offVarDefs, offLinearForms, offBlocks, offMinMax;
+  int i;
+
+  /* one allocation holds the DTREE and its pointer based arrays */
+  cb = sizeof(DTRFLATTREE);
+  offVarDefs = cb;
+  cb += (size_t)pHdr->nDim * sizeof(VARDEF);
+  offLinearForms = cb;
+  cb += (size_t)pHdr->nLinearForms * sizeof(LINEARFORM);
+  offBlocks = cb;
+  cb += (size_t)pHdr->nBlocks * sizeof(BLOCK);
+  offMinMax = cb;
+  cb += (size_t)pHdr->nMinMaxNodes * sizeof(MINMAXNODE);
+
+  pFlat = (DTRFLATTREE*)calloc(cb, 1);
+  if (pFlat == NULL)
+    return DTR_MALLOCFAILED;
+
+  pDtree = &pFlat->dtree;
+  pDtree->nDim = pHdr->nDim;
+  pDtree->nOutputIndex = pHdr->nOutputIndex;
+  pDtree->nLinearForms = pHdr->nLinearForms;
+  pDtree->nBlocks = pHdr->nBlocks;
+  pDtree->nNodes = pHdr->nNodes;
+  pDtree->aVarDefs = (VARDEF*)((char*)pFlat + offVarDefs);
+  pDtree->aLinearForms = (LINEARFORM*)((char*)pFlat + offLinearForms);
+  pDtree->aBlocks = (BLOCK*)((char*)pFlat + offBlocks);
+  pDtree->aNodes = (DTREENODE*)(pImage + pHdr->offNodes);
+  pDtree->pvFlatImage = (void*)pImage;
+
+  for (i = 0; i < pHdr->nDim; i++)
+  {
+    pDtree->aVarDefs[i].bound.dblMin = aFlatVars[i].dblMin;
+    pDtree->aVarDefs[i].bound.dblMax = aFlatVars[i].dblMax;
+    if (aFlatVars[i].offName != 0)
+      pDtree->aVarDefs[i].pszName = (char*)(pImage + aFlatVars[i].offName);
+  }
+
+  for (i = 0; i < pHdr->nLinearForms; i++)
+  {
+    pDtree->aLinearForms[i].dblBias = adblBias[i];
+    pDtree->aLinearForms[i].adblW = adblW + (size_t)i * pHdr->nDim;
+    pDtree->aLinearForms[i].adblC = adblC + (size_t)i * pHdr->nDim;
+  }
+
+  aMMN = (MINMAXNODE*)((char*)pFlat + offMinMax);
+  for (i = 0; i < pHdr->nMinMaxNodes; i++)
+  {
+    aMMN[i].nType = aMM[i].nType;
+    if (aMM[i].nType == DTREE_LINEAR)
+      MMN_LFINDEX(aMMN + i) = aMM[i].nInfo;
+    else
+      MMN_CHILDLIST(aMMN + i) = aMMN + aMM[i].nInfo;
+    aMMN[i].pNext = (aMM[i].nNext >= 0) ? aMMN + aMM[i].nNext : NULL;
+  }
+
+  for (i = 0; i < pHdr->nBlocks; i++)
+  {
+    pDtree->aBlocks[i].nDtreeIndex = aFlatBlocks[i].nDtreeIndex;
+    pDtree->aBlocks[i].pMinMaxTree = aMMN + aFlatBlocks[i].nMinMaxRoot;
+  }
+
+  *ppDtree = pDtree;
+  return DTR_NOERROR;
+}
+
+int ReadFlatDtreeImage(const void* pvImage, size_t cbImage, DTREE** ppDtree)
+{
+  int nErr;
+
+  *ppDtree = NULL;
+  if (pvImage == NULL)
+    return DTR_GENERIC;
+
+  /* tables are used in place, so the image must be aligned for doubles */
+  if (((size_t)pvImage % DTRFLATALIGN) != 0)
+    return DTR_BADFLATIMAGE;
+
+  nErr = ValidateFlatImage((const char*)pvImage, cbImage);
+  if (nErr != DTR_NOERROR)
+    return nErr;
+
+  return BuildFlatDtree((const char*)pvImage, ppDtree);
+}
+
+int IsFlatDtreeFile(FILE* pFile)
+{
+  char achIdent[8];
+  int bFlat;
+
+  bFlat = fread(achIdent, 1, sizeof(achIdent), pFile) == sizeof(achIdent) &&
+          memcmp(achIdent, _szDTRFlatIdent, sizeof(achIdent)) == 0;
+  rewind(pFile);
+  return bFlat;
+}
+
+/* maps a whole file read only, returns NULL on failure */
+static void* MapFlatFile(const char* pszFileName, size_t* pcbView)
+{
+#ifdef _WIN32
+  HANDLE hFile, hMapping;
+  LARGE_INTEGER liSize;
+  void* pvView = NULL;
+
+  hFile = CreateFileA(pszFileName, GENERIC_READ, FILE_SHARE_READ, NULL,
+                      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (hFile == INVALID_HANDLE_VALUE)
+    return NULL;
+
+  if (GetFileSizeEx(hFile, &liSize) && liSize.QuadPart > 0 &&
+      (unsigned long long)liSize.QuadPart == (size_t)liSize.QuadPart)
+  {
+    hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (hMapping != NULL)
+    {
+      pvView = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+      CloseHandle(hMapping);  /* the view keeps the mapping alive */
+    }
+  }
+  CloseHandle(hFile);
+
+  if (pvView != NULL)
+    *pcbView = (size_t)liSize.QuadPart;
+  return pvView;
+#else
+  int fd;
+  struct stat st;
+  void* pvView = NULL;
+
+  fd = open(pszFileName, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+
+  if (fstat(fd, &st) == 0 && st.st_size > 0 &&
+      (unsigned long long)st.st_size == (size_t)st.st_size)
+  {
+    pvView = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (pvView == MAP_FAILED)
+      pvView = NULL;
+  }
+  close(fd);  /* the mapping stays valid after close */
+
+  if (pvView != NULL)
+    *pcbView = (size_t)st.st_size;
+  return pvView;
+#endif
+}
+
+static void UnmapFlatFile(void* pvView, size_t cbView)
+{
+#ifdef _WIN32
+  (void)cbView;
+  UnmapViewOfFile(pvView);
+#else
+  munmap(pvView, cbView);
+#endif
+}
+
+int MapFlatDtreeFile(const char* pszFileName, DTREE** ppDtree)
+{
+  void* pvView;
+  size_t cbView = 0;
+  int nErr;
+
+  *ppDtree = NULL;
+  pvView = MapFlatFile(pszFileName, &cbView);
+  if (pvView == NULL)
+    return DTR_FILEERR;
+
+  nErr = ReadFlatDtreeImage(pvView, cbView, ppDtree);
+  if (nErr != DTR_NOERROR)
+  {
+    UnmapFlatFile(pvView, cbView);
+    return nErr;
+  }
+
+  /* the DTREE now owns the view */
+  ((DTRFLATTREE*)*ppDtree)->pvView = pvView;
+  ((DTRFLATTREE*)*ppDtree)->cbView = cbView;
+  return DTR_NOERROR;
+}
+
+void DestroyFlatDtree(DTREE* pDtree)
+{
+  DTRFLATTREE* pFlat = (DTRFLATTREE*)pDtree;
+
+  if (pFlat->pvView != NULL)
+    UnmapFlatFile(pFlat->pvView, pFlat->cbView);
+
+  /* arrays were allocated with the DTREE */
+  free(pFlat);
+}
@@ -66,7 +66,7 @@
 #define MAXTOKLEN 128
 typedef struct tagTOKEN
 {
-  long lFilePos;
+  const char* pPos;               /* token start, for pushback */
   union
   {
     long l;
@@ -75,6 +75,20 @@ typedef struct tagTOKEN
   } value;
 } TOKEN;        
   
+/*
+// lexer input: the whole file is held in memory and scanned with a
+// pointer, so lookahead and pushback never touch the stream
+*/
+typedef struct tagDTRLEX
+{
+  const char* p;                  /* next char */
+  const char* pEnd;               /* end of input */
+} DTRLEX;
+
+#define LEX_EOF(pLex) ((pLex)->p >= (pLex)->pEnd)
+#define LEX_PEEK(pLex, n) (((pLex)->p + (n) < (pLex)->pEnd) ? \
+                           (int)(unsigned char)(pLex)->p[(n)] : EOF)
+
 /*
 // reserved words
 */
@@ -97,15 +111,15 @@ int _nReserved[]  =
 /*                         
 // parser helpers
 */
-int GetVarDef(FILE* pFile, VARDEF* pVarDef);
-int GetDtreeNode(FILE* pFile, BLOCK* aBlocks, int nBlocks, 
+int GetVarDef(DTRLEX* pLex, VARDEF* pVarDef);
+int GetDtreeNode(DTRLEX* pLex, BLOCK* aBlocks, int nBlocks, 
                  VARDEF* aVarDefs, int nDim, DTREENODE* aNodes, 
                  int nNodes, int nNode);
-int GetBlock(FILE* pFile, LINEARFORM* aLinearForms, int nLinearForms, 
+int GetBlock(DTRLEX* pLex, LINEARFORM* aLinearForms, int nLinearForms, 
              BLOCK* pBlock);
-int GetMinMaxTree(FILE* pFile, LINEARFORM* aLinearForms, int nLinearForms,
+int GetMinMaxTree(DTRLEX* pLex, LINEARFORM* aLinearForms, int nLinearForms,
                   MINMAXNODE** ppMinMaxNode);       
-int GetLinearForm(FILE* pFile, int nDim, int nOutput, 
+int GetLinearForm(DTRLEX* pLex, int nDim, int nOutput, 
                   LINEARFORM* pLinearForm, VARDEF* aVarDefs);
 
 /* case insensitive string comparison */
@@ -126,25 +140,44 @@ int GetLinearForm(FILE* pFile, int nDim, int nOutput,
 /*
 // lexer helpers
 */
-void SkipWS(FILE* pFile);                     /* skips white space and comments */
-int GetToken(FILE* pFile, TOKEN* pTok);       /* gets next token */
-int GetIntegerToken(FILE* pFile, TOKEN* pTok);/* gets an integer token */
-int GetDoubleToken(FILE* pFile, TOKEN* pTok); /* gets double token, will convert an integer to double */
-void PushbackToken(FILE* pFile, TOKEN* pTok); /* pushes token back onto stream */
-int GetSymbol(FILE* pFile, TOKEN* pTok);      /* gets symbol token */
-int GetNumber(FILE* pFile, TOKEN* pTok);      /* gets number token */
-int GetIdentifier(FILE* pFile, TOKEN* pTok);  /* get identifier token */
+void SkipWS(DTRLEX* pLex);                     /* skips white space and comments */
+int GetToken(DTRLEX* pLex, TOKEN* pTok);       /* gets next token */
+int GetIntegerToken(DTRLEX* pLex, TOKEN* pTok);/* gets an integer token */
+int GetDoubleToken(DTRLEX* pLex, TOKEN* pTok); /* gets double token, will convert an integer to double */
+void PushbackToken(DTRLEX* pLex, TOKEN* pTok); /* pushes token back onto stream */
+int GetSymbol(DTRLEX* pLex, TOKEN* pTok);      /* gets symbol token */
+int GetNumber(DTRLEX* pLex, TOKEN* pTok);      /* gets number token */
+int GetIdentifier(DTRLEX* pLex, TOKEN* pTok);  /* get identifier token */
 int IsReserved(char* psz);                    /* checks if identifier is a reserved word */
-int IsComment(FILE* pFile);                   /* eats any comments */
+int IsComment(DTRLEX* pLex);                   /* eats any comments */
+long ParseLong(const char* psz, int nLen);     /* converts a scanned integer */
+double ParseDouble(const char* psz, int nLen); /* converts a scanned number */
 
 #define ISCSYM(c) ((c) == '_' || isalnum((c)))  /* valid symbol character */
 #define ISCSYMF(c) ((c) == '_' || isalpha((c))) /* valid symbol first character */
+#define ISDIGIT(c) ((unsigned)((c) - '0') < 10u) /* locale independent digit */
 
 
 /*
-// export helpers
+// export helpers: output is formatted into a buffer and written in
+// large blocks rather than through one fprintf per field
 */
-int WriteMinMaxTree(FILE* pFile, DTREE* pDtree, MINMAXNODE* pMMN, int nIndent);
+#define WRITEBUFSIZE 65536
+typedef struct tagDTRWRITER
+{
+  FILE* pFile;
+  char* pBuf;
+  size_t cb;                      /* bytes in buffer */
+  int nErr;                       /* first write error */
+} DTRWRITER;
+
+void PutChars(DTRWRITER* pW, const char* pch, size_t n);
+void PutString(DTRWRITER* pW, const char* psz);
+void PutChar(DTRWRITER* pW, char c);
+void PutLong(DTRWRITER* pW, long l);
+void PutDouble(DTRWRITER* pW, double dbl);
+void FlushWriter(DTRWRITER* pW);
+int WriteMinMaxTree(DTRWRITER* pW, DTREE* pDtree, MINMAXNODE* pMMN, int nIndent);
 
 
 /* 
@@ -169,6 +202,60 @@ int WriteMinMaxTree(FILE* pFile, DTREE* pDtree, MINMAXNODE* pMMN, int nIndent);
 */
 int ParseDtreeFile(FILE* pFile, DTREE** ppDtree)
 {
+  int nErr = DTR_NOERROR;
+  char* pBuf = NULL;
+  size_t cb = 0;
+  size_t cbMax = 0;
+  long lPos, lEnd;
+
+  /* check arguments */
+  if (pFile == NULL || ppDtree == NULL)
+    return DTR_GENERIC;
+  *ppDtree = NULL;
+
+  /* size hint from the file length; text mode reads may return less */
+  lPos = ftell(pFile);
+  if (lPos >= 0 && fseek(pFile, 0, SEEK_END) == 0)
+  {
+    lEnd = ftell(pFile);
+    fseek(pFile, lPos, SEEK_SET);
+    if (lEnd > lPos)
+      cbMax = (size_t)(lEnd - lPos);
+  }
+  if (cbMax == 0)
+    cbMax = WRITEBUFSIZE;
+
+  /* read the whole file, growing the buffer if the hint was short */
+  for (;;)
+  {
+    char* pNew = (char*)realloc(pBuf, cbMax + 1);
+    if (pNew == NULL)
+    {
+      free(pBuf);
+      return DTR_MALLOCFAILED;
+    }
+    pBuf = pNew;
+    cb += fread(pBuf + cb, 1, cbMax - cb, pFile);
+    if (cb < cbMax)
+      break;
+    cbMax *= 2;
+  }
+  if (ferror(pFile))
+  {
+    free(pBuf);
+    return DTR_FILEREADERR;
+  }
+  pBuf[cb] = '\0';
+
+  nErr = ParseDtreeBuffer(pBuf, cb, ppDtree);
+  free(pBuf);
+  return nErr;
+}
+
+int ParseDtreeBuffer(const char* pBuf, size_t cb, DTREE** ppDtree)
+{
+  DTRLEX lex;                                 /* lexer state */
+  DTRLEX* pLex = &lex;
   int nErr = DTR_NOERROR;                     /* error number */
   int i;                                      /* loop counter */
   TOKEN tok;                                  /* token */
@@ -186,17 +273,19 @@ int ParseDtreeFile(FILE* pFile, DTREE** ppDtree)
   char* aMapSeen = NULL;                      /* map to track parsed indexes */
   
   /* check arguments */
-  if (pFile == NULL || ppDtree == NULL)
+  if (pBuf == NULL || ppDtree == NULL)
     return DTR_GENERIC;
   
   /* init dtree pointer */
   *ppDtree = NULL;
+  lex.p = pBuf;
+  lex.pEnd = pBuf + cb;
 
   /* parsing helper definitions */
   #define _ON_ERR(nErrCode) { nErr = nErrCode; goto PARSE_ERR; }
-  #define _TOKEN(nType, nErrCode) if (GetToken(pFile, &tok) != nType) _ON_ERR(nErrCode)
-  #define _INTTOKEN(nErrCode) if (GetIntegerToken(pFile, &tok) != L_INT) _ON_ERR(nErrCode)
-  #define _DBLTOKEN(nErrCode) if (GetDoubleToken(pFile, &tok) != L_DBL) _ON_ERR(nErrCode)
+  #define _TOKEN(nType, nErrCode) if (GetToken(pLex, &tok) != nType) _ON_ERR(nErrCode)
+  #define _INTTOKEN(nErrCode) if (GetIntegerToken(pLex, &tok) != L_INT) _ON_ERR(nErrCode)
+  #define _DBLTOKEN(nErrCode) if (GetDoubleToken(pLex, &tok) != L_DBL) _ON_ERR(nErrCode)
   
   /*///////// get version token */
   _TOKEN(R_VERSION, DTR_BADVERSIONDEF);     /* version token */
@@ -222,7 +311,7 @@ int ParseDtreeFile(FILE* pFile, DTREE** ppDtree)
     _ON_ERR(DTR_MALLOCFAILED);
   for (i = 0; i < nDim; i++)                /* parse each var */
   {      
-    if ((nErr = GetVarDef(pFile, aVarDefs + i)) != DTR_NOERROR)
+    if ((nErr = GetVarDef(pLex, aVarDefs + i)) != DTR_NOERROR)
       _ON_ERR(nErr);
   }
   
@@ -263,7 +352,7 @@ int ParseDtreeFile(FILE* pFile, DTREE** ppDtree)
     _TOKEN(L_INT, DTR_MISSINGLINEARINDEX);/* linear array index */
     nIndex = tok.value.l;                     
                   
-    if (nIndex >= nLinearForms)
+    if (nIndex < 0 || nIndex >= nLinearForms)
       _ON_ERR(DTR_BADLINEARINDEXRANGE);                  
                   
     if (TESTMAP(aMapSeen, nIndex))          /* slot should be empty */
@@ -271,7 +360,7 @@ int ParseDtreeFile(FILE* pFile, DTREE** ppDtree)
     _TOKEN(':', DTR_MISSINGLINEARCOLON);    /* ':' */
     
     /* get form */
-    if ((nErr = GetLinearForm(pFile, nDim, nOutput, 
+    if ((nErr = GetLinearForm(pLex, nDim, nOutput, 
                               aLinearForms + nIndex, aVarDefs)) != DTR_NOERROR)
       _ON_ERR(nErr);
     
@@ -300,7 +389,7 @@ int ParseDtreeFile(FILE* pFile, DTREE** ppDtree)
     _TOKEN(L_INT, DTR_MISSINGBLOCKINDEX); /* block array index */
     nIndex = tok.value.l;
       
-    if (nIndex >= nBlocks)
+    if (nIndex < 0 || nIndex >= nBlocks)
       _ON_ERR(DTR_BADBLOCKINDEXRANGE);                        
       
     if (TESTMAP(aMapSeen, nIndex))          /* slot should be empty */
@@ -308,7 +397,7 @@ int ParseDtreeFile(FILE* pFile, DTREE** ppDtree)
     _TOKEN(':', DTR_MISSINGBLOCKCOLON);     /* ':' */
                                     
     /* get block */
-    if ((nErr = GetBlock(pFile, aLinearForms, nLinearForms, 
+    if ((nErr = GetBlock(pLex, aLinearForms, nLinearForms, 
                          aBlocks + nIndex)) != DTR_NOERROR)
       _ON_ERR(nErr);
     
@@ -337,7 +426,7 @@ int ParseDtreeFile(FILE* pFile, DTREE** ppDtree)
     _TOKEN(L_INT, DTR_MISSINGDTREEINDEX); /* node array index */
     nIndex = tok.value.l;        
     
-    if (nIndex >= nNodes)
+    if (nIndex < 0 || nIndex >= nNodes)
       _ON_ERR(DTR_BADDTREEINDEXRANGE);
     
     if (TESTMAP(aMapSeen, nIndex))          /* slot should be empty */
@@ -345,7 +434,7 @@ int ParseDtreeFile(FILE* pFile, DTREE** ppDtree)
     _TOKEN(':', DTR_MISSINGLINEARCOLON);    /* ':' */
     
     /* get node */
-    if ((nErr = GetDtreeNode(pFile, aBlocks, nBlocks, aVarDefs, nDim,
+    if ((nErr = GetDtreeNode(pLex, aBlocks, nBlocks, aVarDefs, nDim,
                              aNodes, nNodes, nIndex)) != DTR_NOERROR)
       _ON_ERR(nErr);
     
@@ -398,31 +487,31 @@ PARSE_OK:
 /////////////////////////////////////////////////////////////////////
 // variable definition parser         
 */
-int GetVarDef(FILE* pFile, VARDEF* pVarDef)
+int GetVarDef(DTRLEX* pLex, VARDEF* pVarDef)
 {  
   char szName[MAXTOKLEN];
   TOKEN tok;
   
-  if (GetToken(pFile, &tok) != IDENTIFIER)    /* identifier */
+  if (GetToken(pLex, &tok) != IDENTIFIER)    /* identifier */
     return DTR_BADVARDEFIDENT;
   strcpy(szName, tok.value.sz);
-  if (GetToken(pFile, &tok) != ':')           /* ':' */
+  if (GetToken(pLex, &tok) != ':')           /* ':' */
     return DTR_MISSINGVARDEFCOLON;
-  if (GetToken(pFile, &tok) != '[')           /* '[' */
+  if (GetToken(pLex, &tok) != '[')           /* '[' */
     return DTR_MISSINGVARBOUNDSTART;
-  if (GetDoubleToken(pFile, &tok) != L_DBL)  /* minimum */
+  if (GetDoubleToken(pLex, &tok) != L_DBL)  /* minimum */
     return DTR_BADVARBOUND;
   pVarDef->bound.dblMin = tok.value.dbl;
-  if (GetToken(pFile, &tok) != ',')           /* comma */
+  if (GetToken(pLex, &tok) != ',')           /* comma */
     return DTR_MISSINGVARBOUNDCOMMA;
-  if (GetDoubleToken(pFile, &tok) != L_DBL)  /* maximum */
+  if (GetDoubleToken(pLex, &tok) != L_DBL)  /* maximum */
     return DTR_BADVARBOUND;
   pVarDef->bound.dblMax = tok.value.dbl;
   if (pVarDef->bound.dblMin >= pVarDef->bound.dblMax) /* check range */
     return DTR_NEGATIVEVARBOUNDRANGE;
-  if (GetToken(pFile, &tok) != ']')           /* ']' */
+  if (GetToken(pLex, &tok) != ']')           /* ']' */
     return DTR_MISSINGVARBOUNDSTART;
-  if (GetToken(pFile, &tok) != ';')           /* end of statement */
+  if (GetToken(pLex, &tok) != ';')           /* end of statement */
     return DTR_MISSINGVARDEFSEMI;
   
   SetVarDefName(pVarDef, szName);             /* set name */
@@ -433,18 +522,18 @@ int GetVarDef(FILE* pFile, VARDEF* pVarDef)
 /////////////////////////////////////////////////////////////////////
 // block parser               
 */
-int GetBlock(FILE* pFile, LINEARFORM* aLinearForms, int nLinearForms, 
+int GetBlock(DTRLEX* pLex, LINEARFORM* aLinearForms, int nLinearForms, 
              BLOCK* pBlock)
 {             
   int nErr = DTR_NOERROR;
   TOKEN tok;
   
   /* get min max tree */
-  if ((nErr = GetMinMaxTree(pFile, aLinearForms, nLinearForms,
+  if ((nErr = GetMinMaxTree(pLex, aLinearForms, nLinearForms,
                             &(pBlock->pMinMaxTree))) != DTR_NOERROR)
     return nErr;
 
-  if (GetToken(pFile, &tok) != ';')     /* end of statement */
+  if (GetToken(pLex, &tok) != ';')     /* end of statement */
     return DTR_MISSINGBLOCKSEMI;
           
   return DTR_NOERROR;
@@ -454,7 +543,7 @@ int GetBlock(FILE* pFile, LINEARFORM* aLinearForms, int nLinearForms,
 /////////////////////////////////////////////////////////////////////
 // min/max tree parser
 */
-int GetMinMaxTree(FILE* pFile, LINEARFORM* aLinearForms, int nLinearForms, 
+int GetMinMaxTree(DTRLEX* pLex, LINEARFORM* aLinearForms, int nLinearForms, 
                   MINMAXNODE** ppMMN)
 {             
   TOKEN tok;
@@ -462,7 +551,7 @@ int GetMinMaxTree(FILE* pFile, LINEARFORM* aLinearForms, int nLinearForms,
   int nErr = DTR_NOERROR;
 
   /* lookahead to determine if this a min/max node or a linear elem index */
-  nType = GetToken(pFile, &tok);
+  nType = GetToken(pLex, &tok);
   if (nType != L_INT && nType != R_MIN && nType != R_MAX)
     return DTR_BADMINMAXNODE;               /* bad token type */
 
@@ -473,7 +562,7 @@ int GetMinMaxTree(FILE* pFile, LINEARFORM* aLinearForms, int nLinearForms,
   if (nType == L_INT)                     /* linear form index */
   {                      
     int nLFIndex = tok.value.l;          
-    if(nLFIndex >= nLinearForms || aLinearForms == NULL)
+    if(nLFIndex < 0 || nLFIndex >= nLinearForms || aLinearForms == NULL)
     {
       nErr = DTR_UNDEFINEDLINEARFORM;       /* linear form does not exist */
       goto MINMAXNODE_ERR;
@@ -488,14 +577,14 @@ int GetMinMaxTree(FILE* pFile, LINEARFORM* aLinearForms, int nLinearForms,
     MINMAXNODE* pList = NULL;
     (*ppMMN)->nType = (short)((nType == R_MIN) ? DTREE_MIN : DTREE_MAX);
     
-    if (GetToken(pFile, &tok) != '(')       /* '(' */
+    if (GetToken(pLex, &tok) != '(')       /* '(' */
     {
       nErr = DTR_MISSINGMINMAXLISTSTART;
       goto MINMAXNODE_ERR;     
     }
     
     /* read child list */
-    nType = GetToken(pFile, &tok);          /* lookahead */
+    nType = GetToken(pLex, &tok);          /* lookahead */
     while (nType != ')')                    /* until we hit close paren */
     {
       MINMAXNODE* pChild = NULL;
@@ -504,10 +593,10 @@ int GetMinMaxTree(FILE* pFile, LINEARFORM* aLinearForms, int nLinearForms,
         nErr = DTR_BADMINMAXLISTELEM;
         goto MINMAXNODE_ERR;
       }
-      PushbackToken(pFile, &tok);           /* pushback lookahead token */
+      PushbackToken(pLex, &tok);           /* pushback lookahead token */
       
       /* get child list element */
-      if ((nErr = GetMinMaxTree(pFile, aLinearForms, nLinearForms, 
+      if ((nErr = GetMinMaxTree(pLex, aLinearForms, nLinearForms, 
                                 &pChild)) != DTR_NOERROR)
         goto MINMAXNODE_ERR;
                              
@@ -523,9 +612,9 @@ int GetMinMaxTree(FILE* pFile, LINEARFORM* aLinearForms, int nLinearForms,
         pList = pChild;
       }
       
-      nType = GetToken(pFile, &tok);        /* get next lookahead token */
+      nType = GetToken(pLex, &tok);        /* get next lookahead token */
       if (nType == ',')                     /* skip if list elem separator */
-        nType = GetToken(pFile, &tok);
+        nType = GetToken(pLex, &tok);
     }
     
     if (MMN_CHILDLIST((*ppMMN)) == NULL)    /* can't have empty child list */
@@ -549,18 +638,24 @@ MINMAXNODE_OK:
 /////////////////////////////////////////////////////////////////////
 // linear form parser
 */
-int GetLinearForm(FILE* pFile, int nDim, int nOutput, LINEARFORM* pLF, 
+int GetLinearForm(DTRLEX* pLex, int nDim, int nOutput, LINEARFORM* pLF, 
                   VARDEF* aVarDefs)
 { 
   int i;
   TOKEN tok;
   int nType;
   int bNeg = 0;                       /* negative flag */
+  char aVarMapLocal[32];              /* map storage for up to 256 vars */
   char* aVarMap = NULL;               /* map of parsed vars */
+  int nNextVar = 0;                   /* var expected next, terms are */
+                                      /*   usually in var order */
   int nErr = DTR_NOERROR;
   
   /* allocate var seen map */
-  aVarMap = (char*)malloc(MAPBYTECOUNT(nDim));
+  if ((size_t)MAPBYTECOUNT(nDim) <= sizeof(aVarMapLocal))
+    aVarMap = aVarMapLocal;
+  else
+    aVarMap = (char*)malloc(MAPBYTECOUNT(nDim));
   if (aVarMap == NULL)
   {
     nErr = DTR_MALLOCFAILED;    
@@ -576,7 +671,7 @@ int GetLinearForm(FILE* pFile, int nDim, int nOutput, LINEARFORM* pLF,
   }
 
   /* get token */
-  nType = GetToken(pFile, &tok);
+  nType = GetToken(pLex, &tok);
   while(nType != ';')
   {
     double dblW;
@@ -587,7 +682,7 @@ int GetLinearForm(FILE* pFile, int nDim, int nOutput, LINEARFORM* pLF,
     if (nType == '-')                  
     {
       bNeg = !bNeg;
-      nType = GetToken(pFile, &tok);
+      nType = GetToken(pLex, &tok);
     }
                 
     /* get weight */   
@@ -605,22 +700,26 @@ int GetLinearForm(FILE* pFile, int nDim, int nOutput, LINEARFORM* pLF,
     if (bNeg) dblW = -dblW;
     
     /* get centroid expr. */
-    if (GetToken(pFile, &tok) != '(')
+    if (GetToken(pLex, &tok) != '(')
     {
       nErr = DTR_MISSINGCENTROIDSTART;
       goto LINEARFORM_ERR;
     }
     /* get var name */
-    if (GetToken(pFile, &tok) != IDENTIFIER)
+    if (GetToken(pLex, &tok) != IDENTIFIER)
     {
       nErr = DTR_MISSINGCENTROIDIDENT;
       goto LINEARFORM_ERR;
     }
-    for (i = 0; i < nDim; i++)
+    i = nNextVar;
+    if (i >= nDim || strcmp(tok.value.sz, aVarDefs[i].pszName) != 0)
     {
-      /* var names are case sensitive */
-      if (strcmp(tok.value.sz, aVarDefs[i].pszName) == 0)
-        break;
+      for (i = 0; i < nDim; i++)
+      {
+        /* var names are case sensitive */
+        if (strcmp(tok.value.sz, aVarDefs[i].pszName) == 0)
+          break;
+      }
     }
     if (i == nDim)
     {
@@ -628,6 +727,7 @@ int GetLinearForm(FILE* pFile, int nDim, int nOutput, LINEARFORM* pLF,
       goto LINEARFORM_ERR;
     }
     nVarIndex = i;
+    nNextVar = i + 1;
     if (TESTMAP(aVarMap, nVarIndex))
     {
       nErr = DTR_DUPVARCENTROID;
@@ -635,7 +735,7 @@ int GetLinearForm(FILE* pFile, int nDim, int nOutput, LINEARFORM* pLF,
     }    
     
     /* sign */
-    nCSign = GetToken(pFile, &tok);
+    nCSign = GetToken(pLex, &tok);
     if (nCSign != '-' && nCSign != '+')
     {
       nErr = DTR_MISSINGLINEARSIGN;
@@ -645,7 +745,7 @@ int GetLinearForm(FILE* pFile, int nDim, int nOutput, LINEARFORM* pLF,
     else bNeg = 0;
     
     /* get centroid */
-    if (GetDoubleToken(pFile, &tok) != L_DBL)
+    if (GetDoubleToken(pLex, &tok) != L_DBL)
     {
       nErr = DTR_BADLINEARCENTROID;
       goto LINEARFORM_ERR;
@@ -654,7 +754,7 @@ int GetLinearForm(FILE* pFile, int nDim, int nOutput, LINEARFORM* pLF,
     if (bNeg) dblC = -dblC;
     
     /* get close paren */
-    if (GetToken(pFile, &tok) != ')')
+    if (GetToken(pLex, &tok) != ')')
     {
       nErr = DTR_MISSINGCENTROIDEND;
       goto LINEARFORM_ERR;
@@ -666,7 +766,7 @@ int GetLinearForm(FILE* pFile, int nDim, int nOutput, LINEARFORM* pLF,
     SETMAP(aVarMap, nVarIndex); 
     
     /* lookahead */
-    nType = GetToken(pFile, & tok);
+    nType = GetToken(pLex, & tok);
     if (nType != ';' && nType != '+' && nType != '-')
     {
       nErr = DTR_MISSINGLINEARSEMI;
@@ -675,15 +775,21 @@ int GetLinearForm(FILE* pFile, int nDim, int nOutput, LINEARFORM* pLF,
     else if (nType != ';')            /* + or - */
     {
       bNeg = nType == '-';            /* set neg flag for next time thru loop*/
-      nType = GetToken(pFile, & tok); /* lookahead again */
+      nType = GetToken(pLex, & tok); /* lookahead again */
     }
   }
   
   if (nOutput >= nDim)                /* verify output index */
-    return DTR_BADOUTPUTRANGE;
+  {
+    nErr = DTR_BADOUTPUTRANGE;
+    goto LINEARFORM_ERR;
+  }
                                    
   if (pLF->adblW[nOutput] == 0)       /* make sure output weight != 0 */
-    return DTR_ZEROOUTPUTWEIGHT;
+  {
+    nErr = DTR_ZEROOUTPUTWEIGHT;
+    goto LINEARFORM_ERR;
+  }
                      
   /* calc bias weight */
   pLF->dblBias = 0;
@@ -692,7 +798,8 @@ int GetLinearForm(FILE* pFile, int nDim, int nOutput, LINEARFORM* pLF,
 
 LINEARFORM_ERR:
 
-  free(aVarMap);
+  if (aVarMap != aVarMapLocal)
+    free(aVarMap);
   return nErr;
 }
 
@@ -700,7 +807,7 @@ LINEARFORM_ERR:
 /////////////////////////////////////////////////////////////////////
 // dtree node parser
 */
-int GetDtreeNode(FILE* pFile, BLOCK* aBlocks, int nBlocks, VARDEF* aVarDefs,
+int GetDtreeNode(DTRLEX* pLex, BLOCK* aBlocks, int nBlocks, VARDEF* aVarDefs,
                  int nDim, DTREENODE* aNodes, int nNodes, int nNode)
 {
   int nType;
@@ -713,7 +820,7 @@ int GetDtreeNode(FILE* pFile, BLOCK* aBlocks, int nBlocks, VARDEF* aVarDefs,
   pNode = aNodes + nNode;
   
   /* lookahead determines whether this is a leaf or internal node */
-  nType = GetToken(pFile, &tok);
+  nType = GetToken(pLex, &tok);
   if (nType != R_BLOCK && nType != '(')
     return DTR_BADDTREEDEF;                 /* bad token type */
     
@@ -721,7 +828,7 @@ int GetDtreeNode(FILE* pFile, BLOCK* aBlocks, int nBlocks, VARDEF* aVarDefs,
   { 
     int nVarIndex = 0;
     
-    if (GetToken(pFile, &tok) != IDENTIFIER)
+    if (GetToken(pLex, &tok) != IDENTIFIER)
       return DTR_MISSINGDTREEVAR;
                                                                              
     /* get variable index */
@@ -736,25 +843,25 @@ int GetDtreeNode(FILE* pFile, BLOCK* aBlocks, int nBlocks, VARDEF* aVarDefs,
     if (DNODE_VARINDEX(pNode) == nDim)      /* var ident not found */
       return DTR_UNKNOWNVARIDENT;
     
-    if (GetToken(pFile, &tok) != S_LE)      /* '<=' */
+    if (GetToken(pLex, &tok) != S_LE)      /* '<=' */
       return DTR_MISSINGDTREELE; 
-    if (GetDoubleToken(pFile, &tok) != L_DBL)  /* threshold */
+    if (GetDoubleToken(pLex, &tok) != L_DBL)  /* threshold */
       return DTR_MISSINGDTREETHRESHOLD;
     DNODE_THRESHOLD(pNode) = tok.value.dbl;
     if (DNODE_THRESHOLD(pNode) < aVarDefs[DNODE_VARINDEX(pNode)].bound.dblMin ||
         DNODE_THRESHOLD(pNode) > aVarDefs[DNODE_VARINDEX(pNode)].bound.dblMax)
       return DTR_BADTHRESHOLDRANGE;         /* check thresh range */
     
-    if (GetToken(pFile, &tok) != ')')       /* ')' */
+    if (GetToken(pLex, &tok) != ')')       /* ')' */
       return DTR_MISSINGDTREEPAREN;
-    if (GetToken(pFile, &tok) != '?')       /* '?' */
+    if (GetToken(pLex, &tok) != '?')       /* '?' */
       return DTR_MISSINGDTREEQUESTION;
-    if (GetToken(pFile, &tok) != L_INT)   /* left child */
+    if (GetToken(pLex, &tok) != L_INT)   /* left child */
       return DTR_MISSINGDTREECHILDINDEX;                                          
     DNODE_LEFTINDEX(pNode) = tok.value.l;      
-    if (GetToken(pFile, &tok) != ':')       /* ':' */
+    if (GetToken(pLex, &tok) != ':')       /* ':' */
       return DTR_MISSINGDTREECHILDSEP;
-    if (GetToken(pFile, &tok) != L_INT)   /* right child */
+    if (GetToken(pLex, &tok) != L_INT)   /* right child */
       return DTR_MISSINGDTREECHILDINDEX;                                          
     DNODE_RIGHTINDEX(pNode) = tok.value.l;      
                                           
@@ -775,11 +882,11 @@ int GetDtreeNode(FILE* pFile, BLOCK* aBlocks, int nBlocks, VARDEF* aVarDefs,
   }
   else /* leaf node */
   { 
-    if (GetToken(pFile, &tok) != L_INT)
+    if (GetToken(pLex, &tok) != L_INT)
       return DTR_MISSINGDTREEBLOCKINDEX;
   
     DNODE_BLOCKINDEX(pNode) = tok.value.l;
-    if(DNODE_BLOCKINDEX(pNode) >= nBlocks)
+    if(DNODE_BLOCKINDEX(pNode) < 0 || DNODE_BLOCKINDEX(pNode) >= nBlocks)
       return DTR_UNDEFINEDREGION;   
                
     pNode->nLeaf = 1;                       /* mark as a leaf */
@@ -788,152 +895,137 @@ int GetDtreeNode(FILE* pFile, BLOCK* aBlocks, int nBlocks, VARDEF* aVarDefs,
     aBlocks[DNODE_BLOCKINDEX(pNode)].nDtreeIndex = nNode;
   } 
   
-  if (GetToken(pFile, &tok) != ';')         /* end of statement */
+  if (GetToken(pLex, &tok) != ';')         /* end of statement */
     return DTR_MISSINGDTREESEMI;
 
   return DTR_NOERROR;
 }
   
-/*  
+/*
 /////////////////////////////////////////////////////////////////////
 // lexers
 */
-    
-void SkipWS(FILE* pFile) 
-{ 
+
+void SkipWS(DTRLEX* pLex)
+{
   int c;
-  
-WS_SEARCH: 
-  /* check for eof */
-  if (feof(pFile))
-    return;
- 
-  do
+
+WS_SEARCH:
+  /* skip white space */
+  while (!LEX_EOF(pLex))
   {
-    c = fgetc(pFile);
+    c = (unsigned char)*pLex->p;
+    if (!isspace(c))
+      break;
     if (c == '\n') dtree_lineno++;     /* inc linecount */
-  } while (isspace(c) && !feof(pFile));
-    
+    pLex->p++;
+  }
+
   /* check for eof */
-  if (feof(pFile))
+  if (LEX_EOF(pLex))
     return;
-  
-  /* put back last char */
-  ungetc(c, pFile);
-  
+
   /* check for comment */
-  if (IsComment(pFile))
+  if (IsComment(pLex))
   {
-    if (feof(pFile))
+    if (LEX_EOF(pLex))
       return;       /* EOF in comment */
     goto WS_SEARCH; /* skip any more WS */
   }
-}    
-    
-int GetToken(FILE* pFile, TOKEN* pTok)
-{ 
+}
+
+int GetToken(DTRLEX* pLex, TOKEN* pTok)
+{
   int c, c2;
 
-  if (feof(pFile))
-    return EOF;
-  
-  /* skip any white space */  
-  SkipWS(pFile);    
+  /* skip any white space */
+  SkipWS(pLex);
 
   /* check for eof */
-  if (feof(pFile))
-    return EOF;    
+  if (LEX_EOF(pLex))
+    return EOF;
 
   /* get token position */
-  pTok->lFilePos = ftell(pFile);    
-  
-  
+  pTok->pPos = pLex->p;
+
   /* lookahead at next 2 chars */
-  c = fgetc(pFile);  
-  c2 = fgetc(pFile);  
-  fseek(pFile, pTok->lFilePos, SEEK_SET); /* go back */  
-    
+  c = LEX_PEEK(pLex, 0);
+  c2 = LEX_PEEK(pLex, 1);
+
   /* get token */
   if (ISCSYMF(c))
-    return GetIdentifier(pFile, pTok);
-  else if (isdigit(c))
-    return GetNumber(pFile, pTok);
+    return GetIdentifier(pLex, pTok);
+  else if (ISDIGIT(c))
+    return GetNumber(pLex, pTok);
   else
   {
-    if (c == '-' && isdigit(c2))          /* part of number! */
-      return GetNumber(pFile, pTok);
+    if (c == '-' && ISDIGIT(c2))          /* part of number! */
+      return GetNumber(pLex, pTok);
     else
-      return GetSymbol(pFile, pTok);
+      return GetSymbol(pLex, pTok);
   }
 }
 
-void PushbackToken(FILE* pFile, TOKEN* pTok)
+void PushbackToken(DTRLEX* pLex, TOKEN* pTok)
 {
-  fseek(pFile, pTok->lFilePos, SEEK_SET);  
+  pLex->p = pTok->pPos;
 }
- 
-int GetSymbol(FILE* pFile, TOKEN* pTok)
+
+int GetSymbol(DTRLEX* pLex, TOKEN* pTok)
 {
   int c;
- 
-  if (feof(pFile))
+
+  if (LEX_EOF(pLex))
     return EOF;
-         
-  c = fgetc(pFile);
+
+  c = (unsigned char)*pLex->p++;
   pTok->value.l = c;
 
   /* look ahead to get '<=' symbol */
-  if (c == '<' && !feof(pFile))
-  {     
-    int c2 = fgetc(pFile);
-    if (c2 == '=')
-      pTok->value.l = S_LE;     /* <= symbol */
-    else                  
-      ungetc(c2, pFile);  /* not <=, putback */
+  if (c == '<' && LEX_PEEK(pLex, 0) == '=')
+  {
+    pLex->p++;
+    pTok->value.l = S_LE;     /* <= symbol */
   }
-  
+
   return (int)pTok->value.l;
 }
 
-int GetIntegerToken(FILE* pFile, TOKEN* pTok)
-{ 
-  int c;                        
-  char szTok[MAXTOKLEN];        /* token */
+int GetIntegerToken(DTRLEX* pLex, TOKEN* pTok)
+{
+  const char* pStart;
   int nLen = 0;                 /* length of token */
   int nType = ERR_TOKEN;
-  
-  /* skip any white space */  
-  SkipWS(pFile);    
-  
-  if (feof(pFile))
+
+  /* skip any white space */
+  SkipWS(pLex);
+
+  if (LEX_EOF(pLex))
     return EOF;
-  
+
   /* keep scanning 'til error in integer def */
-  szTok[0] = 0;
-  while (!feof(pFile) && (nLen < (MAXTOKLEN - 1)))
+  pStart = pLex->p;
+  while (!LEX_EOF(pLex) && (nLen < (MAXTOKLEN - 1)))
   {
-    c = fgetc(pFile);
-    if (!isdigit(c) && ((c != '-') || nLen > 0))
-    {
-      /* bad char or neg sign in bad place... putback */
-      ungetc(c, pFile); break;
-    }
-    szTok[nLen++] = (char)c;
-  } 
-  szTok[nLen] = 0;  /* terminate string */
+    int c = (unsigned char)*pLex->p;
+    if (!ISDIGIT(c) && ((c != '-') || nLen > 0))
+      break;    /* bad char or neg sign in bad place */
+    pLex->p++;
+    nLen++;
+  }
 
   if (nLen > 0)
   {
-    pTok->value.l = atol(szTok);
+    pTok->value.l = ParseLong(pStart, nLen);
     nType = L_INT;
   }
-          
+
   return nType;
 }
 
-int GetDoubleToken(FILE* pFile, TOKEN* pTok)
+int GetDoubleToken(DTRLEX* pLex, TOKEN* pTok)
 {
-  int nType = GetToken(pFile, pTok);
+  int nType = GetToken(pLex, pTok);
   if (nType == L_INT)
   {
     pTok->value.dbl = pTok->value.l;  /* convert int to double */
@@ -942,113 +1034,202 @@ int GetDoubleToken(FILE* pFile, TOKEN* pTok)
   return nType;
 }
 
-int GetNumber(FILE* pFile, TOKEN* pTok)  
+int GetNumber(DTRLEX* pLex, TOKEN* pTok)
 {
-  int c;                        
-  char szTok[MAXTOKLEN];        /* token */
+  const char* pStart;
   int nLen = 0;                 /* length of token */
   int nE = 0;                   /* e notation 'e' position */
   int nDots = 0;                /* number of decimal places seen */
   int nType = ERR_TOKEN;
-  
-  if (feof(pFile))
+
+  if (LEX_EOF(pLex))
     return EOF;
-  
+
   /* keep scanning 'til error in number def */
-  szTok[0] = 0;
-  while (!feof(pFile) && (nLen < (MAXTOKLEN - 1)))
+  pStart = pLex->p;
+  while (!LEX_EOF(pLex) && (nLen < (MAXTOKLEN - 1)))
   {
-    c = fgetc(pFile);
-    if (!isdigit(c))
+    int c = (unsigned char)*pLex->p;
+    if (!ISDIGIT(c))
     {
       if (c == '-')
-      {     
+      {
         if ((!nE && nLen > 0) || (nE && (nLen != nE + 1)))
-        {
-          /* neg sign in bad place... putback */
-          ungetc(c, pFile);
-          break;
-        }          
+          break;        /* neg sign in bad place */
       }
       else if (c == '+')
-      {     
+      {
         if (!(nE && (nLen == nE + 1)))
-        {
-          /* plus sign in bad place... putback */
-          ungetc(c, pFile);
-          break;
-        }          
+          break;        /* plus sign in bad place */
       }
       else if (c == '.')
       {
         nDots++;
-        if (nDots > 1)  /* not part of the number, putback */
-        {
-          ungetc(c, pFile);
+        if (nDots > 1)  /* not part of the number */
           break;
-        }
       }
       else if (c == 'e' || c == 'E')
-      {  
+      {
         if (!nE)
           nE = nLen;
-        else            /* not part of the number, putback */
-        { 
-          ungetc(c, pFile);
+        else            /* not part of the number */
           break;
-        }
       }
-      else              /* not part of the number, putback */
-      {
-        ungetc(c, pFile);
+      else              /* not part of the number */
         break;
-      }
     }
-    szTok[nLen++] = (char)c;
-  } 
-  szTok[nLen] = 0;      /* terminate string */
+    pLex->p++;
+    nLen++;
+  }
 
   if (nDots > 0 || nE > 0)
-  {           
-    pTok->value.dbl = atof(szTok);
+  {
+    pTok->value.dbl = ParseDouble(pStart, nLen);
     nType = L_DBL;
   }
   else
   {
-    pTok->value.l = atol(szTok);
+    pTok->value.l = ParseLong(pStart, nLen);
     nType = L_INT;
   }
-          
+
   return nType;
 }
 
-int GetIdentifier(FILE* pFile, TOKEN* pTok)
+long ParseLong(const char* psz, int nLen)
+{
+  char szTok[MAXTOKLEN];
+  const char* p = psz;
+  const char* pEnd = psz + nLen;
+  long l = 0;
+  int bNeg = 0;
+
+  /* up to 9 digits cannot overflow; longer tokens go to atol */
+  if (p < pEnd && *p == '-')
+  {
+    bNeg = 1;
+    p++;
+  }
+  if (pEnd - p > 9)
+  {
+    memcpy(szTok, psz, nLen);
+    szTok[nLen] = 0;
+    return atol(szTok);
+  }
+  for (; p < pEnd && ISDIGIT(*p); p++)
+    l = l * 10 + (*p - '0');
+  return bNeg ? -l : l;
+}
+
+/* powers of ten exactly representable as doubles */
+static const double _adblPow10[] =
+{
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+double ParseDouble(const char* psz, int nLen)
+{
+  /*
+  // Fast path: a mantissa of at most 2^53 and a power of ten up to 1e22
+  // are both exact doubles, so one multiply or divide gives the correctly
+  // rounded result (Clinger).  Anything else goes to atof.
+  */
+  const char* p = psz;
+  const char* pEnd = psz + nLen;
+  unsigned long long ullMant = 0;
+  int nDigits = 0;              /* significant digits in mantissa */
+  int nExp10 = 0;               /* decimal exponent of mantissa */
+  int bNeg = 0;
+  char szTok[MAXTOKLEN];
+
+  if (p < pEnd && *p == '-')
+  {
+    bNeg = 1;
+    p++;
+  }
+  if (p == pEnd || (!ISDIGIT(*p) && *p != '.'))
+    goto SLOW_PATH;
+
+  for (; p < pEnd && ISDIGIT(*p); p++)
+  {
+    if (ullMant != 0 || *p != '0')
+    {
+      if (++nDigits > 19)
+        goto SLOW_PATH;
+      ullMant = ullMant * 10 + (*p - '0');
+    }
+  }
+  if (p < pEnd && *p == '.')
+  {
+    for (p++; p < pEnd && ISDIGIT(*p); p++)
+    {
+      if (ullMant != 0 || *p != '0')
+      {
+        if (++nDigits > 19)
+          goto SLOW_PATH;
+        ullMant = ullMant * 10 + (*p - '0');
+      }
+      nExp10--;
+    }
+  }
+  if (p < pEnd && (*p == 'e' || *p == 'E'))
+  {
+    int nExp = 0;
+    int bExpNeg = 0;
+    p++;
+    if (p < pEnd && (*p == '-' || *p == '+'))
+      bExpNeg = (*p++ == '-');
+    if (p == pEnd || !ISDIGIT(*p))
+      goto SLOW_PATH;
+    for (; p < pEnd && ISDIGIT(*p); p++)
+    {
+      if (nExp > 10000)
+        goto SLOW_PATH;
+      nExp = nExp * 10 + (*p - '0');
+    }
+    nExp10 += bExpNeg ? -nExp : nExp;
+  }
+  if (p != pEnd)
+    goto SLOW_PATH;
+
+  if (ullMant <= (1ULL << 53) && nExp10 >= -22 && nExp10 <= 22)
+  {
+    double dbl = (double)ullMant;
+    if (nExp10 < 0)
+      dbl /= _adblPow10[-nExp10];
+    else
+      dbl *= _adblPow10[nExp10];
+    return bNeg ? -dbl : dbl;
+  }
+
+SLOW_PATH:
+  memcpy(szTok, psz, nLen);
+  szTok[nLen] = 0;
+  return atof(szTok);
+}
+
+int GetIdentifier(DTRLEX* pLex, TOKEN* pTok)
 {
-  int c;
-  char szTok[MAXTOKLEN];        /* token */
   int nLen = 0;                 /* length of token */
   int nType = ERR_TOKEN;
-  
-  if (feof(pFile))
+
+  if (LEX_EOF(pLex))
     return EOF;
-  
+
   /* scanning 'til error in identifier def */
-  szTok[0] = 0;
-  while (!feof(pFile) && (nLen < (MAXTOKLEN - 1)))
+  while (!LEX_EOF(pLex) && (nLen < (MAXTOKLEN - 1)))
   {
-    c = fgetc(pFile);
+    int c = (unsigned char)*pLex->p;
     if ((nLen == 0 && !ISCSYMF(c)) ||
         (nLen > 0 && !ISCSYM(c)))
-    {
-      /* putback bad char */
-      ungetc(c, pFile);
       break;
-    }
-    szTok[nLen++] = (char)c;
+    pTok->value.sz[nLen++] = (char)c;
+    pLex->p++;
   }
-  szTok[nLen] = 0;  /* terminate string */
-  
-  nType = IsReserved(szTok);
+  pTok->value.sz[nLen] = 0;  /* terminate string */
+
+  nType = IsReserved(pTok->value.sz);
   if(nType != 0)
   {
     pTok->value.l = nType;
@@ -1056,13 +1237,12 @@ int GetIdentifier(FILE* pFile, TOKEN* pTok)
   }
   else
   {
-    strcpy(pTok->value.sz, szTok);
     return IDENTIFIER;
   }
 }
- 
+
 int IsReserved(char* psz)
-{ 
+{
   int i;
   for (i = 0; _nReserved[i] != 0; i++)
   {
@@ -1071,69 +1251,131 @@ int IsReserved(char* psz)
       return _nReserved[i];
     }
   }
-  
+
   return 0;
 }
 
-int IsComment(FILE* pFile)
+int IsComment(DTRLEX* pLex)
 {
   int c;
-  long lFilePos;
-  
-  /* check eof */
-  if (feof(pFile))
-    return 0;       /* should never be EOF here */
-    
-  /* save filepos */
-  lFilePos = ftell(pFile);
-         
-  /* get char */
-  c = fgetc(pFile);
-  
-  if (c != '/' || feof(pFile))
-  {
-    ungetc(c, pFile); /* put it back */
+
+  /* check for comment start */
+  if (LEX_PEEK(pLex, 0) != '/')
     return 0;         /* not a comment */
-  }
-  
-  /* might be a comment, get next char */
-  c = fgetc(pFile);
+
+  c = LEX_PEEK(pLex, 1);
   if (c == '/')       /* C++ style single line comment */
   {
-    while (c != '\n' && !feof(pFile))
+    const char* pNL;
+    pLex->p += 2;
+    pNL = (const char*)memchr(pLex->p, '\n', pLex->pEnd - pLex->p);
+    if (pNL == NULL)
     {
-      c = fgetc(pFile);
-      if (c == '\n') dtree_lineno++; /* inc linecount */
+      pLex->p = pLex->pEnd;
+      return 1;       /* eof in comment */
     }
-    return 1;         /* end of comment or eof in comment */
+    dtree_lineno++;   /* inc linecount */
+    pLex->p = pNL + 1;
+    return 1;         /* end of comment */
   }
-    
+
   if (c == '*')       /* C style comment */
   {
-  COMMENT_SEARCH:
-    if (feof(pFile))
-      return 1;       /* end of file in comment */
-    do
+    pLex->p += 2;
+    while (!LEX_EOF(pLex))
     {
-      c = fgetc(pFile);
-      if (c == '\n') dtree_lineno++; /* inc linecount */
-    } while (c != '*' && !feof(pFile));
-    if (feof(pFile))
-      return 1;       /* end of file in comment */
-    c = fgetc(pFile);
-    if (c == '\n') dtree_lineno++;   /* inc linecount */
-    else if (c == '/')
-      return 1;       /* end of comment */
-      
-    goto COMMENT_SEARCH;  /* keep searching */
+      c = (unsigned char)*pLex->p++;
+      if (c == '\n')
+        dtree_lineno++; /* inc linecount */
+      else if (c == '*' && LEX_PEEK(pLex, 0) == '/')
+      {
+        pLex->p++;
+        return 1;     /* end of comment */
+      }
+    }
+    return 1;         /* end of file in comment */
   }
-  
-  /* not a comment, push back file pointer */
-  fseek(pFile, lFilePos, SEEK_SET); /* go back */
+
+  /* not a comment */
   return 0;
 }
 
-/*  
+/*
+/////////////////////////////////////////////////////////////////////
+// buffered output
+*/
+
+void FlushWriter(DTRWRITER* pW)
+{
+  if (pW->cb > 0 && pW->nErr == DTR_NOERROR &&
+      fwrite(pW->pBuf, 1, pW->cb, pW->pFile) != pW->cb)
+    pW->nErr = DTR_FILEWRITEERR;
+  pW->cb = 0;
+}
+
+void PutChars(DTRWRITER* pW, const char* pch, size_t n)
+{
+  while (n > 0)
+  {
+    size_t nCopy = WRITEBUFSIZE - pW->cb;
+    if (nCopy > n)
+      nCopy = n;
+    memcpy(pW->pBuf + pW->cb, pch, nCopy);
+    pW->cb += nCopy;
+    pch += nCopy;
+    n -= nCopy;
+    if (pW->cb == WRITEBUFSIZE)
+      FlushWriter(pW);
+  }
+}
+
+void PutString(DTRWRITER* pW, const char* psz)
+{
+  PutChars(pW, psz, strlen(psz));
+}
+
+void PutChar(DTRWRITER* pW, char c)
+{
+  if (pW->cb == WRITEBUFSIZE)
+    FlushWriter(pW);
+  pW->pBuf[pW->cb++] = c;
+}
+
+void PutLong(DTRWRITER* pW, long l)
+{
+  char sz[24];
+  char* p = sz + sizeof(sz);
+  unsigned long ul = (l < 0) ? 0UL - (unsigned long)l : (unsigned long)l;
+
+  do
+  {
+    *--p = (char)('0' + ul % 10);
+    ul /= 10;
+  } while (ul != 0);
+  if (l < 0)
+    *--p = '-';
+
+  PutChars(pW, p, sz + sizeof(sz) - p);
+}
+
+void PutDouble(DTRWRITER* pW, double dbl)
+{
+  /* 17 significant digits always read back to the same double */
+  char sz[32];
+  int n;
+
+  /* integral values are common (weights of -1, bounds) */
+  if (dbl > -1e9 && dbl < 1e9 && dbl != 0 && dbl == (double)(long)dbl)
+  {
+    PutLong(pW, (long)dbl);
+    return;
+  }
+
+  n = sprintf(sz, "%.17g", dbl);
+  PutChars(pW, sz, n);
+}
+
+/*
 /////////////////////////////////////////////////////////////////////
 // Dtree exporter
 */
@@ -1141,69 +1383,94 @@ int IsComment(FILE* pFile)
 int ExportDtreeFile(FILE* pFile, const char* pszFileName, DTREE* pDtree)
 {
   time_t timeNow;
-  int i;        
-  
-  static char _szHeader[] = "// %s exported on %s\n"
-                            "// ALN Decision Tree file format v1.0 (C) 2018 William W. Armstrong\n\n";
-                                        
-  static char _szVersion[] = "VERSION = 1.0;\n";                                        
-  static char _szVarDefs[] = "VARIABLES = %ld;\n";
-  static char _szOutput[] = "OUTPUT = %s;\n";
-  static char _szLinearForms[] = "LINEARFORMS = %ld;\n";
-  static char _szBlocks[] = "BLOCKS = %ld;\n";
-  static char _szDtree[] = "DTREE = %ld;\n";
-  
+  int i;
+  DTRWRITER w;
+  int nErr = DTR_NOERROR;
+
+  static char _szHeader1[] = "// ";
+  static char _szHeader2[] = " exported on ";
+  static char _szHeader3[] = "\n// ALN Decision Tree file format v1.0 (C) 2018 William W. Armstrong\n\n";
+
+  static char _szVersion[] = "VERSION = 1.0;\n";
+  static char _szVarDefs[] = "VARIABLES = ";
+  static char _szOutput[] = "OUTPUT = ";
+  static char _szLinearForms[] = "LINEARFORMS = ";
+  static char _szBlocks[] = "BLOCKS = ";
+  static char _szDtree[] = "DTREE = ";
+  static char _szEnd[] = ";\n";
+  static char _szIndex[] = " : ";
+
   if (pFile == NULL || pDtree == NULL)
     return DTR_GENERIC;
-  
-  /* write header */
+
+  w.pFile = pFile;
+  w.cb = 0;
+  w.nErr = DTR_NOERROR;
+  if ((w.pBuf = (char*)malloc(WRITEBUFSIZE)) == NULL)
+    return DTR_MALLOCFAILED;
+
+  /* helper to finish up on error */
+  #define _ON_ERR(nErrCode) { nErr = nErrCode; goto EXPORT_END; }
+
+  /* write header, asctime string ends with a newline */
   time(&timeNow);
-  fprintf(pFile, _szHeader, pszFileName, asctime(localtime(&timeNow)));
-  
+  PutString(&w, _szHeader1);
+  PutString(&w, pszFileName);
+  PutString(&w, _szHeader2);
+  PutString(&w, asctime(localtime(&timeNow)));
+  PutString(&w, _szHeader3);
+
   /* write version */
-  fprintf(pFile, _szVersion);
-  
+  PutString(&w, _szVersion);
+
   /* write variables */
-  fprintf(pFile, _szVarDefs, pDtree->nDim);
+  PutString(&w, _szVarDefs);
+  PutLong(&w, pDtree->nDim);
+  PutString(&w, _szEnd);
   if (pDtree->aVarDefs == NULL)
-    return DTR_GENERIC;
+    _ON_ERR(DTR_GENERIC);
   for (i = 0; i < pDtree->nDim; i++)
-  { 
-    static char _szVarDef[] = "%s : [%.19lg, %.19lg];\n";
+  {
     VARDEF* pV = pDtree->aVarDefs + i;
-    fprintf(pFile, _szVarDef, pV->pszName, pV->bound.dblMin, pV->bound.dblMax);
+    PutString(&w, pV->pszName);
+    PutString(&w, " : [");
+    PutDouble(&w, pV->bound.dblMin);
+    PutString(&w, ", ");
+    PutDouble(&w, pV->bound.dblMax);
+    PutString(&w, "]");
+    PutString(&w, _szEnd);
   }
-  
+
   /* write output */
   if (pDtree->nOutputIndex >= pDtree->nDim)
-    return DTR_GENERIC;
-  fprintf(pFile, _szOutput, pDtree->aVarDefs[pDtree->nOutputIndex].pszName);
-  
+    _ON_ERR(DTR_GENERIC);
+  PutString(&w, _szOutput);
+  PutString(&w, pDtree->aVarDefs[pDtree->nOutputIndex].pszName);
+  PutString(&w, _szEnd);
+
   /* write linear forms */
-  fprintf(pFile, _szLinearForms, pDtree->nLinearForms);
+  PutString(&w, _szLinearForms);
+  PutLong(&w, pDtree->nLinearForms);
+  PutString(&w, _szEnd);
   if (pDtree->aLinearForms == NULL)
-    return DTR_GENERIC;
+    _ON_ERR(DTR_GENERIC);
   for (i = 0; i < pDtree->nLinearForms; i++)
-  {      
+  {
     int j;
     int nVarsOut;
-    static char _szLinearForm[] = "%ld : ";
-    static char _szVar[] = "%.19lg (%s %c %.19lg)";
-    static char _szSign[] = " %c ";
     LINEARFORM* pLF = pDtree->aLinearForms + i;
-    if (pLF == NULL)
-      return DTR_GENERIC;
-    fprintf(pFile, _szLinearForm, i);
-                        
+    PutLong(&w, i);
+    PutString(&w, _szIndex);
+
     nVarsOut = 0;     /* no vars output yet */
     for (j = 0; j < pDtree->nDim; j++)
-    {                  
-      int nWSign, nCSign; 
+    {
+      char nWSign, nCSign;
       double dblW, dblC;
-    
+
       if (pLF->adblW[j] == 0)
-        continue;               
-      
+        continue;
+
       dblW = pLF->adblW[j];
       dblC = pLF->adblC[j];
 
@@ -1214,8 +1481,8 @@ int ExportDtreeFile(FILE* pFile, const char* pszFileName, DTREE* pDtree)
         dblW = -dblW;
       }
       else
-        nWSign = '+'; 
-        
+        nWSign = '+';
+
       if (dblC < 0)
       {
         nCSign = '+';
@@ -1223,115 +1490,135 @@ int ExportDtreeFile(FILE* pFile, const char* pszFileName, DTREE* pDtree)
       }
       else
         nCSign = '-';
-      
+
       if (nVarsOut > 0)
-        fprintf(pFile, _szSign, nWSign);
-        
-      fprintf(pFile, _szVar, dblW, pDtree->aVarDefs[j].pszName, nCSign, dblC);
+      {
+        PutChar(&w, ' ');
+        PutChar(&w, nWSign);
+        PutChar(&w, ' ');
+      }
+
+      /* weight (var sign centroid) */
+      PutDouble(&w, dblW);
+      PutString(&w, " (");
+      PutString(&w, pDtree->aVarDefs[j].pszName);
+      PutChar(&w, ' ');
+      PutChar(&w, nCSign);
+      PutChar(&w, ' ');
+      PutDouble(&w, dblC);
+      PutChar(&w, ')');
       nVarsOut++;
     }
     /* write statement end */
-    fputc(';', pFile);
-    fputc('\n', pFile);
+    PutString(&w, _szEnd);
   }
-  
+
   /* write blocks */
-  fprintf(pFile, _szBlocks, pDtree->nBlocks);
+  PutString(&w, _szBlocks);
+  PutLong(&w, pDtree->nBlocks);
+  PutString(&w, _szEnd);
   if (pDtree->aBlocks == NULL)
-    return DTR_GENERIC;
+    _ON_ERR(DTR_GENERIC);
   for (i = 0; i < pDtree->nBlocks; i++)
-  {                                        
-    int nErr = DTR_NOERROR;
-    static char _szBlock[] = "%ld : ";
+  {
     BLOCK* pBlock = pDtree->aBlocks + i;
-    fprintf(pFile, _szBlock, i);
-    
+    PutLong(&w, i);
+    PutString(&w, _szIndex);
+
     /* write minmax node */
-    if ((nErr = WriteMinMaxTree(pFile, pDtree, pBlock->pMinMaxTree, 0)) != DTR_NOERROR)
-      return nErr;
-    
+    if ((nErr = WriteMinMaxTree(&w, pDtree, pBlock->pMinMaxTree, 0)) != DTR_NOERROR)
+      _ON_ERR(nErr);
+
     /* write statement end */
-    fputc(';', pFile);
-    fputc('\n', pFile);
+    PutString(&w, _szEnd);
   }
 
   /* write dtree */
-  fprintf(pFile, _szDtree, pDtree->nNodes);
+  PutString(&w, _szDtree);
+  PutLong(&w, pDtree->nNodes);
+  PutString(&w, _szEnd);
   if (pDtree->aNodes == NULL)
-    return DTR_GENERIC;
+    _ON_ERR(DTR_GENERIC);
   for (i = 0; i < pDtree->nNodes; i++)
-  {                                        
-    static char _szNode[] = "%ld : ";
+  {
     DTREENODE* pNode = pDtree->aNodes + i;
-    fprintf(pFile, _szNode, i);
-    
+    PutLong(&w, i);
+    PutString(&w, _szIndex);
+
     /* is this a leaf ? */
     if (pNode->nLeaf != 0)
     {
-      static char _szLeaf[] = "block %ld";
-      fprintf(pFile, _szLeaf, DNODE_BLOCKINDEX(pNode));
+      /* block n */
+      PutString(&w, "block ");
+      PutLong(&w, DNODE_BLOCKINDEX(pNode));
     }
     else  /* internal node */
     {
-      static char _szInternal[] = "(%s <= %.19lg) ? %ld : %ld";
-      fprintf(pFile, _szInternal, 
-              pDtree->aVarDefs[DNODE_VARINDEX(pNode)].pszName,
-              DNODE_THRESHOLD(pNode), DNODE_LEFTINDEX(pNode), 
-              DNODE_RIGHTINDEX(pNode));
+      /* (var <= t) ? left : right */
+      PutChar(&w, '(');
+      PutString(&w, pDtree->aVarDefs[DNODE_VARINDEX(pNode)].pszName);
+      PutString(&w, " <= ");
+      PutDouble(&w, DNODE_THRESHOLD(pNode));
+      PutString(&w, ") ? ");
+      PutLong(&w, DNODE_LEFTINDEX(pNode));
+      PutString(&w, _szIndex);
+      PutLong(&w, DNODE_RIGHTINDEX(pNode));
     }
-    
+
     /* write statement end */
-    fputc(';', pFile);
-    fputc('\n', pFile);
+    PutString(&w, _szEnd);
   }
-            
-  return DTR_NOERROR;
+
+  #undef _ON_ERR
+
+EXPORT_END:
+  FlushWriter(&w);
+  free(w.pBuf);
+  if (nErr == DTR_NOERROR)
+    nErr = w.nErr;
+  return nErr;
 }
 
-int WriteMinMaxTree(FILE* pFile, DTREE* pDtree, MINMAXNODE* pMMN, int nIndent)
-{ 
-  if (pFile == NULL || pDtree == NULL || pMMN == NULL)
+int WriteMinMaxTree(DTRWRITER* pW, DTREE* pDtree, MINMAXNODE* pMMN, int nIndent)
+{
+  if (pW == NULL || pDtree == NULL || pMMN == NULL)
     return DTR_GENERIC;
-                          
+
   if (pMMN->nType == DTREE_LINEAR)
-  {        
-    static char _szIndex[] = "%ld";
-    
-    if (MMN_LFINDEX(pMMN) >= pDtree->nLinearForms || 
+  {
+    if (MMN_LFINDEX(pMMN) >= pDtree->nLinearForms ||
         pDtree->aLinearForms == NULL)
       return DTR_UNDEFINEDLINEARFORM;
-    
-    fprintf(pFile, _szIndex, MMN_LFINDEX(pMMN));
+
+    PutLong(pW, MMN_LFINDEX(pMMN));
   }
   else if (pMMN->nType == DTREE_MIN || pMMN->nType == DTREE_MAX)
-  {   
+  {
     int nErr = DTR_NOERROR;
-    static char _szMin[] = "MIN";
-    static char _szMax[] = "MAX";
+    static char _szMin[] = "MIN(";
+    static char _szMax[] = "MAX(";
     static char _szSep[] = ", ";
-    static char _szNL[] = "\n%*s";
-    MINMAXNODE* pList = MMN_CHILDLIST(pMMN);                    
+    MINMAXNODE* pList = MMN_CHILDLIST(pMMN);
     if (pMMN->nType == DTREE_MIN)
-      fprintf(pFile, _szMin);
+      PutString(pW, _szMin);
     else
-      fprintf(pFile, _szMax);
-               
-    fputc('(', pFile);
+      PutString(pW, _szMax);
+
     while(pList)
-    { 
-      if ((nErr = WriteMinMaxTree(pFile,pDtree,pList,nIndent+4)) != DTR_NOERROR)
+    {
+      if ((nErr = WriteMinMaxTree(pW, pDtree, pList, nIndent + 4)) != DTR_NOERROR)
         return nErr;
-                
-      if (pList->pNext != NULL) 
-        fprintf(pFile, _szSep);
-      
+
+      if (pList->pNext != NULL)
+        PutString(pW, _szSep);
+
       pList = pList->pNext;
-    }     
-    fputc(')', pFile);
+    }
+    PutChar(pW, ')');
   }
   else
     return DTR_GENERIC;
-                          
+
   return DTR_NOERROR;
 }
 
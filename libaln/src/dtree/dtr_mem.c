@@ -53,6 +53,15 @@ DTRIMP void DTREEAPI DestroyDtree(DTREE* pDtree)
 {       
   if (pDtree == NULL)
     return;
+
+  UncompileDtree(pDtree);
+
+  /* arrays of a flat image DTREE are not individually allocated */
+  if (pDtree->pvFlatImage != NULL)
+  {
+    DestroyFlatDtree(pDtree);
+    return;
+  }
   
   /* delete arrays */
   DestroyVarDefArray(pDtree->aVarDefs, pDtree->nDim);
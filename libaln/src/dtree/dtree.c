@@ -62,6 +62,10 @@ DTRIMP int DTREEAPI ReadDtree(const char* pszFileName, DTREE** ppDtree)
   
   /* parse the file */
   nErr = ParseDtreeFile(pFile, ppDtree);
+
+  /* compile for evaluation, the tree walk remains if this fails */
+  if (nErr == DTR_NOERROR)
+    CompileDtree(*ppDtree, DTR_COMPILE_STRICT);
   
   /* set the error number */
   dtree_errno = nErr;
@@ -106,9 +110,20 @@ DTRIMP int DTREEAPI BinReadDtree(const char* pszFileName, DTREE** ppDtree)
   {
     return DTR_FILEERR;
   }           
+
+  /* flat images are mapped rather than parsed */
+  if (IsFlatDtreeFile(pFile))
+  {
+    fclose(pFile);
+    return FlatReadDtree(pszFileName, ppDtree);
+  }
   
   /* parse the file */
   nErr = ReadBinDtreeFile(pFile, ppDtree);
+
+  /* compile for evaluation */
+  if (nErr == DTR_NOERROR)
+    CompileDtree(*ppDtree, DTR_COMPILE_STRICT);
   
   /* set the error number */
   dtree_errno = nErr;
@@ -140,6 +155,62 @@ DTRIMP int DTREEAPI BinWriteDtree(const char* pszFileName, DTREE* pDtree)
   return nErr;
 }
 
+DTRIMP int DTREEAPI FlatReadDtree(const char* pszFileName, DTREE** ppDtree)
+{
+  int nErr = DTR_NOERROR;
+
+  /* map the file */
+  nErr = MapFlatDtreeFile(pszFileName, ppDtree);
+
+  /* compile for evaluation */
+  if (nErr == DTR_NOERROR)
+    CompileDtree(*ppDtree, DTR_COMPILE_STRICT);
+
+  /* set the error number */
+  dtree_errno = nErr;
+  return nErr;
+}
+
+DTRIMP int DTREEAPI FlatWriteDtree(const char* pszFileName, DTREE* pDtree)
+{
+  FILE* pFile = NULL;
+  int nErr = DTR_NOERROR;
+
+  /* open file */
+  if (fopen_s(&pFile, pszFileName, "wb") != 0 )
+  {
+    return DTR_FILEERR;
+  }
+
+  /* export the file */
+  nErr = WriteFlatDtreeFile(pFile, pDtree);
+
+  /* close file */
+  if (fclose(pFile) != 0 && nErr == DTR_NOERROR)
+    nErr = DTR_FILEWRITEERR;
+
+  /* set the error number */
+  dtree_errno = nErr;
+  return nErr;
+}
+
+DTRIMP int DTREEAPI ReadDtreeFromMemory(const void* pvImage, size_t cbImage,
+                                        DTREE** ppDtree)
+{
+  int nErr = DTR_NOERROR;
+
+  /* use the image in place */
+  nErr = ReadFlatDtreeImage(pvImage, cbImage, ppDtree);
+
+  /* compile for evaluation */
+  if (nErr == DTR_NOERROR)
+    CompileDtree(*ppDtree, DTR_COMPILE_STRICT);
+
+  /* set the error number */
+  dtree_errno = nErr;
+  return nErr;
+}
+
 DTRIMP void DTREEAPI GetDtreeError(int nErrno, char* pBuf, int nMaxBufLen)
 {
   GetErrMsg(nErrno, pBuf, nMaxBufLen);
@@ -161,11 +232,17 @@ DTRIMP int DTREEAPI EvalDtree(DTREE* pDtree, double* adblInput,
       pNode = pDtree->aNodes + DNODE_RIGHTINDEX(pNode);
   }
   
-  /* eval block */
-  nErr = EvalMinMaxTree(pDtree->aBlocks[DNODE_BLOCKINDEX(pNode)].pMinMaxTree,
-                        pDtree->aLinearForms, pDtree->nDim, 
-                        pDtree->nOutputIndex, 
-                        adblInput, pdblResult, pnLinearIndex);
+  /* eval block, walking the min/max tree if it has no usable compiled
+     copy */
+  nErr = DTRC_TREEWALK;
+  if (pDtree->pvCompiled != NULL)
+    nErr = EvalCompiledBlock(pDtree, DNODE_BLOCKINDEX(pNode),
+                             adblInput, pdblResult, pnLinearIndex);
+  if (nErr == DTRC_TREEWALK)
+    nErr = EvalMinMaxTree(pDtree->aBlocks[DNODE_BLOCKINDEX(pNode)].pMinMaxTree,
+                          pDtree->aLinearForms, pDtree->nDim, 
+                          pDtree->nOutputIndex, 
+                          adblInput, pdblResult, pnLinearIndex);
                         
   /* bound output */
   if (*pdblResult < pDtree->aVarDefs[pDtree->nOutputIndex].bound.dblMin)
@@ -176,6 +253,152 @@ DTRIMP int DTREEAPI EvalDtree(DTREE* pDtree, double* adblInput,
   return nErr;
 }
     
+/* batches smaller than this are evaluated on the calling thread */
+#define DTR_BATCHPARALLEL 8192
+
+/* rows of one block evaluated by one work item */
+#define DTR_BATCHCHUNK 1024
+
+DTRIMP int DTREEAPI EvalDtreeBatch(DTREE* pDtree, const double* adblRows,
+                                   int nRows, int nStride, double* adblOut,
+                                   int* anLFIndex)
+{
+  int* anBlock = NULL;            /* block reached by each row              */
+  int* anStart = NULL;            /* first entry of each block in anOrder   */
+  int* anOrder = NULL;            /* row indexes grouped by block           */
+  int* anItem = NULL;             /* block of each work item                */
+  int nItems = 0;
+  double dblMin, dblMax;
+  int nErr = DTR_NOERROR;
+  int i;
+
+  if (pDtree == NULL || nRows < 0 || nStride < 1)
+    return DTR_GENERIC;
+
+  /* an empty batch needs no buffers, which may come from malloc(0) */
+  if (nRows == 0)
+    return DTR_NOERROR;
+  if (adblRows == NULL || adblOut == NULL)
+    return DTR_GENERIC;
+
+  /* without compiled blocks there is nothing to share between rows; the
+     same goes for blocks changed after compiling */
+  if (pDtree->pvCompiled == NULL || !IsCompiledCurrent(pDtree))
+  {
+    #pragma omp parallel for if (nRows >= DTR_BATCHPARALLEL)
+    for (i = 0; i < nRows; i++)
+    {
+      int nRowErr = EvalDtree(pDtree, (double*)(adblRows + (size_t)i * nStride),
+                              adblOut + i, anLFIndex ? anLFIndex + i : NULL);
+      if (nRowErr != DTR_NOERROR)
+      {
+        #pragma omp critical
+        nErr = nRowErr;
+      }
+    }
+    return nErr;
+  }
+
+  anBlock = (int*)malloc(nRows * sizeof(int));
+  anOrder = (int*)malloc(nRows * sizeof(int));
+  anStart = (int*)calloc(pDtree->nBlocks + 1, sizeof(int));
+  anItem = (int*)malloc((pDtree->nBlocks + nRows / DTR_BATCHCHUNK + 1) * sizeof(int) * 2);
+  if (anBlock == NULL || anOrder == NULL || anStart == NULL || anItem == NULL)
+  {
+    nErr = DTR_MALLOCFAILED;
+    goto done;
+  }
+
+  /* find leaves */
+  #pragma omp parallel for if (nRows >= DTR_BATCHPARALLEL)
+  for (i = 0; i < nRows; i++)
+  {
+    const double* adblInput = adblRows + (size_t)i * nStride;
+    DTREENODE* pNode = pDtree->aNodes;
+    while (pNode->nLeaf == 0)
+    {
+      if (adblInput[DNODE_VARINDEX(pNode)] <= DNODE_THRESHOLD(pNode))
+        pNode = pDtree->aNodes + DNODE_LEFTINDEX(pNode);
+      else
+        pNode = pDtree->aNodes + DNODE_RIGHTINDEX(pNode);
+    }
+    anBlock[i] = DNODE_BLOCKINDEX(pNode);
+  }
+
+  /* group rows by block, keeping row order within a block */
+  for (i = 0; i < nRows; i++)
+    anStart[anBlock[i] + 1]++;
+  for (i = 0; i < pDtree->nBlocks; i++)
+    anStart[i + 1] += anStart[i];
+  for (i = 0; i < nRows; i++)
+    anOrder[anStart[anBlock[i]]++] = i;
+  for (i = pDtree->nBlocks; i > 0; i--)
+    anStart[i] = anStart[i - 1];
+  anStart[0] = 0;
+
+  /* work items are (block, first entry) pairs of at most DTR_BATCHCHUNK rows */
+  for (i = 0; i < pDtree->nBlocks; i++)
+  {
+    int nFirst;
+    for (nFirst = anStart[i]; nFirst < anStart[i + 1]; nFirst += DTR_BATCHCHUNK)
+    {
+      anItem[2 * nItems] = i;
+      anItem[2 * nItems + 1] = nFirst;
+      nItems++;
+    }
+  }
+
+  /* evaluate blocks over their rows */
+  #pragma omp parallel if (nRows >= DTR_BATCHPARALLEL)
+  {
+    void* pvScratch = malloc(CompiledScratchSize(pDtree->pvCompiled));
+    int nItem;
+
+    #pragma omp for schedule(dynamic)
+    for (nItem = 0; nItem < nItems; nItem++)
+    {
+      int nBlock = anItem[2 * nItem];
+      int nFirst = anItem[2 * nItem + 1];
+      int nCount = anStart[nBlock + 1] - nFirst;
+      int nItemErr;
+      if (nCount > DTR_BATCHCHUNK)
+        nCount = DTR_BATCHCHUNK;
+
+      if (pvScratch == NULL)
+        nItemErr = DTR_MALLOCFAILED;
+      else
+        nItemErr = EvalCompiledRows(pDtree->pvCompiled, nBlock, adblRows,
+                                    nStride, anOrder + nFirst, nCount,
+                                    adblOut, anLFIndex, pvScratch);
+      if (nItemErr != DTR_NOERROR)
+      {
+        #pragma omp critical
+        nErr = nItemErr;
+      }
+    }
+
+    free(pvScratch);
+  }
+
+  /* bound output */
+  dblMin = pDtree->aVarDefs[pDtree->nOutputIndex].bound.dblMin;
+  dblMax = pDtree->aVarDefs[pDtree->nOutputIndex].bound.dblMax;
+  for (i = 0; i < nRows; i++)
+  {
+    if (adblOut[i] < dblMin)
+      adblOut[i] = dblMin;
+    else if (adblOut[i] > dblMax)
+      adblOut[i] = dblMax;
+  }
+
+done:
+  free(anBlock);
+  free(anOrder);
+  free(anStart);
+  free(anItem);
+  return nErr;
+}
+    
 DTRIMP int DTREEAPI EvalMinMaxTree(MINMAXNODE* pMMN, LINEARFORM* aLF, 
                                    int nDim, int nOutput, double* adblInput, 
                                    double* pdblResult, int* pnLinearIndex)
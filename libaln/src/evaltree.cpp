@@ -31,6 +31,10 @@
 #include <aln.h>
 #include "alnpriv.h"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #ifdef _DEBUG
 #undef THIS_FILE
 static char THIS_FILE[] = __FILE__;
@@ -41,12 +45,166 @@ static void DebugValidateEvalTreeInfo(const ALN* pALN,
                                       const ALNDATAINFO* pDataInfo,
                                       const ALNCALLBACKINFO* pCallbackInfo,
                                       double* adblResult,
-                                      int* pnStart, int* pnEnd,
+                                      long long* pnStart, long long* pnEnd,
                                       ALNNODE** apActiveLFNs,
                                       double* adblInput,
                                       double* adblOutput);
 #endif
 
+// points per block of the parallel evaluation loop
+#define EVALBLOCKPOINTS 4096
+
+// evaluates points nFirst to nLast, with nStart as from CalcDataEndPoints;
+// the arrays are indexed from 0 for point nFirst
+static void EvalPoints(const ALN* pALN,
+                       const ALNDATAINFO* pDataInfo,
+                       const ALNCALLBACKINFO* pCallbackInfo,
+                       long long nStart, long long nFirst, long long nLast,
+                       const double** apdblBase, double* adblX,
+                       BOOL bErrorResults, double* adblResult,
+                       ALNNODE** apActiveLFNs, double* adblInput,
+                       double* adblOutput)
+{
+  int nDim = pALN->nDim;
+  ALNNODE* pTree = pALN->pTree;		  // on stack for quicker access
+  ALNNODE* pActiveLFN = NULL;
+  for (long long i = nFirst; i <= nLast; i++)
+  {
+    long long n = i - nFirst;
+
+    // fill input vector
+    FillInputVector(pALN, adblX, i - nStart, nStart, apdblBase, 
+                    pDataInfo, pCallbackInfo);
+
+    // copy input vector?
+    if (adblInput)
+    {
+      // get the input row
+      double* adblRow = adblInput + (n * nDim);
+
+      // copy values
+      memcpy(adblRow, adblX, nDim * sizeof(double));
+      
+      // set the bias value in the output var spot
+      adblRow[pALN->nOutput] = 1.0;
+    }
+
+    // copy desired output 
+    // ... do this before setting output value in input vector to zero below
+    if (adblOutput)
+    {
+      adblOutput[n] = adblX[pALN->nOutput];
+    }
+
+    // CutoffEval returns distance from surface to point in the direction of
+	  // the output variable, so we need to add that to the existing output value
+    // to get the actual surface value
+    if (!bErrorResults)
+    {
+      adblX[pALN->nOutput] = 0; // set output value to zero...
+
+      // ... since output value is zero, the distance CutoffEval returns
+      // is the value of the function surface
+    }
+
+    // get the distance from the point to the surface defined by the ALN
+    adblResult[n] = CutoffEval(pTree, pALN, adblX, CEvalCutoff(),
+                               &pActiveLFN);
+    
+    // save the active LFN
+    if (apActiveLFNs != NULL)
+    {
+      apActiveLFNs[n] = pActiveLFN;
+    }
+  }
+}
+
+// evaluates points nFirst to nLast as EvalPoints; the points are
+// independent, so when the data is in memory and there is no vector info
+// callback, which need not be reentrant, blocks of points are evaluated
+// in parallel
+static void EvalRange(const ALN* pALN,
+                      const ALNDATAINFO* pDataInfo,
+                      const ALNCALLBACKINFO* pCallbackInfo,
+                      long long nStart, long long nFirst, long long nLast,
+                      BOOL bErrorResults, double* adblResult,
+                      ALNNODE** apActiveLFNs, double* adblInput,
+                      double* adblOutput)
+{
+  int nDim = pALN->nDim;
+  double* adblX = NULL;             // eval vector
+  const double** apdblBase = NULL;  // column base ptr
+
+  try
+  {
+   	// allocate column base vector, read only below
+    apdblBase = AllocColumnBase(nStart, pALN, pDataInfo);
+
+    BOOL bParallel = pDataInfo->adblData != NULL &&
+                     nLast - nFirst + 1 > EVALBLOCKPOINTS &&
+                     !(pCallbackInfo && CanCallback(AN_VECTORINFO,
+                                                    pCallbackInfo->pfnNotifyProc,
+                                                    pCallbackInfo->nNotifyMask));
+    if (!bParallel)
+    {
+      // allocate input vector     
+      adblX = new double[nDim];   
+      if (!adblX) ThrowALNMemoryException();
+      memset(adblX, 0, sizeof(double) * nDim);
+
+      EvalPoints(pALN, pDataInfo, pCallbackInfo, nStart, nFirst, nLast,
+                 apdblBase, adblX, bErrorResults, adblResult, apActiveLFNs,
+                 adblInput, adblOutput);
+    }
+    else
+    {
+      int nBlocks = (int)((nLast - nFirst + EVALBLOCKPOINTS) / EVALBLOCKPOINTS);
+      int nFailed = 0;
+      int b;
+      #pragma omp parallel for schedule(dynamic)
+      for (b = 0; b < nBlocks; b++)
+      {
+        long long n = (long long)b * EVALBLOCKPOINTS;
+        long long nBlockLast = nFirst + n + EVALBLOCKPOINTS - 1;
+        if (nBlockLast > nLast)
+          nBlockLast = nLast;
+
+        // each block has its own input vector
+        double* adblBlockX = (double*)calloc(nDim, sizeof(double));
+        if (adblBlockX == NULL)
+        {
+          #pragma omp atomic
+          nFailed++;
+          continue;
+        }
+
+        EvalPoints(pALN, pDataInfo, pCallbackInfo, nStart, nFirst + n,
+                   nBlockLast, apdblBase, adblBlockX, bErrorResults,
+                   adblResult + n,
+                   apActiveLFNs ? apActiveLFNs + n : NULL,
+                   adblInput ? adblInput + n * nDim : NULL,
+                   adblOutput ? adblOutput + n : NULL);
+
+        free(adblBlockX);
+      }
+
+      if (nFailed > 0)
+        ThrowALNMemoryException();
+    }
+  }
+  catch (...)
+  {
+    // clear memory and pass it on
+	  delete[] adblX;
+    FreeColumnBase(apdblBase);
+    throw;
+  }
+
+  // clear memory	
+	delete[] adblX;
+  FreeColumnBase(apdblBase);
+}
+
 // evaluation of ALN on data
 
 int ALNAPI EvalTree(const ALNNODE* pNode, 
@@ -54,7 +212,7 @@ int ALNAPI EvalTree(const ALNNODE* pNode,
                     const ALNDATAINFO* pDataInfo,
                     const ALNCALLBACKINFO* pCallbackInfo,
                     double* adblResult,
-                    int* pnStart, int* pnEnd,
+                    long long* pnStart, long long* pnEnd,
                     BOOL bErrorResults /*= FALSE*/,
                     ALNNODE** apActiveLFNs /*= NULL*/,
                     double* adblInput /*= NULL*/,
@@ -68,10 +226,9 @@ int ALNAPI EvalTree(const ALNNODE* pNode,
 #endif
   
   int nDim = pALN->nDim;
-  int nPoints = pDataInfo->nPoints;
 
   // calc start and end points
-  long nStart, nEnd; 
+  long long nStart, nEnd; 
   CalcDataEndPoints(nStart, nEnd, pALN, pDataInfo);
   
   if (pnStart != NULL)
@@ -81,76 +238,67 @@ int ALNAPI EvalTree(const ALNNODE* pNode,
 
   // evaluation loop
   int nReturn = ALN_NOERROR;        // assume OK
-  double* adblX = NULL;             // eval vector
-  const double** apdblBase = NULL;  // column base ptr
-  ALNNODE* pTree = pALN->pTree;		  // on stack for quicker access
-  CCutoffInfo* aCutoffInfo = NULL;  
  
 	try
  	{
     // reset active lfn array
     if (apActiveLFNs != NULL)
     {
-      memset(apActiveLFNs, 0, pDataInfo->nPoints * sizeof(ALNNODE*));
+      memset(apActiveLFNs, 0, (size_t)pDataInfo->nPoints * sizeof(ALNNODE*));
     }
 
-  	// allocate input vector     
-   	adblX = new double[nDim];   
-    if (!adblX) ThrowALNMemoryException();
-    memset(adblX, 0, sizeof(double) * nDim);
-
-   	// allocate column base vector
-    apdblBase = AllocColumnBase(nStart, pALN, pDataInfo);
-
     // main loop
-    ALNNODE* pActiveLFN = NULL;
-    for (int i = nStart; i <= nEnd; i++)
-    {
-      // fill input vector
-      FillInputVector(pALN, adblX, i - nStart, nStart, apdblBase, 
-                      pDataInfo, pCallbackInfo);
-
-      // copy input vector?
-      if (adblInput)
-      {
-        // get the input row
-        double* adblRow = adblInput + (i * pALN->nDim);
-
-        // copy values
-        memcpy(adblRow, adblX, pALN->nDim * sizeof(double));
-        
-        // set the bias value in the output var spot
-        adblRow[pALN->nOutput] = 1.0;
-      }
+    EvalRange(pALN, pDataInfo, pCallbackInfo, nStart, nStart, nEnd,
+              bErrorResults, adblResult + nStart,
+              apActiveLFNs ? apActiveLFNs + nStart : NULL,
+              adblInput ? adblInput + nStart * nDim : NULL,
+              adblOutput ? adblOutput + nStart : NULL);
+  }
+  catch (CALNUserException* e)
+  {
+  	nReturn = ALN_USERABORT;
+    e->Delete();
+  }
+  catch (CALNMemoryException* e)
+  {
+  	nReturn = ALN_OUTOFMEM;
+    e->Delete();
+  }
+  catch (CALNException* e)
+  {
+  	nReturn = ALN_GENERIC;
+    e->Delete();
+  }
+  catch (...)
+  {
+  	nReturn = ALN_GENERIC;
+  }
 
-      // copy desired output 
-      // ... do this before setting output value in input vector to zero below
-      if (adblOutput)
-      {
-        adblOutput[i] = adblX[pALN->nOutput];
-      }
+  return nReturn;
+}
 
-      // CutoffEval returns distance from surface to point in the direction of
-	    // the output variable, so we need to add that to the existing output value
-      // to get the actual surface value
-      if (!bErrorResults)
-      {
-        adblX[pALN->nOutput] = 0; // set output value to zero...
+// evaluation of ALN on points nFirst to nLast of a dataset, nFirst and
+// nLast within the range of CalcDataEndPoints; adblResult holds
+// nLast - nFirst + 1 values
+int ALNAPI EvalTreeRange(const ALN* pALN,
+                         const ALNDATAINFO* pDataInfo,
+                         const ALNCALLBACKINFO* pCallbackInfo,
+                         long long nFirst, long long nLast,
+                         double* adblResult,
+                         BOOL bErrorResults /*= FALSE*/)
+{
+  ASSERT(pALN && pDataInfo && adblResult);
 
-        // ... since output value is zero, the distance CutoffEval returns
-        // is the value of the function surface
-      }
+  long long nStart, nEnd; 
+  CalcDataEndPoints(nStart, nEnd, pALN, pDataInfo);
+  ASSERT(nFirst >= nStart && nLast <= nEnd);
 
-      // get the distance from the point to the surface defined by the ALN
-      adblResult[i] = CutoffEval(pTree, pALN, adblX, CEvalCutoff(),
-                                 &pActiveLFN);
-      
-      // save the active LFN
-      if (apActiveLFNs != NULL)
-      {
-        apActiveLFNs[i] = pActiveLFN;
-      }
-    }
+  int nReturn = ALN_NOERROR;
+ 
+	try
+ 	{
+    EvalRange(pALN, pDataInfo, pCallbackInfo, nStart, nFirst, nLast,
+              bErrorResults, adblResult, NULL, NULL, NULL);
   }
   catch (CALNUserException* e)
   {
@@ -172,10 +320,6 @@ int ALNAPI EvalTree(const ALNNODE* pNode,
   	nReturn = ALN_GENERIC;
   }
 
-  // clear memory	
-	delete[] adblX;
-  FreeColumnBase(apdblBase);
-	
   return nReturn;
 }
 
@@ -185,7 +329,7 @@ static void DebugValidateEvalTreeInfo(const ALN* pALN,
                                       const ALNDATAINFO* pDataInfo,
                                       const ALNCALLBACKINFO* pCallbackInfo,
                                       double* adblResult,
-                                      int* pnStart, int* pnEnd,
+                                      long long* pnStart, long long* pnEnd,
                                       ALNNODE** apActiveLFNs,
                                       double* adblInput,
                                       double* adblOutput)
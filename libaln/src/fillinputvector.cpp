@@ -36,8 +36,8 @@ static char THIS_FILE[] = __FILE__;
 
 void ALNAPI FillInputVector(const ALN* pALN,
                             double* adblX, 
-                            int nPoint,
-                            int nStart,
+                            long long nPoint,
+                            long long nStart,
                             const double** apdblBase,
                             const ALNDATAINFO* pDataInfo,
                             const ALNCALLBACKINFO* pCallbackInfo)
@@ -55,7 +55,7 @@ void ALNAPI FillInputVector(const ALN* pALN,
   vectorinfo.bNeedData = FALSE;
   if (aVarInfo != NULL && adblData != NULL)
   {
-    int nOffset = nPoint * nCols;
+    long long nOffset = nPoint * nCols;
     for (int j = 0; j < nDim; j++)
     {
       adblX[j] = *(apdblBase[j] + nOffset);
@@ -29,6 +29,7 @@
 
 #include <aln.h>
 #include "alnpriv.h"
+#include <string.h>
 #include <boost\math\special_functions\beta.hpp>
 using namespace boost::math;
 
@@ -39,19 +40,52 @@ static char THIS_FILE[] = __FILE__;
 
 // calculate probability p of an event occuring, such that
 // the probablity of m or less such events occuring in n trials
-// is x; currently limited to accuracy of 1.e-7
+// is x
 
-// implementation based on Ridders method documented in Press et al
+// the cumulative binomial dist 0 to m events in n trials is
+// 1 - I_p(m + 1, n - m), see Press et al p229, so p is the inverse of the
+// complemented incomplete beta function at x; boost's ibetac_inv starts
+// from an asymptotic estimate and refines it with Halley iteration (Newton
+// with a second order term) to full double precision
 
-// method: advance p until cumulative binomial dist 0 to m events in n 
-//         trials drops to x
+// recent results are kept in a small set associative table keyed on n, m
+// and x, since the same limits are asked for repeatedly when many ALNs
+// are monitored
 
-double ALNAPI PLimit(int n, int m, double dblX)
+#define PLIMITCACHESETS 2048  // power of 2
+#define PLIMITCACHEWAYS 4
+
+struct PLIMITCACHE
 {
-  static const double dblInc = 0.1;     // coarse increment
-  static const double dblAcc = 1.0e-7;  // maximum accuracy
+  long long n;     // 0 in an empty entry, which n never matches here
+  long long m;
+  double dblX;
+  double dblP;
+};
+
+static PLIMITCACHE _aPLimitCache[PLIMITCACHESETS][PLIMITCACHEWAYS];
+static int _anPLimitCacheNext[PLIMITCACHESETS];  // way to replace next
+
+static int PLimitCacheSet(long long n, long long m, double dblX)
+{
+  unsigned long long nBits;
+  memcpy(&nBits, &dblX, sizeof(nBits));
+
+  // splitmix64 finalizer over the combined key
+  unsigned long long nHash = (unsigned long long)n * 0x9E3779B97F4A7C15ull ^
+                             (unsigned long long)m ^ (nBits * 0xC2B2AE3D27D4EB4Full);
+  nHash = (nHash ^ (nHash >> 30)) * 0xBF58476D1CE4E5B9ull;
+  nHash = (nHash ^ (nHash >> 27)) * 0x94D049BB133111EBull;
+  nHash ^= nHash >> 31;
 
-  if (dblX < 0.0 || dblX > 1.0 || n < 0)
+  return (int)(nHash & (PLIMITCACHESETS - 1));
+}
+
+static double PLimitSearch(long long n, long long m, double dblX);
+
+double ALNAPI PLimit(long long n, long long m, double dblX)
+{
+  if (!(dblX >= 0.0 && dblX <= 1.0) || n < 0)
   {
     return NAN;
   }
@@ -62,7 +96,67 @@ double ALNAPI PLimit(int n, int m, double dblX)
   if (m >= n)
     return 1.0;
 
- 
+  int nSet = PLimitCacheSet(n, m, dblX);
+  BOOL bFound = FALSE;
+  double dblP;
+
+  #pragma omp critical (plimitcache)
+  {
+    for (int i = 0; i < PLIMITCACHEWAYS; i++)
+    {
+      const PLIMITCACHE& entry = _aPLimitCache[nSet][i];
+      if (entry.n == n && entry.m == m && entry.dblX == dblX)
+      {
+        dblP = entry.dblP;
+        bFound = TRUE;
+        break;
+      }
+    }
+  }
+
+  if (bFound)
+    return dblP;
+
+  try
+  {
+    dblP = ibetac_inv((double)(m + 1), (double)(n - m), dblX);
+  }
+  catch (...)
+  {
+    dblP = NAN;
+  }
+
+  // fall back on the bracketing search if the inverse failed
+  if (!(dblP >= 0.0 && dblP <= 1.0))
+    dblP = PLimitSearch(n, m, dblX);
+
+  #pragma omp critical (plimitcache)
+  {
+    int nWay = _anPLimitCacheNext[nSet];
+    _anPLimitCacheNext[nSet] = (nWay + 1) % PLIMITCACHEWAYS;
+
+    PLIMITCACHE& entry = _aPLimitCache[nSet][nWay];
+    entry.n = n;
+    entry.m = m;
+    entry.dblX = dblX;
+    entry.dblP = dblP;
+  }
+
+  return dblP;
+}
+
+// bracketing search for p, limited to accuracy of 1.e-7
+
+// implementation based on Ridders method documented in Press et al
+
+// method: advance p until cumulative binomial dist 0 to m events in n 
+//         trials drops to x
+
+static double PLimitSearch(long long n, long long m, double dblX)
+{
+  static const double dblInc = 0.1;     // coarse increment
+  static const double dblAcc = 1.0e-7;  // maximum accuracy
+
   // P is desired probability, Y is difference between desired area
   // under tail and the area under the tail given P
 
@@ -37,23 +37,45 @@ static char THIS_FILE[] = __FILE__;
 ///////////////////////////////////////////////////////////////////////////////
 // shuffle
 
-void ALNAPI Shuffle(int nStart, int nEnd, int* anShuffle)
+// random index in [0, nRange); one draw when the range fits, so short
+// shuffles keep their sequence
+static inline long long RandIndex(long long nRange)
+{
+  if (nRange <= (long long)ALNRAND_MAX)
+    return ALNRand() % nRange;
+
+  unsigned long long n = ((unsigned long long)ALNRand() << 32) | ALNRand();
+  return (long long)(n % (unsigned long long)nRange);
+}
+
+template <class T>
+static void DoShuffle(long long nStart, long long nEnd, T* anShuffle)
 {
   ASSERT(anShuffle);
 
   if ((nEnd - nStart) > 1)
   {
-  	for (int nSwap = nStart; nSwap <= nEnd; nSwap++)
+  	for (long long nSwap = nStart; nSwap <= nEnd; nSwap++)
   	{
   		// calc swap indexes
-  	  int a, b;
-  	  a = ALNRand() % (nEnd - nStart + 1);
-  	  do { b = ALNRand() % (nEnd - nStart + 1); } while (a == b);
+  	  long long a, b;
+  	  a = RandIndex(nEnd - nStart + 1);
+  	  do { b = RandIndex(nEnd - nStart + 1); } while (a == b);
 
   	  // swap indexes
-  		#define _SWAP(a, b) (a) = (a)^(b); (b) = (a)^(b); (a) = (a)^(b)
-  		_SWAP(anShuffle[a], anShuffle[b]);
-  		#undef _SWAP
+  		T t = anShuffle[a];
+  		anShuffle[a] = anShuffle[b];
+  		anShuffle[b] = t;
   	} // end shuffle    
   }
 }
+
+void ALNAPI Shuffle(long long nStart, long long nEnd, int* anShuffle)
+{
+  DoShuffle(nStart, nEnd, anShuffle);
+}
+
+void ALNAPI Shuffle(long long nStart, long long nEnd, long long* anShuffle)
+{
+  DoShuffle(nStart, nEnd, anShuffle);
+}
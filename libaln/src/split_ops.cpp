@@ -40,18 +40,20 @@ static char THIS_FILE[] = __FILE__;
 // include classes
 #include ".\cmyaln.h"
 #include "aln.h"
+#include "alnpriv.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 // We use dblRespTotal in two ways and the following definition helps.
 #define DBLNOISEVARIANCE dblRespTotal
 
 extern CDataFile TRfile; // The training file (global).
 extern int nDim;	// Greater by one than the dimension of the domain of the function to be learned.
-extern long nRowsTR; // The number of training samples
+extern long long nRowsTR; // The number of training samples
 extern BOOL bStopTraining; // This becomes TRUE and stops training when pieces are no longer splitting.
 void splitControl(ALN* pALN, double dblLimit);
-void zeroSplitValues(ALN* pALN, ALNNODE* pNode);
 void splitUpdateValues(ALN * pALN, double dblLimit);
-void doSplits(ALN* pALN, ALNNODE* pNode, double dblLimit);
 int ALNAPI SplitLFN(ALN* pALN, ALNNODE* pNode);
 ALNDATAINFO* GetDataInfo();
 extern double* aNoiseSampleTool; // Used to create noise samples for the F-test to stop pieces splitting.
@@ -87,32 +89,42 @@ static const double adblFconstant50[13]{ 1,1,1,1,1,1,1,1,1,1,1,1,1 };
 static const double adblFconstant35[13]{ 0.58, 0.65, 0.70, 0.73, 0.75, 0.77, 0.78, 0.79, 0.80, 0.86, 0.88, 0.90, 0.92 };
 static const double adblFconstant25[13]{ 0.333, 0.424, 0.485, 0.529, 0.562, 0.588, 0.610, 0.629, 0.645, 0.735, 0.781, 0.806, 0.840 };
 
+// rows per block of the parallel split statistics pass
+#define SPLITBLOCKROWS 4096
+// rows per chunk, whose evaluations are kept so the sums can be taken in row order
+#define SPLITCHUNKROWS 65536
+
+static void zeroSplitValues(ALNNODE* const* apLeaves, int nLeaves);
+static void doSplit(ALN* pALN, ALNNODE* pNode, double dblLimit);
+
 void splitControl(ALN* pALN, double dblLimit)  // routine
 {
   ASSERT(pALN);
 	ASSERT(pALN->pTree);
-	// initialize all the SPLIT values to zero
-	zeroSplitValues(pALN, pALN->pTree);
+	// The other steps go through the leaf nodes in the leaf index of the ALN, with room
+	// reserved for every leaf node to split. A leaf node that splits is replaced there by its
+	// left child and its right child goes at the end, so the loop stops at the present leaves.
+	if (!BuildLFNIndex(pALN, pALN->nLFNs)) ThrowALNMemoryException();
+	int nLeaves = pALN->nLFNs;
+	// Resetting the SPLIT components to zero is done here before the next statistics are gathered.
+	zeroSplitValues(pALN->apLFNs, nLeaves);
 	// get square errors of pieces on training set and the noise variance estimates
 	splitUpdateValues(pALN, dblLimit);
-	// With the above statistics, doSplits recursively determines splits of eligible pieces.
-  doSplits(pALN, pALN->pTree, dblLimit);
-  // Resetting the SPLIT components to zero by zeroSplitValues is done in alntrain.
+	// With the above statistics, doSplit determines splits of eligible pieces.
+	for (int i = 0; i < nLeaves; i++)
+	{
+		doSplit(pALN, pALN->apLFNs[i], dblLimit);
+	}
 }
 
 // Routines that set some fields to zero
 
-void zeroSplitValues(ALN* pALN, ALNNODE* pNode) // routine
+static void zeroSplitValues(ALNNODE* const* apLeaves, int nLeaves) // routine
 {
 	// initializes split counters of all leaf nodes before the next training period
-	ASSERT(pNode);
-	if (NODE_ISMINMAX(pNode))
-	{
-		zeroSplitValues(pALN, MINMAX_LEFT(pNode));
-		zeroSplitValues(pALN, MINMAX_RIGHT(pNode));
-	}
-	else
+	for (int i = 0; i < nLeaves; i++)
 	{
+		ALNNODE* pNode = apLeaves[i];
 		ASSERT(NODE_ISLFN(pNode));
 		(pNode->DATA.LFN.pSplit)->nCount = 0;
 		(pNode->DATA.LFN.pSplit)->dblSqError = 0;
@@ -122,33 +134,25 @@ void zeroSplitValues(ALN* pALN, ALNNODE* pNode) // routine
 
 // Routines that get the training errors and noise variance values.
 
-void splitUpdateValues(ALN * pALN, double dblLimit) // routine
+// evaluates rows nFirst to nLast of TRfile in place; the arrays are indexed from 0 for nFirst
+static void splitEvalRows(const ALN* pALN, long long nFirst, long long nLast, double dblLimit,
+                          ALNNODE** apActiveLFN, double* adblSqError, double* adblNoise)
 {
-	// Assign the square errors on the training set and the noise variance
-	// sample values to the leaf nodes of the ALN.
-	double * adblX = (double *)malloc((nDim) * sizeof(double));
-	double fromFile = 0;
-	double predict = 0;
 	int nDimm1 = nDim - 1;
-
-	ALNNODE* pActiveLFN;
-	long nrows = TRfile.RowCount();
-	for (long i = 0; i < nrows; i++)
+	for (long long i = nFirst; i <= nLast; i++)
 	{
-		for (int j = 0; j < nDim; j++)
-		{
-			adblX[j] = TRfile.GetAt(i, j, 0);
-		}
-		predict = ALNQuickEval(pALN, adblX, &pActiveLFN); // the current ALN value
+		long long n = i - nFirst;
+		const double* adblX = TRfile.GetRowAt(i);
+		ALNNODE* pActiveLFN;
+		double predict = ALNQuickEval(pALN, adblX, &pActiveLFN); // the current ALN value
+		apActiveLFN[n] = pActiveLFN;
 		if (LFN_CANSPLIT(pActiveLFN)) // Skip this leaf node if it can't split anyway.
 		{
-			double noiseSampleTemp;
-			fromFile = adblX[nDimm1]; //adblX[nDim - 1] is the desired value in the data
-			(pActiveLFN->DATA.LFN.pSplit)->nCount++;
-			(pActiveLFN->DATA.LFN.pSplit)->dblSqError += (predict - fromFile) * (predict - fromFile);
+			double fromFile = adblX[nDimm1]; //adblX[nDim - 1] is the desired value in the data
+			adblSqError[n] = (predict - fromFile) * (predict - fromFile);
 			if (dblLimit <= 0)
 			{
-				noiseSampleTemp = aNoiseSampleTool[(i + 1) * nDim - 1]; // Get the difference of values in the tool
+				double noiseSampleTemp = aNoiseSampleTool[(i + 1) * nDim - 1]; // Get the difference of values in the tool
 				// This has to be corrected for the slopes of the LFN
 				for (int kk = 0; kk < nDim - 1; kk++) // Just do the domain dimensions.
 				{
@@ -156,78 +160,132 @@ void splitUpdateValues(ALN * pALN, double dblLimit) // routine
 					// Adding 1 in kk + 1 skips the bias weight.
 					noiseSampleTemp -= LFN_W(pActiveLFN)[kk + 1] * aNoiseSampleTool[i * nDim + kk];
 				}
-				(pActiveLFN->DATA.LFN.pSplit)->DBLNOISEVARIANCE += noiseSampleTemp * noiseSampleTemp;
+				adblNoise[n] = noiseSampleTemp * noiseSampleTemp;
 			}
 		}
-	} // end loop over both files
-	free(adblX);
-} // END of splitUpdateValues
+	}
+}
 
-void doSplits(ALN* pALN, ALNNODE* pNode, double dblLimit) // routine
+void splitUpdateValues(ALN * pALN, double dblLimit) // routine
 {
-	// This routine visits all the leaf nodes and determines whether or not to split.
-	// If dblLimit < 0, it uses an F test with d.o.f. based on the number of samples counted,
-	// but if dblLimit >= 0 it uses the actual dblLimit value to compare to the square training error.
+	// Assign the square errors on the training set and the noise variance
+	// sample values to the leaf nodes of the ALN.
+	// The rows of a chunk are evaluated in parallel blocks, reading TRfile in place.
+	// Their results are then added to the leaf nodes in row order,
+	// so the sums are the same for any number of threads.
+	long long nrows = TRfile.RowCount();
+	long long nChunkRows = nrows < SPLITCHUNKROWS ? nrows : SPLITCHUNKROWS;
+	if (nChunkRows <= 0)
+		return;
 
-	ASSERT(pNode);
-	if (NODE_ISMINMAX(pNode))
+	ALNNODE** apActiveLFN = (ALNNODE**)malloc(nChunkRows * sizeof(ALNNODE*));
+	double* adblSqError = (double*)malloc(nChunkRows * sizeof(double));
+	double* adblNoise = (double*)malloc(nChunkRows * sizeof(double));
+	if (apActiveLFN == NULL || adblSqError == NULL || adblNoise == NULL)
 	{
-		doSplits(pALN, MINMAX_LEFT(pNode), dblLimit);
-		doSplits(pALN, MINMAX_RIGHT(pNode), dblLimit);
+		free(apActiveLFN);
+		free(adblSqError);
+		free(adblNoise);
+		ThrowALNMemoryException();
 	}
-	else
+
+	for (long long nChunk = 0; nChunk < nrows; nChunk += nChunkRows)
 	{
-		ASSERT(NODE_ISLFN(pNode));
-		if (LFN_CANSPLIT(pNode))
+		long long nChunkLast = nChunk + nChunkRows - 1;
+		if (nChunkLast >= nrows)
+			nChunkLast = nrows - 1;
+
+		// ALNQuickEval does not change the ALN, so the blocks can be evaluated at the same time
+		int nBlocks = (int)((nChunkLast - nChunk + SPLITBLOCKROWS) / SPLITBLOCKROWS);
+		int b;
+		#pragma omp parallel for schedule(dynamic)
+		for (b = 0; b < nBlocks; b++)
 		{
-			long Count = (pNode->DATA.LFN.pSplit)->nCount;
-			if (Count > nDim) // There are enough samples on the piece to consider splitting
+			long long n = (long long)b * SPLITBLOCKROWS;
+			long long nBlockLast = nChunk + n + SPLITBLOCKROWS - 1;
+			if (nBlockLast > nChunkLast)
+				nBlockLast = nChunkLast;
+			splitEvalRows(pALN, nChunk + n, nBlockLast, dblLimit,
+			              apActiveLFN + n, adblSqError + n, adblNoise + n);
+		}
+
+		for (long long i = nChunk; i <= nChunkLast; i++)
+		{
+			long long n = i - nChunk;
+			ALNNODE* pActiveLFN = apActiveLFN[n];
+			if (LFN_CANSPLIT(pActiveLFN))
 			{
-				double dblPieceSquareTrainError = (pNode->DATA.LFN.pSplit)->dblSqError; // total square error on the piece
-				double dblPieceNoiseVariance = (double)Count; // Used when there is no F-test.
-				double dblSplitLimit = dblLimit; // if dblLimit is <= 0, otherwise they test training MSE < dblLimit
-				if (dblLimit <= 0) // if this is TRUE, we do the F test.
+				(pActiveLFN->DATA.LFN.pSplit)->nCount++;
+				(pActiveLFN->DATA.LFN.pSplit)->dblSqError += adblSqError[n];
+				if (dblLimit <= 0)
 				{
-					dblPieceNoiseVariance = (pNode->DATA.LFN.pSplit)->DBLNOISEVARIANCE; // total noise variance samples
-					int dofIndex; // get the dblSplitLimit corresponding to the degrees of freedom of the F test
-					dofIndex = Count - 2;
-					if (Count > 10) dofIndex = 8;
-					if (Count > 20) dofIndex = 9;
-					if (Count > 30) dofIndex = 10;
-					if (Count > 40) dofIndex = 11;
-					if (Count > 60) dofIndex = 12;
-					dblSplitLimit = adblFconstant75[dofIndex]; // One can reject the H0 of a good fit with various percentages
-					// 90, 75, 50, 35, 25. E.g. 90% says that if the training error is greater than the dblSplitLimit prescribes
-					// it is 90% sure that the fit is bad.  A higher percentage needs less training time.
-					// Note that when there are few hits on the piece, the dblSplitLimit is larger and 
-					// the criterion for fitting well enough is easier to satisfy.
-				}
-				else
-				{
-					dblSplitLimit = dblLimit;
+					(pActiveLFN->DATA.LFN.pSplit)->DBLNOISEVARIANCE += adblNoise[n];
 				}
+			}
+		}
+	} // end loop over chunks
+	free(apActiveLFN);
+	free(adblSqError);
+	free(adblNoise);
+} // END of splitUpdateValues
 
-				if (dblPieceSquareTrainError > dblPieceNoiseVariance * dblSplitLimit)
-				{
-					// The piece doesn't fit and needs to split; then training must continue.
-					SplitLFN(pALN, pNode); // We split *every* leaf node that reaches this point.
-					// We start an epoch with bStopTraining == TRUE, but if any leaf node might still split,
-					bStopTraining = FALSE; //  we set it to FALSE and continue to another epoch of training.
-				}
-				else
-				{
-				// The piece fits well enough and doesn't need to split or train
-				LFN_FLAGS(pNode) &= ~LF_SPLIT;  // this flag setting prevents further splitting 
-				// The problem here is adjoining pieces become responsible for the rest of the fit.
-				}
+static void doSplit(ALN* pALN, ALNNODE* pNode, double dblLimit) // routine
+{
+	// This routine determines whether or not to split the leaf node pNode.
+	// If dblLimit < 0, it uses an F test with d.o.f. based on the number of samples counted,
+	// but if dblLimit >= 0 it uses the actual dblLimit value to compare to the square training error.
+
+	ASSERT(pNode);
+	ASSERT(NODE_ISLFN(pNode));
+	if (LFN_CANSPLIT(pNode))
+	{
+		long Count = (pNode->DATA.LFN.pSplit)->nCount;
+		if (Count > nDim) // There are enough samples on the piece to consider splitting
+		{
+			double dblPieceSquareTrainError = (pNode->DATA.LFN.pSplit)->dblSqError; // total square error on the piece
+			double dblPieceNoiseVariance = (double)Count; // Used when there is no F-test.
+			double dblSplitLimit = dblLimit; // if dblLimit is <= 0, otherwise they test training MSE < dblLimit
+			if (dblLimit <= 0) // if this is TRUE, we do the F test.
+			{
+				dblPieceNoiseVariance = (pNode->DATA.LFN.pSplit)->DBLNOISEVARIANCE; // total noise variance samples
+				int dofIndex; // get the dblSplitLimit corresponding to the degrees of freedom of the F test
+				dofIndex = Count - 2;
+				if (Count > 10) dofIndex = 8;
+				if (Count > 20) dofIndex = 9;
+				if (Count > 30) dofIndex = 10;
+				if (Count > 40) dofIndex = 11;
+				if (Count > 60) dofIndex = 12;
+				dblSplitLimit = adblFconstant75[dofIndex]; // One can reject the H0 of a good fit with various percentages
+				// 90, 75, 50, 35, 25. E.g. 90% says that if the training error is greater than the dblSplitLimit prescribes
+				// it is 90% sure that the fit is bad.  A higher percentage needs less training time.
+				// Note that when there are few hits on the piece, the dblSplitLimit is larger and 
+				// the criterion for fitting well enough is easier to satisfy.
 			}
 			else
 			{
-				// The piece has at most nDim samples on it, stop splitting it. 
-				LFN_FLAGS(pNode) &= ~LF_SPLIT;  // this flag setting prevents further splitting 
-				// It may still need to train
+				dblSplitLimit = dblLimit;
+			}
+
+			if (dblPieceSquareTrainError > dblPieceNoiseVariance * dblSplitLimit)
+			{
+				// The piece doesn't fit and needs to split; then training must continue.
+				SplitLFN(pALN, pNode); // We split *every* leaf node that reaches this point.
+				// We start an epoch with bStopTraining == TRUE, but if any leaf node might still split,
 				bStopTraining = FALSE; //  we set it to FALSE and continue to another epoch of training.
 			}
+			else
+			{
+			// The piece fits well enough and doesn't need to split or train
+			LFN_FLAGS(pNode) &= ~LF_SPLIT;  // this flag setting prevents further splitting 
+			// The problem here is adjoining pieces become responsible for the rest of the fit.
+			}
+		}
+		else
+		{
+			// The piece has at most nDim samples on it, stop splitting it. 
+			LFN_FLAGS(pNode) &= ~LF_SPLIT;  // this flag setting prevents further splitting 
+			// It may still need to train
+			bStopTraining = FALSE; //  we set it to FALSE and continue to another epoch of training.
 		}
 	}
 }
@@ -42,6 +42,10 @@ static char THIS_FILE[] = __FILE__;
 #include <dtree.h>
 #include <datafile.h>
 #include <malloc.h>
+#include <time.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include ".\cmyaln.h" 
 #include "alnextern.h"
 #include "alnintern.h"
@@ -51,7 +55,7 @@ static char THIS_FILE[] = __FILE__;
 
 // files used in training operations
 CDataFile TRfile; // Training data, changed for different purposes.
-long nRowsTR; // the number of rows in the current training set in TRfile
+long long nRowsTR; // the number of rows in the current training set in TRfile
 
 //routines
 void ALNAPI createTR_file();
@@ -72,12 +76,63 @@ double dblLimit; // If dblLimit <= 0, noise is estimated and used to stop splitt
 double dblMinRMSE = 0; // Training is stopped when the mean square training error is smaller than this
 double dblLearnRate = 0.2;  // Roughly, 0.2 corrects 20% of the deviation of ALN from desired. Fifteen passes through TRfile corrects most of the error.
 int nMaxEpochs; // This controls the number of epochs between splittings of linear pieces. The linear pieces get time to fit better before splitting.
+BOOL bAdaptiveSchedule = FALSE; // If TRUE, an iteration's epochs end early once the pieces settle and the learning rate adapts to progress; otherwise every iteration uses all nMaxEpochs epochs and the learning rate drops at fixed iterations.
+double dblEpochConvergence = 0; // If > 0, an iteration's epochs end early when the estimated RMSE improves by less than this fraction...
+double dblPieceConvergence = 0; // ... and no active piece has moved by more than this fraction of the estimated RMSE in the last epoch.
+int nMinEpochs = 3; // The epochs of an iteration never end early before this many epochs.
+int nTotalEpochs = 0; // Total number of epochs used by approximate(), counted in cmyaln.h.
 //double dblLimit = -1  ;// A negative value splits pieces based on an F test, otherwise they split if training MSE < dblLimit.
 // MYTEST above now part of ALNDATAINFO
 BOOL bStopTraining = FALSE; // Set to TRUE and becomes FALSE if any (active) linear piece still needs training
 int nNotifyMask = AN_TRAIN | AN_EPOCH | AN_VECTORINFO; // Used with callbacks at different times for reporting on learning progress.
 double * adblX = NULL; // This buffer holds an input vector including the desired output as last component.
 double* aNoiseSampleTool = NULL; // aNoiseSampleTool helps create noise variance samples based on LFN weights during training.
+BOOL bCheckpoint = FALSE; // If TRUE, approximate() saves its state after every iteration and a new run resumes from the saved state.
+char szCheckpointFileName[256]; // The data file name with the extension replaced by Checkpoint.aln
+char szNoiseToolFileName[256]; // The data file name with the extension replaced by NoiseTool.bin
+
+// The training configuration of approximate().  A checkpoint is only resumed
+// when it was made with the same configuration, since the ALN read from it
+// brings its own constraints.
+struct APPROXCONFIG
+{
+	BOOL bJitter;
+	BOOL bAdaptiveSchedule;
+	int nMaxEpochs;
+	int nMinEpochs;
+	double dblMinRMSE;
+	double dblLimit;
+	double dblEpochConvergence;
+	double dblPieceConvergence;
+	unsigned int nConstraintHash; // The epsilons, bounds and weight bounds of the inputs.
+};
+
+// The state of approximate() which is saved with the ALN in a checkpoint.
+// Together with the ALN and its random number generator state, this is all
+// the next iteration depends on, so a resumed run continues exactly as the
+// interrupted one would have.
+struct APPROXSTATE
+{
+	long long nRowsTR;        // These identify the training data
+	int nDim;                 // the checkpoint was made with.
+	unsigned int nDataHash;
+	APPROXCONFIG config;      // The training configuration it was made with.
+	int nIteration;           // The next iteration to be done.
+	double dblLearnRate;
+	double dblBestTrainErr;
+	double dblTrainErr;
+	int nTotalEpochs;
+	int nNumberLFNs;
+	double dblSeconds;        // Time used by approximate() before the checkpoint.
+};
+
+// checkpoint helpers
+static void makeCheckpointFileNames();
+static unsigned int hashTrainingData();
+static void getApproxConfig(APPROXCONFIG& config);
+static BOOL loadNoiseVarianceTool(unsigned int nDataHash);
+static void saveNoiseVarianceTool(unsigned int nDataHash);
+static BOOL resumeApproximation(APPROXSTATE& state);
 
 using namespace std;
 
@@ -86,20 +141,15 @@ void ALNAPI createTR_file() // routine
 	// This routine uses the TVfile to set up TRfile.
 	// The V stands for validation, but we now no longer need a validation set.
 	// The TVfile is all of the PreprocessedDataFile which is not used for testing..
-	long i;
-	int j;
+	// TRfile is a view of the TVfile rows, so nothing is copied.
 	fprintf(fpProtocol, "Setting up the training data in TRfile\n");
-	nRowsTR = TVfile.RowCount();
-	TRfile.Create(nRowsTR, nDim);
-	// First we fill TRfile from TVfile
-	double dblValue;
-	for (i = 0; i < nRowsTV; i++)
+	ASSERT(TVfile.ColumnCount() == nDim);
+	nRowsTR = nRowsTV;
+	if (!TRfile.CreateView(TVfile, 0, nRowsTR))
 	{
-		for (j = 0; j < nDim; j++)
-		{
-			dblValue = TVfile.GetAt(i, j, 0);
-			TRfile.SetAt(i, j, dblValue, 0);
-		}
+		fprintf(fpProtocol, "Creating internal data file TRfile failed!\n");
+		fflush(fpProtocol);
+		exit(0);
 	}
 }
 
@@ -119,12 +169,26 @@ void ALNAPI createNoiseVarianceTool()
 	// Set up the data
 	createTR_file(); // This selects the training data after some samples for testing have been removed. 
 	ASSERT(nRowsTR == TRfile.RowCount());
+	// The tool only depends on the training data, so a run resuming from a checkpoint
+	// can skip its long computation.
+	unsigned int nDataHash = 0;
+	if (bCheckpoint)
+	{
+		makeCheckpointFileNames();
+		nDataHash = hashTrainingData();
+		if (loadNoiseVarianceTool(nDataHash))
+		{
+			fprintf(fpProtocol, "The noise variance tool was read from %s\n", szNoiseToolFileName);
+			fflush(fpProtocol);
+			return;
+		}
+	}
 	double* aXcentral = NULL;
 	double* aXnearby = NULL;
 	aXcentral = (double*)malloc(nDim * sizeof(double));
 	aXnearby = (double*)malloc(nDim * sizeof(double));
-	aNoiseSampleTool = (double*) malloc(nRowsTR * nDim * sizeof(double));
-	long i, j, iTimesnDim; // The TRfile can be huge. 
+	aNoiseSampleTool = (double*) malloc((size_t)nRowsTR * nDim * sizeof(double));
+	long long i, j, iTimesnDim; // The TRfile can be huge. 
 	int k;  // The dimension is small, eg less than 20 usually.
 	double ds, dstemp;
 	for (i = 0; i < nRowsTR; i++) // i is the central sample.
@@ -161,6 +225,10 @@ void ALNAPI createNoiseVarianceTool()
 			}
 		} // end of j loop
 	} // end loop over i
+	if (bCheckpoint)
+	{
+		saveNoiseVarianceTool(nDataHash);
+	}
 }
 
 void ALNAPI approximate() // routine
@@ -234,19 +302,29 @@ void ALNAPI approximate() // routine
 	nMaxEpochs = 20; // The number of passes through the data without splitting LFNs.
 	dblMinRMSE = 1e-20; // Stops training when the error is tiny.
 	dblLearnRate = 0.2;
+	if (bAdaptiveSchedule)
+	{
+		// Pieces jitter around their best fit by a good fraction of the noise, so the piece
+		// tolerance is much looser than the tolerance on the RMSE trend.
+		dblEpochConvergence = 0.01;
+		dblPieceConvergence = 0.25;
+		fprintf(fpProtocol, "Epochs end early when the pieces have stabilised; the learning rate adapts to progress\n");
+	}
+	else
+	{
+		dblEpochConvergence = 0;
+		dblPieceConvergence = 0;
+		fprintf(fpProtocol, "Every iteration uses %d epochs; the learning rate drops at fixed iterations\n", nMaxEpochs);
+	}
+	double dblBestTrainErr = DBL_MAX; // best training RMSE at the end of an iteration so far
+	nTotalEpochs = 0;
+	clock_t clockStart = clock();
 	bStopTraining = FALSE; // Set to TRUE at the start of each epoch in alntrain.cpp. 
 	// Set FALSE by any piece needing more training. 
   nNumberLFNs = 1;  // initialize at 1
 	// Tell the training algorithm the way to access the data using fillvector
 	nRowsTR = TRfile.RowCount();
 	ASSERT(nRowsTR == nRowsTV);
-	const double* adblData = TRfile.GetDataPtr(); // This is where training gets samples.
-	// The third parameter in the following could also set to NULL instead of adblData.
-	// Then, instead of using FillInputVector(), the program uses fillvector()
-	// for setting up the input vectors to the ALN.  fillvector() allows the
-	// system to choose training vectors more flexibly (even online with proper programming).
-	// The advantage of giving the pointer adblData instead of NULL is that training permutes
-	// the order of the samples and goes through all samples exactly once per epoch.
 	dblLimit = -1.0; // Negative to split leaf nodes according to an F test;
 	// positive to split if training MSE > dblLimit.
 	if (dblLimit <= 0)
@@ -260,12 +338,45 @@ void ALNAPI approximate() // routine
 		bEstimateNoiseVariance = FALSE;
 	}
 	fflush(fpProtocol);
+	// Continue an interrupted run from its last checkpoint if there is one for this training data
+	// and configuration.
+	int nFirstIteration = 0;
+	double dblSecondsBefore = 0;
+	APPROXSTATE state;
+	BOOL bWriteCheckpoints = bCheckpoint;
+	if (bCheckpoint)
+	{
+		makeCheckpointFileNames();
+		state.nRowsTR = nRowsTR;
+		state.nDim = nDim;
+		state.nDataHash = hashTrainingData();
+		getApproxConfig(state.config);
+		if (resumeApproximation(state))
+		{
+			nFirstIteration = state.nIteration;
+			dblLearnRate = state.dblLearnRate;
+			dblBestTrainErr = state.dblBestTrainErr;
+			dblTrainErr = state.dblTrainErr;
+			nTotalEpochs = state.nTotalEpochs;
+			nNumberLFNs = state.nNumberLFNs;
+			dblSecondsBefore = state.dblSeconds;
+			fprintf(fpProtocol, "Resuming approximation from %s at iteration %d\n", szCheckpointFileName, nFirstIteration);
+			fflush(fpProtocol);
+		}
+	}
+	const double* adblData = TRfile.GetDataPtr(); // This is where training gets samples.
+	// The third parameter in the following could also set to NULL instead of adblData.
+	// Then, instead of using FillInputVector(), the program uses fillvector()
+	// for setting up the input vectors to the ALN.  fillvector() allows the
+	// system to choose training vectors more flexibly (even online with proper programming).
+	// The advantage of giving the pointer adblData instead of NULL is that training permutes
+	// the order of the samples and goes through all samples exactly once per epoch.
 	pBaseNeuron->SetDataInfo(nRowsTR, nDim, adblData, NULL,dblLimit);
 	fprintf(fpProtocol,"----------  Training approximation ALN ------------------\n");
 	fflush(fpProtocol);
-	for(int iteration = 0; iteration < 100; iteration++) 
+	for(int iteration = nFirstIteration; iteration < 100; iteration++) 
 	{
-		fprintf(fpProtocol, "\nIteration %d of %d epochs ", iteration, nMaxEpochs);
+		fprintf(fpProtocol, "\nIteration %d of at most %d epochs ", iteration, nMaxEpochs);
 		fflush(fpProtocol);
 		// TRAIN ALNS WITHOUT OVERTRAINING   vvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvv
 		if (!pBaseNeuron->Train(nMaxEpochs, dblMinRMSE, dblLearnRate, bJitter, nNotifyMask))
@@ -283,51 +394,153 @@ void ALNAPI approximate() // routine
 		}
 		fprintf(fpProtocol, "Learning rate is %f\n", dblLearnRate);
 		fflush(fpProtocol);
-		if (iteration == 90) dblLearnRate = 0.15;
-		if (iteration == 95) dblLearnRate = 0.05;
-		if (iteration == 99) dblLearnRate = 0.01;
+		if (bAdaptiveSchedule)
+		{
+			// Splitting normally lowers the training error from one iteration to the next.
+			// When it stops doing so, the pieces are dithering around their fits and a smaller
+			// learning rate lets them settle.
+			if (dblTrainErr > (1.0 - dblEpochConvergence) * dblBestTrainErr)
+			{
+				dblLearnRate *= 0.5;
+				if (dblLearnRate < 0.01) dblLearnRate = 0.01;
+			}
+			if (dblTrainErr < dblBestTrainErr) dblBestTrainErr = dblTrainErr;
+		}
+		else
+		{
+			if (iteration == 90) dblLearnRate = 0.15;
+			if (iteration == 95) dblLearnRate = 0.05;
+			if (iteration == 99) dblLearnRate = 0.01;
+		}
+		if (bWriteCheckpoints)
+		{
+			// Save everything the next iteration depends on.
+			state.nIteration = iteration + 1;
+			state.dblLearnRate = dblLearnRate;
+			state.dblBestTrainErr = dblBestTrainErr;
+			state.dblTrainErr = dblTrainErr;
+			state.nTotalEpochs = nTotalEpochs;
+			state.nNumberLFNs = nNumberLFNs;
+			state.dblSeconds = dblSecondsBefore + (double)(clock() - clockStart) / CLOCKS_PER_SEC;
+			if (!pBaseNeuron->WriteCheckpoint(szCheckpointFileName, &state, sizeof(APPROXSTATE)))
+			{
+				fprintf(fpProtocol, "Writing the checkpoint failed; training continues without checkpoints.\n");
+				fflush(fpProtocol);
+				bWriteCheckpoints = FALSE;
+			}
+		}
 	} // end of loop of training interations over one ALN
+	fprintf(fpProtocol, "Approximation used %d epochs in total and took %.2f seconds\n", nTotalEpochs,
+		dblSecondsBefore + (double)(clock() - clockStart) / CLOCKS_PER_SEC);
+	fflush(fpProtocol);
+	if (bCheckpoint)
+	{
+		// The run is complete, so the next run starts from scratch.
+		remove(szCheckpointFileName);
+		remove(szNoiseToolFileName);
+	}
 	free(adblX);
 	// we don't destroy the ALN because it is needed for further work in reporting
 }
 
+// rows per block of the statistics pass in outputTrainingResults
+#define TVSTATROWS 4096
+
+// accumulates rows nFirst to nFirst + nRows - 1 of the TVfile into one block of
+// partial results: adblStats holds the column means, the column sums of squared
+// deviations from the mean (Welford), and the sums of the weights and absolute
+// weights of the active LFNs, nDim values each
+static void accumulateTVBlock(long nFirst, long nRows, double* adblStats,
+                              double* pdblSE, int* pnClassError)
+{
+	double* adblMean = adblStats;
+	double* adblM2 = adblStats + nDim;
+	double* adblWAcc = adblStats + 2 * nDim;
+	double* adblAbsWAcc = adblStats + 3 * nDim;
+	for (int k = 0; k < 4 * nDim; k++)
+	{
+		adblStats[k] = 0;
+	}
+	double se = 0;
+	int nClassError = 0;
+	ALNNODE* pActiveLFN = NULL;
+	for (long j = 0; j < nRows; j++)
+	{
+		const double* adblX = TVfile.GetRowAt(nFirst + j);
+		// CAln::QuickEval records its error in the object, so call the library directly
+		double dblValue = ALNQuickEval(pBaseNeuron->GetALN(), adblX, &pActiveLFN);
+		const double* adblW = pActiveLFN->DATA.LFN.adblW;
+		double dblN = (double)(j + 1);
+		for (int k = 0; k < nDim; k++)
+		{
+			adblWAcc[k] += adblW[k + 1]; //the adblW vector has the bias in it so the components are shifted
+			adblAbsWAcc[k] += fabs(adblW[k + 1]);
+			double dblDelta = adblX[k] - adblMean[k];
+			adblMean[k] += dblDelta / dblN;
+			adblM2[k] += dblDelta * (adblX[k] - adblMean[k]);
+		}
+		double desired = adblX[nDim - 1]; // get the desired result
+		se += (dblValue - desired) * (dblValue - desired);
+		if (fabs(desired - dblValue) > 0.5)  nClassError++; // desired must be integer
+	}
+	*pdblSE = se;
+	*pnClassError = nClassError;
+}
+
 void ALNAPI outputTrainingResults() // routine
 {
 	fprintf(fpProtocol, "\n**** Analyzing results of approximation begins ***\n");
 	// all the ALNs have been trained, now report results
-	int i, j, k;
-	double desired, sum;
-	ALNNODE* pActiveLFN = NULL;
-	// test the average of the ALNs against data in the TV set
-	double * adblX = (double *)malloc((nDim) * sizeof(double));
-	double * adblWAcc = (double *)malloc((nDim) * sizeof(double));
-	double * adblAbsWAcc = (double *)malloc((nDim) * sizeof(double));
-	for (k = 0; k < nDim; k++)
+	int i, k;
+	double desired;
+	// One pass over the TV set does the whole report: each block of rows gets the
+	// ALN errors, the active LFN weight sums and the column means and sums of
+	// squared deviations.  The blocks are merged in order, so the results do not
+	// depend on the number of threads.
+	int nBlocks = (int)((nRowsTV + TVSTATROWS - 1) / TVSTATROWS);
+	double * adblBlockStats = (double *)malloc((size_t)nBlocks * 4 * nDim * sizeof(double));
+	double * adblBlockSE = (double *)malloc(nBlocks * sizeof(double));
+	int * anBlockClassError = (int *)malloc(nBlocks * sizeof(int));
+	if (nBlocks <= 0 || adblBlockStats == NULL || adblBlockSE == NULL || anBlockClassError == NULL)
 	{
-		adblWAcc[k] = 0; // zero the accumulator for the average weight
-		adblAbsWAcc[k] = 0; // zero the accumulator for the average absolute weight
+		fprintf(fpProtocol, "Allocating the statistics of TVfile failed!\n");
+		fflush(fpProtocol);
+		exit(0);
 	}
-	double se = 0; // square error accumulator
-
-	int	nClassError = 0;  // for classification problems
-	for (j = 0; j < nRowsTV; j++)
+	#pragma omp parallel for schedule(dynamic)
+	for (i = 0; i < nBlocks; i++)
+	{
+		long nFirst = (long)i * TVSTATROWS;
+		long nRows = (nRowsTV - nFirst < TVSTATROWS) ? nRowsTV - nFirst : TVSTATROWS;
+		accumulateTVBlock(nFirst, nRows, adblBlockStats + (size_t)i * 4 * nDim,
+		                  &adblBlockSE[i], &anBlockClassError[i]);
+	}
+	// merge the blocks into the first: for sets a and b with d = mean b - mean a,
+	// M2 = M2 a + M2 b + d * d * n a * n b / (n a + n b)   (Chan, Golub and LeVeque)
+	double * adblMean = adblBlockStats;
+	double * adblM2 = adblBlockStats + nDim;
+	double * adblWAcc = adblBlockStats + 2 * nDim;
+	double * adblAbsWAcc = adblBlockStats + 3 * nDim;
+	double se = adblBlockSE[0]; // square error accumulator
+	int	nClassError = anBlockClassError[0];  // for classification problems
+	double dblN = (nRowsTV < TVSTATROWS) ? (double)nRowsTV : (double)TVSTATROWS;
+	for (i = 1; i < nBlocks; i++)
 	{
-		sum = 0;
-		for (i = 0; i < nDim; i++)
+		const double* adblStats = adblBlockStats + (size_t)i * 4 * nDim;
+		long nFirst = (long)i * TVSTATROWS;
+		double dblBlockN = (double)((nRowsTV - nFirst < TVSTATROWS) ? nRowsTV - nFirst : TVSTATROWS);
+		double dblTotalN = dblN + dblBlockN;
+		for (k = 0; k < nDim; k++)
 		{
-			adblX[i] = TVfile.GetAt(j, i, 0);
+			double dblDelta = adblStats[k] - adblMean[k];
+			adblMean[k] += dblDelta * dblBlockN / dblTotalN;
+			adblM2[k] += adblStats[nDim + k] + dblDelta * dblDelta * dblN * dblBlockN / dblTotalN;
+			adblWAcc[k] += adblStats[2 * nDim + k];
+			adblAbsWAcc[k] += adblStats[3 * nDim + k];
 		}
-		double dblValue = pBaseNeuron->QuickEval(adblX, &pActiveLFN);
-		sum += dblValue;
-		for (int k = 0; k < nDim; k++)
-		{
-			adblWAcc[k] += ((pActiveLFN)->DATA.LFN.adblW)[k + 1]; //the adblW vector has the bias in it
-																											// so the components are shifted
-			adblAbsWAcc[k] += fabs(((pActiveLFN)->DATA.LFN.adblW)[k + 1]);
-		} ; 
-		desired = TVfile.GetAt(j, nDim - 1, 0); // get the desired result	
-		se += (sum - desired) * (sum - desired);
-		if (fabs(desired - sum) > 0.5)  nClassError++; // desired must be integer
+		se += adblBlockSE[i];
+		nClassError += anBlockClassError[i];
+		dblN = dblTotalN;
 	}
 	double rmse = sqrt(se / ((double)nRowsTV - 1.0)); // frees se for use below.
 	// get the average weight on all variables k
@@ -345,24 +558,12 @@ void ALNAPI outputTrainingResults() // routine
 	fprintf(fpProtocol, "For example a sawtooth function with six teeth would have importance 12.\n");
 	fprintf(fpProtocol, "First we have to compute the standard deviation of the output variable.\n");
 	fflush(fpProtocol);
-	//compute the average of the output variable in the TVset
+	//the average of the output variable in the TVset
 	k = nDim - 1;
-	desired = 0;
-	for (j = 0; j < nRowsTV; j++)
-	{
-		desired += TVfile.GetAt(j, k, 0);
-	}
-	desired /= nRowsTV; // now desired holds the average for variable k
+	desired = adblMean[k]; // now desired holds the average for variable k
 
-	// compute the standard deviation of the output variable in the TVset
-	se = 0;
-	double temp;
-	for (j = 0; j < nRowsTV; j++)
-	{
-		temp = TVfile.GetAt(j, k, 0);
-		se += (temp - desired) * (temp - desired);
-	}
-	se /= ((double)nRowsTV - 1.0); // sample variance of the output variable
+	// the standard deviation of the output variable in the TVset
+	se = adblM2[k] / ((double)nRowsTV - 1.0); // sample variance of the output variable
 	double stdevOutput = sqrt(se);
 	fprintf(fpProtocol, "\nStandard deviation of the output in the TVfile %f\n", stdevOutput);
 	if (fabs(stdevOutput) < 1e-10)
@@ -372,27 +573,12 @@ void ALNAPI outputTrainingResults() // routine
 		fclose(fpProtocol);
 		exit(0);
 	}
-	// we compute the variance of each column of TV
+	// the variance of each column of TV
 	se = 0;
 	for (k = 0; k < nDim - 1; k++) // do each variable k
 	{
-		//compute the average of variable k in TVset
-		desired = 0;
-		for (j = 0; j < nRowsTV; j++)
-		{
-			desired += TVfile.GetAt(j, k, 0);
-		}
-		desired /= nRowsTV; // now desired holds the average for variable k
-
-		// compute the standard deviation of variable k in TVset
-		se = 0;
-		double temp;
-		for (j = 0; j < nRowsTV; j++)
-		{
-			temp = TVfile.GetAt(j, k, 0);
-			se += (temp - desired) * (temp - desired);
-		}
-		se /= ((double)nRowsTV - 1.0); // sample variance of variable k
+		// the standard deviation of variable k in TVset
+		se = adblM2[k] / ((double)nRowsTV - 1.0); // sample variance of variable k
 		dblImportance[k] = sqrt(se) * adblAbsWAcc[k] / stdevOutput;
 		if (nLag[k] == 0)
 		{
@@ -412,9 +598,9 @@ void ALNAPI outputTrainingResults() // routine
 		fprintf(fpProtocol, "Percentage of TV file cases misclassified = %f", 100.0*(double)nClassError / (double)nRowsTV);
 	}
 	fflush(fpProtocol);
-	free(adblX);
-	free(adblWAcc);
-	free(adblAbsWAcc);
+	free(adblBlockStats);
+	free(adblBlockSE);
+	free(anBlockClassError);
 }
 
 void ALNAPI constructDTREE(int nMaxDepth) // routine
@@ -429,7 +615,12 @@ void ALNAPI constructDTREE(int nMaxDepth) // routine
 	// allows much faster evaluation. This could turn out to be
 	// useful for extremely demanding real-time tasks like
 	// controlling nuclear fusion in ITER.
-	pBaseNeuronDTR = pBaseNeuron->ConvertDtree(nMaxDepth);
+	// The training samples guide the splits, so the regions where the data
+	// lies get the shallowest leaves and the smallest blocks.
+	if (nMaxDepth > 1)
+		pBaseNeuronDTR = pBaseNeuron->ConvertDtree(nMaxDepth, pBaseNeuron->GetDataInfo());
+	else
+		pBaseNeuronDTR = pBaseNeuron->ConvertDtree(nMaxDepth);
   if(pBaseNeuronDTR == NULL)
 	{
 		fprintf(fpProtocol,"No DTREE was generated from the ALN. Stopping. \n");
@@ -473,8 +664,8 @@ void fillvector(double * adblX, CMyAln* paln) // routine
 {
 	// IMPORTANT: This routine can be adapted to create training vectors
 	// for real-time applications.
-	long nRow;
-	nRow = (long)floor(ALNRandFloat() * (double) nRowsTR); // This is where the TRfile is indicated for training.
+	long long nRow;
+	nRow = (long long)floor(ALNRandFloat() * (double) nRowsTR); // This is where the TRfile is indicated for training.
 	for(int i = 0; i < nDim; i++)
 	{
 		adblX[i] = TRfile.GetAt(nRow,i,0); // Notice that TRfile is fixed.
@@ -493,3 +684,165 @@ double dist(double* adblA, double* adblB)
 	}
 	return sum;
 }
+
+static void makeCheckpointFileNames()
+{
+	// The checkpoint files go next to the data file, so a rerun on the same data finds them
+	// even when time prefixes give the other files new names.
+	char szPrefix[256];
+	strcpy(szPrefix, szDataFileName);
+	char* pDot = strrchr(szPrefix, '.');
+	char* pSlash = strrchr(szPrefix, '\\');
+	char* pForwardSlash = strrchr(szPrefix, '/');
+	if (pForwardSlash != NULL && (pSlash == NULL || pForwardSlash > pSlash)) pSlash = pForwardSlash;
+	if (pDot != NULL && (pSlash == NULL || pDot > pSlash)) *pDot = '\0';
+	szPrefix[256 - 20] = '\0'; // leave room for the suffix
+	sprintf(szCheckpointFileName, "%sCheckpoint.aln", szPrefix);
+	sprintf(szNoiseToolFileName, "%sNoiseTool.bin", szPrefix);
+}
+
+static unsigned int hashTrainingData()
+{
+	// FNV-1a hash of the training samples, so a checkpoint is never used with other data.
+	const unsigned char* pByte = (const unsigned char*)TRfile.GetDataPtr();
+	size_t nBytes = (size_t)nRowsTR * nDim * sizeof(double);
+	unsigned int nHash = 2166136261u;
+	for (size_t i = 0; i < nBytes; i++)
+	{
+		nHash = (nHash ^ pByte[i]) * 16777619u;
+	}
+	return nHash;
+}
+
+static BOOL loadNoiseVarianceTool(unsigned int nDataHash)
+{
+	FILE* fp = fopen(szNoiseToolFileName, "rb");
+	if (fp == NULL) return FALSE;
+	long long nRows = 0;
+	int nCols = 0;
+	unsigned int nHash = 0;
+	BOOL bSuccess = fread(&nRows, sizeof(nRows), 1, fp) == 1 &&
+		fread(&nCols, sizeof(nCols), 1, fp) == 1 &&
+		fread(&nHash, sizeof(nHash), 1, fp) == 1 &&
+		nRows == nRowsTR && nCols == nDim && nHash == nDataHash;
+	if (bSuccess)
+	{
+		aNoiseSampleTool = (double*)malloc((size_t)nRowsTR * nDim * sizeof(double));
+		bSuccess = aNoiseSampleTool != NULL &&
+			fread(aNoiseSampleTool, nDim * sizeof(double), (size_t)nRowsTR, fp) == (size_t)nRowsTR;
+		if (!bSuccess)
+		{
+			free(aNoiseSampleTool);
+			aNoiseSampleTool = NULL;
+		}
+	}
+	fclose(fp);
+	return bSuccess;
+}
+
+static void saveNoiseVarianceTool(unsigned int nDataHash)
+{
+	// A partly written file is rejected by loadNoiseVarianceTool, so no temporary file is needed.
+	FILE* fp = fopen(szNoiseToolFileName, "wb");
+	if (fp == NULL) return;
+	BOOL bSuccess = fwrite(&nRowsTR, sizeof(nRowsTR), 1, fp) == 1 &&
+		fwrite(&nDim, sizeof(nDim), 1, fp) == 1 &&
+		fwrite(&nDataHash, sizeof(nDataHash), 1, fp) == 1 &&
+		fwrite(aNoiseSampleTool, nDim * sizeof(double), (size_t)nRowsTR, fp) == (size_t)nRowsTR;
+	if (fclose(fp) != 0 || !bSuccess) remove(szNoiseToolFileName);
+}
+
+static unsigned int hashConstraints()
+{
+	// FNV-1a hash of the constraints set on the inputs of pBaseNeuron.
+	double adblValues[5];
+	unsigned int nHash = 2166136261u;
+	for (int m = 0; m < nDim - 1; m++)
+	{
+		adblValues[0] = pBaseNeuron->GetEpsilon(m);
+		adblValues[1] = pBaseNeuron->GetMin(m);
+		adblValues[2] = pBaseNeuron->GetMax(m);
+		adblValues[3] = pBaseNeuron->GetWeightMin(m);
+		adblValues[4] = pBaseNeuron->GetWeightMax(m);
+		const unsigned char* pByte = (const unsigned char*)adblValues;
+		for (size_t i = 0; i < sizeof(adblValues); i++)
+		{
+			nHash = (nHash ^ pByte[i]) * 16777619u;
+		}
+	}
+	return nHash;
+}
+
+static void getApproxConfig(APPROXCONFIG& config)
+{
+	memset(&config, 0, sizeof(APPROXCONFIG));
+	config.bJitter = bJitter;
+	config.bAdaptiveSchedule = bAdaptiveSchedule;
+	config.nMaxEpochs = nMaxEpochs;
+	config.nMinEpochs = nMinEpochs;
+	config.dblMinRMSE = dblMinRMSE;
+	config.dblLimit = dblLimit;
+	config.dblEpochConvergence = dblEpochConvergence;
+	config.dblPieceConvergence = dblPieceConvergence;
+	config.nConstraintHash = hashConstraints();
+}
+
+// writes the names of the settings which differ between the configurations to the protocol
+static void reportConfigDifferences(const APPROXCONFIG& saved, const APPROXCONFIG& config)
+{
+	const char* pszSep = "";
+	fprintf(fpProtocol, "Settings that differ:");
+#define CHECKCONFIG(field) \
+	if (saved.field != config.field) { fprintf(fpProtocol, "%s %s", pszSep, #field); pszSep = ","; }
+	CHECKCONFIG(bJitter)
+	CHECKCONFIG(bAdaptiveSchedule)
+	CHECKCONFIG(nMaxEpochs)
+	CHECKCONFIG(nMinEpochs)
+	CHECKCONFIG(dblMinRMSE)
+	CHECKCONFIG(dblLimit)
+	CHECKCONFIG(dblEpochConvergence)
+	CHECKCONFIG(dblPieceConvergence)
+	CHECKCONFIG(nConstraintHash)
+#undef CHECKCONFIG
+	fprintf(fpProtocol, "\n");
+}
+
+static BOOL resumeApproximation(APPROXSTATE& state)
+{
+	// On entry, state identifies the current training data and configuration; on success it
+	// holds the saved state.  Reading a checkpoint restores the random number generator, which
+	// has to be undone if the checkpoint turns out to belong to other data or settings.
+	unsigned int nSeed = CAln::GetRandSeed();
+	APPROXSTATE saved;
+	CMyAln* pResumed = new CMyAln;
+	if (!pResumed->ReadCheckpoint(szCheckpointFileName, &saved, sizeof(APPROXSTATE)))
+	{
+		delete pResumed;
+		return FALSE;
+	}
+	if (saved.nRowsTR != state.nRowsTR || saved.nDim != state.nDim || saved.nDataHash != state.nDataHash)
+	{
+		fprintf(fpProtocol, "WARNING: The checkpoint %s was made with other training data. "
+			"It is not used and will be overwritten.\n", szCheckpointFileName);
+		fflush(fpProtocol);
+		CAln::SRand(nSeed);
+		delete pResumed;
+		return FALSE;
+	}
+	// The constraints and settings of the checkpoint would silently replace the ones just configured.
+	// Both configurations were zeroed before they were filled in, so they can be compared bytewise.
+	if (memcmp(&saved.config, &state.config, sizeof(APPROXCONFIG)) != 0)
+	{
+		fprintf(fpProtocol, "WARNING: The checkpoint %s was made with a different training configuration. "
+			"It is not used and will be overwritten.\n", szCheckpointFileName);
+		reportConfigDifferences(saved.config, state.config);
+		fflush(fpProtocol);
+		CAln::SRand(nSeed);
+		delete pResumed;
+		return FALSE;
+	}
+	state = saved;
+	delete pBaseNeuron;
+	pBaseNeuron = pResumed;
+	return TRUE;
+}